@@ -5,6 +5,7 @@
 #include "hlifealgo.h"
 #include "generationsalgo.h"
 #include "ltlalgo.h"
+#include "bitgenalgo.h"
 #include "jvnalgo.h"
 #include "ruleloaderalgo.h"
 #include "readpattern.h"
@@ -12,14 +13,93 @@
 #include "viewport.h"
 #include "liferender.h"
 #include "writepattern.h"
+#include "lifeslice.h"
+#include "lifemem.h"
 #include <stdlib.h>
 #include <iostream>
 #include <cstdio>
 #include <string.h>
 #include <cstdlib>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 using namespace std ;
 
+viewport viewport(1000, 1000) ;
+lifealgo *imp = 0 ;
+char *nodefile = 0 ;
+int memstats ;
+
+/*
+ *   For --memstats, count data TLB misses and page faults over the run,
+ *   if the kernel lets us, and say how much of our memory is on huge
+ *   pages at the end.
+ */
+#ifdef __linux__
+int tlbfd = -1, faultfd = -1 ;
+int opencounter(unsigned int type, unsigned long long config) {
+   struct perf_event_attr pe ;
+   memset(&pe, 0, sizeof(pe)) ;
+   pe.size = sizeof(pe) ;
+   pe.type = type ;
+   pe.config = config ;
+   pe.exclude_hv = 1 ;
+   return (int)syscall(SYS_perf_event_open, &pe, 0, -1, -1, 0) ;
+}
+void startmemstats() {
+   tlbfd = opencounter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                       (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                       (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)) ;
+   faultfd = opencounter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS) ;
+}
+void showcounter(const char *name, int fd) {
+   long long v ;
+   cout << name << ": " ;
+   if (fd >= 0 && read(fd, &v, sizeof(v)) == sizeof(v))
+      cout << v << endl ;
+   else
+      cout << "not available" << endl ;
+}
+void showmemstats() {
+   cout << "Huge pages " << (bigmemhugepages() ? "on" : "off")
+        << ", NUMA interleave " << (bigmeminterleave() ? "on" : "off") << endl ;
+   showcounter("dTLB read misses", tlbfd) ;
+   showcounter("Page faults", faultfd) ;
+   FILE *f = fopen("/proc/self/smaps_rollup", "r") ;
+   if (f == 0)
+      return ;
+   char line[256] ;
+   while (fgets(line, sizeof(line), f))
+      if (strncmp(line, "Rss:", 4) == 0 ||
+          strncmp(line, "AnonHugePages:", 14) == 0 ||
+          strncmp(line, "Private_Hugetlb:", 16) == 0)
+         cout << line ;
+   fclose(f) ;
+}
+#else
+void startmemstats() {
+}
+void showmemstats() {
+   cout << "Memory statistics are only available on Linux" << endl ;
+}
+#endif
+
+/*
+ *   If we have a node file, leave the run there so it can be resumed.
+ */
+void finish() {
+   if (memstats)
+      showmemstats() ;
+   if (nodefile && imp) {
+      const char *err = ((hlifealgo *)imp)->savenodefile() ;
+      if (err) lifefatal(err) ;
+   }
+   exit(0) ;
+}
+
 double start ;
 int maxtime = 0 ;
 double timestamp() {
@@ -28,12 +108,41 @@ double timestamp() {
    if (start == 0)
       start = now ;
    else if (maxtime && r > maxtime)
-      exit(0) ;   
+      finish() ;
    return r ;
 }
 
-viewport viewport(1000, 1000) ;
-lifealgo *imp = 0 ;
+/*
+ *   For --stats, what the algorithm says about its hash and memory after
+ *   each step, as one JSON object per line.
+ */
+char *statsfilename = 0 ;
+FILE *statsfile = 0 ;
+void writestats() {
+   lifestats s ;
+   if (!imp->getstats(s))
+      return ;
+   fprintf(statsfile, "{\"generation\":\"%s\",\"seconds\":%.3f",
+           imp->getGeneration().tostring(), gollySecondCount() - start) ;
+   fprintf(statsfile, ",\"lookups\":%.0f,\"hits\":%.0f,\"misses\":%.0f",
+           s.lookups, s.hits, s.lookups - s.hits) ;
+   fprintf(statsfile, ",\"hitrate\":%.4f,\"probesperlookup\":%.3f",
+           s.lookups ? s.hits / s.lookups : 0,
+           s.lookups ? s.probes / s.lookups : 0) ;
+   fprintf(statsfile, ",\"hashsize\":%.0f,\"hashpop\":%.0f,\"leaves\":%.0f",
+           s.hashsize, s.hashpop, s.leaves) ;
+   fprintf(statsfile, ",\"nodesbysize\":[") ;
+   for (size_t k=0; k<s.nodesbysize.size(); k++)
+      fprintf(statsfile, "%s%.0f", k ? "," : "", s.nodesbysize[k]) ;
+   fprintf(statsfile, "],\"bytesused\":%.0f,\"maxmem\":%.0f",
+           s.bytesused, s.maxmem) ;
+   fprintf(statsfile, ",\"gccount\":%.0f,\"gcpausetotal\":%.3f"
+           ",\"gcpausemax\":%.3f,\"gcpauselast\":%.3f",
+           s.gccount, s.gcpausetotal, s.gcpausemax, s.gcpauselast) ;
+   fprintf(statsfile, ",\"invalidations\":%.0f,\"nodescalculated\":%.0f}\n",
+           s.invalidations, s.nodescalculated) ;
+   fflush(statsfile) ;
+}
 
 /*
  *   This is a "renderer" that is just stubs, for performance testing.
@@ -121,6 +230,7 @@ struct options {
 } ;
 bigint maxgen = -1, inc = 0 ;
 int maxmem = 256 ;
+int numthreads = 1 ;
 int hyperxxx ;   // renamed hyper to avoid conflict with windows.h
 int render, autofit, quiet, popcount, progress ;
 int hashlife ;
@@ -132,12 +242,22 @@ char *liferule = 0 ;
 char *outfilename = 0 ;
 char *renderscale = (char *)"1" ;
 char *testscript = 0 ;
+char *leafkernel = 0 ;
+int leafbench ;
+int tablebench ;
+int smallpages, interleave ;
+char *comparealgo = 0 ;
+int sharenodes ;
+int findperiods ;
+int resumed ;
 int outputgzip, outputismc ;
 int numberoffset ; // where to insert file name numbers
 options options[] = {
   { "-m", "--generation", "How far to run", 'I', &maxgen },
   { "-i", "--stepsize", "Step size", 'I', &inc },
   { "-M", "--maxmemory", "Max memory to use in megabytes", 'i', &maxmem },
+  { "-j", "--threads", "Number of threads to use (hashlife, quicklife)", 'i',
+                                                               &numthreads },
   { "-T", "--maxtime", "Max duration", 'i', &maxtime },
   { "-b", "--benchmark", "Show timestamps", 'b', &benchmark },
   { "-2", "--exponential", "Use exponentially increasing steps", 'b', &hyperxxx },
@@ -150,6 +270,8 @@ options options[] = {
                                                                &outfilename },
   { "-v", "--verbose", "Verbose", 'b', &verbose },
   { "-t", "--timeline", "Use timeline", 'b', &timeline },
+  { "",   "--nodefile", "Keep hashlife nodes in this file; resume the run saved there",
+                                                          's', &nodefile },
   { "",   "--render", "Render (benchmarking)", 'b', &render },
   { "",   "--progress", "Render during progress dialog (debugging)", 'b', &progress },
   { "",   "--popcount", "Popcount (benchmarking)", 'b', &popcount },
@@ -160,6 +282,24 @@ options options[] = {
 //                                                        'i', &stepfactor },
   { "",   "--autofit", "Autofit before each render", 'b', &autofit },
   { "",   "--exec", "Run testing script", 's', &testscript },
+  { "",   "--leafkernel", "Leaf kernel for hashlife (swar, sse2, avx2)", 's',
+                                                               &leafkernel },
+  { "",   "--leafbench", "Time the leaf kernels (benchmarking)", 'b', &leafbench },
+  { "",   "--tablebench", "Time the rule table or tree evaluators (benchmarking)", 'b',
+                                                               &tablebench },
+  { "",   "--smallpages", "Don't use huge pages for hashing memory", 'b', &smallpages },
+  { "",   "--interleave", "Interleave hashing memory across NUMA nodes", 'b',
+                                                               &interleave },
+  { "",   "--memstats", "Show TLB misses and huge page use (benchmarking)", 'b',
+                                                               &memstats },
+  { "",   "--stats", "Write hash statistics as JSON after each step (- for stdout)",
+                                                     's', &statsfilename },
+  { "",   "--sharenodes", "Let hashlife patterns with the same rule share nodes",
+                                                     'b', &sharenodes },
+  { "",   "--period", "Stop when the pattern repeats and show its period",
+                                                     'b', &findperiods },
+  { "",   "--compare", "Check each step against another algorithm (debugging)",
+                                                     's', &comparealgo },
   { 0, 0, 0, 0, 0 }
 } ;
 
@@ -176,7 +316,7 @@ int endswith(const char *s, const char *suff) {
 }
 
 void usage(const char *s) {
-  fprintf(stderr, "Usage:  bgolly [options] patternfile\n") ;
+  fprintf(stderr, "Usage:  bgolly [options] patternfile...\n") ;
   for (int i=0; options[i].shortopt; i++)
     fprintf(stderr, "%3s %-15s %s\n", options[i].shortopt, options[i].longopt,
             options[i].desc) ;
@@ -451,6 +591,74 @@ lifealgo *createUniverse() {
    return imp ;
 }
 
+/*
+ *   For --compare, a second universe runs the same pattern with another
+ *   algorithm, stepped by the same increments.  After each step the two
+ *   must have the same cells, else we stop with exit status 10.
+ */
+lifealgo *cmpimp = 0 ;
+void startcompare() {
+   char *name = algoName ;
+   algoName = comparealgo ;
+   delete cmpimp ;
+   cmpimp = createUniverse() ;
+   algoName = name ;
+   const char *err = readpattern(filename, *cmpimp) ;
+   if (err) lifefatal(err) ;
+   if (liferule) {
+      err = cmpimp->setrule(liferule) ;
+      if (err) lifefatal(err) ;
+   }
+}
+void comparefail(const char *why) {
+   cout << "Generation " << imp->getGeneration().tostring() << ": " ;
+   cout << algoName << " and " << comparealgo << " differ in " << why << endl ;
+   exit(10) ;
+}
+void stepcompare() {
+   if (cmpimp->unbounded && (cmpimp->gridwd > 0 || cmpimp->gridht > 0)) {
+      // it can only step a bounded grid one generation at a time
+      cmpimp->setIncrement(1) ;
+      while (cmpimp->getGeneration() < imp->getGeneration()) {
+         if (!cmpimp->CreateBorderCells())
+            lifefatal("Cannot step the pattern being compared") ;
+         cmpimp->step() ;
+         if (!cmpimp->DeleteBorderCells())
+            lifefatal("Cannot step the pattern being compared") ;
+      }
+   } else {
+      cmpimp->setIncrement(imp->getIncrement()) ;
+      cmpimp->step() ;
+   }
+   if (imp->getGeneration() != cmpimp->getGeneration())
+      comparefail("generation") ;
+   if (imp->getPopulation() != cmpimp->getPopulation())
+      comparefail("population") ;
+   if (imp->isEmpty())
+      return ;
+   bigint t, l, b, r, t2, l2, b2, r2 ;
+   imp->findedges(&t, &l, &b, &r) ;
+   cmpimp->findedges(&t2, &l2, &b2, &r2) ;
+   if (t != t2 || l != l2 || b != b2 || r != r2)
+      comparefail("bounding box") ;
+   bigint lim = 1000000000, neglim = -1000000000 ;
+   if (t < neglim || l < neglim || b > lim || r > lim)
+      return ; // too far out for nextcell; the population will have to do
+   int minx = l.toint(), maxx = r.toint() ;
+   for (int y=t.toint(); y<=b.toint(); y++) {
+      for (int x=minx; x<=maxx; x++) {
+         int v, v2 ;
+         int dx = imp->nextcell(x, y, v) ;
+         int dx2 = cmpimp->nextcell(x, y, v2) ;
+         if (dx != dx2 || (dx >= 0 && v != v2))
+            comparefail("cells") ;
+         if (dx < 0)
+            break ;
+         x += dx ;
+      }
+   }
+}
+
 struct newcmd : public cmdbase {
    newcmd() : cmdbase("new", "") {}
    virtual void doit() {
@@ -511,6 +719,313 @@ void runtestscript(const char *testscript) {
    exit(0) ;
 }
 
+/*
+ *   Drive the hashlife leaf kernels directly, for benchmarking.  Each
+ *   kernel this processor has runs the same random 16-squares forward
+ *   1, 2 and 4 generations; we check that they all agree bit for bit,
+ *   and that the part of the square that should be right matches what
+ *   the rule table says, a cell at a time.
+ */
+static int tablecell(const char *ruletable, int g[16][16], int r, int c) {
+   int x = 0 ;
+   for (int i=0; i<4; i++)
+      for (int j=0; j<4; j++) {
+         int y = r - 1 + i, z = c - 1 + j ;
+         x = (x << 1) | (y < 16 && z < 16 ? g[y][z] : 0) ;
+      }
+   return (ruletable[x] & 0x20) != 0 ;
+}
+static void tablegens(const char *ruletable, const sliceword *w, int gens,
+                      int g[16][16]) {
+   int t[16][16] ;
+   for (int r=0; r<16; r++)
+      for (int c=0; c<16; c++)
+         g[r][c] = (int)(w[r >> 2] >> (16 * (3 - (r & 3)) + 15 - c)) & 1 ;
+   for (int i=0; i<gens; i++) {
+      for (int r=0; r<16; r++)
+         for (int c=0; c<16; c++)
+            t[r][c] = r > 0 && c > 0 ? tablecell(ruletable, g, r, c) : 0 ;
+      memcpy(g, t, sizeof(t)) ;
+   }
+}
+void runleafbench(const char *rule) {
+   liferules rules ;
+   const char *err = rules.setrule(rule, imp) ;
+   if (err)
+      lifefatal(err) ;
+   sliceword sel[24] ;
+   int kind = findslicerule(rules.rule0, sel) ;
+   if (kind == 0)
+      lifefatal("The leaf kernels only do Bx/Sy rules on the Moore neighborhood") ;
+   const int NSQ = 4096, REPS = 200 ;
+   vector<sliceword> in(4 * NSQ), want(4 * NSQ), got(4 * NSQ) ;
+   srand(1) ;
+   for (int i=0; i<NSQ; i++) {
+      int density = 1 + i % 7 ; // in eighths
+      for (int k=0; k<4; k++) {
+         sliceword x = 0 ;
+         for (int b=0; b<64; b++)
+            x = (x << 1) | (rand() % 8 < density) ;
+         in[4*i+k] = x ;
+      }
+   }
+   cout << "Rule " << rules.getrule() << ", using " << currentslicekernel()
+        << endl ;
+   for (int gens=1; gens<=4; gens+=gens) {
+      for (int n=0; n<numslicekernels(); n++) {
+         slicekernel f = getslicekernel(n) ;
+         const sliceword *s = kind == 1 ? 0 : sel ;
+         double t0 = gollySecondCount() ;
+         for (int rep=0; rep<REPS; rep++) {
+            got = in ;
+            for (int i=0; i<NSQ; i++)
+               f(&got[4*i], gens, s) ;
+         }
+         double t = gollySecondCount() - t0 ;
+         int bad = 0 ;
+         if (n == 0) {
+            want = got ;
+            for (int i=0; i<NSQ; i++) {
+               int g[16][16] ;
+               tablegens(rules.rule0, &in[4*i], gens, g) ;
+               for (int r=gens; r<16-gens; r++)
+                  for (int c=gens; c<16-gens; c++)
+                     if (g[r][c] != (int)(want[4*i+(r>>2)] >>
+                                          (16 * (3 - (r & 3)) + 15 - c) & 1))
+                        bad++ ;
+            }
+         } else if (got != want) {
+            bad = 1 ;
+         }
+         cout << slicekernelname(n) << " gens " << gens << ": "
+              << (1e9 * t / REPS / NSQ) << " ns per square" ;
+         if (bad)
+            cout << " MISMATCH" ;
+         cout << endl ;
+         if (bad)
+            exit(10) ;
+      }
+   }
+}
+
+/*
+ *   Drive a rule table through both of its evaluators, for benchmarking:
+ *   the compiled transitions that slowcalc walks, and the bitmask matcher
+ *   they were compiled from.  We try every neighborhood if there are few
+ *   enough of them, otherwise a random sample, and the two must agree on
+ *   all of them.  JvN's table is checked against its rules as written in
+ *   the same way.  A rule tree has just the one evaluator, which we time
+ *   too.  Times are the best of three runs.
+ */
+typedef state (*rulecalc)(void *, const state *) ;
+static state tablefast(void *t, const state *p) {
+   return ((ruletable_algo *)t)->ruletable_algo::slowcalc(p[0], p[1], p[2],
+                                   p[3], p[4], p[5], p[6], p[7], p[8]) ;
+}
+static state tableslow(void *t, const state *p) {
+   return ((ruletable_algo *)t)->matchcalc(p[0], p[1], p[2], p[3], p[4],
+                                           p[5], p[6], p[7], p[8]) ;
+}
+static state jvnfast(void *t, const state *p) {
+   return ((jvnalgo *)t)->jvnalgo::slowcalc(p[0], p[1], p[2], p[3], p[4],
+                                            p[5], p[6], p[7], p[8]) ;
+}
+static state jvnslow(void *t, const state *p) {
+   return ((jvnalgo *)t)->logiccalc(p[1], p[3], p[4], p[5], p[7]) ;
+}
+static state treecalc(void *t, const state *p) {
+   return ((ruletreealgo *)t)->ruletreealgo::slowcalc(p[0], p[1], p[2],
+                                   p[3], p[4], p[5], p[6], p[7], p[8]) ;
+}
+void runtablebench(const char *rule) {
+   jvnalgo jvn ;
+   ruleloaderalgo loader ;
+   lifealgo *algo = &jvn ;
+   ruletable_algo *table = 0 ;
+   ruletreealgo *tree = 0 ;
+   if (jvn.setrule(rule)) {
+      const char *err = loader.setrule(rule) ;
+      if (err)
+         lifefatal(err) ;
+      algo = &loader ;
+      table = loader.GetRuleTable() ;
+      tree = loader.GetRuleTree() ;
+   }
+   void *t ;
+   rulecalc calc[2] ;
+   const char *name[2] ;
+   int mask, npass = 2 ;
+   cout << "Rule " << algo->getrule() << ", " << algo->NumCellStates()
+        << " states, " ;
+   if (algo == &jvn) {
+      t = &jvn ;
+      calc[0] = jvnslow ;
+      calc[1] = jvnfast ;
+      name[0] = "rules" ;
+      name[1] = "table" ;
+      mask = jvn.calcmask() ;
+      cout << "von Neumann neighborhood" << endl ;
+   } else if (table) {
+      t = table ;
+      calc[0] = tableslow ;
+      calc[1] = tablefast ;
+      name[0] = "matcher" ;
+      name[1] = "compiled" ;
+      mask = table->calcmask() ;
+      if (table->iscompiled())
+         cout << "compiled into " << table->compiledsize() << " bytes" << endl ;
+      else
+         cout << "too big to compile" << endl ;
+   } else {
+      t = tree ;
+      calc[0] = treecalc ;
+      name[0] = "tree" ;
+      npass = 1 ;
+      mask = tree->calcmask() ;
+      cout << "a tree" << endl ;
+   }
+   const int MAXNB = 1 << 22 ;
+   int ns = algo->NumCellStates() ;
+   int nn = 1 ;
+   for (int b=0; b<9; b++)
+      if ((mask >> b) & 1)
+         nn = nn > MAXNB / ns ? MAXNB + 1 : nn * ns ;
+   bool every = nn <= MAXNB ;
+   if (!every)
+      nn = MAXNB ;
+   vector<state> nb(9 * nn, 0) ;
+   srand(1) ;
+   for (int i=0; i<nn; i++) {
+      int x = i ;
+      for (int b=0; b<9; b++)
+         if ((mask >> b) & 1) {
+            nb[9*i+8-b] = (state)(every ? x % ns : rand() % ns) ;
+            x /= ns ;
+         }
+   }
+   cout << nn << (every ? " neighborhoods (all of them)" :
+                          " random neighborhoods") << endl ;
+   int reps = MAXNB / nn ;
+   if (reps < 1)
+      reps = 1 ;
+   vector<state> want(nn), got(nn) ;
+   for (int pass=0; pass<npass; pass++) {
+      vector<state> &out = pass ? got : want ;
+      rulecalc f = calc[pass] ;
+      double secs = 0 ;
+      for (int best=0; best<3; best++) {
+         double t0 = gollySecondCount() ;
+         for (int rep=0; rep<reps; rep++) {
+            const state *p = &nb[0] ;
+            for (int i=0; i<nn; i++, p += 9)
+               out[i] = f(t, p) ;
+         }
+         t0 = gollySecondCount() - t0 ;
+         if (best == 0 || t0 < secs)
+            secs = t0 ;
+      }
+      cout << name[pass] << ": " << (1e9 * secs / reps / nn)
+           << " ns per cell" ;
+      if (pass && got != want)
+         cout << " MISMATCH" ;
+      cout << endl ;
+   }
+   if (npass == 2 && got != want)
+      exit(10) ;
+}
+
+void setliferule() {
+   if (liferule) {
+      const char *err = imp->setrule(liferule) ;
+      if (err) lifefatal(err) ;
+   }
+}
+
+void runpattern() {
+   bool boundedgrid = imp->unbounded && (imp->gridwd > 0 || imp->gridht > 0) ;
+   if (boundedgrid) {
+      if (hyperxxx || inc > 1)
+         lifewarning("Step size must be 1 for a bounded grid") ;
+      hyperxxx = 0 ;
+      inc = 1 ;     // only step by 1
+   }
+   if (inc != 0)
+      imp->setIncrement(inc) ;
+   else if (resumed && hyperxxx)
+      imp->setIncrement(imp->getGeneration()) ;
+   if (timeline) {
+      int lowbit = inc.lowbitset() ;
+      bigint t = 1 ;
+      for (int i=0; i<lowbit; i++)
+         t.mul_smallint(2) ;
+      if (t != inc)
+         lifefatal("Bad increment for timeline") ;
+      imp->startrecording(2, lowbit) ;
+   }
+   if (findperiods && !imp->startperiodsearch())
+      lifefatal("This algorithm cannot find periods") ;
+   int fc = 0 ;
+   for (;;) {
+      if (benchmark)
+         cout << timestamp() << " " ;
+      else
+         timestamp() ;
+      if (quiet < 2) {
+         cout << imp->getGeneration().tostring() ;
+         if (!quiet) {
+            const char *s = imp->getPopulation().tostring() ;
+            if (benchmark) {
+               cout << endl ;
+               cout << timestamp() << " pop " << s << endl ;
+            } else {
+               cout << ": " << s << endl ;
+            }
+         } else
+            cout << endl ;
+      }
+      if (popcount)
+         imp->getPopulation() ;
+      if (autofit)
+        imp->fit(viewport, 1) ;
+      if (render)
+        imp->draw(viewport, renderer) ;
+      if (maxgen >= 0 && imp->getGeneration() >= maxgen)
+         break ;
+      if (!hyperxxx && maxgen > 0 && inc == 0) {
+         bigint diff = maxgen ;
+         diff -= imp->getGeneration() ;
+         int bs = diff.lowbitset() ;
+         diff = 1 ;
+         diff <<= bs ;
+         imp->setIncrement(diff) ;
+      }
+      if (boundedgrid && !imp->CreateBorderCells()) break ;
+      imp->step() ;
+      if (boundedgrid && !imp->DeleteBorderCells()) break ;
+      if (cmpimp) stepcompare() ;
+      if (statsfile) writestats() ;
+      if (findperiods) {
+         bigint period, dx, dy ;
+         if (imp->findperiod(period, dx, dy)) {
+            cout << "Period " << period.tostring() ;
+            cout << " at generation " << imp->getGeneration().tostring() ;
+            cout << ", moving " << dx.tostring() ;
+            cout << "," << dy.tostring() << endl ;
+            break ;
+         }
+      }
+      if (timeline) imp->extendtimeline() ;
+      if (maxgen < 0 && outfilename != 0)
+         writepat(fc++) ;
+      if (timeline && imp->getframecount() + 2 > MAX_FRAME_COUNT)
+         imp->pruneframes() ;
+      if (hyperxxx)
+         imp->setIncrement(imp->getGeneration()) ;
+   }
+   if (maxgen >= 0 && outfilename != 0)
+      writepat(-1) ;
+}
+
 int main(int argc, char *argv[]) {
    cout << "This is bgolly " STRINGIFY(VERSION) " Copyright 2005-2018 The Golly Gang."
         << endl ;
@@ -522,6 +1037,7 @@ int main(int argc, char *argv[]) {
    hlifealgo::doInitializeAlgoInfo(staticAlgoInfo::tick()) ;
    generationsalgo::doInitializeAlgoInfo(staticAlgoInfo::tick()) ;
    ltlalgo::doInitializeAlgoInfo(staticAlgoInfo::tick()) ;
+   bitgenalgo::doInitializeAlgoInfo(staticAlgoInfo::tick()) ;
    jvnalgo::doInitializeAlgoInfo(staticAlgoInfo::tick()) ;
    ruleloaderalgo::doInitializeAlgoInfo(staticAlgoInfo::tick()) ;
    while (argc > 1 && argv[1][0] == '-') {
@@ -565,10 +1081,14 @@ case 's':
       if (!hit)
          usage("Bad option given") ;
    }
-   if (argc < 2 && !testscript)
+   if (leafkernel && !setslicekernel(leafkernel))
+      lifefatal("No such leaf kernel on this processor") ;
+   if (argc < 2 && !testscript && !nodefile && !leafbench && !tablebench)
       usage("No pattern argument given") ;
-   if (argc > 2)
-      usage("Extra stuff after pattern argument") ;
+   if (comparealgo && (testscript || nodefile))
+      usage("--compare cannot be used with --exec or --nodefile") ;
+   if (argc > 2 && (testscript || nodefile || outfilename))
+      usage("Only one pattern can be given with --exec, --nodefile or -o") ;
    if (outfilename) {
       if (endswith(outfilename, ".rle")) {
       } else if (endswith(outfilename, ".mc")) {
@@ -588,6 +1108,11 @@ case 's':
    }
    if (timeline && hyperxxx)
       lifefatal("Cannot use both timeline and exponentially increasing steps") ;
+   setbigmempolicy(!smallpages, interleave) ;
+   if (memstats)
+      startmemstats() ;
+   if (sharenodes)
+      hlifealgo::setsharednodes(1) ;
    imp = createUniverse() ;
    if (progress)
       lifeerrors::seterrorhandler(&progerrors_instance) ;
@@ -596,88 +1121,65 @@ case 's':
    if (verbose) {
       hlifealgo::setVerbose(1) ;
    }
+   lifealgo::setNumThreads(numthreads) ;
    imp->setMaxMemory(maxmem) ;
+   if (statsfilename) {
+      lifestats s ;
+      if (!imp->getstats(s))
+         lifewarning("This algorithm keeps no statistics") ;
+      statsfile = strcmp(statsfilename, "-") == 0 ? stdout :
+                                                  fopen(statsfilename, "w") ;
+      if (statsfile == 0)
+         lifefatal("Cannot open the statistics file") ;
+   }
+   if (leafbench) {
+      runleafbench(liferule ? liferule : "B3/S23") ;
+      exit(0) ;
+   }
+   if (tablebench) {
+      runtablebench(liferule ? liferule : "Langtons-Loops") ;
+      exit(0) ;
+   }
+   if (nodefile) {
+      if (strcmp(algoName, "HashLife") != 0)
+         lifefatal("Node files only work with HashLife") ;
+      const char *err = ((hlifealgo *)imp)->setnodefile(nodefile, resumed) ;
+      if (err) lifefatal(err) ;
+      if (!resumed && argc < 2)
+         lifefatal("No saved run in the node file, and no pattern given") ;
+   }
    timestamp() ;
    if (testscript) {
-      if (argc > 1) {
+      if (argc > 1 && !resumed) {
          filename = argv[1] ;
          const char *err = readpattern(argv[1], *imp) ;
          if (err) lifefatal(err) ;
       }
       runtestscript(testscript) ;
    }
-   filename = argv[1] ;
-   const char *err = readpattern(argv[1], *imp) ;
-   if (err) lifefatal(err) ;
-   if (liferule) {
-      err = imp->setrule(liferule) ;
-      if (err) lifefatal(err) ;
-   }
-   bool boundedgrid = imp->unbounded && (imp->gridwd > 0 || imp->gridht > 0) ;
-   if (boundedgrid) {
-      if (hyperxxx || inc > 1)
-         lifewarning("Step size must be 1 for a bounded grid") ;
-      hyperxxx = 0 ;
-      inc = 1 ;     // only step by 1
-   }
-   if (inc != 0)
-      imp->setIncrement(inc) ;
-   if (timeline) {
-      int lowbit = inc.lowbitset() ;
-      bigint t = 1 ;
-      for (int i=0; i<lowbit; i++)
-         t.mul_smallint(2) ;
-      if (t != inc)
-         lifefatal("Bad increment for timeline") ;
-      imp->startrecording(2, lowbit) ;
+   if (resumed) {
+      if (argc > 1)
+         lifewarning("Resuming the run in the node file; ignoring the pattern") ;
+      setliferule() ;
+      runpattern() ;
    }
-   int fc = 0 ;
-   for (;;) {
-      if (benchmark)
-         cout << timestamp() << " " ;
-      else
-         timestamp() ;
-      if (quiet < 2) {
-         cout << imp->getGeneration().tostring() ;
-         if (!quiet) {
-            const char *s = imp->getPopulation().tostring() ;
-            if (benchmark) {
-               cout << endl ;
-               cout << timestamp() << " pop " << s << endl ;
-            } else {
-               cout << ": " << s << endl ;
-            }
-         } else
-            cout << endl ;
-      }
-      if (popcount)
-         imp->getPopulation() ;
-      if (autofit)
-        imp->fit(viewport, 1) ;
-      if (render)
-        imp->draw(viewport, renderer) ;
-      if (maxgen >= 0 && imp->getGeneration() >= maxgen)
-         break ;
-      if (!hyperxxx && maxgen > 0 && inc == 0) {
-         bigint diff = maxgen ;
-         diff -= imp->getGeneration() ;
-         int bs = diff.lowbitset() ;
-         diff = 1 ;
-         diff <<= bs ;
-         imp->setIncrement(diff) ;
+   // each pattern gets a universe of its own; the last one goes only
+   // once the next has its rule, so a store it shares is kept
+   lifealgo *last = 0 ;
+   for (int i=1; i<argc && !resumed; i++) {
+      if (i > 1) {
+         last = imp ;
+         imp = createUniverse() ;
       }
-      if (boundedgrid && !imp->CreateBorderCells()) break ;
-      imp->step() ;
-      if (boundedgrid && !imp->DeleteBorderCells()) break ;
-      if (timeline) imp->extendtimeline() ;
-      if (maxgen < 0 && outfilename != 0)
-         writepat(fc++) ;
-      if (timeline && imp->getframecount() + 2 > MAX_FRAME_COUNT)
-         imp->pruneframes() ;
-      if (hyperxxx)
-         imp->setIncrement(imp->getGeneration()) ;
+      filename = argv[i] ;
+      const char *err = readpattern(argv[i], *imp) ;
+      if (err) lifefatal(err) ;
+      setliferule() ;
+      delete last ;
+      last = 0 ;
+      if (comparealgo)
+         startcompare() ;
+      runpattern() ;
    }
-   if (maxgen >= 0 && outfilename != 0)
-      writepat(-1) ;
-   exit(0) ;
+   finish() ;
 }
@@ -0,0 +1,31 @@
+#!/bin/sh
+# Step patterns with one algorithm and check every step against another,
+# using bgolly's --compare option.  Run it from the top of the source
+# tree, giving the bgolly to test:
+#
+#     cmdline/check-algos.sh ./bgolly
+#
+# It stops at the first case that fails.
+
+BGOLLY=${1:-./bgolly}
+
+check() {
+   echo "$@"
+   "$BGOLLY" -q -q "$@" > /dev/null || {
+      "$BGOLLY" -q -q "$@" | tail -1
+      echo "FAILED"
+      exit 1
+   }
+}
+
+# this grows at the speed of light, so a step of any increment below
+# 2^(n+1) needs the border of two steps of 2^n
+RULER=Patterns/Non-Totalistic/infinite-binary-ruler-generator.rle
+check -a HashLife --compare QuickLife -m 7000 -i 1000 $RULER
+check -a HashLife --compare QuickLife -m 3000 -i 36 $RULER
+check -a HashLife --compare QuickLife -m 3000 -i 100 $RULER
+check -a HashLife -j 4 --compare QuickLife -m 7000 -i 1000 $RULER
+check -a HashLife --compare QuickLife -m 3000 -i 37 \
+      -r B2ak3nr4iy/S3-nr4ent5er:T700,500 $RULER
+
+echo "All passed"
@@ -0,0 +1,743 @@
+// This file is part of Golly.
+// See docs/License.html for the copyright notice.
+
+// A non-hashing algorithm for Generations rules, for patterns too
+// chaotic for the hashing in the Generations algorithm to pay off.
+// See Help/Algorithms/BitGenerations.html for more info.
+
+#include "bitgenalgo.h"
+#include "util.h"
+#include <string.h>     // for memset, memcpy, strchr and strcpy
+
+// -----------------------------------------------------------------------------
+
+// tiles must stay inside this square (in units of 64 cells) so that every
+// cell has int coordinates
+static const int MAXTILE = 1 << 25;
+
+// the neighbors of a tile, in the order of tile::nb
+static const int nbdx[8] = { -1, 0, 1, -1, 1, -1, 0, 1 };
+static const int nbdy[8] = { -1, -1, -1, 0, 0, 1, 1, 1 };
+
+static const unsigned long long zerorows[64] = { 0 };
+
+static inline int popcount64(unsigned long long w)
+{
+#ifdef FASTPOPCOUNT
+    return FASTPOPCOUNT((unsigned int)w) + FASTPOPCOUNT((unsigned int)(w >> 32));
+#else
+    int n = 0;
+    while (w) {
+        w &= w - 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+// lowest and highest set bits of a non-zero word
+static inline int lowbit(unsigned long long w)
+{
+    int i = 0;
+    while ((w & 1) == 0) {
+        w >>= 1;
+        i++;
+    }
+    return i;
+}
+
+static inline int highbit(unsigned long long w)
+{
+    int i = 63;
+    while ((w >> 63) == 0) {
+        w <<= 1;
+        i--;
+    }
+    return i;
+}
+
+// -----------------------------------------------------------------------------
+
+// Create a new empty universe.
+
+bitgenalgo::bitgenalgo()
+{
+    nplanes = 1;
+    population = 0;
+    show_warning = true;
+    generation = 0;
+    increment = 1;
+    setrule(DefaultRule());
+}
+
+// -----------------------------------------------------------------------------
+
+// Destroy the universe.
+
+bitgenalgo::~bitgenalgo()
+{
+    freetiles();
+}
+
+// -----------------------------------------------------------------------------
+
+bitgenalgo::tile* bitgenalgo::findtile(int tx, int ty)
+{
+    tilemap::iterator it = tiles.find(std::make_pair(ty, tx));
+    return it == tiles.end() ? 0 : it->second;
+}
+
+// -----------------------------------------------------------------------------
+
+bitgenalgo::tile* bitgenalgo::maketile(int tx, int ty)
+{
+    if (tx < -MAXTILE || tx >= MAXTILE || ty < -MAXTILE || ty >= MAXTILE) return 0;
+    tile* t = new tile;
+    t->tx = tx;
+    t->ty = ty;
+    t->cells = new unsigned long long[nplanes * 64];
+    t->next = new unsigned long long[nplanes * 64];
+    memset(t->cells, 0, nplanes * 64 * sizeof(unsigned long long));
+    memset(t->alive, 0, sizeof(t->alive));
+    t->pop = 0;
+    t->anyalive = false;
+    tiles[std::make_pair(ty, tx)] = t;
+    return t;
+}
+
+// -----------------------------------------------------------------------------
+
+void bitgenalgo::freetile(tile* t)
+{
+    delete[] t->cells;
+    delete[] t->next;
+    delete t;
+}
+
+// -----------------------------------------------------------------------------
+
+void bitgenalgo::freetiles()
+{
+    for (tilemap::iterator it = tiles.begin(); it != tiles.end(); ++it)
+        freetile(it->second);
+    tiles.clear();
+    population = 0;
+}
+
+// -----------------------------------------------------------------------------
+
+void bitgenalgo::clearall()
+{
+    freetiles();
+}
+
+// -----------------------------------------------------------------------------
+
+// Change the number of bit-planes a tile has.  If there are fewer, states
+// lose their high bits; the GUI gets rid of such cells before that.
+
+void bitgenalgo::setplanes(int n)
+{
+    for (tilemap::iterator it = tiles.begin(); it != tiles.end(); ++it) {
+        tile* t = it->second;
+        unsigned long long* cells = new unsigned long long[n * 64];
+        memset(cells, 0, n * 64 * sizeof(unsigned long long));
+        memcpy(cells, t->cells, (n < nplanes ? n : nplanes) * 64 * sizeof(unsigned long long));
+        delete[] t->cells;
+        delete[] t->next;
+        t->cells = cells;
+        t->next = new unsigned long long[n * 64];
+    }
+    nplanes = n;
+    population = 0;
+    for (tilemap::iterator it = tiles.begin(); it != tiles.end(); ++it) {
+        recount(it->second);
+        population += it->second->pop;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void bitgenalgo::recount(tile* t)
+{
+    t->pop = 0;
+    t->anyalive = false;
+    for (int r = 0; r < 64; r++) {
+        unsigned long long any = t->cells[r], high = 0;
+        for (int p = 1; p < nplanes; p++) high |= t->cells[p * 64 + r];
+        any |= high;
+        t->alive[r] = t->cells[r] & ~high;
+        t->pop += popcount64(any);
+        if (t->alive[r]) t->anyalive = true;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void bitgenalgo::setstate(tile* t, int col, int row, int newstate)
+{
+    unsigned long long bit = 1ULL << col;
+    int oldstate = getstate(t, col, row);
+    for (int p = 0; p < nplanes; p++) {
+        if ((newstate >> p) & 1)
+            t->cells[p * 64 + row] |= bit;
+        else
+            t->cells[p * 64 + row] &= ~bit;
+    }
+    if (newstate == 1) {
+        t->alive[row] |= bit;
+        t->anyalive = true;
+    } else {
+        t->alive[row] &= ~bit;
+    }
+    t->pop += (newstate != 0) - (oldstate != 0);
+}
+
+// -----------------------------------------------------------------------------
+
+int bitgenalgo::getstate(tile* t, int col, int row)
+{
+    int s = 0;
+    for (int p = 0; p < nplanes; p++)
+        s |= (int)((t->cells[p * 64 + row] >> col) & 1) << p;
+    return s;
+}
+
+// -----------------------------------------------------------------------------
+
+int bitgenalgo::NumCellStates()
+{
+    return maxCellStates;
+}
+
+// -----------------------------------------------------------------------------
+
+void bitgenalgo::endofpattern()
+{
+    show_warning = true;
+}
+
+// -----------------------------------------------------------------------------
+
+int bitgenalgo::setcell(int x, int y, int newstate)
+{
+    if (newstate < 0 || newstate >= maxCellStates) return -1;
+    tile* t = findtile(x >> 6, y >> 6);
+    if (t == 0) {
+        if (newstate == 0) return 0;
+        t = maketile(x >> 6, y >> 6);
+    }
+    int oldstate = getstate(t, x & 63, y & 63);
+    setstate(t, x & 63, y & 63, newstate);
+    population += (newstate != 0) - (oldstate != 0);
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+
+// Get the state of the cell at the given location.
+
+int bitgenalgo::getcell(int x, int y)
+{
+    tile* t = findtile(x >> 6, y >> 6);
+    return t ? getstate(t, x & 63, y & 63) : 0;
+}
+
+// -----------------------------------------------------------------------------
+
+// Return the distance to the next non-zero cell in the given row,
+// or -1 if there is none.
+
+int bitgenalgo::nextcell(int x, int y, int& v)
+{
+    int tx = x >> 6, row = y & 63;
+    tilemap::iterator it = tiles.lower_bound(std::make_pair(y >> 6, tx));
+    for (; it != tiles.end() && it->first.first == (y >> 6); ++it) {
+        tile* t = it->second;
+        if (t->pop == 0) continue;
+        unsigned long long w = 0;
+        for (int p = 0; p < nplanes; p++) w |= t->cells[p * 64 + row];
+        if (t->tx == tx) w &= ~0ULL << (x & 63);
+        if (w) {
+            int col = lowbit(w);
+            v = getstate(t, col, row);
+            return t->tx * 64 + col - x;
+        }
+    }
+    return -1;
+}
+
+// -----------------------------------------------------------------------------
+
+static bigint bigpop;
+
+const bigint& bitgenalgo::getPopulation()
+{
+    bigpop = bigint(population);
+    return bigpop;
+}
+
+// -----------------------------------------------------------------------------
+
+int bitgenalgo::isEmpty()
+{
+    return population == 0 ? 1 : 0;
+}
+
+// -----------------------------------------------------------------------------
+
+/*
+ *   The new states of a row of 64 cells, given the cells in state 1 in
+ *   the rows above, at and below it; each comes with the rows beside it
+ *   in the tiles to the west and east, for the cells at the ends.  A
+ *   bit is set for a cell the rule gives state 1, as if the cell were
+ *   in state 1 or 0 as it is in m; whether it is a cell that can be born
+ *   or survive is up to the caller.
+ */
+unsigned long long bitgenalgo::rowcalc(unsigned long long a, unsigned long long aw, unsigned long long ae,
+                                       unsigned long long m, unsigned long long mw, unsigned long long me,
+                                       unsigned long long b, unsigned long long bw, unsigned long long be)
+{
+    if (!totalistic)
+        return mapcalc(a, aw, ae, m, mw, me, b, bw, be);
+    switch (neighbormask) {
+        case 0x1bb:
+            return countcalc<0x1bb>(a, aw, ae, m, mw, me, b, bw, be);
+        case 0x0ba:
+            return countcalc<0x0ba>(a, aw, ae, m, mw, me, b, bw, be);
+        default:
+            return countcalc<0x1ff>(a, aw, ae, m, mw, me, b, bw, be);
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+// For a rule that only depends on how many neighbors are in state 1,
+// count them with bit-sliced adders: a 4-bit count for each column.
+
+template <int mask>
+unsigned long long bitgenalgo::countcalc(unsigned long long a, unsigned long long aw, unsigned long long ae,
+                                         unsigned long long m, unsigned long long mw, unsigned long long me,
+                                         unsigned long long b, unsigned long long bw, unsigned long long be)
+{
+    // the neighbors of each column (bit i is column i, so west is i-1)
+    unsigned long long xnw = (mask & 0x100) ? (a << 1) | (aw >> 63) : 0;
+    unsigned long long xn  = (mask & 0x080) ? a : 0;
+    unsigned long long xne = (mask & 0x040) ? (a >> 1) | (ae << 63) : 0;
+    unsigned long long xw  = (mask & 0x020) ? (m << 1) | (mw >> 63) : 0;
+    unsigned long long xe  = (mask & 0x008) ? (m >> 1) | (me << 63) : 0;
+    unsigned long long xsw = (mask & 0x004) ? (b << 1) | (bw >> 63) : 0;
+    unsigned long long xs  = (mask & 0x002) ? b : 0;
+    unsigned long long xse = (mask & 0x001) ? (b >> 1) | (be << 63) : 0;
+
+    // add them up: three full adders and a half adder give the ones and
+    // four twos, then the twos give the twos bit and two fours
+    unsigned long long s0 = xnw ^ xn ^ xne, c0 = (xnw & xn) | (xne & (xnw ^ xn));
+    unsigned long long s1 = xw ^ xe ^ xsw, c1 = (xw & xe) | (xsw & (xw ^ xe));
+    unsigned long long s2 = xs ^ xse, c2 = xs & xse;
+    unsigned long long n0 = s0 ^ s1 ^ s2, c3 = (s0 & s1) | (s2 & (s0 ^ s1));
+    unsigned long long t0 = c0 ^ c1 ^ c2, c4 = (c0 & c1) | (c2 & (c0 ^ c1));
+    unsigned long long n1 = t0 ^ c3, c5 = t0 & c3;
+    unsigned long long n2 = c4 ^ c5, n3 = c4 & c5;
+
+    unsigned long long born = 0, survive = 0;
+    for (int k = 0; k <= 8; k++) {
+        if (((birth | survival) >> k) & 1) {
+            unsigned long long is = ((k & 1) ? n0 : ~n0) & ((k & 2) ? n1 : ~n1) &
+                                    ((k & 4) ? n2 : ~n2) & ((k & 8) ? n3 : ~n3);
+            if ((birth >> k) & 1) born |= is;
+            if ((survival >> k) & 1) survive |= is;
+        }
+    }
+    return (m & survive) | (~m & born);
+}
+
+// -----------------------------------------------------------------------------
+
+// For any other rule, look up each column's 3x3 block in the rule map.
+
+unsigned long long bitgenalgo::mapcalc(unsigned long long a, unsigned long long aw, unsigned long long ae,
+                                       unsigned long long m, unsigned long long mw, unsigned long long me,
+                                       unsigned long long b, unsigned long long bw, unsigned long long be)
+{
+    // bits i, i+1 and i+2 of these are the west, center and east cells of
+    // column i for columns 0 to 61, and of column i+62 in the high words
+    unsigned long long la = (a << 1) | (aw >> 63), ha = (a >> 61) | ((ae & 1) << 3);
+    unsigned long long lm = (m << 1) | (mw >> 63), hm = (m >> 61) | ((me & 1) << 3);
+    unsigned long long lb = (b << 1) | (bw >> 63), hb = (b >> 61) | ((be & 1) << 3);
+    unsigned long long r = 0;
+    for (int i = 0; i < 62; i++) {
+        if (lut[((la >> i) & 7) | (((lm >> i) & 7) << 3) | (((lb >> i) & 7) << 6)])
+            r |= 1ULL << i;
+    }
+    for (int i = 0; i < 2; i++) {
+        if (lut[((ha >> i) & 7) | (((hm >> i) & 7) << 3) | (((hb >> i) & 7) << 6)])
+            r |= 1ULL << (62 + i);
+    }
+    return r;
+}
+
+// -----------------------------------------------------------------------------
+
+// Calculate the next generation of a tile in its next planes.
+
+void bitgenalgo::gentile(tile* t)
+{
+    const unsigned long long* nb[8];
+    for (int k = 0; k < 8; k++) nb[k] = t->nb[k] ? t->nb[k]->alive : zerorows;
+    const unsigned long long *nw = nb[0], *n = nb[1], *ne = nb[2], *w = nb[3];
+    const unsigned long long *e = nb[4], *sw = nb[5], *s = nb[6], *se = nb[7];
+    const unsigned long long* c = t->alive;
+    const unsigned long long* cur = t->cells;
+    unsigned long long* next = t->next;
+    int maxstate = maxCellStates - 1;
+    int pop = 0;
+    unsigned long long anyalive = 0;
+
+    for (int r = 0; r < 64; r++) {
+        unsigned long long a, aw, ae, b, bw, be;
+        if (r == 0) {
+            a = n[63]; aw = nw[63]; ae = ne[63];
+        } else {
+            a = c[r-1]; aw = w[r-1]; ae = e[r-1];
+        }
+        unsigned long long m = c[r], mw = w[r], me = e[r];
+        if (r == 63) {
+            b = s[0]; bw = sw[0]; be = se[0];
+        } else {
+            b = c[r+1]; bw = w[r+1]; be = e[r+1];
+        }
+        unsigned long long lives = 0;
+        if (a | m | b | ((aw | mw | bw) >> 63) | ((ae | me | be) << 63))
+            lives = rowcalc(a, aw, ae, m, mw, me, b, bw, be);
+
+        // cells in state 0 or 1 take their new state from the rule; a cell
+        // in state 1 that doesn't survive goes to 2, and the states above
+        // that count up until the last goes back to 0
+        unsigned long long any = 0, last = ~0ULL;
+        for (int p = 0; p < nplanes; p++) {
+            unsigned long long bits = cur[p * 64 + r];
+            any |= bits;
+            last &= ((maxstate >> p) & 1) ? bits : ~bits;
+        }
+        unsigned long long dying = any & ~m;
+        unsigned long long born = lives & ~dying;
+        unsigned long long carry = dying & ~last, inc = carry;
+        unsigned long long nonzero = 0;
+        for (int p = 0; p < nplanes; p++) {
+            unsigned long long bits = cur[p * 64 + r];
+            unsigned long long nbits = (bits ^ carry) & inc;
+            carry &= bits;
+            if (p == 0) nbits |= born;
+            if (p == 1) nbits |= m & ~lives;
+            next[p * 64 + r] = nbits;
+            nonzero |= nbits;
+        }
+        t->nextalive[r] = born;
+        anyalive |= born;
+        pop += popcount64(nonzero);
+    }
+    t->pop = pop;
+    t->anyalive = anyalive != 0;
+}
+
+// -----------------------------------------------------------------------------
+
+// Calculate the next generation, returning false if the pattern has grown
+// to the edge of the universe.
+
+bool bitgenalgo::dogen()
+{
+    // a tile with cells in state 1 at an edge might have births in the
+    // tile beyond, so make sure that is there
+    std::vector< std::pair<int, int> > want;
+    for (tilemap::iterator it = tiles.begin(); it != tiles.end(); ++it) {
+        tile* t = it->second;
+        if (!t->anyalive) continue;
+        unsigned long long cols = 0;
+        for (int r = 0; r < 64; r++) cols |= t->alive[r];
+        unsigned long long top = t->alive[0], bottom = t->alive[63];
+        bool edge[8] = { (top & 1) != 0, top != 0, (top >> 63) != 0,
+                         (cols & 1) != 0, (cols >> 63) != 0,
+                         (bottom & 1) != 0, bottom != 0, (bottom >> 63) != 0 };
+        for (int k = 0; k < 8; k++)
+            if (edge[k]) want.push_back(std::make_pair(t->tx + nbdx[k], t->ty + nbdy[k]));
+    }
+    for (size_t i = 0; i < want.size(); i++) {
+        if (findtile(want[i].first, want[i].second) == 0 &&
+            maketile(want[i].first, want[i].second) == 0) return false;
+    }
+
+    // step every tile that has non-zero cells or a neighbor with cells in
+    // state 1; the rest stay empty
+    std::vector<tile*> work;
+    for (tilemap::iterator it = tiles.begin(); it != tiles.end(); ++it) {
+        tile* t = it->second;
+        bool busy = t->pop > 0;
+        for (int k = 0; k < 8; k++) {
+            t->nb[k] = findtile(t->tx + nbdx[k], t->ty + nbdy[k]);
+            if (t->nb[k] && t->nb[k]->anyalive) busy = true;
+        }
+        if (busy) work.push_back(t);
+    }
+    for (size_t i = 0; i < work.size(); i++) gentile(work[i]);
+    for (size_t i = 0; i < work.size(); i++) {
+        tile* t = work[i];
+        unsigned long long* temp = t->cells;
+        t->cells = t->next;
+        t->next = temp;
+        memcpy(t->alive, t->nextalive, sizeof(t->alive));
+    }
+
+    // free empty tiles, unless a neighbor would only want them back
+    population = 0;
+    std::vector<tile*> empty;
+    for (tilemap::iterator it = tiles.begin(); it != tiles.end(); ++it) {
+        tile* t = it->second;
+        population += t->pop;
+        if (t->pop > 0) continue;
+        bool keep = false;
+        for (int k = 0; k < 8; k++)
+            if (t->nb[k] && t->nb[k]->anyalive) keep = true;
+        if (!keep) empty.push_back(t);
+    }
+    for (size_t i = 0; i < empty.size(); i++) {
+        tiles.erase(std::make_pair(empty[i]->ty, empty[i]->tx));
+        freetile(empty[i]);
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+// On a torus, the cells in state 1 on each edge of the grid are copied
+// to just outside the opposite edge, so the cells on the edges see their
+// neighbors on the far side; cliptogrid gets rid of them afterwards.
+
+void bitgenalgo::wraptorus()
+{
+    int gl = gridleft.toint(), gt = gridtop.toint();
+    int gr = gridright.toint(), gb = gridbottom.toint();
+    for (int y = gt; y <= gb; y++) {
+        if (getcell(gr, y) == 1) setcell(gl - 1, y, 1);
+        if (getcell(gl, y) == 1) setcell(gr + 1, y, 1);
+    }
+    for (int x = gl; x <= gr; x++) {
+        if (getcell(x, gb) == 1) setcell(x, gt - 1, 1);
+        if (getcell(x, gt) == 1) setcell(x, gb + 1, 1);
+    }
+    if (getcell(gr, gb) == 1) setcell(gl - 1, gt - 1, 1);
+    if (getcell(gl, gb) == 1) setcell(gr + 1, gt - 1, 1);
+    if (getcell(gr, gt) == 1) setcell(gl - 1, gb + 1, 1);
+    if (getcell(gl, gt) == 1) setcell(gr + 1, gb + 1, 1);
+}
+
+// -----------------------------------------------------------------------------
+
+void bitgenalgo::cliptogrid()
+{
+    int gl = gridleft.toint(), gt = gridtop.toint();
+    int gr = gridright.toint(), gb = gridbottom.toint();
+    population = 0;
+    for (tilemap::iterator it = tiles.begin(); it != tiles.end(); ++it) {
+        tile* t = it->second;
+        if (t->pop > 0) {
+            int x0 = t->tx * 64, y0 = t->ty * 64;
+            if (x0 < gl || x0 + 63 > gr || y0 < gt || y0 + 63 > gb) {
+                // keep the rows and columns inside the grid
+                unsigned long long cols = 0;
+                for (int i = 0; i < 64; i++)
+                    if (x0 + i >= gl && x0 + i <= gr) cols |= 1ULL << i;
+                for (int r = 0; r < 64; r++) {
+                    unsigned long long keep = (y0 + r >= gt && y0 + r <= gb) ? cols : 0;
+                    for (int p = 0; p < nplanes; p++) t->cells[p * 64 + r] &= keep;
+                }
+                recount(t);
+            }
+        }
+        population += t->pop;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void bitgenalgo::step()
+{
+    bigint t = increment;
+    while (t != 0) {
+        if (population > 0) {
+            int grid = nativegrid();
+            if (grid == TORUSGRID) wraptorus();
+            if (!dogen()) {
+                lifewarning("Sorry, but the pattern has reached the edge of the universe.");
+                poller->setInterrupted();
+                return;
+            }
+            if (grid != BORDERGRID) cliptogrid();
+        }
+
+        generation += bigint::one;
+
+        // this is a safe place to check for user events
+        if (poller->inner_poll()) return;
+
+        t -= 1;
+        // user might have changed increment
+        if (t > increment) t = increment;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+// Get the rule from our Generations parser: the 3x3 map reordered so
+// the bits of a column's block in three rows make the index, and whether
+// it only depends on the number of neighbors in state 1.
+
+void bitgenalgo::setmapfromrules()
+{
+    const char* map = rules.getRuleMap();
+    neighbormask = rules.calcmask();
+    for (int i = 0; i < 512; i++) {
+        int j = 0;
+        for (int bit = 0; bit < 9; bit++)
+            if ((i >> bit) & 1) j |= 1 << (8 - bit);
+        lut[i] = map[j];
+    }
+    int seen[2][9];
+    memset(seen, -1, sizeof(seen));
+    totalistic = true;
+    for (int i = 0; i < 512; i++) {
+        int center = (i >> 4) & 1;
+        int count = popcount64(i & neighbormask & ~0x10);
+        int v = map[i] ? 1 : 0;
+        if (seen[center][count] < 0)
+            seen[center][count] = v;
+        else if (seen[center][count] != v)
+            totalistic = false;
+    }
+    birth = survival = 0;
+    for (int k = 0; k <= 8; k++) {
+        if (seen[0][k] == 1) birth |= 1 << k;
+        if (seen[1][k] == 1) survival |= 1 << k;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+// Switch to the given rule if it is valid.
+
+const char* bitgenalgo::setrule(const char* s)
+{
+    const char* err = rules.setrule(s);
+    if (err) return err;
+
+    // check for rule suffix like ":T200,100" to specify a bounded universe
+    const char* colonptr = strchr(s, ':');
+    if (colonptr) {
+        err = setgridsize(colonptr);
+        if (err) return err;
+    } else {
+        // universe is unbounded
+        gridwd = 0;
+        gridht = 0;
+    }
+
+    strcpy(canonrule, rules.getrule());
+    maxCellStates = rules.NumCellStates();
+    int bits = 1;
+    while ((1 << bits) < maxCellStates) bits++;
+    if (bits != nplanes) setplanes(bits);
+    setmapfromrules();
+
+    if (neighbormask == 0x1bb)
+        grid_type = HEX_GRID;
+    else if (neighbormask == 0x0ba)
+        grid_type = VN_GRID;
+    else
+        grid_type = SQUARE_GRID;
+
+    // a plain torus or bounded plane we step ourselves
+    unbounded = (nativegrid() == BORDERGRID);
+    if (!unbounded) {
+        clipcells();
+        cliptogrid();
+    }
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+
+const char* bitgenalgo::getrule()
+{
+    return canonrule;
+}
+
+// -----------------------------------------------------------------------------
+
+const char* bitgenalgo::DefaultRule()
+{
+    return rules.DefaultRule();
+}
+
+// -----------------------------------------------------------------------------
+
+// Find the edges of the pattern; if it is empty the edges can't be valid
+// (top > bottom), but the caller should check first.
+
+void bitgenalgo::findedges(bigint* ptop, bigint* pleft, bigint* pbottom, bigint* pright)
+{
+    int top = 1, left = 1, bottom = 0, right = 0;
+    bool found = false;
+    for (tilemap::iterator it = tiles.begin(); it != tiles.end(); ++it) {
+        tile* t = it->second;
+        if (t->pop == 0) continue;
+        int rmin = 64, rmax = -1;
+        unsigned long long cols = 0;
+        for (int r = 0; r < 64; r++) {
+            unsigned long long w = 0;
+            for (int p = 0; p < nplanes; p++) w |= t->cells[p * 64 + r];
+            if (w) {
+                if (rmin > r) rmin = r;
+                rmax = r;
+                cols |= w;
+            }
+        }
+        int t0 = t->ty * 64 + rmin, b0 = t->ty * 64 + rmax;
+        int l0 = t->tx * 64 + lowbit(cols), r0 = t->tx * 64 + highbit(cols);
+        if (!found || t0 < top) top = t0;
+        if (!found || b0 > bottom) bottom = b0;
+        if (!found || l0 < left) left = l0;
+        if (!found || r0 > right) right = r0;
+        found = true;
+    }
+    *ptop = top;
+    *pleft = left;
+    *pbottom = bottom;
+    *pright = right;
+}
+
+// -----------------------------------------------------------------------------
+
+static lifealgo* creator() { return new bitgenalgo(); }
+
+void bitgenalgo::doInitializeAlgoInfo(staticAlgoInfo& ai)
+{
+    ai.setAlgorithmName("BitGenerations");
+    ai.setAlgorithmCreator(&creator);
+    ai.setDefaultBaseStep(10);
+    ai.setDefaultMaxMem(0);
+    ai.minstates = 2;
+    ai.maxstates = 256;
+    // init default color scheme (as for Generations)
+    ai.defgradient = true;              // use gradient
+    ai.defr1 = 255;                     // start color = red
+    ai.defg1 = 0;
+    ai.defb1 = 0;
+    ai.defr2 = 255;                     // end color = yellow
+    ai.defg2 = 255;
+    ai.defb2 = 0;
+    // if not using gradient then set all states to white
+    for (int i=0; i<256; i++) {
+        ai.defr[i] = ai.defg[i] = ai.defb[i] = 255;
+    }
+}
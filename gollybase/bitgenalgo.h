@@ -0,0 +1,111 @@
+// This file is part of Golly.
+// See docs/License.html for the copyright notice.
+
+// A non-hashing algorithm for Generations rules.
+
+#ifndef BITGENALGO_H
+#define BITGENALGO_H
+
+#include "lifealgo.h"
+#include "liferules.h"        // for MAXRULESIZE
+#include "generationsalgo.h"  // for parsing rules
+#include <map>
+#include <vector>
+
+class bitgenalgo : public lifealgo {
+public:
+    bitgenalgo();
+    virtual ~bitgenalgo();
+    virtual void clearall();
+    virtual int setcell(int x, int y, int newstate);
+    virtual int getcell(int x, int y);
+    virtual int nextcell(int x, int y, int& v);
+    virtual void endofpattern();
+    virtual void setIncrement(bigint inc) { increment = inc; }
+    virtual void setIncrement(int inc) { increment = inc; }
+    virtual void setGeneration(bigint gen) { generation = gen; }
+    virtual const bigint& getPopulation();
+    virtual int isEmpty();
+    virtual int hyperCapable() { return 0; }
+    virtual void setMaxMemory(int) {}
+    virtual int getMaxMemory() { return 0; }
+    virtual const char* setrule(const char* s);
+    virtual const char* getrule();
+    virtual const char* DefaultRule();
+    virtual int NumCellStates();
+    virtual void step();
+    virtual void* getcurrentstate() { return 0; }
+    virtual void setcurrentstate(void*) {}
+    virtual void draw(viewport& view, liferender& renderer);
+    virtual void fit(viewport& view, int force);
+    virtual void lowerRightPixel(bigint& x, bigint& y, int mag);
+    virtual void findedges(bigint* t, bigint* l, bigint* b, bigint* r);
+    virtual const char* writeNativeFormat(std::ostream&, char*) {
+        return "No native format for bitgenalgo.";
+    }
+    static void doInitializeAlgoInfo(staticAlgoInfo&);
+
+private:
+    // The universe is a set of 64x64 tiles, created as the pattern
+    // reaches them.  A tile holds its cells as bit-planes, nplanes words
+    // for each row with bit i of plane p being bit p of the state of the
+    // cell in column i, so a row of 64 cells is stepped with a few dozen
+    // word operations.  The cells in state 1 (the only ones neighbors
+    // count) are kept in a plane of their own as well.
+    struct tile {
+        int tx, ty;                     // position, in units of 64 cells
+        unsigned long long* cells;      // nplanes*64 words
+        unsigned long long* next;       // the same for the next generation
+        unsigned long long alive[64];   // cells in state 1
+        unsigned long long nextalive[64];
+        tile* nb[8];                    // nw, n, ne, w, e, sw, s, se (or 0)
+        int pop;                        // non-zero cells
+        bool anyalive;                  // any cells in state 1?
+    };
+    typedef std::map<std::pair<int, int>, tile*> tilemap;   // keyed by (ty, tx)
+
+    generationsalgo rules;              // parses and checks our rules
+    char canonrule[MAXRULESIZE];        // canonical version of valid rule passed into setrule
+    tilemap tiles;
+    int nplanes;                        // bits in a state
+    G_INT64 population;
+    bool show_warning;                  // flag used to avoid multiple warning dialogs
+
+    // the rule: if it only depends on how many of the neighbors are in
+    // state 1, which counts give birth and survival, else the new state
+    // of the center cell for each 3x3 block, as a bit in column order
+    int neighbormask;                   // which of the 3x3 cells are neighbors
+    bool totalistic;
+    int birth, survival;                // bit n set if n neighbors give birth, survival
+    char lut[512];                      // bit 0 nw, 1 n, 2 ne, 3 w, 4 c, ... 8 se
+
+    tile* findtile(int tx, int ty);
+    tile* maketile(int tx, int ty);     // 0 if beyond the universe limits
+    void freetile(tile* t);
+    void freetiles();
+    void setplanes(int n);              // change nplanes, keeping the cells
+    void setstate(tile* t, int col, int row, int newstate);
+    int getstate(tile* t, int col, int row);
+    void recount(tile* t);              // redo a tile's pop, anyalive, alive
+    void setmapfromrules();
+
+    bool dogen();                       // one generation; false if the universe is full
+    void gentile(tile* t);
+    unsigned long long rowcalc(unsigned long long a, unsigned long long aw, unsigned long long ae,
+                               unsigned long long m, unsigned long long mw, unsigned long long me,
+                               unsigned long long b, unsigned long long bw, unsigned long long be);
+    template <int mask>
+    unsigned long long countcalc(unsigned long long a, unsigned long long aw, unsigned long long ae,
+                                 unsigned long long m, unsigned long long mw, unsigned long long me,
+                                 unsigned long long b, unsigned long long bw, unsigned long long be);
+    unsigned long long mapcalc(unsigned long long a, unsigned long long aw, unsigned long long ae,
+                               unsigned long long m, unsigned long long mw, unsigned long long me,
+                               unsigned long long b, unsigned long long bw, unsigned long long be);
+
+    // a plain torus or bounded plane we step ourselves; other bounded
+    // grids get border cells from the caller, as in the hash algorithms
+    void wraptorus();                   // copy the edges outside the grid
+    void cliptogrid();                  // clear all cells outside the grid
+};
+
+#endif
@@ -0,0 +1,239 @@
+// This file is part of Golly.
+// See docs/License.html for the copyright notice.
+
+#include "bitgenalgo.h"
+#include "util.h"
+#include <string.h>     // for memset and memcpy
+
+// -----------------------------------------------------------------------------
+
+// A 256x256 pixmap is good for OpenGL and matches the size
+// used in qlifedraw.cpp and hlifedraw.cpp.
+
+const int logpmsize = 8;                    // 8=256x256
+const int pmsize = (1<<logpmsize);          // pixmap wd and ht, in pixels
+const int bpp = 4;                          // bytes per pixel (RGBA)
+const int rowoff = (pmsize*bpp);            // row offset, in bytes
+const int ibufsize = (pmsize*pmsize*bpp);   // buffer size, in bytes
+static unsigned char ipixbuf[ibufsize];     // shared buffer for pixels
+static unsigned char *pixbuf = ipixbuf;
+
+// RGBA view of pixbuf
+static unsigned int *pixRGBAbuf = (unsigned int *)ipixbuf;
+
+// one state per cell of a tile, for pixblit when pmag > 1 and for stateblit
+static unsigned char tilebuf[64*64];
+
+// arrays of RGB colors for each cell state (set by getcolors call)
+static unsigned char* cellred;
+static unsigned char* cellgreen;
+static unsigned char* cellblue;
+
+// alpha values for dead pixels and live pixels (also set by getcolors call)
+static unsigned char deada;
+static unsigned char livea;
+
+static unsigned int cellRGBA[256];          // cell colors in RGBA format
+
+// -----------------------------------------------------------------------------
+
+// kill all cells in pixbuf
+
+static void killpixels()
+{
+    // pmag is 1 so pixblit assumes pixbuf contains 4 bytes (RGBA) for each pixel
+    if (deada == 0) {
+        // dead cells are 100% transparent so we can use fast method
+        // (RGB values are irrelevant if alpha is 0)
+        memset(pixbuf, 0, sizeof(ipixbuf));
+    } else {
+        // use slower method
+        unsigned int deadRGBA = cellRGBA[0];
+        unsigned int *rgbabuf = pixRGBAbuf;
+
+        // fill the first row with the dead pixel state
+        for (int i = 0; i < pmsize; i++) {
+            *rgbabuf++ = deadRGBA;
+        }
+        // copy 1st row to remaining rows
+        for (int i = rowoff; i < ibufsize; i += rowoff) {
+            memcpy(&pixbuf[i], pixbuf, rowoff);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+// this is the top-level drawing routine
+
+void bitgenalgo::draw(viewport &view, liferender &renderer)
+{
+    if (population == 0) return;
+
+    if (!renderer.justState()) {
+       // get cell colors and alpha values for dead and live pixels
+       renderer.getcolors(&cellred, &cellgreen, &cellblue, &deada, &livea);
+
+       // create RGBA view
+       unsigned char *rgbaptr = (unsigned char *)cellRGBA;
+
+       // create dead color
+       *rgbaptr++ = cellred[0];
+       *rgbaptr++ = cellgreen[0];
+       *rgbaptr++ = cellblue[0];
+       *rgbaptr++ = deada;
+
+       // create live colors
+       unsigned int livestates = NumCellStates() - 1;
+       for (unsigned int ui = 1; ui <= livestates; ui++) {
+           *rgbaptr++ = cellred[ui];
+           *rgbaptr++ = cellgreen[ui];
+           *rgbaptr++ = cellblue[ui];
+           *rgbaptr++ = livea;
+       }
+    }
+
+    int mag, pmag;
+    int vieww = view.getwidth();
+    int viewh = view.getheight();
+    if (view.getmag() > 0) {
+        pmag = 1 << view.getmag();
+        mag = 0;
+    } else {
+        pmag = 1;
+        mag = -view.getmag();
+    }
+
+    if (renderer.justState() || pmag > 1) {
+        // draw each visible tile with one byte per cell
+        for (tilemap::iterator it = tiles.begin(); it != tiles.end(); ++it) {
+            tile* t = it->second;
+            if (t->pop == 0) continue;
+            pair<int,int> tpxl = view.screenPosOf(t->tx * 64, t->ty * 64, this);
+            int x = tpxl.first;
+            int y = tpxl.second;
+            int wd = 64 * pmag;
+            if (x >= vieww || y >= viewh || x+wd <= 0 || y+wd <= 0) continue;
+            for (int row = 0; row < 64; row++) {
+                for (int col = 0; col < 64; col++)
+                    tilebuf[row * 64 + col] = getstate(t, col, row);
+            }
+            if (renderer.justState())
+               renderer.stateblit(x, y, wd, wd, tilebuf) ;
+            else
+               renderer.pixblit(x, y, wd, wd, tilebuf, pmag);
+        }
+    } else {
+        // pmag is 1 so divide the universe into blocks of pmsize*(2^mag) cells
+        // and shrink each down to pmsize * pmsize pixels; when zoomed out,
+        // all non-zero cells are drawn using the state 1 color
+        if (mag > 30) mag = 30;
+        int shift = logpmsize + mag;            // log2 of block size in cells
+
+        // when zoomed out, lowerRightPixel puts the top of each pixel one
+        // cell below a multiple of 2^mag, so the blocks start there too
+        long long yoff = mag > 0 ? 1 : 0;
+
+        // a tile is in at most two blocks vertically (and one horizontally)
+        std::map< std::pair<long long, long long>, std::vector<tile*> > blocks;
+        for (tilemap::iterator it = tiles.begin(); it != tiles.end(); ++it) {
+            tile* t = it->second;
+            if (t->pop == 0) continue;
+            long long bx = ((long long)t->tx * 64) >> shift;
+            long long by1 = ((long long)t->ty * 64 - yoff) >> shift;
+            long long by2 = ((long long)t->ty * 64 + 63 - yoff) >> shift;
+            blocks[std::make_pair(by1, bx)].push_back(t);
+            if (by2 != by1) blocks[std::make_pair(by2, bx)].push_back(t);
+        }
+
+        killpixels();
+        std::map< std::pair<long long, long long>, std::vector<tile*> >::iterator bit;
+        for (bit = blocks.begin(); bit != blocks.end(); ++bit) {
+            long long top = (bit->first.first << shift) + yoff;
+            long long left = bit->first.second << shift;
+            bigint bigtop((G_INT64)top), bigleft((G_INT64)left);
+            pair<int,int> bpxl = view.screenPosOf(bigleft, bigtop, this);
+            int x = bpxl.first;
+            int y = bpxl.second;
+            if (x >= vieww || y >= viewh || x+pmsize <= 0 || y+pmsize <= 0) continue;
+
+            // store the non-zero cells of the block's tiles in pixbuf
+            std::vector<tile*>& list = bit->second;
+            for (size_t i = 0; i < list.size(); i++) {
+                tile* t = list[i];
+                long long dx = (long long)t->tx * 64 - left;
+                for (int row = 0; row < 64; row++) {
+                    long long dy = (long long)t->ty * 64 + row - top;
+                    if (dy < 0 || (dy >> shift) != 0) continue;
+                    unsigned long long w = 0;
+                    for (int p = 0; p < nplanes; p++) w |= t->cells[p * 64 + row];
+                    int pixrow = (int)(dy >> mag) * pmsize;
+                    while (w) {
+                        int col = 0;
+                        while (((w >> col) & 1) == 0) col++;
+                        w &= w - 1;
+                        int pixcol = (int)((dx + col) >> mag);
+                        pixRGBAbuf[pixrow + pixcol] = cellRGBA[mag == 0 ? getstate(t, col, row) : 1];
+                    }
+                }
+            }
+
+            // draw this block
+            renderer.pixblit(x, y, pmsize, pmsize, pixbuf, 1);
+            killpixels();
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void bitgenalgo::fit(viewport &view, int force)
+{
+    if (population == 0) {
+        view.center();
+        view.setmag(MAX_MAG);
+        return;
+    }
+
+    bigint top, left, bottom, right;
+    findedges(&top, &left, &bottom, &right);
+
+    if (!force) {
+        // if all four of the above dimensions are in the viewport, don't change
+        if (view.contains(left, top) && view.contains(right, bottom))
+            return;
+    }
+
+    bigint midx = right;
+    midx -= left;
+    midx += bigint::one;
+    midx.div2();
+    midx += left;
+
+    bigint midy = bottom;
+    midy -= top;
+    midy += bigint::one;
+    midy.div2();
+    midy += top;
+
+    int mag = MAX_MAG;
+    for (;;) {
+        view.setpositionmag(midx, midy, mag);
+        if (view.contains(left, top) && view.contains(right, bottom))
+            break;
+        mag--;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void bitgenalgo::lowerRightPixel(bigint &x, bigint &y, int mag)
+{
+    if (mag >= 0) return;
+    x >>= -mag;
+    x <<= -mag;
+    y -= 1;
+    y >>= -mag;
+    y <<= -mag;
+    y += 1;
+}
@@ -51,6 +51,8 @@ state generationsalgo::slowcalc(state nw, state n, state ne, state w, state c,
    return result ;
 }
 
+template class ghashalgo<generationsalgo> ;
+
 static lifealgo *creator() { return new generationsalgo() ; }
 
 void generationsalgo::doInitializeAlgoInfo(staticAlgoInfo &ai) {
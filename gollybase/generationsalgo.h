@@ -7,7 +7,7 @@
 /**
  *   Our Generations algo class.
  */
-class generationsalgo : public ghashbase {
+class generationsalgo : public ghashalgo<generationsalgo> {
 public:
    generationsalgo() ;
    virtual ~generationsalgo() ;
@@ -19,14 +19,10 @@ public:
    virtual int NumCellStates() ;
    static void doInitializeAlgoInfo(staticAlgoInfo &) ;
 
-   enum neighborhood_masks {
-      MOORE = 0x1ff,         // all 8 neighbors
-      HEXAGONAL = 0x1bb,     // ignore NE and SW neighbors
-      VON_NEUMANN = 0x0ba    // 4 orthogonal neighbors
-   } ;
-
+   int calcmask() const { return neighbormask ; }
    bool isHexagonal() const { return neighbormask == HEXAGONAL ; }
    bool isVonNeumann() const { return neighbormask == VON_NEUMANN ; }
+   const char *getRuleMap() const { return rule3x3 ; }
 
 private:
    char canonrule[MAXRULESIZE] ;      // canonical version of valid rule passed into setrule
@@ -62,4 +58,6 @@ private:
    int addLetters(int count, int p) ;
 } ;
 
+extern template class ghashalgo<generationsalgo> ;
+
 #endif
@@ -17,12 +17,16 @@
 #include "util.h"
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
 using namespace std ;
 /*
  *   Power of two hash sizes work fine.
  */
 #ifdef PRIMEMOD
 #define HASHMOD(a) ((a)%hashprime)
+#define OLDHASHMOD(a) ((a)%oldhashprime)
 static g_uintptr_t nexthashsize(g_uintptr_t i) {
    g_uintptr_t j ;
    i |= 1 ;
@@ -36,6 +40,7 @@ static g_uintptr_t nexthashsize(g_uintptr_t i) {
 }
 #else
 #define HASHMOD(a) ((a)&(hashmask))
+#define OLDHASHMOD(a) ((a)&(oldhashprime-1))
 static g_uintptr_t nexthashsize(g_uintptr_t i) {
    while ((i & (i - 1)))
       i += (i & (1 + ~i)) ; // i & - i is more idiomatic but generates warning
@@ -48,155 +53,434 @@ static g_uintptr_t nexthashsize(g_uintptr_t i) {
  */
 #ifdef PRIMEMOD
 #define ghnode_hash(a,b,c,d) (65537*(g_uintptr_t)(d)+257*(g_uintptr_t)(c)+17*(g_uintptr_t)(b)+5*(g_uintptr_t)(a))
+#define ghleaf_hash(c) (65537*(c)[3]+257*(c)[2]+17*(c)[1]+5*(c)[0])
 #else
+/*
+ *   With a power of two hash size we only look at the low bits, and
+ *   since we probe linearly we want them well mixed.
+ */
+static inline g_uintptr_t hashmix(g_uintptr_t r) {
+   r *= (g_uintptr_t)0x9e3779b97f4a7c15ULL ;
+   return r ^ (r >> (4 * sizeof(g_uintptr_t))) ;
+}
 g_uintptr_t ghnode_hash(void *a, void *b, void *c, void *d) {
-   g_uintptr_t r = (65537*(g_uintptr_t)(d)+257*(g_uintptr_t)(c)+17*(g_uintptr_t)(b)+5*(g_uintptr_t)(a)) ;
-   r += (r >> 11) ;
-   return r ;
+   return hashmix(65537*(g_uintptr_t)(d)+257*(g_uintptr_t)(c)+17*(g_uintptr_t)(b)+5*(g_uintptr_t)(a)) ;
+}
+static inline g_uintptr_t ghleaf_hash(const g_uintptr_t *c) {
+   return hashmix(65537*c[3]+257*c[2]+17*c[1]+5*c[0]) ;
 }
 #endif
-#define ghleaf_hash(a,b,c,d) (65537*(d)+257*(c)+17*(b)+5*(a))
-/*
- *   Resize the hash.  The max load factor defined here does not actually
- *   yield the maximum load factor the hash will see, because when we
- *   do the last resize before exhausting memory, we may find we are
- *   not permitted (while keeping total memory consumption below the
- *   limit) to do the resize, so the actual max load factor may be
- *   somewhat higher.  Conversely, because we double the hash size
- *   each time, the actual final max load factor may be less than this.
- *   Additional code can be added to manage this, but after some
- *   experimentation, it has been found that the impact is tiny, so
- *   we are keeping the code simple.  Nonetheless, this factor can be
- *   tweaked in the case where you absolutely want as many nodes as
- *   possible in memory, and are willing to use a large load factor to
- *   permit this; with the move-to-front heuristic, the code actually
- *   handles a large load factor fairly well.
+/*
+ *   The hash table is open-addressed with linear probing; an entry is
+ *   in the first empty slot at or after its home slot (wrapping around
+ *   at the end of the table).  Nothing is ever removed from the table
+ *   except by a gc or a resize, both of which rebuild it from scratch,
+ *   so a lookup can always stop at the first empty slot it sees.
+ *
+ *   Nodes and leaves are pointer-aligned, so the low bits of each slot
+ *   are free; we keep a few more bits of the hash there.  Most of the
+ *   time this lets a probe skip past an entry for a different ghnode
+ *   without having to touch it.
+ *
+ *   The top one of those bits is not part of the tag; once a step has
+ *   needed a gc, it is set when a lookup finds the ghnode, and tells the
+ *   next gc that the ghnode is in use even if nothing it can see points
+ *   to it (see do_gc).
+ */
+#define TAGMASK ((g_uintptr_t)(sizeof(ghnode *) - 1))
+#define REFBIT ((TAGMASK + 1) >> 1)
+#define HASHTAG(h) ((((h) * (g_uintptr_t)0x9e3779b97f4a7c15ULL) >> \
+                     (8 * sizeof(g_uintptr_t) - 3)) & TAGMASK & ~REFBIT)
+#define slotnode(p) ((ghnode *)(~TAGMASK & (g_uintptr_t)(p)))
+#define slottag(p) (TAGMASK & ~REFBIT & (g_uintptr_t)(p))
+#define referenced(p) (REFBIT & (g_uintptr_t)(p))
+#define tagged(p,t) ((ghnode *)((t) | (g_uintptr_t)(p)))
+#define nextslot(i) ((i) + 1 == hashprime ? 0 : (i) + 1)
+#define nextoldslot(i) ((i) + 1 == oldhashprime ? 0 : (i) + 1)
+/*
+ *   Resize the hash.  Because we double the hash size each time, the
+ *   actual load factor will be somewhere between half of the max load
+ *   factor defined here and the max itself.  When we do the last resize
+ *   before exhausting memory, we may find we are not permitted (while
+ *   keeping total memory consumption below the limit) to grow the
+ *   hash; in that case we let it fill up to the max fill factor
+ *   instead, which makes probes longer but lets us keep more nodes.
+ *   An open-addressed table must never fill up completely, so past
+ *   that point we grow the hash regardless.
+ *
+ *   The entries move across a few slots at a time as lookups go by
+ *   (see movehash), with lookups that miss in the new table trying the
+ *   old one, so a resize is no longer one long pause.  If the last gc
+ *   threw most of the hash away, or the two tables would not fit in
+ *   memory together, we free the old one first and have a gc rebuild
+ *   the hash from the live ghnodes instead (only the latter if
+ *   NOGCBEFORERESIZE is defined).
  */
 double ghashbase::maxloadfactor = 0.7 ;
+double ghashbase::maxfillfactor = 0.9 ;
+#define MOVESLOTS 8
 void ghashbase::resize() {
-#ifndef NOGCBEFORERESIZE
-   if (okaytogc) {
-      do_gc(0) ;
-   }
-#endif
-   g_uintptr_t i, nhashprime = nexthashsize(2 * hashprime) ;
-   ghnode *p, **nhashtab ;
+   finishresize() ;
+   g_uintptr_t nhashprime = nexthashsize(2 * hashprime) ;
+   g_uintptr_t nbytes = nhashprime * sizeof(ghnode *) ;
+   g_uintptr_t obytes = hashprime * sizeof(ghnode *) ;
+   g_uintptr_t room = alloced > maxmem ? 0 : maxmem - alloced ;
+   int rebuild = okaytogc && nbytes > room ;
    if (hashprime > (totalthings >> 2)) {
-      if (alloced > maxmem ||
-          nhashprime * sizeof(ghnode *) > (maxmem - alloced)) {
-         hashlimit = G_MAX ;
-         return ;
+      if (nbytes - obytes > room || (nbytes > room && !okaytogc)) {
+         hashlimit = (g_uintptr_t)(maxfillfactor * hashprime) ;
+         if (hashpop <= hashlimit)
+            return ;
       }
    }
+#ifndef NOGCBEFORERESIZE
+   // a gc first is worth it if it throws most of the hash away; if the
+   // last one didn't, move things over instead, but try again next time
+   if (okaytogc && lastgcfreed > 0.5)
+      rebuild = 1 ;
+   else
+      lastgcfreed = 1 ;
+#endif
    if (verbose) {
      sprintf(statusline, "Resizing hash to %" PRIuPTR "...", nhashprime) ;
      lifestatus(statusline) ;
    }
-   nhashtab = (ghnode **)calloc(nhashprime, sizeof(ghnode *)) ;
+   ghnode **nhashtab ;
+   if (rebuild) {
+      bigfree(hashtab) ;
+      hashtab = 0 ;
+      nhashtab = (ghnode **)bigcalloc(nhashprime, sizeof(ghnode *)) ;
+      if (nhashtab == 0) {
+         hashtab = (ghnode **)bigcalloc(hashprime, sizeof(ghnode *)) ;
+         if (hashtab == 0)
+            lifefatal("Out of memory; try reducing the hash memory limit.") ;
+      }
+   } else {
+      nhashtab = (ghnode **)bigcalloc(nhashprime, sizeof(ghnode *)) ;
+   }
    if (nhashtab == 0) {
+     hashlimit = (g_uintptr_t)(maxfillfactor * hashprime) ;
+     if (hashpop > hashlimit && !rebuild)
+       lifefatal("Out of memory; try reducing the hash memory limit.") ;
      lifewarning("Out of memory; running in a somewhat slower mode; "
                  "try reducing the hash memory limit after restarting.") ;
-     hashlimit = G_MAX ;
+     if (rebuild)
+       do_gc(0) ;
      return ;
    }
-   alloced += sizeof(ghnode *) * (nhashprime - hashprime) ;
-   g_uintptr_t ohashprime = hashprime ;
+   if (rebuild) {
+      alloced += nbytes - obytes ;
+   } else {
+      alloced += nbytes ;
+      oldhashtab = hashtab ;
+      oldhashprime = hashprime ;
+      oldhashnext = 0 ;
+   }
+   hashtab = nhashtab ;
    hashprime = nhashprime ;
 #ifndef PRIMEMOD
    hashmask = hashprime - 1 ;
 #endif
-   for (i=0; i<ohashprime; i++) {
-      for (p=hashtab[i]; p;) {
-         ghnode *np = p->next ;
-         g_uintptr_t h ;
-         if (is_ghnode(p)) {
-            h = ghnode_hash(p->nw, p->ne, p->sw, p->se) ;
-         } else {
-            ghleaf *l = (ghleaf *)p ;
-            h = ghleaf_hash(l->nw, l->ne, l->sw, l->se) ;
-         }
-         h = HASHMOD(h) ;
-         p->next = nhashtab[h] ;
-         nhashtab[h] = p ;
-         p = np ;
-      }
-   }
-   free(hashtab) ;
-   hashtab = nhashtab ;
    hashlimit = (g_uintptr_t)(maxloadfactor * hashprime) ;
+   if (rebuild)
+      do_gc(0) ;
    if (verbose) {
-     strcpy(statusline+strlen(statusline), " done.") ;
+     // a gc will have used the status line
+     sprintf(statusline, "Resizing hash to %" PRIuPTR "... done.", hashprime) ;
      lifestatus(statusline) ;
    }
 }
+/*
+ *   Move the next n slots of the old table into the new one, whole,
+ *   and free the old table once we get to the end of it.
+ */
+void ghashbase::movehash(g_uintptr_t n) {
+   for (; n > 0 && oldhashnext < oldhashprime; n--) {
+      ghnode *s = oldhashtab[oldhashnext++] ;
+      ghnode *p = slotnode(s) ;
+      if (p == 0)
+         continue ;
+      g_uintptr_t h ;
+      if (is_ghnode(p)) {
+         h = ghnode_hash(p->nw, p->ne, p->sw, p->se) ;
+      } else {
+         h = ghleaf_hash(((ghleaf *)p)->cells) ;
+      }
+      g_uintptr_t i = HASHMOD(h) ;
+      while (hashtab[i])
+         i = nextslot(i) ;
+      hashtab[i] = s ;
+   }
+   if (oldhashnext >= oldhashprime)
+      dropoldhash() ;
+}
+void ghashbase::finishresize() {
+   if (oldhashtab)
+      movehash(oldhashprime) ;
+}
+void ghashbase::dropoldhash() {
+   if (oldhashtab) {
+      bigfree(oldhashtab) ;
+      alloced -= oldhashprime * sizeof(ghnode *) ;
+      oldhashtab = 0 ;
+      oldhashprime = 0 ;
+      oldhashnext = 0 ;
+   }
+}
+/*
+ *   Look in the old table for an entry not moved yet.
+ */
+ghnode *ghashbase::findoldghnode(g_uintptr_t h, ghnode *nw, ghnode *ne,
+                                 ghnode *sw, ghnode *se) {
+   ghnode *p ;
+   g_uintptr_t tag = HASHTAG(h) ;
+   for (g_uintptr_t i = OLDHASHMOD(h); (p=oldhashtab[i]) != 0;
+        i = nextoldslot(i)) {
+      if (slottag(p) == tag) {
+         ghnode *s = p ;
+         p = slotnode(p) ;
+         if (nw == p->nw && ne == p->ne && sw == p->sw && se == p->se) {
+            if (gcstep > 1 && !referenced(s))
+               oldhashtab[i] = tagged(s, REFBIT) ;
+            return p ;
+         }
+      }
+   }
+   return 0 ;
+}
+#define samecells(p,c) ((p)->cells[0] == (c)[0] && (p)->cells[1] == (c)[1] && \
+                        (p)->cells[2] == (c)[2] && (p)->cells[3] == (c)[3])
+ghleaf *ghashbase::findoldghleaf(g_uintptr_t h, const g_uintptr_t *cells) {
+   ghnode *q ;
+   g_uintptr_t tag = HASHTAG(h) ;
+   for (g_uintptr_t i = OLDHASHMOD(h); (q=oldhashtab[i]) != 0;
+        i = nextoldslot(i)) {
+      if (slottag(q) == tag) {
+         ghleaf *p = (ghleaf *)slotnode(q) ;
+         if (samecells(p, cells) && !is_ghnode(p))
+            return p ;
+      }
+   }
+   return 0 ;
+}
+/*
+ *   Put an entry we know is not there yet into the hash.
+ */
+void ghashbase::hashinsert(ghnode *p, g_uintptr_t h) {
+   g_uintptr_t i = HASHMOD(h) ;
+   while (hashtab[i])
+      i = nextslot(i) ;
+   hashtab[i] = tagged(p, HASHTAG(h)) ;
+}
 /*
  *   These next two routines are (nearly) our only hash table access
  *   routines; we simply look up the passed in information.  If we
  *   find it in the hash table, we return it; otherwise, we build a
- *   new ghnode and store it in the hash table, and return that.
+ *   new ghnode and store it in the hash table, and return that.  If
+ *   getting the new ghnode caused a gc, the table has been rebuilt, so
+ *   we have to look for an empty slot all over again.
  */
 ghnode *ghashbase::find_ghnode(ghnode *nw, ghnode *ne, ghnode *sw, ghnode *se) {
    ghnode *p ;
    g_uintptr_t h = ghnode_hash(nw,ne,sw,se) ;
-   ghnode *pred = 0 ;
-   h = HASHMOD(h) ;
-   for (p=hashtab[h]; p; p = p->next) { /* make sure to compare nw *first* */
-      if (nw == p->nw && ne == p->ne && sw == p->sw && se == p->se) {
-         if (pred) { /* move this one to the front */
-            pred->next = p->next ;
-            p->next = hashtab[h] ;
-            hashtab[h] = p ;
+   g_uintptr_t tag = HASHTAG(h), i = HASHMOD(h) ;
+   counts.lookups++ ;
+   for (; (p=hashtab[i]) != 0; i = nextslot(i)) {
+      counts.probes++ ;
+      if (slottag(p) == tag) {
+         ghnode *s = p ;
+         p = slotnode(p) ; /* make sure to compare nw *first* */
+         if (nw == p->nw && ne == p->ne && sw == p->sw && se == p->se) {
+            if (gcstep > 1 && !referenced(s))
+               hashtab[i] = tagged(s, REFBIT) ;
+            counts.hits++ ;
+            return save(p) ;
          }
+      }
+   }
+   if (oldhashtab) {
+      p = findoldghnode(h, nw, ne, sw, se) ;
+      if (p) {
+         counts.hits++ ;
+         movehash(MOVESLOTS) ;
          return save(p) ;
       }
-      pred = p ;
    }
+   int gcs = gccount ;
    p = newghnode() ;
    p->nw = nw ;
    p->ne = ne ;
    p->sw = sw ;
    p->se = se ;
    p->res = 0 ;
-   p->next = hashtab[h] ;
-   hashtab[h] = p ;
+   if (gcs == gccount)
+      hashtab[i] = tagged(p, tag) ;
+   else
+      hashinsert(p, h) ;
    hashpop++ ;
    save(p) ;
+   if (oldhashtab)
+      movehash(MOVESLOTS) ;
    if (hashpop > hashlimit)
       resize() ;
    return p ;
 }
-ghleaf *ghashbase::find_ghleaf(state nw, state ne, state sw, state se) {
+ghleaf *ghashbase::find_ghleaf(const g_uintptr_t *cells) {
    ghleaf *p ;
-   ghleaf *pred = 0 ;
-   g_uintptr_t h = ghleaf_hash(nw, ne, sw, se) ;
-   h = HASHMOD(h) ;
-   for (p=(ghleaf *)hashtab[h]; p; p = (ghleaf *)p->next) {
-      if (nw == p->nw && ne == p->ne && sw == p->sw && se == p->se &&
-          !is_ghnode(p)) {
-         if (pred) {
-            pred->next = p->next ;
-            p->next = hashtab[h] ;
-            hashtab[h] = (ghnode *)p ;
+   ghnode *q ;
+   g_uintptr_t h = ghleaf_hash(cells) ;
+   g_uintptr_t tag = HASHTAG(h), i = HASHMOD(h) ;
+   counts.lookups++ ;
+   for (; (q=hashtab[i]) != 0; i = nextslot(i)) {
+      counts.probes++ ;
+      if (slottag(q) == tag) {
+         p = (ghleaf *)slotnode(q) ;
+         if (samecells(p, cells) && !is_ghnode(p)) {
+            counts.hits++ ;
+            return (ghleaf *)save((ghnode *)p) ;
          }
+      }
+   }
+   if (oldhashtab) {
+      p = findoldghleaf(h, cells) ;
+      if (p) {
+         counts.hits++ ;
+         movehash(MOVESLOTS) ;
          return (ghleaf *)save((ghnode *)p) ;
       }
-      pred = p ;
    }
+   int gcs = gccount ;
    p = newghleaf() ;
-   p->nw = nw ;
-   p->ne = ne ;
-   p->sw = sw ;
-   p->se = se ;
-   p->leafpop = bigint((short)((nw != 0) + (ne != 0) + (sw != 0) + (se != 0))) ;
+   for (int j=0; j<4; j++)
+      p->cells[j] = cells[j] ;
    p->isghnode = 0 ;
-   p->next = hashtab[h] ;
-   hashtab[h] = (ghnode *)p ;
+   if (gcs == gccount)
+      hashtab[i] = tagged(p, tag) ;
+   else
+      hashinsert((ghnode *)p, h) ;
    hashpop++ ;
    save((ghnode *)p) ;
+   if (oldhashtab)
+      movehash(MOVESLOTS) ;
    if (hashpop > hashlimit)
       resize() ;
    return p ;
 }
+/*
+ *   Leaves are packed and unpacked a row at a time; a row never spans
+ *   two words.  The other routines go through these, or through a grid
+ *   of one state a cell.
+ */
+#define WORDBITS (8 * (int)sizeof(g_uintptr_t))
+static void unpackcells(const g_uintptr_t *c, int bits, int side,
+                        state *g, int pitch) {
+   g_uintptr_t mask = ((g_uintptr_t)1 << bits) - 1 ;
+   for (int y=0; y<side; y++, g += pitch) {
+      int at = y * side * bits ;
+      g_uintptr_t row = c[at / WORDBITS] >> (at % WORDBITS) ;
+      for (int x=0; x<side; x++, row >>= bits)
+         g[x] = (state)(row & mask) ;
+   }
+}
+static void packcells(const state *g, int pitch, int bits, int side,
+                      g_uintptr_t *c) {
+   c[0] = c[1] = c[2] = c[3] = 0 ;
+   for (int y=0; y<side; y++, g += pitch) {
+      g_uintptr_t row = 0 ;
+      for (int x=side-1; x>=0; x--)
+         row = (row << bits) | g[x] ;
+      int at = y * side * bits ;
+      c[at / WORDBITS] |= row << (at % WORDBITS) ;
+   }
+}
+state ghashbase::leafcell(ghleaf *l, int x, int y) {
+   int at = ((y << (leafdepth + 1)) + x) * leafbits ;
+   return (state)((l->cells[at / WORDBITS] >> (at % WORDBITS)) &
+                  (((g_uintptr_t)1 << leafbits) - 1)) ;
+}
+void ghashbase::unpackleaf(ghleaf *l, state *g, int pitch) {
+   unpackcells(l->cells, leafbits, 2 << leafdepth, g, pitch) ;
+}
+ghleaf *ghashbase::find_ghleaf(const state *g, int pitch) {
+   g_uintptr_t c[4] ;
+   packcells(g, pitch, leafbits, 2 << leafdepth, c) ;
+   return find_ghleaf(c) ;
+}
+/*
+ *   The leaf made of the inner quadrants of four leaves in a square,
+ *   put together a row at a time without unpacking them.
+ */
+ghleaf *ghashbase::centreleaf(ghleaf *nw, ghleaf *ne, ghleaf *sw,
+                              ghleaf *se) {
+   int s = 2 << leafdepth, rb = s * leafbits, hb = rb / 2 ;
+   g_uintptr_t mask = ~(g_uintptr_t)0 >> (WORDBITS - rb) ;
+   g_uintptr_t c[4] = { 0, 0, 0, 0 } ;
+   for (int y=0; y<s; y++) {
+      ghleaf *w = y < s / 2 ? nw : sw, *e = y < s / 2 ? ne : se ;
+      int from = ((y + s / 2) % s) * rb, to = y * rb ;
+      g_uintptr_t wr = w->cells[from / WORDBITS] >> (from % WORDBITS) ;
+      g_uintptr_t er = e->cells[from / WORDBITS] >> (from % WORDBITS) ;
+      c[to / WORDBITS] |= (((wr & mask) >> hb) | ((er << hb) & mask))
+                          << (to % WORDBITS) ;
+   }
+   return find_ghleaf(c) ;
+}
+/*
+ *   How many cells of a leaf are not zero:  fold each cell's bits down
+ *   into its lowest one and count those.
+ */
+int ghashbase::leafpop(ghnode *n) {
+   g_uintptr_t low = 0 ;
+   for (int i=0; i<WORDBITS; i += leafbits)
+      low |= (g_uintptr_t)1 << i ;
+   int r = 0 ;
+   for (int j=0; j<4; j++) {
+      g_uintptr_t t = ((ghleaf *)n)->cells[j] ;
+      for (int b=1; b<leafbits; b += b)
+         t |= t >> b ;
+      for (t &= low; t; t &= t - 1)
+         r++ ;
+   }
+   return r ;
+}
+/*
+ *   Copy the cells of n (at depth d) that fall in the side by side
+ *   square x across and y down from n's top left corner into g, which
+ *   has pitch cells a row; the rest of g is left alone.
+ */
+void ghashbase::copycells(ghnode *n, int d, long long x, long long y,
+                          int side, state *g, int pitch) {
+   long long s = (long long)2 << d ;
+   if (x >= s || y >= s || x + side <= 0 || y + side <= 0 ||
+       n == zeroghnode(d))
+      return ;
+   if (d == leafdepth) {
+      state c[64] ;
+      unpackleaf((ghleaf *)n, c, (int)s) ;
+      for (int j=0; j<side; j++)
+         if (y + j >= 0 && y + j < s)
+            for (int i=0; i<side; i++)
+               if (x + i >= 0 && x + i < s)
+                  g[j * pitch + i] = c[(y + j) * s + x + i] ;
+      return ;
+   }
+   long long h = s >> 1 ;
+   copycells(n->nw, d-1, x, y, side, g, pitch) ;
+   copycells(n->ne, d-1, x-h, y, side, g, pitch) ;
+   copycells(n->sw, d-1, x, y-h, side, g, pitch) ;
+   copycells(n->se, d-1, x-h, y-h, side, g, pitch) ;
+}
+/*
+ *   The ghnode of depth d (at least leafdepth) for a square of cells.
+ */
+ghnode *ghashbase::gridnode(const state *g, int pitch, int d) {
+   if (d == leafdepth)
+      return (ghnode *)find_ghleaf(g, pitch) ;
+   int h = 1 << d ;
+   return find_ghnode(gridnode(g, pitch, d-1), gridnode(g + h, pitch, d-1),
+                      gridnode(g + h * pitch, pitch, d-1),
+                      gridnode(g + h * pitch + h, pitch, d-1)) ;
+}
 /*
  *   The following routine does the same, but first it checks to see if
  *   the cached result is any good.  If it is, it directly returns that.
@@ -225,19 +509,14 @@ ghnode *ghashbase::getres(ghnode *n, int depth) {
    if (running_hperf.fastinc(depth, ngens < depth))
       running_hperf.report(inc_hperf, verbose) ;
    depth-- ;
-   if (ngens >= depth) {
-     if (is_ghnode(n->nw)) {
-       res = dorecurs(n->nw, n->ne, n->sw, n->se, depth) ;
-     } else {
-       res = (ghnode *)dorecurs_ghleaf((ghleaf *)n->nw, (ghleaf *)n->ne,
-                                       (ghleaf *)n->sw, (ghleaf *)n->se) ;
-     }
+   if (!is_ghnode(n->nw)) {
+     res = (ghnode *)dorecurs_ghleaf((ghleaf *)n->nw, (ghleaf *)n->ne,
+                                     (ghleaf *)n->sw, (ghleaf *)n->se,
+                                     ngens < depth ? ngens : depth) ;
+   } else if (ngens >= depth) {
+     res = dorecurs(n->nw, n->ne, n->sw, n->se, depth) ;
    } else {
-     if (is_ghnode(n->nw)) {
-       res = dorecurs_half(n->nw, n->ne, n->sw, n->se, depth) ;
-     } else {
-       lifefatal("! can't happen") ;
-     }
+     res = dorecurs_half(n->nw, n->ne, n->sw, n->se, depth) ;
    }
    pop(sp) ;
    if (softinterrupt || poller->isInterrupted()) // don't assign this to the cache field!
@@ -260,29 +539,45 @@ void ghashbase::setupprefetch(ghsetup_t &su, ghnode *nw, ghnode *ne, ghnode *sw,
 }
 ghnode *ghashbase::find_ghnode(ghsetup_t &su) {
    ghnode *p ;
-   ghnode *pred = 0 ;
-   g_uintptr_t h = HASHMOD(su.h) ;
-   for (p=hashtab[h]; p; p = p->next) { /* make sure to compare nw *first* */
-      if (su.nw == p->nw && su.ne == p->ne && su.sw == p->sw && su.se == p->se) {
-         if (pred) { /* move this one to the front */
-            pred->next = p->next ;
-            p->next = hashtab[h] ;
-            hashtab[h] = p ;
+   g_uintptr_t tag = HASHTAG(su.h), i = HASHMOD(su.h) ;
+   counts.lookups++ ;
+   for (; (p=hashtab[i]) != 0; i = nextslot(i)) {
+      counts.probes++ ;
+      if (slottag(p) == tag) {
+         ghnode *s = p ;
+         p = slotnode(p) ; /* make sure to compare nw *first* */
+         if (su.nw == p->nw && su.ne == p->ne && su.sw == p->sw &&
+             su.se == p->se) {
+            if (gcstep > 1 && !referenced(s))
+               hashtab[i] = tagged(s, REFBIT) ;
+            counts.hits++ ;
+            return save(p) ;
          }
+      }
+   }
+   if (oldhashtab) {
+      p = findoldghnode(su.h, su.nw, su.ne, su.sw, su.se) ;
+      if (p) {
+         counts.hits++ ;
+         movehash(MOVESLOTS) ;
          return save(p) ;
       }
-      pred = p ;
    }
+   int gcs = gccount ;
    p = newghnode() ;
    p->nw = su.nw ;
    p->ne = su.ne ;
    p->sw = su.sw ;
    p->se = su.se ;
    p->res = 0 ;
-   p->next = hashtab[h] ;
-   hashtab[h] = p ;
+   if (gcs == gccount)
+      hashtab[i] = tagged(p, tag) ;
+   else
+      hashinsert(p, su.h) ;
    hashpop++ ;
    save(p) ;
+   if (oldhashtab)
+      movehash(MOVESLOTS) ;
    if (hashpop > hashlimit)
       resize() ;
    return p ;
@@ -359,7 +654,7 @@ ghnode *ghashbase::dorecurs(ghnode *n, ghnode *ne, ghnode *t,
 ghnode *ghashbase::dorecurs_half(ghnode *n, ghnode *ne, ghnode *t,
                                ghnode *e, int depth) {
    int sp = gsp ;
-   if (depth > 1) {
+   if (depth > leafdepth + 1) {
       ghnode
       *t00 = find_ghnode(n->nw->se, n->ne->sw, n->sw->ne, n->se->nw),
       *t01 = find_ghnode(n->ne->se, ne->nw->sw, n->se->ne, ne->sw->nw),
@@ -375,57 +670,98 @@ ghnode *ghashbase::dorecurs_half(ghnode *n, ghnode *ne, ghnode *t,
                       getres(find_ghnode(t10, t11, t20, t21), depth),
                       getres(find_ghnode(t11, t12, t21, t22), depth)) ;
    } else {
-      ghnode
-      *t00 = getres(n, depth),
-      *t01 = getres(find_ghnode(n->ne, ne->nw, n->se, ne->sw), depth),
-      *t10 = getres(find_ghnode(n->sw, n->se, t->nw, t->ne), depth),
-      *t11 = getres(find_ghnode(n->se, ne->sw, t->ne, e->nw), depth),
-      *t02 = getres(ne, depth),
-      *t12 = getres(find_ghnode(ne->sw, ne->se, e->nw, e->ne), depth),
-      *t20 = getres(t, depth),
-      *t21 = getres(find_ghnode(t->ne, e->nw, t->se, e->sw), depth),
-      *t22 = getres(e, depth) ;
-      n = find_ghnode((ghnode *)find_ghleaf(((ghleaf *)t00)->se,
-                                             ((ghleaf *)t01)->sw,
-                                             ((ghleaf *)t10)->ne,
-                                             ((ghleaf *)t11)->nw),
-                    (ghnode *)find_ghleaf(((ghleaf *)t01)->se,
-                                             ((ghleaf *)t02)->sw,
-                                             ((ghleaf *)t11)->ne,
-                                             ((ghleaf *)t12)->nw),
-                    (ghnode *)find_ghleaf(((ghleaf *)t10)->se,
-                                             ((ghleaf *)t11)->sw,
-                                             ((ghleaf *)t20)->ne,
-                                             ((ghleaf *)t21)->nw),
-                    (ghnode *)find_ghleaf(((ghleaf *)t11)->se,
-                                             ((ghleaf *)t12)->sw,
-                                             ((ghleaf *)t21)->ne,
-                                             ((ghleaf *)t22)->nw)) ;
+      // the results are leaves; we make the centres from their quadrants
+      ghnode *r[9] = {
+         getres(n, depth),
+         getres(find_ghnode(n->ne, ne->nw, n->se, ne->sw), depth),
+         getres(ne, depth),
+         getres(find_ghnode(n->sw, n->se, t->nw, t->ne), depth),
+         getres(find_ghnode(n->se, ne->sw, t->ne, e->nw), depth),
+         getres(find_ghnode(ne->sw, ne->se, e->nw, e->ne), depth),
+         getres(t, depth),
+         getres(find_ghnode(t->ne, e->nw, t->se, e->sw), depth),
+         getres(e, depth)
+      } ;
+      ghleaf **l = (ghleaf **)r ;
+      n = find_ghnode((ghnode *)centreleaf(l[0], l[1], l[3], l[4]),
+                      (ghnode *)centreleaf(l[1], l[2], l[4], l[5]),
+                      (ghnode *)centreleaf(l[3], l[4], l[6], l[7]),
+                      (ghnode *)centreleaf(l[4], l[5], l[7], l[8])) ;
    }
    pop(sp) ;
    return save(n) ;
 }
 /*
- *   If the ghnode is a 16-ghnode, then the constituents are leaves, so we
- *   need a very similar but still somewhat different subroutine.  Since
- *   we do not (yet) garbage collect leaves, we don't need all that
- *   save/pop mumbo-jumbo.
+ *   If the ghnode's children are leaves, we step its cells ourselves,
+ *   2^k generations, each generation on a square one cell smaller all
+ *   round than the one before, down to the centre.
  */
 ghleaf *ghashbase::dorecurs_ghleaf(ghleaf *nw, ghleaf *ne, ghleaf *sw,
-                                   ghleaf *se) {
-   return find_ghleaf(
-             slowcalc(nw->nw, nw->ne, ne->nw,
-                      nw->sw, nw->se, ne->sw,
-                      sw->nw, sw->ne, se->nw),
-             slowcalc(nw->ne, ne->nw, ne->ne,
-                      nw->se, ne->sw, ne->se,
-                      sw->ne, se->nw, se->ne),
-             slowcalc(nw->sw, nw->se, ne->sw,
-                      sw->nw, sw->ne, se->nw,
-                      sw->sw, sw->se, se->sw),
-             slowcalc(nw->se, ne->sw, ne->se,
-                      sw->ne, se->nw, se->ne,
-                      sw->se, se->sw, se->se)) ;
+                                   ghleaf *se, int k) {
+   int s = 2 << leafdepth, p = 2 * s ;
+   state g[2][16 * 16] ;
+   unpackleaf(nw, g[0], p) ;
+   unpackleaf(ne, g[0] + s, p) ;
+   unpackleaf(sw, g[0] + s * p, p) ;
+   unpackleaf(se, g[0] + s * p + s, p) ;
+   int cur = 0 ;
+   for (int i=(1<<k)-1; i>=0; i--) {
+      int o = s / 2 - i ;
+      blockcalc(g[cur] + o * p + o, g[1-cur] + o * p + o, p, p - 2 * o,
+                p - 2 * o) ;
+      cur = 1 - cur ;
+   }
+   return find_ghleaf(g[cur] + (s / 2) * p + s / 2, p) ;
+}
+/*
+ *   Like gridcalc, for a w by h block with both even, but a 2x2 at a
+ *   time, looking each up in the block cache first.
+ */
+#define BLOCKCACHEBITS 16
+void ghashbase::blockcalc(const state *in, state *out, int pitch,
+                          int w, int h) {
+   for (int y=0; y<h; y += 2, in += 2 * pitch, out += 2 * pitch) {
+      for (int x=0; x<w; x += 2) {
+         const state *c = in + x - pitch - 1 ;
+         unsigned int r0, r1, r2, r3 ;
+         memcpy(&r0, c, 4) ;
+         memcpy(&r1, c + pitch, 4) ;
+         memcpy(&r2, c + 2 * pitch, 4) ;
+         memcpy(&r3, c + 3 * pitch, 4) ;
+         unsigned long long top = r0 | ((unsigned long long)r1 << 32) ;
+         unsigned long long bottom = r2 | ((unsigned long long)r3 << 32) ;
+         unsigned long long hh = (top ^ (bottom * 0xff51afd7ed558ccdULL)) *
+                                 0x9e3779b97f4a7c15ULL ;
+         blockresult &b = blockcache[hh >> (64 - BLOCKCACHEBITS)] ;
+         state *o = out + x ;
+         if (b.full && b.top == top && b.bottom == bottom) {
+            o[0] = b.r[0] ;
+            o[1] = b.r[1] ;
+            o[pitch] = b.r[2] ;
+            o[pitch+1] = b.r[3] ;
+         } else {
+            gridcalc(in + x, o, pitch, 2, 2) ;
+            b.top = top ;
+            b.bottom = bottom ;
+            b.r[0] = o[0] ;
+            b.r[1] = o[1] ;
+            b.r[2] = o[pitch] ;
+            b.r[3] = o[pitch+1] ;
+            b.full = 1 ;
+         }
+      }
+   }
+}
+void ghashbase::gridcalc(const state *in, state *out, int pitch,
+                         int w, int h) {
+   for (int y=0; y<h; y++, in += pitch, out += pitch) {
+      for (int x=0; x<w; x++) {
+         const state *c = in + x ;
+         out[x] = slowcalc(c[-pitch-1], c[-pitch], c[1-pitch],
+                           c[-1], c[0], c[1],
+                           c[pitch-1], c[pitch], c[pitch+1]) ;
+      }
+   }
 }
 /*
  *   We keep free ghnodes in a linked list for allocation, and we allocate
@@ -433,35 +769,35 @@ ghleaf *ghashbase::dorecurs_ghleaf(ghleaf *nw, ghleaf *ne, ghleaf *sw,
  */
 ghnode *ghashbase::newghnode() {
    ghnode *r ;
+   if (freeghnodes == 0)
+      sweep() ;
    if (freeghnodes == 0) {
       int i ;
-      freeghnodes = (ghnode *)calloc(1001, sizeof(ghnode)) ;
+      freeghnodes = (ghnode *)nodepool->alloc() ;
       if (freeghnodes == 0)
          lifefatal("Out of memory; try reducing the hash memory limit.") ;
       alloced += 1001 * sizeof(ghnode) ;
-      freeghnodes->next = ghnodeblocks ;
+      freeghnodes->res = ghnodeblocks ;
       ghnodeblocks = freeghnodes++ ;
       for (i=0; i<999; i++) {
-         freeghnodes[1].next = freeghnodes ;
+         freeghnodes[1].res = freeghnodes ;
          freeghnodes++ ;
       }
       totalthings += 1000 ;
    }
-   if (freeghnodes->next == 0 && alloced + 1000 * sizeof(ghnode) > maxmem &&
-       okaytogc) {
+   if (freeghnodes->res == 0 && sweepnext == sweepblocks.size() &&
+       alloced + 1000 * sizeof(ghnode) > maxmem && okaytogc) {
       do_gc(0) ;
    }
    r = freeghnodes ;
-   freeghnodes = freeghnodes->next ;
+   freeghnodes = freeghnodes->res ;
    return r ;
 }
 /*
  *   Leaves are the same.
  */
 ghleaf *ghashbase::newghleaf() {
-   ghleaf *r = (ghleaf *)newghnode() ;
-   new(&(r->leafpop))bigint ;
-   return r ;
+   return (ghleaf *)newghnode() ;
 }
 /*
  *   Sometimes we want the new ghnode or ghleaf to be automatically cleared
@@ -471,9 +807,7 @@ ghnode *ghashbase::newclearedghnode() {
    return (ghnode *)memset(newghnode(), 0, sizeof(ghnode)) ;
 }
 ghleaf *ghashbase::newclearedghleaf() {
-   ghleaf *r = (ghleaf *)newclearedghnode() ;
-   new(&(r->leafpop))bigint ;
-   return r ;
+   return (ghleaf *)newclearedghnode() ;
 }
 ghashbase::ghashbase() {
    hashprime = nexthashsize(1000) ;
@@ -482,9 +816,13 @@ ghashbase::ghashbase() {
 #endif
    hashlimit = (g_uintptr_t)(maxloadfactor * hashprime) ;
    hashpop = 0 ;
-   hashtab = (ghnode **)calloc(hashprime, sizeof(ghnode *)) ;
+   nodepool = new blockpool(1001 * sizeof(ghnode), 64) ;
+   hashtab = (ghnode **)bigcalloc(hashprime, sizeof(ghnode *)) ;
    if (hashtab == 0)
      lifefatal("Out of memory (1).") ;
+   oldhashtab = 0 ;
+   oldhashprime = 0 ;
+   oldhashnext = 0 ;
    alloced = hashprime * sizeof(ghnode *) ;
    ngens = 0 ;
    stacksize = 0 ;
@@ -497,7 +835,15 @@ ghashbase::ghashbase() {
    okaytogc = 0 ;
    totalthings = 0 ;
    ghnodeblocks = 0 ;
+   sweepnext = 0 ;
+   livenext = 0 ;
+   maxgcpause = 0 ;
+   lastgcpause = 0 ;
+   totalgcpause = 0 ;
+   lastgcfreed = 1 ;
    zeroghnodea = 0 ;
+   leafbits = 2 ;
+   leafdepth = 2 ;
 /*
  *   We initialize our universe to be a 16-square.  We are in drawing
  *   mode at this point.
@@ -509,14 +855,18 @@ ghashbase::ghashbase() {
    setincrement = 1 ;
    nonpow2 = 1 ;
    pow2step = 1 ;
+   stepgrid = BORDERGRID ;
    llsize = 0 ;
-   depth = 1 ;
+   depth = leafdepth + 1 ;
    hashed = 0 ;
    popValid = 0 ;
    needPop = 0 ;
    inGC = 0 ;
    cacheinvalid = 0 ;
+   blockcache.assign(1 << BLOCKCACHEBITS, blockresult()) ;
    gccount = 0 ;
+   invalidations = 0 ;
+   counts.clear() ;
    gcstep = 0 ;
    running_hperf.clear() ;
    inc_hperf = running_hperf ;
@@ -527,12 +877,9 @@ ghashbase::ghashbase() {
  *   Destructor frees memory.
  */
 ghashbase::~ghashbase() {
-   free(hashtab) ;
-   while (ghnodeblocks) {
-      ghnode *r = ghnodeblocks ;
-      ghnodeblocks = ghnodeblocks->next ;
-      free(r) ;
-   }
+   bigfree(hashtab) ;
+   bigfree(oldhashtab) ;
+   delete nodepool ;
    if (zeroghnodea)
       free(zeroghnodea) ;
    if (stack)
@@ -561,7 +908,7 @@ void ghashbase::step() {
    while (1) {
       int cleareddownto = 1000000000 ;
       softinterrupt = 0 ;
-      while (increment != setincrement) {
+      while (increment != setincrement || stepgrid != nativegrid()) {
          bigint pendingincrement = increment ;
          int newpow2 = 0 ;
          bigint t = pendingincrement ;
@@ -572,14 +919,19 @@ void ghashbase::step() {
          nonpow2 = t.low31() ;
          if (t != nonpow2)
             lifefatal("bad increment") ;
-         int downto = newpow2 ;
-         if (ngens < newpow2)
+         // past gridngens the rest is done in full steps; see runtorus
+         stepgrid = nativegrid() ;
+         int newngens = newpow2 ;
+         if (newngens > gridngens())
+            newngens = gridngens() ;
+         int downto = newngens ;
+         if (ngens < newngens)
             downto = ngens ;
-         if (newpow2 != ngens && cleareddownto > downto) {
-            new_ngens(newpow2) ;
+         if (newngens != ngens && cleareddownto > downto) {
+            new_ngens(newngens) ;
             cleareddownto = downto ;
          } else {
-            ngens = newpow2 ;
+            ngens = newngens ;
          }
          setincrement = pendingincrement ;
          pow2step = 1 ;
@@ -608,6 +960,108 @@ void ghashbase::setcurrentstate(void *n) {
       popValid = 0 ;
    }
 }
+/*
+ *   For period search:  the cellhash of a state, moved so its bounding
+ *   box starts at the origin, found as in hlifealgo.
+ */
+int ghashbase::hashstate(void *st, const bigint &top, const bigint &left,
+                         cellhash &h) {
+   ghnode *n = (ghnode *)st ;
+   int d = ghnode_depth(n) ;
+   if (d >= 50)
+      return 0 ;
+   double half = ldexp(1.0, d) ;
+   double x = left.todouble() + half ;
+   double y = top.todouble() + half - 1 ;
+   if (x < 0 || y < 0)
+      return 0 ;
+   h = hashghnode(n, d).moved((unsigned long long)x, (unsigned long long)y) ;
+   return 1 ;
+}
+cellhash ghashbase::hashghnode(ghnode *n, int d) {
+   if (n == zeroghnode(d))
+      return cellhash() ;
+   std::unordered_map<ghnode *, cellhash>::iterator it = cellhashes.find(n) ;
+   if (it != cellhashes.end())
+      return it->second ;
+   cellhash r ;
+   if (d == leafdepth) {
+      int s = 2 << leafdepth ;
+      state g[64] ;
+      unpackleaf((ghleaf *)n, g, s) ;
+      for (int i=0; i<s*s; i++)
+         if (g[i])
+            r.addcell(g[i], i % s, i / s) ;
+   } else {
+      r = cellhash::quads(hashghnode(n->nw, d-1), hashghnode(n->ne, d-1),
+                          hashghnode(n->sw, d-1), hashghnode(n->se, d-1), d) ;
+   }
+   cellhashes[n] = r ;
+   return r ;
+}
+/*
+ *   The part of n (at depth d) in the square of side 2^(wd+1) whose top
+ *   left corner is x across and y down from n's top left corner.
+ */
+ghnode *ghashbase::window(ghnode *n, int d, long long x, long long y,
+                          int wd, windowmemo &memo) {
+   long long s = (long long)1 << (d + 1) ;
+   long long ws = (long long)1 << (wd + 1) ;
+   if (n == zeroghnode(d) || x >= s || y >= s || x + ws <= 0 || y + ws <= 0)
+      return zeroghnode(wd) ;
+   if (x == 0 && y == 0 && wd == d)
+      return n ;
+   if (d > wd) {
+      long long half = s >> 1 ;
+      long long ox = (x >= half) ? half : 0 ;
+      long long oy = (y >= half) ? half : 0 ;
+      if (x >= ox && x + ws <= ox + half && y >= oy && y + ws <= oy + half) {
+         ghnode *q = oy ? (ox ? n->se : n->sw) : (ox ? n->ne : n->nw) ;
+         return window(q, d-1, x-ox, y-oy, wd, memo) ;
+      }
+   }
+   if (wd == leafdepth) {
+      state g[64] ;
+      int s = 2 << leafdepth ;
+      memset(g, 0, sizeof(g)) ;
+      copycells(n, d, x, y, s, g, s) ;
+      return (ghnode *)find_ghleaf(g, s) ;
+   }
+   std::tuple<ghnode *, long long, long long, int> key(n, x, y, wd) ;
+   windowmemo::iterator it = memo.find(key) ;
+   if (it != memo.end())
+      return it->second ;
+   long long hw = ws >> 1 ;
+   ghnode *r = find_ghnode(window(n, d, x, y, wd-1, memo),
+                           window(n, d, x+hw, y, wd-1, memo),
+                           window(n, d, x, y+hw, wd-1, memo),
+                           window(n, d, x+hw, y+hw, wd-1, memo)) ;
+   memo[key] = r ;
+   return r ;
+}
+/*
+ *   The state of the cell x across and y down from n's top left corner.
+ */
+state ghashbase::cellat(ghnode *n, int d, long long x, long long y) {
+   long long s = (long long)1 << (d + 1) ;
+   if (x < 0 || y < 0 || x >= s || y >= s)
+      return 0 ;
+   while (d > leafdepth) {
+      if (n == zeroghnode(d))
+         return 0 ;
+      long long half = (long long)1 << d ;
+      if (y < half)
+         n = (x < half) ? n->nw : n->ne ;
+      else
+         n = (x < half) ? n->sw : n->se ;
+      if (x >= half)
+         x -= half ;
+      if (y >= half)
+         y -= half ;
+      d-- ;
+   }
+   return leafcell((ghleaf *)n, (int)x, (int)y) ;
+}
 /*
  *   Set the max memory
  */
@@ -657,7 +1111,7 @@ void ghashbase::pushroot_1() {
  *   Return the depth of this ghnode (2 is 8x8).
  */
 int ghashbase::ghnode_depth(ghnode *n) {
-   int depth = 0 ;
+   int depth = leafdepth ;
    while (is_ghnode(n)) {
       depth++ ;
       n = n->nw ;
@@ -680,8 +1134,9 @@ ghnode *ghashbase::zeroghnode(int depth) {
          zeroghnodea[nzeros++] = 0 ;
    }
    if (zeroghnodea[depth] == 0) {
-      if (depth == 0) {
-         zeroghnodea[depth] = (ghnode *)find_ghleaf(0, 0, 0, 0) ;
+      if (depth == leafdepth) {
+         g_uintptr_t c[4] = { 0, 0, 0, 0 } ;
+         zeroghnodea[depth] = (ghnode *)find_ghleaf(c) ;
       } else {
          ghnode *z = zeroghnode(depth-1) ;
          zeroghnodea[depth] = find_ghnode(z, z, z, z) ;
@@ -712,35 +1167,18 @@ ghnode *ghashbase::pushroot(ghnode *n) {
  *   the ghnodes can be null.  We'll patch this up in due course.
  */
 ghnode *ghashbase::gsetbit(ghnode *n, int x, int y, int newstate, int depth) {
-   if (depth == 0) {
+   if (depth == leafdepth) {
       ghleaf *l = (ghleaf *)n ;
-      if (hashed) {
-         state nw = l->nw ;
-         state sw = l->sw ;
-         state ne = l->ne ;
-         state se = l->se ;
-         if (x < 0)
-           if (y < 0)
-             sw = (state)newstate ;
-           else
-             nw = (state)newstate ;
-         else
-           if (y < 0)
-             se = (state)newstate ;
-           else
-             ne = (state)newstate ;
-         return save((ghnode *)find_ghleaf(nw, ne, sw, se)) ;
-      }
-      if (x < 0)
-        if (y < 0)
-          l->sw = (state)newstate ;
-        else
-          l->nw = (state)newstate ;
-      else
-        if (y < 0)
-          l->se = (state)newstate ;
-        else
-          l->ne = (state)newstate ;
+      int h = 1 << leafdepth ;
+      int at = (((h - 1 - y) << (leafdepth + 1)) + x + h) * leafbits ;
+      g_uintptr_t c[4] = { l->cells[0], l->cells[1], l->cells[2], l->cells[3] } ;
+      g_uintptr_t mask = (((g_uintptr_t)1 << leafbits) - 1) << (at % WORDBITS) ;
+      c[at / WORDBITS] = (c[at / WORDBITS] & ~mask) |
+                         ((g_uintptr_t)newstate << (at % WORDBITS)) ;
+      if (hashed)
+         return save((ghnode *)find_ghleaf(c)) ;
+      for (int i=0; i<4; i++)
+         l->cells[i] = c[i] ;
       return (ghnode *)l ;
    } else {
       unsigned int w = 0, wh = 0 ;
@@ -780,7 +1218,7 @@ ghnode *ghashbase::gsetbit(ghnode *n, int x, int y, int newstate, int depth) {
          }
       }
       if (*nptr == 0) {
-         if (depth == 0)
+         if (depth == leafdepth)
             *nptr = (ghnode *)newclearedghleaf() ;
          else
             *nptr = newclearedghnode() ;
@@ -825,18 +1263,9 @@ int ghashbase::getbit(ghnode *n, int x, int y, int depth) {
       n = &tnode ;
       depth-- ;
    }
-   if (depth == 0) {
-      ghleaf *l = (ghleaf *)n ;
-      if (x < 0)
-         if (y < 0)
-           return l->sw ;
-         else
-           return l->nw ;
-      else
-         if (y < 0)
-           return l->se ;
-         else
-           return l->ne ;
+   if (depth == leafdepth) {
+      int h = 1 << leafdepth ;
+      return leafcell((ghleaf *)n, x + h, h - 1 - y) ;
    } else {
       unsigned int w = 0, wh = 0 ;
       if (depth >= 32) {
@@ -873,25 +1302,13 @@ int ghashbase::getbit(ghnode *n, int x, int y, int depth) {
 int ghashbase::nextbit(ghnode *n, int x, int y, int depth, int &v) {
    if (n == 0 || n == zeroghnode(depth))
       return -1 ;
-   if (depth == 0) {
-      ghleaf *l = (ghleaf *)n ;
-      if (y < 0) {
-        if (x < 0 && l->sw) {
-          v = l->sw ;
-          return 0 ;
-        }
-        if (l->se) {
-          v = l->se ;
-          return -x ;
-        }
-      } else {
-        if (x < 0 && l->nw) {
-          v = l->nw ;
-          return 0 ;
-        }
-        if (l->ne) {
-          v = l->ne ;
-          return -x ;
+   if (depth == leafdepth) {
+      int h = 1 << leafdepth ;
+      for (int i=x+h; i<2*h; i++) {
+        state c = leafcell((ghleaf *)n, i, h - 1 - y) ;
+        if (c) {
+          v = c ;
+          return i - x - h ;
         }
       }
       return -1 ; // none found
@@ -933,6 +1350,7 @@ int ghashbase::nextbit(ghnode *n, int x, int y, int depth, int &v) {
 int ghashbase::setcell(int x, int y, int newstate) {
    if (newstate < 0 || newstate >= maxCellStates)
      return -1 ;
+   checkleafbits() ;
    if (hashed) {
       clearstack() ;
       save(root) ;
@@ -965,6 +1383,116 @@ int ghashbase::setcell(int x, int y, int newstate) {
    }
    return 0 ;
 }
+/*
+ *   Bulk loading, as in hlifealgo:  build the tree for a batch of cells
+ *   from the bottom up in Morton order, then lay it over the universe.
+ */
+int ghashbase::setcells(const vector<loadcell> &cells) {
+   for (size_t i=0; i<cells.size(); i++)
+      if (cells[i].state < 0 || cells[i].state >= maxCellStates)
+         return -1 ;
+   checkleafbits() ;
+   vector<mortoncell> sorted ;
+   int bd = mortonsort(cells, leafdepth + 1, sorted) ;
+   if (bd < 0)
+      return lifealgo::setcells(cells) ;
+   if (sorted.empty())
+      return 0 ;
+   ensure_hashed() ;
+   clearstack() ;
+   save(root) ;
+   okaytogc = 1 ;
+   ghnode *b = buildcells(sorted, bd) ;
+   while (depth < bd) {
+      root = save(pushroot(root)) ;
+      depth++ ;
+   }
+   while (bd < depth) {
+      b = save(pushroot(b)) ;
+      bd++ ;
+   }
+   root = save(overlay(root, b, depth)) ;
+   okaytogc = 0 ;
+   popValid = 0 ;
+   return 0 ;
+}
+/*
+ *   The tree of depth d for the sorted cells:  the leaves first, each
+ *   from a run of cells sharing all but the low bits of their keys that
+ *   place them in a leaf, then the nodes over those.  Where a cell is
+ *   given twice the later one wins, as the sort is stable.
+ */
+ghnode *ghashbase::buildcells(const vector<mortoncell> &cells, int d) {
+   int lb = 2 * (leafdepth + 1), s = 2 << leafdepth ;
+   leaflist leaves ;
+   for (size_t i=0; i<cells.size(); ) {
+      unsigned long long at = cells[i].key >> lb ;
+      state g[64] ;
+      memset(g, 0, sizeof(g)) ;
+      for (; i<cells.size() && (cells[i].key >> lb) == at; i++) {
+         int x = 0, y = 0 ;
+         for (int b=0; b<lb/2; b++) {
+            x |= (int)((cells[i].key >> (2 * b)) & 1) << b ;
+            y |= (int)((cells[i].key >> (2 * b + 1)) & 1) << b ;
+         }
+         g[y * s + x] = (state)cells[i].state ;
+      }
+      leaves.push_back(std::make_pair(at, (ghnode *)find_ghleaf(g, s))) ;
+   }
+   return buildnodes(leaves, 0, leaves.size(), d) ;
+}
+/*
+ *   The ghnode of depth d over the leaves from lo up to hi.
+ */
+ghnode *ghashbase::buildnodes(const leaflist &leaves, size_t lo, size_t hi,
+                              int d) {
+   if (lo == hi)
+      return zeroghnode(d) ;
+   if (d == leafdepth)
+      return leaves[lo].second ;
+   int sp = gsp ;
+   ghnode *q[4] ;
+   size_t at = lo ;
+   int sh = 2 * (d - leafdepth - 1) ;
+   for (int i=0; i<4; i++) {
+      size_t end = at ;
+      while (end < hi && (int)((leaves[end].first >> sh) & 3) == i)
+         end++ ;
+      q[i] = buildnodes(leaves, at, end, d-1) ;
+      at = end ;
+   }
+   ghnode *r = find_ghnode(q[0], q[1], q[2], q[3]) ;
+   pop(sp) ;
+   return save(r) ;
+}
+/*
+ *   Two trees of the same depth, with the live cells of b set over a.
+ */
+ghnode *ghashbase::overlay(ghnode *a, ghnode *b, int d) {
+   ghnode *z = zeroghnode(d) ;
+   if (b == z || a == b)
+      return a ;
+   if (a == z)
+      return b ;
+   if (d == leafdepth) {
+      int s = 2 << leafdepth ;
+      state ga[64], gb[64] ;
+      unpackleaf((ghleaf *)a, ga, s) ;
+      unpackleaf((ghleaf *)b, gb, s) ;
+      for (int i=0; i<s*s; i++)
+         if (gb[i])
+            ga[i] = gb[i] ;
+      return (ghnode *)find_ghleaf(ga, s) ;
+   }
+   int sp = gsp ;
+   ghnode *nw = overlay(a->nw, b->nw, d-1) ;
+   ghnode *ne = overlay(a->ne, b->ne, d-1) ;
+   ghnode *sw = overlay(a->sw, b->sw, d-1) ;
+   ghnode *se = overlay(a->se, b->se, d-1) ;
+   ghnode *r = find_ghnode(nw, ne, sw, se) ;
+   pop(sp) ;
+   return save(r) ;
+}
 /*
  *   Our nonrecurse top-level bit getting routine.
  */
@@ -1033,10 +1561,10 @@ ghnode *ghashbase::hashpattern(ghnode *root, int depth) {
    ghnode *r ;
    if (root == 0) {
       r = zeroghnode(depth) ;
-   } else if (depth == 0) {
-      ghleaf *n = (ghleaf *)root ;
-      r = (ghnode *)find_ghleaf(n->nw, n->ne, n->sw, n->se) ;
-      n->next = freeghnodes ;
+   } else if (depth == leafdepth) {
+      r = (ghnode *)find_ghleaf(((ghleaf *)root)->cells) ;
+      root->nw = 0 ;
+      root->res = freeghnodes ;
       freeghnodes = root ;
    } else {
       depth-- ;
@@ -1044,7 +1572,8 @@ ghnode *ghashbase::hashpattern(ghnode *root, int depth) {
                     hashpattern(root->ne, depth),
                     hashpattern(root->sw, depth),
                     hashpattern(root->se, depth)) ;
-      root->next = freeghnodes ;
+      root->nw = 0 ;
+      root->res = freeghnodes ;
       freeghnodes = root ;
    }
    return r ;
@@ -1069,7 +1598,7 @@ void ghashbase::ensure_hashed() {
  */
 ghnode *ghashbase::popzeros(ghnode *n) {
    int depth = ghnode_depth(n) ;
-   while (depth > 1) {
+   while (depth > leafdepth + 1) {
       ghnode *z = zeroghnode(depth-2) ;
       if (n->nw->nw == z && n->nw->ne == z && n->nw->sw == z &&
           n->ne->nw == z && n->ne->ne == z && n->ne->se == z &&
@@ -1086,133 +1615,73 @@ ghnode *ghashbase::popzeros(ghnode *n) {
 /*
  *   A lot of the routines from here on down traverse the universe, hanging
  *   information off the ghnodes.  The way they generally do so is by using
- *   (or abusing) the cache (res) field, and the least significant bit of
- *   the hash next field (as a visited bit).
- */
-#define marked(n) (1 & (g_uintptr_t)(n)->next)
-#define mark(n) ((n)->next = (ghnode *)(1 | (g_uintptr_t)(n)->next))
-#define clearmark(n) ((n)->next = (ghnode *)(~1 & (g_uintptr_t)(n)->next))
-#define clearmarkbit(p) ((ghnode *)(~1 & (g_uintptr_t)(p)))
-/*
- *   Sometimes we want to use *res* instead of next to mark.  You cannot
- *   do this to leaves, though.
- */
-#define marked2(n) (3 & (g_uintptr_t)(n)->res)
-#define mark2(n) ((n)->res = (ghnode *)(1 | (g_uintptr_t)(n)->res))
-#define mark2v(n, v) ((n)->res = (ghnode *)(v | (g_uintptr_t)(n)->res))
-#define clearmark2(n) ((n)->res = (ghnode *)(~3 & (g_uintptr_t)(n)->res))
-void ghashbase::unhash_ghnode(ghnode *n) {
-   ghnode *p ;
-   g_uintptr_t h = ghnode_hash(n->nw,n->ne,n->sw,n->se) ;
-   ghnode *pred = 0 ;
-   h = HASHMOD(h) ;
-   for (p=hashtab[h]; (!is_ghnode(p) || !marked2(p)) && p; p = p->next) {
-      if (p == n) {
-         if (pred)
-            pred->next = p->next ;
-         else
-            hashtab[h] = p->next ;
-         return ;
-      }
-      pred = p ;
-   }
-   lifefatal("Didn't find ghnode to unhash") ;
-}
-void ghashbase::unhash_ghnode2(ghnode *n) {
-   ghnode *p ;
-   g_uintptr_t h = ghnode_hash(n->nw,n->ne,n->sw,n->se) ;
-   ghnode *pred = 0 ;
-   h = HASHMOD(h) ;
-   for (p=hashtab[h]; p; p = p->next) {
-      if (p == n) {
-         if (pred)
-            pred->next = p->next ;
-         else
-            hashtab[h] = p->next ;
-         return ;
-      }
-      pred = p ;
-   }
-   lifefatal("Didn't find ghnode to unhash") ;
-}
-void ghashbase::rehash_ghnode(ghnode *n) {
-   g_uintptr_t h = ghnode_hash(n->nw,n->ne,n->sw,n->se) ;
-   h = HASHMOD(h) ;
-   n->next = hashtab[h] ;
-   hashtab[h] = n ;
-}
+ *   (or abusing) the cache (res) field.  The least significant bit of res
+ *   is our visited bit.  Leaves have no res field to spare, so the gc
+ *   (the only routine that needs to mark leaves) marks them by putting
+ *   LEAFMARK in the isghnode field; it clears these again as it rebuilds
+ *   the hash.
+ */
+#define LEAFMARK ((ghnode *)1)
+#define marked(n) (1 & (g_uintptr_t)(n)->res)
+#define mark(n) ((n)->res = (ghnode *)(1 | (g_uintptr_t)(n)->res))
+#define clearmark(n) ((n)->res = (ghnode *)(~1 & (g_uintptr_t)(n)->res))
+/*
+ *   When we count the universe we need to hang a number off each
+ *   ghnode we visit.  We set the next bit up in res, keep the number in
+ *   the rest of it, and stash the real res in savedres, indexed by that
+ *   same number.  You cannot do this to leaves, though.
+ */
+#define marked2(n) (2 & (g_uintptr_t)(n)->res)
+#define mark2(n,v) ((n)->res = (ghnode *)(((g_uintptr_t)(v) << 2) | 2))
+#define mark2val(n) ((g_uintptr_t)(n)->res >> 2)
 /*
  *   This recursive routine calculates the population by hanging the
- *   population on marked ghnodes.
+ *   population on marked nodes.  The populations live in savedpop,
+ *   which never moves an entry once it is there, so we can hand out
+ *   references to them.
  */
 const bigint &ghashbase::calcpop(ghnode *root, int depth) {
    if (root == zeroghnode(depth))
       return bigint::zero ;
-   if (depth == 0)
-      return ((ghleaf *)root)->leafpop ;
    if (marked2(root))
-      return *(bigint*)&(root->next) ;
+      return savedpop[mark2val(root)] ;
    depth-- ;
-   if (root->next == 0)
-      mark2v(root, 3) ;
-   else {
-      unhash_ghnode(root) ;
-      mark2(root) ;
-   }
-/**
- *   We use the memory in root->next as a value bigint.  But we want to
- *   make sure the copy constructor doesn't "clean up" something that
- *   doesn't exist.  So we clear it to zero here.
- */
-   new(&(root->next))bigint(
+   if (depth == leafdepth)
+      savedpop.emplace_back(leafpop(root->nw) + leafpop(root->ne) +
+                            leafpop(root->sw) + leafpop(root->se)) ;
+   else
+      savedpop.emplace_back(
         calcpop(root->nw, depth), calcpop(root->ne, depth),
         calcpop(root->sw, depth), calcpop(root->se, depth)) ;
-   return *(bigint *)&(root->next) ;
+   savedres.push_back(root->res) ;
+   mark2(root, savedpop.size() - 1) ;
+   return savedpop.back() ;
 }
 /*
- *   Call this after doing something that unhashes ghnodes in order to
- *   use the next field as a temp pointer.
+ *   Call this after calcpop to put the cache fields back.
  */
 void ghashbase::aftercalcpop2(ghnode *root, int depth) {
-   if (depth == 0 || root == zeroghnode(depth))
+   if (depth == leafdepth || root == zeroghnode(depth))
       return ;
-   int v = marked2(root) ;
-   if (v) {
-      clearmark2(root) ;
+   if (marked2(root)) {
+      root->res = savedres[mark2val(root)] ;
       depth-- ;
-      if (depth > 0) {
+      if (depth > leafdepth) {
          aftercalcpop2(root->nw, depth) ;
          aftercalcpop2(root->ne, depth) ;
          aftercalcpop2(root->sw, depth) ;
          aftercalcpop2(root->se, depth) ;
       }
-      ((bigint *)&(root->next))->~bigint() ;
-      if (v == 3)
-         root->next = 0 ;
-      else
-         rehash_ghnode(root) ;
    }
 }
 /*
- *   Call this after doing something that unhashes ghnodes in order to
- *   use the next field as a temp pointer.
+ *   Once everything has been put back we can let the side tables go.
  */
-void ghashbase::afterwritemc(ghnode *root, int depth) {
-   if (root == zeroghnode(depth))
-      return ;
-   if (depth == 0) {
-      root->nw = 0 ; // all these bigints are guaranteed to be small
-      return ;
-   }
-   if (marked2(root)) {
-      clearmark2(root) ;
-      depth-- ;
-      afterwritemc(root->nw, depth) ;
-      afterwritemc(root->ne, depth) ;
-      afterwritemc(root->sw, depth) ;
-      afterwritemc(root->se, depth) ;
-      rehash_ghnode(root) ;
-   }
+void ghashbase::clearsaved() {
+   savedres.clear() ;
+   savedres.shrink_to_fit() ;
+   savedpop.clear() ;
+   savedpop.shrink_to_fit() ;
 }
 /*
  *   This top level routine calculates the population of a universe.
@@ -1223,6 +1692,7 @@ void ghashbase::calcPopulation() {
    depth = ghnode_depth(root) ;
    population = calcpop(root, depth) ;
    aftercalcpop2(root, depth) ;
+   clearsaved() ;
 }
 /*
  *   Is the universe empty?
@@ -1259,37 +1729,61 @@ void ghashbase::clearstack() {
    gsp = 0 ;
 }
 /*
- *   Do a gc.  Walk down from all ghnodes reachable on the stack, saveing
- *   them by setting the odd bit on the next link.  Then, walk the hash,
- *   eliminating the res from everything that's not saveed, and moving
- *   the ghnodes from the hash to the freelist as appropriate.  Finally,
- *   walk the hash again, clearing the low order bits in the next pointers.
+ *   Do a gc.  Walk down from all ghnodes reachable on the stack, saving
+ *   them by marking them and adding them to liveghnodes.  We keep our
+ *   own stack of ghnodes still to be visited rather than recursing, so
+ *   the depth of the universe and the length of any chain of results do
+ *   not matter.  If we are invalidating, we eliminate the res from
+ *   everything we mark.
  */
 void ghashbase::gc_mark(ghnode *root, int invalidate) {
-   if (!marked(root)) {
-      mark(root) ;
-      if (is_ghnode(root)) {
-         gc_mark(root->nw, invalidate) ;
-         gc_mark(root->ne, invalidate) ;
-         gc_mark(root->sw, invalidate) ;
-         gc_mark(root->se, invalidate) ;
-         if (root->res) {
+   markstack.push_back(root) ;
+   while (!markstack.empty()) {
+      ghnode *n = markstack.back() ;
+      markstack.pop_back() ;
+      if (!is_ghnode(n)) {
+         ((ghleaf *)n)->isghnode = LEAFMARK ;
+         liveghnodes.push_back(n) ;
+      } else if (n->nw != LEAFMARK && !marked(n)) {
+         ghnode *r = n->res ;
+         mark(n) ;
+         liveghnodes.push_back(n) ;
+         if (r) {
             if (invalidate)
-              root->res = 0 ;
+              n->res = (ghnode *)1 ; /* cleared, but still marked */
             else
-              gc_mark(root->res, invalidate) ;
+              markstack.push_back(r) ;
          }
+         markstack.push_back(n->se) ;
+         markstack.push_back(n->sw) ;
+         markstack.push_back(n->ne) ;
+         markstack.push_back(n->nw) ;
       }
    }
 }
-/**
- *   If the invalidate flag is set, we want to kill *all* cache entries
- *   and recalculate all leaves.
+/*
+ *   Then we put the live ghnodes and leaves back into a freshly cleared
+ *   hash, clearing their marks as we go.  Usually most of the ghnodes
+ *   are dead, and we do not touch those at all while the gc holds things
+ *   up; instead we sort the live ghnodes and the ghnode blocks by
+ *   address, and sweep the blocks lazily, one at a time as the free list
+ *   runs dry, freeing every ghnode in a block that is not next in
+ *   liveghnodes.
+ *
+ *   Before that, we also keep ghnodes that some lookup has found since
+ *   the last gc, along with everything they point to (their results, in
+ *   particular), as long as no more than maxhotfraction of all ghnodes
+ *   survive.  We only do this once a single step has needed more than
+ *   two gcs, which is when we are thrashing; otherwise the extra ghnodes
+ *   just make the hash fuller.  We spread the budget over the whole
+ *   table so the kept ghnodes do not all pile up in one end of it.
  */
+double ghashbase::maxhotfraction = 0.5 ;
 void ghashbase::do_gc(int invalidate) {
    int i ;
    g_uintptr_t freed_ghnodes=0 ;
-   ghnode *p, *pp ;
+   std::chrono::steady_clock::time_point gcstart =
+                                          std::chrono::steady_clock::now() ;
    inGC = 1 ;
    gccount++ ;
    gcstep++ ;
@@ -1300,6 +1794,7 @@ void ghashbase::do_gc(int invalidate) {
        sprintf(statusline, "GC #%d", gccount) ;
      lifestatus(statusline) ;
    }
+   liveghnodes.clear() ;
    for (i=nzeros-1; i>=0; i--)
       if (zeroghnodea[i] != 0)
          break ;
@@ -1313,35 +1808,65 @@ void ghashbase::do_gc(int invalidate) {
    }
    for (i=0; i<timeline.framecount; i++)
       gc_mark((ghnode *)timeline.frames[i], invalidate) ;
-   hashpop = 0 ;
+   // ghnodes are about to be freed, and their addresses used again
+   cellhashes.clear() ;
+   if (!invalidate && gcstep > 2) {
+      g_uintptr_t keep = (g_uintptr_t)(maxhotfraction * totalthings) ;
+      double perslot = (double)keep / hashprime ;
+      for (g_uintptr_t j=0; j<hashprime; j++) {
+         if ((j & 65535) == 0)
+            poller->poll() ;
+         if (referenced(hashtab[j]) && liveghnodes.size() < perslot * j)
+            gc_mark(slotnode(hashtab[j]), 0) ;
+      }
+      for (g_uintptr_t j=oldhashnext; j<oldhashprime; j++) {
+         if ((j & 65535) == 0)
+            poller->poll() ;
+         if (referenced(oldhashtab[j]) && liveghnodes.size() < keep)
+            gc_mark(slotnode(oldhashtab[j]), 0) ;
+      }
+   }
+   dropoldhash() ;
+   g_uintptr_t oldpop = hashpop ;
    memset(hashtab, 0, sizeof(ghnode *) * hashprime) ;
    freeghnodes = 0 ;
-   for (p=ghnodeblocks; p; p=p->next) {
-      poller->poll() ;
-      for (pp=p+1, i=1; i<1001; i++, pp++) {
-         if (marked(pp)) {
-            g_uintptr_t h = 0 ;
-            if (pp->nw) { /* yes, it's a ghnode */
-               h = HASHMOD(ghnode_hash(pp->nw, pp->ne, pp->sw, pp->se)) ;
-            } else {
-               ghleaf *lp = (ghleaf *)pp ;
-               h = HASHMOD(ghleaf_hash(lp->nw, lp->ne, lp->sw, lp->se)) ;
-            }
-            pp->next = hashtab[h] ;
-            hashtab[h] = pp ;
-            hashpop++ ;
-         } else {
-            pp->next = freeghnodes ;
-            freeghnodes = pp ;
-            freed_ghnodes++ ;
-         }
+   for (size_t k=0; k<liveghnodes.size(); k++) {
+      ghnode *pp = liveghnodes[k] ;
+      if ((k & 4095) == 0)
+         poller->poll() ;
+      if (pp->nw == LEAFMARK) {
+         ghleaf *lp = (ghleaf *)pp ;
+         lp->isghnode = 0 ;
+         hashinsert(pp, ghleaf_hash(lp->cells)) ;
+      } else {
+         clearmark(pp) ;
+         hashinsert(pp, ghnode_hash(pp->nw, pp->ne, pp->sw, pp->se)) ;
       }
    }
+   hashpop = liveghnodes.size() ;
+   lastgcfreed = oldpop > hashpop ? 1 - (double)hashpop / oldpop : 0 ;
+   freed_ghnodes = totalthings - hashpop ;
+   std::sort(liveghnodes.begin(), liveghnodes.end()) ;
+   sweepblocks.clear() ;
+   for (ghnode *p=ghnodeblocks; p; p=p->res)
+      sweepblocks.push_back(p) ;
+   std::sort(sweepblocks.begin(), sweepblocks.end()) ;
+   sweepnext = 0 ;
+   livenext = 0 ;
+   // sweep enough for whoever called us to get a ghnode
+   sweep() ;
    inGC = 0 ;
+   double pause = std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - gcstart).count() ;
+   if (pause > maxgcpause)
+      maxgcpause = pause ;
+   lastgcpause = pause ;
+   totalgcpause += pause ;
    if (verbose) {
      double perc = (double)freed_ghnodes / (double)totalthings * 100.0 ;
-     sprintf(statusline+strlen(statusline), " freed %g percent (%" PRIuPTR ").",
-                                                  perc, freed_ghnodes) ;
+     sprintf(statusline+strlen(statusline),
+             " freed %g percent (%" PRIuPTR ") in %.1f ms (max %.1f ms).",
+             perc, freed_ghnodes, pause, maxgcpause) ;
      lifestatus(statusline) ;
    }
    if (needPop) {
@@ -1351,25 +1876,44 @@ void ghashbase::do_gc(int invalidate) {
       poller->updatePop() ;
    }
 }
+/*
+ *   Sweep ghnode blocks onto the free list until we have found some free
+ *   ghnodes.
+ */
+void ghashbase::sweep() {
+   while (sweepnext < sweepblocks.size() && freeghnodes == 0) {
+      ghnode *pp = sweepblocks[sweepnext++] + 1 ;
+      for (int i=1; i<1001; i++, pp++) {
+         if (livenext < liveghnodes.size() && liveghnodes[livenext] == pp) {
+            livenext++ ;
+         } else {
+            pp->nw = 0 ;
+            pp->res = freeghnodes ;
+            freeghnodes = pp ;
+         }
+      }
+   }
+}
 /*
  *   Clear the cache bits down to the appropriate level, marking the
  *   ghnodes we've handled.
  */
 void ghashbase::clearcache(ghnode *n, int depth, int clearto) {
    if (!marked(n)) {
+      ghnode *r = n->res ;
       mark(n) ;
-      if (depth > 1) {
+      if (depth > leafdepth + 1) {
          depth-- ;
          poller->poll() ;
          clearcache(n->nw, depth, clearto) ;
          clearcache(n->ne, depth, clearto) ;
          clearcache(n->sw, depth, clearto) ;
          clearcache(n->se, depth, clearto) ;
-         if (n->res)
-            clearcache(n->res, depth, clearto) ;
+         if (r)
+            clearcache(r, depth, clearto) ;
       }
       if (depth >= clearto)
-         n->res = 0 ;
+         n->res = (ghnode *)1 ; /* cleared, but still marked */
    }
 }
 /*
@@ -1378,6 +1922,7 @@ void ghashbase::clearcache(ghnode *n, int depth, int clearto) {
 void ghashbase::clearcache_p1(ghnode *n, int depth, int clearto) {
    if (depth < clearto || marked(n))
       return ;
+   ghnode *r = n->res ;
    mark(n) ;
    if (depth > clearto) {
       depth-- ;
@@ -1386,8 +1931,8 @@ void ghashbase::clearcache_p1(ghnode *n, int depth, int clearto) {
       clearcache_p1(n->ne, depth, clearto) ;
       clearcache_p1(n->sw, depth, clearto) ;
       clearcache_p1(n->se, depth, clearto) ;
-      if (n->res)
-         clearcache_p1(n->res, depth, clearto) ;
+      if (r)
+         clearcache_p1(r, depth, clearto) ;
    }
 }
 /*
@@ -1430,9 +1975,11 @@ void ghashbase::new_ngens(int newval) {
       ngens = newval ;
       return ;
    }
+   invalidations++ ;
 #ifndef NOGCBEFOREINC
    do_gc(0) ;
 #endif
+   finishresize() ;
    if (verbose) {
      strcpy(statusline, "Changing increment...") ;
      lifestatus(statusline) ;
@@ -1440,18 +1987,20 @@ void ghashbase::new_ngens(int newval) {
    if (newval < clearto)
       clearto = newval ;
    clearto++ ; /* clear this depth and above */
-   if (clearto < 1)
-      clearto = 1 ;
+   if (clearto < leafdepth + 1)
+      clearto = leafdepth + 1 ;
    ngens = newval ;
    inGC = 1 ;
-   for (i=0; i<hashprime; i++)
-      for (p=hashtab[i]; p; p=clearmarkbit(p->next))
-         if (is_ghnode(p) && !marked(p))
-            clearcache(p, ghnode_depth(p), clearto) ;
-   for (p=ghnodeblocks; p; p=p->next) {
+   for (i=0; i<hashprime; i++) {
+      p = slotnode(hashtab[i]) ;
+      if (p && is_ghnode(p) && !marked(p))
+         clearcache(p, ghnode_depth(p), clearto) ;
+   }
+   for (p=ghnodeblocks; p; p=p->res) {
       poller->poll() ;
       for (pp=p+1, i=1; i<1001; i++, pp++)
-         clearmark(pp) ;
+         if (pp->nw)
+            clearmark(pp) ;
    }
    halvesdone = 0 ;
    inGC = 0 ;
@@ -1466,6 +2015,45 @@ void ghashbase::new_ngens(int newval) {
      lifestatus(statusline) ;
    }
 }
+/*
+ *   Statistics for tuning the memory limit and the step size.  Sizing
+ *   the nodes means finding the depth of everything in the hash, as
+ *   new_ngens does, so with a big hash this takes a little while.
+ */
+int ghashbase::getstats(lifestats &s) {
+   s.clear() ;
+   s.lookups = (double)counts.lookups ;
+   s.hits = (double)counts.hits ;
+   s.probes = (double)counts.probes ;
+   s.hashsize = (double)hashprime ;
+   s.hashpop = (double)hashpop ;
+   s.bytesused = (double)alloced ;
+   s.maxmem = (double)maxmem ;
+   s.gccount = gccount ;
+   s.gcpausetotal = totalgcpause ;
+   s.gcpausemax = maxgcpause ;
+   s.gcpauselast = lastgcpause ;
+   s.invalidations = invalidations ;
+   s.nodescalculated = running_hperf.nodesCalculated +
+                       running_hperf.fastNodeInc ;
+   // a resize may not have moved everything yet
+   for (int t=0; t<2; t++) {
+      ghnode **tab = t ? oldhashtab : hashtab ;
+      g_uintptr_t i = t ? oldhashnext : 0, n = t ? oldhashprime : hashprime ;
+      for (; tab && i<n; i++) {
+         ghnode *p = slotnode(tab[i]) ;
+         if (p == 0)
+            continue ;
+         if (!is_ghnode(p))
+            s.leaves++ ;
+         size_t k = ghnode_depth(p) + 1 ;
+         if (s.nodesbysize.size() <= k)
+            s.nodesbysize.resize(k + 1, 0) ;
+         s.nodesbysize[k]++ ;
+      }
+   }
+   return 1 ;
+}
 /*
  *   Return log2.
  */
@@ -1513,10 +2101,15 @@ ghnode *ghashbase::runpattern() {
    okaytogc = 1 ;
    if (cacheinvalid) {
       do_gc(1) ; // invalidate the entire cache and recalc leaves
+      blockcache.assign(1 << BLOCKCACHEBITS, blockresult()) ;
       cacheinvalid = 0 ;
    }
+   int grid = nativegrid() ;
+   if (grid == PLANEGRID)
+      return runplane(n) ;
+   if (grid == TORUSGRID)
+      return runtorus(n) ;
    int depth = ghnode_depth(n) ;
-   ghnode *n2 ;
    n = pushroot(n) ;
    depth++ ;
    n = pushroot(n) ;
@@ -1527,7 +2120,7 @@ ghnode *ghashbase::runpattern() {
    }
    save(zeroghnode(nzeros-1)) ;
    save(n) ;
-   n2 = getres(n, depth) ;
+   ghnode *n2 = getres(n, depth) ;
    okaytogc = 0 ;
    clearstack() ;
    if (halvesdone == 1 && n->res != 0) {
@@ -1540,11 +2133,256 @@ ghnode *ghashbase::runpattern() {
    generation += pow2step ;
    return n ;
 }
+/*
+ *   A torus is stepped as a tiling of the grid, cut back down after,
+ *   in as many full steps of 2^ngens as make pow2step; see hlifealgo.
+ *   What wrapgrid and unwrapgrid build is not on the stack until they
+ *   return (nor is the result they cut the grid from), so there must
+ *   be no gc while they run.
+ */
+ghnode *ghashbase::runtorus(ghnode *n) {
+   bigint passes = pow2step ;
+   passes >>= ngens ;
+   save(zeroghnode(nzeros-1)) ;
+   int sp = gsp ;
+   for (; passes > 0; passes -= bigint::one) {
+      wrapinfo w ;
+      int depth = ghnode_depth(n) ;
+      okaytogc = 0 ;
+      ghnode *t = save(wrapgrid(w, n, depth)) ;
+      okaytogc = 1 ;
+      ghnode *t2 = getres(t, depth) ;
+      if (halvesdone == 1 && t->res != 0) {
+         t->res = 0 ;
+         halvesdone = 0 ;
+      }
+      if (poller->isInterrupted())
+         break ;
+      okaytogc = 0 ;
+      n = unwrapgrid(w, t2, depth-1) ;
+      okaytogc = 1 ;
+      pop(sp) ;
+      save(n) ;
+   }
+   okaytogc = 0 ;
+   clearstack() ;
+   if (poller->isInterrupted())
+      return 0 ; // indicate it was interrupted
+   generation += pow2step ;
+   return n ;
+}
+/*
+ *   A bounded plane has to be cleared outside the grid after every
+ *   generation, so ngens is held at zero and we run pow2step one
+ *   generation at a time; see hlifealgo.  As with a torus, there is no
+ *   gc while gridclip works on a result that is not on the stack.
+ */
+ghnode *ghashbase::runplane(ghnode *n) {
+   int d = griddepth() ;
+   long long x = -(gridleft.toint() + ((long long)1 << d)) ;
+   long long y = -(gridtop.toint() + ((long long)1 << d) - 1) ;
+   n = save(gridpattern(n, d)) ;
+   save(zeroghnode(nzeros-1)) ;
+   int sp = gsp ;
+   for (bigint g = pow2step; g > 0; g -= bigint::one) {
+      ghnode *p = save(pushroot(n)) ;
+      ghnode *p2 = getres(p, d+1) ;
+      if (halvesdone == 1 && p->res != 0) {
+         p->res = 0 ;
+         halvesdone = 0 ;
+      }
+      if (poller->isInterrupted())
+         break ;
+      okaytogc = 0 ;
+      n = gridclip(p2, d, x, y) ;
+      okaytogc = 1 ;
+      pop(sp) ;
+      save(n) ;
+   }
+   okaytogc = 0 ;
+   clearstack() ;
+   if (poller->isInterrupted())
+      return 0 ; // indicate it was interrupted
+   n = popzeros(n) ;
+   generation += pow2step ;
+   return n ;
+}
+/*
+ *   The depth of the smallest root that holds the whole grid.
+ */
+int ghashbase::griddepth() {
+   long long l = gridleft.toint(), r = gridright.toint() ;
+   long long t = gridtop.toint(), b = gridbottom.toint() ;
+   int d = leafdepth + 1 ;
+   while (l < -((long long)1 << d) || r >= ((long long)1 << d) ||
+          t < 1 - ((long long)1 << d) || b > ((long long)1 << d))
+      d++ ;
+   return d ;
+}
+/*
+ *   The most ngens can be for the grid we step: zero for a bounded
+ *   plane, and one less than the grid's depth for a torus whose sides
+ *   are not powers of two; see hlifealgo.
+ */
+int ghashbase::gridngens() {
+   if (stepgrid == PLANEGRID)
+      return 0 ;
+   if (stepgrid == TORUSGRID &&
+       ((gridwd & (gridwd - 1)) != 0 || (gridht & (gridht - 1)) != 0))
+      return griddepth() - 1 ;
+   return 1000000000 ;
+}
+/*
+ *   Root n grown or cut down to depth d, keeping its centre.
+ */
+ghnode *ghashbase::gridpattern(ghnode *n, int d) {
+   int nd = ghnode_depth(n) ;
+   for (; nd < d; nd++)
+      n = pushroot(n) ;
+   for (; nd > d; nd--)
+      n = find_ghnode(n->nw->se, n->ne->sw, n->sw->ne, n->se->nw) ;
+   return n ;
+}
+/*
+ *   Tile the grid part of root n across a root deep enough for ngens and
+ *   for the result to hold the whole grid.  A grid whose sides are
+ *   powers of two lines up with the pattern's nodes, and then with the
+ *   result's, if the tiling starts where the pattern's square does, so
+ *   that only the seams need new nodes.  Any other grid is shifted
+ *   anyway, so there we start the tiling where the grid's corner lands
+ *   on the result's, which needs the smallest root.
+ */
+ghnode *ghashbase::wrapgrid(wrapinfo &w, ghnode *n, int &depth) {
+   w.patdepth = griddepth() ;
+   w.pat = save(gridpattern(n, w.patdepth)) ;
+   w.wd = gridwd ;
+   w.ht = gridht ;
+   w.left = gridleft.toint() + ((long long)1 << w.patdepth) ;
+   w.top = gridtop.toint() + ((long long)1 << w.patdepth) - 1 ;
+   int aligned = (w.wd & (w.wd - 1)) == 0 && (w.ht & (w.ht - 1)) == 0 ;
+   depth = w.patdepth + 1 ;
+   if (depth < ngens + 2)
+      depth = ngens + 2 ;
+   for (;;) {
+      w.hx.resize(depth + 1) ;
+      w.hy.resize(depth + 1) ;
+      w.hx[0] = 1 % w.wd ;
+      w.hy[0] = 1 % w.ht ;
+      for (int i=1; i<=depth; i++) {
+         w.hx[i] = 2 * w.hx[i-1] % w.wd ;
+         w.hy[i] = 2 * w.hy[i-1] % w.ht ;
+      }
+      if (aligned) {
+         w.u = (w.wd - w.left % w.wd) % w.wd ;
+         w.v = (w.ht - w.top % w.ht) % w.ht ;
+      } else {
+         w.u = (w.wd - w.hx[depth-1]) % w.wd ;
+         w.v = (w.ht - w.hy[depth-1]) % w.ht ;
+      }
+      // where the grid's corner falls in the result
+      w.gx = (2 * w.wd - w.u - w.hx[depth-1]) % w.wd ;
+      w.gy = (2 * w.ht - w.v - w.hy[depth-1]) % w.ht ;
+      if (depth > 40 || (w.gx + w.wd <= ((long long)1 << depth) &&
+                         w.gy + w.ht <= ((long long)1 << depth)))
+         break ;
+      depth++ ;
+   }
+   zeroghnode(depth+1) ; // ensure zeros are deep enough
+   return wrapped(w, w.u, w.v, depth) ;
+}
+/*
+ *   The square of the tiling at depth d whose top left corner is cell
+ *   (u,v) of the grid.
+ */
+ghnode *ghashbase::wrapped(wrapinfo &w, long long u, long long v, int d) {
+   if (d < 31 && u + ((long long)2 << d) <= w.wd &&
+       v + ((long long)2 << d) <= w.ht)
+      return window(w.pat, w.patdepth, w.left + u, w.top + v, d, w.windows) ;
+   if (d == leafdepth) {
+      int s = 2 << leafdepth ;
+      state g[64] ;
+      for (int j=0; j<s; j++)
+         for (int i=0; i<s; i++)
+            g[j * s + i] = cellat(w.pat, w.patdepth,
+                                  w.left + (u + i) % w.wd,
+                                  w.top + (v + j) % w.ht) ;
+      return (ghnode *)find_ghleaf(g, s) ;
+   }
+   std::tuple<long long, long long, int> key(u, v, d) ;
+   std::map<std::tuple<long long, long long, int>, ghnode *>::iterator it =
+      w.memo.find(key) ;
+   if (it != w.memo.end())
+      return it->second ;
+   long long u2 = (u + w.hx[d]) % w.wd ;
+   long long v2 = (v + w.hy[d]) % w.ht ;
+   ghnode *r = find_ghnode(wrapped(w, u, v, d-1), wrapped(w, u2, v, d-1),
+                           wrapped(w, u, v2, d-1), wrapped(w, u2, v2, d-1)) ;
+   w.memo[key] = r ;
+   return r ;
+}
+/*
+ *   Cut the grid back out of n, the result (at depth d) of stepping a
+ *   tiling, into a pattern like the one we started from.
+ */
+ghnode *ghashbase::unwrapgrid(wrapinfo &w, ghnode *n, int d) {
+   long long x = w.gx - w.left ;
+   long long y = w.gy - w.top ;
+   for (; d > w.patdepth + 1; d--)
+      n = n->nw ;
+   windowmemo memo ;
+   n = window(n, d, x, y, w.patdepth, memo) ;
+   return popzeros(gridclip(n, w.patdepth, -w.left, -w.top)) ;
+}
+/*
+ *   Clear the cells of n (at depth d, its top left corner x across and
+ *   y down from the grid's) that fall outside the grid.
+ */
+ghnode *ghashbase::gridclip(ghnode *n, int d, long long x, long long y) {
+   long long s = (long long)2 << d ;
+   long long wd = gridwd, ht = gridht ;
+   if (n == zeroghnode(d) || x >= wd || y >= ht || x + s <= 0 || y + s <= 0)
+      return zeroghnode(d) ;
+   if (x >= 0 && y >= 0 && x + s <= wd && y + s <= ht)
+      return n ;
+   if (d == leafdepth) {
+      state g[64] ;
+      unpackleaf((ghleaf *)n, g, (int)s) ;
+      for (int j=0; j<s; j++)
+         for (int i=0; i<s; i++)
+            if (x + i < 0 || x + i >= wd || y + j < 0 || y + j >= ht)
+               g[j * s + i] = 0 ;
+      return (ghnode *)find_ghleaf(g, (int)s) ;
+   }
+   long long h = s >> 1 ;
+   return find_ghnode(gridclip(n->nw, d-1, x, y),
+                      gridclip(n->ne, d-1, x+h, y),
+                      gridclip(n->sw, d-1, x, y+h),
+                      gridclip(n->se, d-1, x+h, y+h)) ;
+}
+/*
+ *   Clear everything outside a grid we step ourselves; setrule has
+ *   already put those cells in clipped_cells.
+ */
+void ghashbase::cliptogrid() {
+   ensure_hashed() ;
+   int sp = gsp ;
+   int d = griddepth() ;
+   long long x = -(gridleft.toint() + ((long long)1 << d)) ;
+   long long y = -(gridtop.toint() + ((long long)1 << d) - 1) ;
+   root = popzeros(gridclip(gridpattern(root, d), d, x, y)) ;
+   depth = ghnode_depth(root) ;
+   popValid = 0 ;
+   pop(sp) ;
+}
 const char *ghashbase::readmacrocell(char *line) {
    int n=0 ;
-   g_uintptr_t i=1, nw=0, ne=0, sw=0, se=0, indlen=0 ;
+   g_uintptr_t i=1, nw=0, ne=0, sw=0, se=0, indlen=0, last=0 ;
    int r, d ;
    ghnode **ind = 0 ;
+   // the cells of squares smaller than a leaf, each after its depth,
+   // and where (plus one) each numbered square's start
+   std::vector<state> sub ;
+   std::vector<g_uintptr_t> subat ;
    root = 0 ;
    while (getline(line, 10000)) {
       if (i >= indlen) {
@@ -1554,6 +2392,7 @@ const char *ghashbase::readmacrocell(char *line) {
            lifefatal("Out of memory (4).") ;
          while (indlen < nlen)
             ind[indlen++] = 0 ;
+         subat.resize(indlen, 0) ;
       }
       if (line[0] == '#') {
          char *p, *pp ;
@@ -1639,7 +2478,7 @@ const char *ghashbase::readmacrocell(char *line) {
 	       if (n != 2 || frameind > MAX_FRAME_COUNT || frameind < 0 ||
 		   nodeind > i || timeline.framecount != frameind)
 		  return "Bad FRAME line" ;
-	       timeline.frames.push_back(ind[nodeind]) ;
+	       timeline.frames.push_back(mcroot(ind, sub, subat, nodeind)) ;
 	       timeline.framecount++ ;
 	       timeline.end = timeline.next ;
 	       timeline.next += timeline.inc ;
@@ -1670,9 +2509,36 @@ const char *ghashbase::readmacrocell(char *line) {
            if (nw >= (g_uintptr_t)maxCellStates || ne >= (g_uintptr_t)maxCellStates ||
                sw >= (g_uintptr_t)maxCellStates || se >= (g_uintptr_t)maxCellStates)
               return "Cell state values too high for this algorithm." ;
-           root = ind[i++] = (ghnode *)find_ghleaf((state)nw, (state)ne,
-                                                   (state)sw, (state)se) ;
-           depth = d - 1 ;
+         }
+         last = i ;
+         if (d <= leafdepth + 1) {
+           // a leaf, or smaller:  put the cells together
+           int h = 1 << (d - 1) ;
+           g_uintptr_t q[4] = { nw, ne, sw, se } ;
+           state g[64] ;
+           for (int k=0; k<4; k++) {
+              state *gq = g + (k >> 1) * 2 * h * h + (k & 1) * h ;
+              if (d == 1) {
+                 gq[0] = (state)q[k] ;
+              } else if (q[k] == 0) {
+                 for (int y=0; y<h; y++)
+                    memset(gq + y * 2 * h, 0, h) ;
+              } else {
+                 if (q[k] >= i || subat[q[k]] == 0 ||
+                     sub[subat[q[k]] - 1] != d - 1)
+                    return "Node out of range in readmacrocell." ;
+                 const state *c = &sub[subat[q[k]]] ;
+                 for (int y=0; y<h; y++)
+                    memcpy(gq + y * 2 * h, c + y * h, h) ;
+              }
+           }
+           if (d == leafdepth + 1) {
+              root = ind[i++] = (ghnode *)find_ghleaf(g, 2 * h) ;
+           } else {
+              subat[i++] = sub.size() + 1 ;
+              sub.push_back((state)d) ;
+              sub.insert(sub.end(), g, g + 4 * h * h) ;
+           }
          } else {
            ind[0] = zeroghnode(d-2) ; /* allow zeros to work right */
            if (nw >= i || ind[nw] == 0 || ne >= i || ind[ne] == 0 ||
@@ -1685,6 +2551,9 @@ const char *ghashbase::readmacrocell(char *line) {
          }
       }
    }
+   root = last ? mcroot(ind, sub, subat, last) : 0 ;
+   if (root)
+      depth = ghnode_depth(root) ;
    if (ind)
       free(ind) ;
    if (root == 0) {
@@ -1696,126 +2565,234 @@ const char *ghashbase::readmacrocell(char *line) {
    hashed = 1 ;
    return 0 ;
 }
+/*
+ *   The root for square k of a macrocell file:  one smaller than a root
+ *   can be is centred in one of the smallest.
+ */
+ghnode *ghashbase::mcroot(ghnode **ind, const std::vector<state> &sub,
+                          const std::vector<g_uintptr_t> &subat,
+                          g_uintptr_t k) {
+   ghnode *n = ind[k] ;
+   if (n && is_ghnode(n))
+      return n ;
+   int nd = leafdepth + 1, s = 2 << nd ;
+   if (n == 0 && subat[k] == 0)
+      return zeroghnode(nd) ;
+   state g[16 * 16] ;
+   memset(g, 0, sizeof(g)) ;
+   if (n) {
+      int o = (1 << nd) - (1 << leafdepth) ;
+      unpackleaf((ghleaf *)n, g + o * s + o, s) ;
+   } else {
+      const state *c = &sub[subat[k]] ;
+      int side = 1 << c[-1], o = (1 << nd) - side / 2 ;
+      for (int y=0; y<side; y++)
+         memcpy(g + (o + y) * s + o, c + y * side, side) ;
+   }
+   return gridnode(g, s, nd) ;
+}
 const char *ghashbase::setrule(const char *) {
    poller->bailIfCalculating() ;
    clearcache() ;
+   checkleafbits() ;
+   // a plain torus or bounded plane we step ourselves
+   unbounded = (nativegrid() == BORDERGRID) ;
+   if (!unbounded) {
+      clipcells() ;
+      cliptogrid() ;
+   }
    return 0 ;
 }
-/**
- *   Write out the native macrocell format.  This is the one we use when
- *   we're not interactive and displaying a progress dialog.
+/*
+ *   Leaves need 2 bits a cell for up to 4 states, 4 for up to 16, and 8
+ *   for more.  If the rule has changed that, we re-encode the universe
+ *   (and any timeline) to suit.
  */
-g_uintptr_t ghashbase::writecell(std::ostream &os, ghnode *root, int depth) {
-   g_uintptr_t thiscell = 0 ;
-   if (root == zeroghnode(depth))
-      return 0 ;
-   if (depth == 0) {
-      if (root->nw != 0)
-         return (g_uintptr_t)(root->nw) ;
-   } else {
-      if (marked2(root))
-         return (g_uintptr_t)(root->next) ;
-      unhash_ghnode2(root) ;
-      mark2(root) ;
-   }
-   thiscell = ++cellcounter ;
-   if (depth == 0) {
-      ghleaf *n = (ghleaf *)root ;
-      root->nw = (ghnode *)thiscell ;
-      os << 1 << ' ' << int(n->nw) << ' ' << int(n->ne)
-              << ' ' << int(n->sw) << ' ' << int(n->se) << '\n' ;
-   } else {
-      g_uintptr_t nw = writecell(os, root->nw, depth-1) ;
-      g_uintptr_t ne = writecell(os, root->ne, depth-1) ;
-      g_uintptr_t sw = writecell(os, root->sw, depth-1) ;
-      g_uintptr_t se = writecell(os, root->se, depth-1) ;
-      root->next = (ghnode *)thiscell ;
-      os << depth+1 << ' ' << nw << ' ' << ne
-                    << ' ' << sw << ' ' << se << '\n' ;
+void ghashbase::checkleafbits() {
+   int bits = maxCellStates <= 4 ? 2 : maxCellStates <= 16 ? 4 : 8 ;
+   if (bits != leafbits)
+      repack(bits) ;
+}
+/*
+ *   The cells of a tree whose leaves have bits a cell and are at depth
+ *   ld, copied into g.
+ */
+static void gathercells(ghnode *n, int d, int bits, int ld, state *g,
+                        int pitch) {
+   if (d == ld) {
+      unpackcells(((ghleaf *)n)->cells, bits, 2 << ld, g, pitch) ;
+      return ;
    }
-   return thiscell ;
+   int h = 1 << d ;
+   gathercells(n->nw, d-1, bits, ld, g, pitch) ;
+   gathercells(n->ne, d-1, bits, ld, g + h, pitch) ;
+   gathercells(n->sw, d-1, bits, ld, g + h * pitch, pitch) ;
+   gathercells(n->se, d-1, bits, ld, g + h * pitch + h, pitch) ;
 }
-/**
- *   This new two-pass method works by doing a prepass that numbers the
- *   ghnodes and counts the number of ghnodes that should be sent, so we can
- *   display an accurate progress dialog.
+/*
+ *   Nothing is rehashed:  a leaf means whatever the current encoding
+ *   says it does, and the old tree is only read the old way while we
+ *   build the new one, with gc held off.  A state too big for the new
+ *   leaves becomes the biggest that fits, so that whoever changed the
+ *   rule can still find it and bring it into range.
  */
-g_uintptr_t ghashbase::writecell_2p1(ghnode *root, int depth) {
-   g_uintptr_t thiscell = 0 ;
-   if (root == zeroghnode(depth))
+void ghashbase::repack(int bits) {
+   int obits = leafbits, odepth = leafdepth ;
+   // as big as fits in a ghnode, up to 8x8
+   int ld = 2 ;
+   while ((4 << (2 * ld)) * bits > 4 * WORDBITS)
+      ld-- ;
+   if (root == 0 || (!hashed && root->nw == 0 && root->ne == 0 &&
+                     root->sw == 0 && root->se == 0)) {
+      // nothing there yet
+      leafbits = bits ;
+      leafdepth = ld ;
+      depth = leafdepth + 1 ;
+      for (int i=0; i<nzeros; i++)
+         zeroghnodea[i] = 0 ;
+      return ;
+   }
+   ensure_hashed() ;
+   stopperiodsearch() ;
+   std::vector<int> depths ;
+   depths.push_back(ghnode_depth(root)) ;
+   for (int i=0; i<timeline.framecount; i++)
+      depths.push_back(ghnode_depth((ghnode *)timeline.frames[i])) ;
+   leafbits = bits ;
+   leafdepth = ld ;
+   for (int i=0; i<nzeros; i++)
+      zeroghnodea[i] = 0 ;
+   int gc = okaytogc, sp = gsp ;
+   okaytogc = 0 ;
+   repackmemo memo ;
+   root = repacked(root, depths[0], obits, odepth, memo, 1) ;
+   for (int i=0; i<timeline.framecount; i++)
+      timeline.frames[i] = repacked((ghnode *)timeline.frames[i],
+                                    depths[i+1], obits, odepth, memo, 1) ;
+   depth = ghnode_depth(root) ;
+   zeroghnode(depth) ;
+   pop(sp) ;
+   okaytogc = gc ;
+   popValid = 0 ;
+}
+/*
+ *   The tree n (at depth d, with leaves of bits a cell at depth ld)
+ *   encoded the current way, at depth d or, if it is the top of a tree
+ *   and that is too shallow for a root, leafdepth+1.
+ */
+ghnode *ghashbase::repacked(ghnode *n, int d, int bits, int ld,
+                            repackmemo &memo, int top) {
+   if (d > ld && d > leafdepth) {
+      repackmemo::iterator it = memo.find(n) ;
+      if (it != memo.end())
+         return it->second ;
+      ghnode *r = find_ghnode(repacked(n->nw, d-1, bits, ld, memo, 0),
+                              repacked(n->ne, d-1, bits, ld, memo, 0),
+                              repacked(n->sw, d-1, bits, ld, memo, 0),
+                              repacked(n->se, d-1, bits, ld, memo, 0)) ;
+      memo[n] = r ;
+      return r ;
+   }
+   // small enough to go through a grid, which for a root we centre in
+   // one at leafdepth+1 if need be
+   int nd = (top && d <= leafdepth) ? leafdepth + 1 : d ;
+   int s = 2 << nd, o = (1 << nd) - (1 << d) ;
+   state g[16 * 16] ;
+   memset(g, 0, sizeof(g)) ;
+   gathercells(n, d, bits, ld, g + o * s + o, s) ;
+   for (int i=0; i<s*s; i++)
+      if (g[i] >> leafbits)
+         g[i] = (state)((1 << leafbits) - 1) ;
+   return gridnode(g, s, nd) ;
+}
+/*
+ *   The cells of a square no bigger than a quarter of a leaf, packed
+ *   into a word; zero only if they all are.
+ */
+g_uintptr_t ghashbase::blockkey(const state *g, int pitch, int side) {
+   g_uintptr_t r = 0 ;
+   for (int y=0; y<side; y++)
+      for (int x=0; x<side; x++)
+         r = (r << leafbits) | g[y * pitch + x] ;
+   return r ;
+}
+/*
+ *   The macrocell format goes down to 2x2 squares whatever our leaves
+ *   are, so the squares inside a leaf are written out from its cells,
+ *   numbered as they are written and shared by content, just as the
+ *   ghnodes they would have been were.
+ */
+g_uintptr_t ghashbase::writeblock(std::ostream &os, const state *g,
+                                  int pitch, int d, mcindex &index,
+                                  blockindex &blocks) {
+   int side = 1 << d ;
+   std::pair<int, g_uintptr_t> key(d, blockkey(g, pitch, side)) ;
+   if (key.second == 0)
       return 0 ;
-   if (depth == 0) {
-      if (root->nw != 0)
-         return (g_uintptr_t)(root->nw) ;
-   } else {
-      if (marked2(root))
-         return (g_uintptr_t)(root->next) ;
-      unhash_ghnode2(root) ;
-      mark2(root) ;
-   }
-   if (depth == 0) {
-      thiscell = ++cellcounter ;
-      // note:  we *must* not abort this prescan
-      if ((cellcounter & 4095) == 0)
-         lifeabortprogress(0, "Scanning tree") ;
-      root->nw = (ghnode *)thiscell ;
+   blockindex::iterator it = blocks.find(key) ;
+   if (it != blocks.end())
+      return it->second ;
+   if (d == 1) {
+      os << 1 << ' ' << int(g[0]) << ' ' << int(g[1])
+              << ' ' << int(g[pitch]) << ' ' << int(g[pitch+1]) << '\n' ;
    } else {
-      writecell_2p1(root->nw, depth-1) ;
-      writecell_2p1(root->ne, depth-1) ;
-      writecell_2p1(root->sw, depth-1) ;
-      writecell_2p1(root->se, depth-1) ;
-      thiscell = ++cellcounter ;
-      // note:  we *must* not abort this prescan
-      if ((cellcounter & 4095) == 0)
-         lifeabortprogress(0, "Scanning tree") ;
-      root->next = (ghnode *)thiscell ;
+      int h = side / 2 ;
+      g_uintptr_t nw = writeblock(os, g, pitch, d-1, index, blocks) ;
+      g_uintptr_t ne = writeblock(os, g + h, pitch, d-1, index, blocks) ;
+      g_uintptr_t sw = writeblock(os, g + h * pitch, pitch, d-1, index,
+                                  blocks) ;
+      g_uintptr_t se = writeblock(os, g + h * pitch + h, pitch, d-1, index,
+                                  blocks) ;
+      os << d << ' ' << nw << ' ' << ne << ' ' << sw << ' ' << se << '\n' ;
    }
-   return thiscell ;
+   return blocks[key] = index.skip() ;
 }
 /**
- *   This one writes the cells, but assuming they've already been
- *   numbered, and displaying a progress dialog.
+ *   Write out the native macrocell format in a single pass, numbering
+ *   ghnodes as they are written in an index of our own; see hlifealgo.
  */
 static char progressmsg[80] ;
-g_uintptr_t ghashbase::writecell_2p2(std::ostream &os, ghnode *root, int depth) {
-   g_uintptr_t thiscell = 0 ;
+g_uintptr_t ghashbase::writecell(std::ostream &os, ghnode *root, int depth,
+                                 mcindex &index, blockindex &blocks,
+                                 double done, double share) {
    if (root == zeroghnode(depth))
       return 0 ;
-   if (depth == 0) {
-      if (cellcounter + 1 != (g_uintptr_t)(root->nw))
-         return (g_uintptr_t)(root->nw) ;
-      thiscell = ++cellcounter ;
-      if ((cellcounter & 4095) == 0) {
-         std::streampos siz = os.tellp() ;
-         sprintf(progressmsg, "File size: %.2f MB", double(siz) / 1048576.0) ;
-         lifeabortprogress(thiscell/(double)writecells, progressmsg) ;
-      }
-      ghleaf *n = (ghleaf *)root ;
-      root->nw = (ghnode *)thiscell ;
-      os << 1 << ' ' << int(n->nw) << ' ' << int(n->ne)
-              << ' ' << int(n->sw) << ' ' << int(n->se) << '\n';
+   g_uintptr_t thiscell = index.find(root) ;
+   if (thiscell != 0)
+      return thiscell ;
+   if (isaborted())
+      return 0 ;
+   if (depth == leafdepth) {
+      int s = 2 << leafdepth, h = s / 2 ;
+      state g[64] ;
+      unpackleaf((ghleaf *)root, g, s) ;
+      g_uintptr_t nw = writeblock(os, g, s, leafdepth, index, blocks) ;
+      g_uintptr_t ne = writeblock(os, g + h, s, leafdepth, index, blocks) ;
+      g_uintptr_t sw = writeblock(os, g + h * s, s, leafdepth, index,
+                                  blocks) ;
+      g_uintptr_t se = writeblock(os, g + h * s + h, s, leafdepth, index,
+                                  blocks) ;
+      os << depth+1 << ' ' << nw << ' ' << ne
+                    << ' ' << sw << ' ' << se << '\n' ;
    } else {
-      if (cellcounter + 1 > (g_uintptr_t)(root->next) || isaborted())
-         return (g_uintptr_t)(root->next) ;
-      g_uintptr_t nw = writecell_2p2(os, root->nw, depth-1) ;
-      g_uintptr_t ne = writecell_2p2(os, root->ne, depth-1) ;
-      g_uintptr_t sw = writecell_2p2(os, root->sw, depth-1) ;
-      g_uintptr_t se = writecell_2p2(os, root->se, depth-1) ;
-      if (!isaborted() &&
-          cellcounter + 1 != (g_uintptr_t)(root->next)) { // this should never happen
-         lifefatal("Internal in writecell_2p2") ;
-         return (g_uintptr_t)(root->next) ;
-      }
-      thiscell = ++cellcounter ;
-      if ((cellcounter & 4095) == 0) {
-         std::streampos siz = os.tellp() ;
-         sprintf(progressmsg, "File size: %.2f MB", double(siz) / 1048576.0) ;
-         lifeabortprogress(thiscell/(double)writecells, progressmsg) ;
-      }
-      root->next = (ghnode *)thiscell ;
+      share /= 4 ;
+      g_uintptr_t nw = writecell(os, root->nw, depth-1, index, blocks,
+                                 done, share) ;
+      g_uintptr_t ne = writecell(os, root->ne, depth-1, index, blocks,
+                                 done + share, share) ;
+      g_uintptr_t sw = writecell(os, root->sw, depth-1, index, blocks,
+                                 done + 2 * share, share) ;
+      g_uintptr_t se = writecell(os, root->se, depth-1, index, blocks,
+                                 done + 3 * share, share) ;
       os << depth+1 << ' ' << nw << ' ' << ne
                     << ' ' << sw << ' ' << se << '\n' ;
    }
+   thiscell = index.add(root) ;
+   if ((thiscell & 4095) == 0) {
+      std::streampos siz = os.tellp() ;
+      sprintf(progressmsg, "File size: %.2f MB", double(siz) / 1048576.0) ;
+      lifeabortprogress(done, progressmsg) ;
+   }
    return thiscell ;
 }
 #define STRINGIFY(arg) STR2(arg)
@@ -1854,30 +2831,12 @@ const char *ghashbase::writeNativeFormat(std::ostream &os, char *comments) {
         }
     }
 
-   inGC = 1 ;
-   /* this is the old way:
-   cellcounter = 0 ;
-   writecell(os, root, depth) ;
-   */
-   /* this is the new two-pass way */
-   cellcounter = 0 ;
-   vector<int> depths(timeline.framecount) ;
+   mcindex index ;
+   blockindex blocks ;
    int framestosave = timeline.framecount ;
    if (timeline.savetimeline == 0)
      framestosave = 0 ;
-   if (framestosave) {
-     for (int i=0; i<timeline.framecount; i++) {
-       ghnode *frame = (ghnode*)timeline.frames[i] ;
-       depths[i] = ghnode_depth(frame) ;
-     }
-     for (int i=0; i<timeline.framecount; i++) {
-       ghnode *frame = (ghnode*)timeline.frames[i] ;
-       writecell_2p1(frame, depths[i]) ;
-     }
-   }
-   writecell_2p1(root, depth) ;
-   writecells = cellcounter ;
-   cellcounter = 0 ;
+   double share = 1.0 / (framestosave + 1) ;
    if (framestosave) {
       os << "#FRAMES"
          << ' ' << timeline.framecount
@@ -1885,20 +2844,12 @@ const char *ghashbase::writeNativeFormat(std::ostream &os, char *comments) {
          << ' ' << timeline.base << '^' << timeline.expo << '\n' ;
       for (int i=0; i<timeline.framecount; i++) {
          ghnode *frame = (ghnode*)timeline.frames[i] ;
-         writecell_2p2(os, frame, depths[i]) ;
-         os << "#FRAME " << i << ' ' << (g_uintptr_t)frame->next << '\n' ;
+         g_uintptr_t n = writecell(os, frame, ghnode_depth(frame), index,
+                                   blocks, i * share, share) ;
+         os << "#FRAME " << i << ' ' << n << '\n' ;
       }
    }
-   writecell_2p2(os, root, depth) ;
-   /* end new two-pass way */
-   if (framestosave) {
-     for (int i=0; i<timeline.framecount; i++) {
-       ghnode *frame = (ghnode*)timeline.frames[i] ;
-       afterwritemc(frame, depths[i]) ;
-     }
-   }
-   afterwritemc(root, depth) ;
-   inGC = 0 ;
+   writecell(os, root, depth, index, blocks, framestosave * share, share) ;
    return 0 ;
 }
 char ghashbase::statusline[120] ;
@@ -4,8 +4,13 @@
 #ifndef GHASHBASE_H
 #define GHASHBASE_H
 #include "lifealgo.h"
+#include "lifemem.h"
 #include "liferules.h"
 #include "util.h"
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <vector>
 /*
  *   This class forms the basis of all hashlife-type algorithms except
  *   the highly-optimized hlifealgo (which is most appropriate for
@@ -20,18 +25,20 @@ typedef unsigned char state ;
  *   Nodes, like the standard hlifealgo nodes.
  */
 struct ghnode {
-   ghnode *next ;              /* hash link */
    ghnode *nw, *ne, *sw, *se ; /* constant; nw != 0 means nonjleaf */
    ghnode *res ;               /* cache */
 } ;
 /*
- *   Leaves, like the standard hlifealgo leaves.
+ *   Leaves are squares of cells packed as tightly as the rule's number
+ *   of states allows, 2, 4 or 8 bits a cell, in the space of a ghnode;
+ *   so a leaf is 8x8, as in hlifealgo, unless that does not fit, when
+ *   it is 4x4.  The cells go row by row from the top left, starting at
+ *   the low bits of cells[0].  A leaf has no cache field; its result is
+ *   the business of the ghnode above it.
  */
 struct ghleaf {
-   ghnode *next ;              /* hash link */
    ghnode *isghnode ;          /* must always be zero for leaves */
-   state nw, ne, sw, se ;      /* constant */
-   bigint leafpop ;            /* how many set bits */
+   g_uintptr_t cells[4] ;      /* constant */
 } ;
 /*
  *   If it is a struct ghnode, this returns a non-zero value, otherwise it
@@ -63,6 +70,22 @@ public:
    //  This should be overridden by a deriving class.
    virtual state slowcalc(state nw, state n, state ne, state w, state c,
                           state e, state sw, state s, state se) = 0 ;
+   //  One generation of a w by h block of cells:  each cell of out is
+   //  slowcalc of the 3x3 block around the same place in in, both grids
+   //  having pitch cells a row, and in having a one cell border around
+   //  the block.  By default this calls slowcalc for each cell; an
+   //  algorithm deriving from ghashalgo gets a version with its own
+   //  slowcalc inlined.
+   virtual void gridcalc(const state *in, state *out, int pitch,
+                         int w, int h) ;
+   //  Which of the nine cells slowcalc looks at, as a 3x3 mask with nw
+   //  the high bit.
+   enum neighborhood_masks {
+      MOORE = 0x1ff,         // all 8 neighbors
+      HEXAGONAL = 0x1bb,     // ignore NE and SW neighbors
+      VON_NEUMANN = 0x0ba    // 4 orthogonal neighbors
+   } ;
+   int calcmask() const { return MOORE ; }
    // note that for ghashbase, clearall() releases no memory; it retains
    // the full cache information but just sets the current pattern to
    // the empty pattern.
@@ -70,6 +93,7 @@ public:
    virtual int setcell(int x, int y, int newstate) ;
    virtual int getcell(int x, int y) ;
    virtual int nextcell(int x, int y, int &v) ;
+   virtual int setcells(const vector<loadcell> &cells) ;
    virtual void endofpattern() ;
    virtual void setIncrement(bigint inc) ;
    virtual void setIncrement(int inc) { setIncrement(bigint(inc)) ; }
@@ -84,6 +108,8 @@ public:
    virtual void step() ;
    virtual void* getcurrentstate() { return root ; }
    virtual void setcurrentstate(void *n) ;
+   virtual int hashstate(void *st, const bigint &top, const bigint &left,
+                         cellhash &h) ;
    /*
     *   The contract of draw() is that it render every pixel in the
     *   viewport precisely once.  This allows us to eliminate all
@@ -95,16 +121,17 @@ public:
    virtual void findedges(bigint *t, bigint *l, bigint *b, bigint *r) ;
    virtual const char *readmacrocell(char *line) ;
    virtual const char *writeNativeFormat(std::ostream &os, char *comments) ;
+   virtual int getstats(lifestats &s) ;
    static void doInitializeAlgoInfo(staticAlgoInfo &) ;
    
 private:
 /*
  *   Some globals representing our universe.  The root is the
  *   real root of the universe, and the depth is the depth of the
- *   tree where 2 means that root is a ghleaf, and 3 means that the
- *   children of root are leaves, and so on.  The center of the
- *   root is always coordinate position (0,0), so at startup the
- *   x and y coordinates range from -4..3; in general,
+ *   tree where leafdepth means that root is a ghleaf, and one more
+ *   means that the children of root are leaves, and so on.  The
+ *   center of the root is always coordinate position (0,0), so in
+ *   general the x and y coordinates range from
  *   -(2**depth)..(2**depth)-1.  The zeroghnodea is an
  *   array of canonical `empty-space' ghnodes at various depths.
  *   The ngens is an input parameter which is the second power of
@@ -112,6 +139,8 @@ private:
  */
    ghnode *root ;
    int depth ;
+   int leafbits ; // bits a cell in a leaf
+   int leafdepth ; // the depth of a leaf, which is 2<<leafdepth a side
    ghnode **zeroghnodea ;
    int nzeros ;
 /*
@@ -125,8 +154,10 @@ private:
 #ifndef PRIMEMOD
    g_uintptr_t hashmask ;
 #endif
-   static double maxloadfactor ;
+   static double maxloadfactor, maxfillfactor, maxhotfraction ;
    ghnode **hashtab ;
+   ghnode **oldhashtab ; // the table a resize is still moving out of
+   g_uintptr_t oldhashprime, oldhashnext ;
    int halvesdone ;
    int gsp ;
    g_uintptr_t alloced, maxmem ;
@@ -134,11 +165,18 @@ private:
    int okaytogc ;
    g_uintptr_t totalthings ;
    ghnode *ghnodeblocks ;
+   blockpool *nodepool ; // where the blocks of ghnodes come from
+   std::vector<ghnode *> markstack, liveghnodes, sweepblocks ;
+   size_t sweepnext, livenext ; // how far the lazy sweep has got
+   double maxgcpause ; // longest gc so far, in milliseconds
+   double lastgcpause, totalgcpause ; // the same, for getstats
+   double lastgcfreed ; // share of the hash the last gc threw away
    bigint population ;
    bigint setincrement ;
    bigint pow2step ; // greatest power of two in increment
    int nonpow2 ; // increment / pow2step
    int ngens ; // log2(pow2step)
+   int stepgrid ; // the kind of grid ngens was chosen for
    int popValid, needPop, inGC ;
    /*
     *   When rendering we store the relevant bits here rather than
@@ -151,28 +189,98 @@ private:
    char *llxb, *llyb ;
    int hashed ;
    int cacheinvalid ;
-   g_uintptr_t cellcounter ; // used when writing
-   g_uintptr_t writecells ; // how many to write
+   /*
+    *   Below a leaf we have no ghnodes to hang results on, so we keep
+    *   the centre 2x2 of each 4x4 block of cells we have stepped in a
+    *   cache of our own, indexed by the block's cells.
+    */
+   struct blockresult {
+      unsigned long long top, bottom ; // the block's rows, 4 bytes each
+      state r[4] ;                     // nw, ne, sw, se a generation on
+      int full ;
+   } ;
+   std::vector<blockresult> blockcache ;
    int gccount ; // how many gcs total this pattern
    int gcstep ; // how many gcs this step
    hperf running_hperf, step_hperf, inc_hperf ;
+   hashcounts counts ; // lookups, for getstats
+   int invalidations ; // times new_ngens cleared the cache
    int softinterrupt ;
+   /*
+    *   While we walk the tree to count it, the cache field of each
+    *   ghnode we have visited holds an index into these, and its real
+    *   value is kept to one side.
+    */
+   std::vector<ghnode *> savedres ;
+   std::deque<bigint> savedpop ;
    static char statusline[] ;
 //
    void resize() ;
+   void hashinsert(ghnode *p, g_uintptr_t h) ;
+   void movehash(g_uintptr_t n) ;
+   void finishresize() ;
+   void dropoldhash() ;
+   typedef std::map<std::tuple<ghnode *, long long, long long, int>, ghnode *>
+      windowmemo ;
+   ghnode *window(ghnode *n, int d, long long x, long long y, int wd,
+                  windowmemo &memo) ;
+   state cellat(ghnode *n, int d, long long x, long long y) ;
+   std::unordered_map<ghnode *, cellhash> cellhashes ; // cleared by each gc
+   cellhash hashghnode(ghnode *n, int d) ;
+   /*
+    *   Stepping a torus ourselves, as in hlifealgo:  the pattern, cut to
+    *   the grid, is tiled across a root as deep as the step needs, and
+    *   the grid is cut back out of the result.
+    */
+   struct wrapinfo {
+      ghnode *pat ;                   // the pattern, at depth patdepth
+      int patdepth ;
+      long long wd, ht ;              // the grid's size
+      long long left, top ;           // its top left corner in pat
+      long long u, v ;                // where the root's corner falls
+      long long gx, gy ;              // the grid's corner in the result
+      std::vector<long long> hx, hy ; // 2^d mod wd and mod ht
+      windowmemo windows ;
+      std::map<std::tuple<long long, long long, int>, ghnode *> memo ;
+   } ;
+   int griddepth() ;
+   int gridngens() ;
+   ghnode *gridpattern(ghnode *n, int d) ;
+   ghnode *wrapgrid(wrapinfo &w, ghnode *n, int &depth) ;
+   ghnode *wrapped(wrapinfo &w, long long u, long long v, int d) ;
+   ghnode *unwrapgrid(wrapinfo &w, ghnode *n, int d) ;
+   ghnode *gridclip(ghnode *n, int d, long long x, long long y) ;
+   void cliptogrid() ;
+   ghnode *runtorus(ghnode *n) ;
+   ghnode *runplane(ghnode *n) ;
+   ghnode *findoldghnode(g_uintptr_t h, ghnode *nw, ghnode *ne,
+                         ghnode *sw, ghnode *se) ;
+   ghleaf *findoldghleaf(g_uintptr_t h, const g_uintptr_t *cells) ;
    ghnode *find_ghnode(ghnode *nw, ghnode *ne, ghnode *sw, ghnode *se) ;
 #ifdef USEPREFETCH
    ghnode *find_ghnode(ghsetup_t &su) ;
    void setupprefetch(ghsetup_t &su, ghnode *nw, ghnode *ne, ghnode *sw, ghnode *se) ;
 #endif
-   void unhash_ghnode(ghnode *n) ;
-   void unhash_ghnode2(ghnode *n) ;
-   void rehash_ghnode(ghnode *n) ;
-   ghleaf *find_ghleaf(state nw, state ne, state sw, state se) ;
+   ghleaf *find_ghleaf(const g_uintptr_t *cells) ;
+   ghleaf *find_ghleaf(const state *g, int pitch) ;
+   state leafcell(ghleaf *l, int x, int y) ;
+   ghleaf *centreleaf(ghleaf *nw, ghleaf *ne, ghleaf *sw, ghleaf *se) ;
+   void unpackleaf(ghleaf *l, state *g, int pitch) ;
+   int leafpop(ghnode *n) ;
+   void copycells(ghnode *n, int d, long long x, long long y, int side,
+                  state *g, int pitch) ;
+   ghnode *gridnode(const state *g, int pitch, int d) ;
+   void checkleafbits() ;
+   void repack(int bits) ;
+   typedef std::map<ghnode *, ghnode *> repackmemo ;
+   ghnode *repacked(ghnode *n, int d, int bits, int ld, repackmemo &memo,
+                    int top) ;
    ghnode *getres(ghnode *n, int depth) ;
    ghnode *dorecurs(ghnode *n, ghnode *ne, ghnode *t, ghnode *e, int depth) ;
    ghnode *dorecurs_half(ghnode *n, ghnode *ne, ghnode *t, ghnode *e, int depth) ;
-   ghleaf *dorecurs_ghleaf(ghleaf *n, ghleaf *ne, ghleaf *t, ghleaf *e) ;
+   ghleaf *dorecurs_ghleaf(ghleaf *n, ghleaf *ne, ghleaf *t, ghleaf *e,
+                           int k) ;
+   void blockcalc(const state *in, state *out, int pitch, int w, int h) ;
    ghnode *newghnode() ;
    ghleaf *newghleaf() ;
    ghnode *newclearedghnode() ;
@@ -186,9 +294,14 @@ private:
    int nextbit(ghnode *n, int x, int y, int depth, int &v) ;
    ghnode *hashpattern(ghnode *root, int depth) ;
    ghnode *popzeros(ghnode *n) ;
+   typedef std::vector<std::pair<unsigned long long, ghnode *> > leaflist ;
+   ghnode *buildcells(const vector<mortoncell> &cells, int depth) ;
+   ghnode *buildnodes(const leaflist &leaves, size_t lo, size_t hi,
+                      int depth) ;
+   ghnode *overlay(ghnode *a, ghnode *b, int depth) ;
    const bigint &calcpop(ghnode *root, int depth) ;
    void aftercalcpop2(ghnode *root, int depth) ;
-   void afterwritemc(ghnode *root, int depth) ;
+   void clearsaved() ;
    void calcPopulation() ;
    ghnode *save(ghnode *n) ;
    void pop(int n) ;
@@ -196,6 +309,7 @@ private:
    void clearcache() ;
    void gc_mark(ghnode *root, int invalidate) ;
    void do_gc(int invalidate) ;
+   void sweep() ;
    void clearcache(ghnode *n, int depth, int clearto) ;
    void clearcache_p1(ghnode *n, int depth, int clearto) ;
    void clearcache_p2(ghnode *n, int depth, int clearto) ;
@@ -206,13 +320,64 @@ private:
    void fill_ll(int d) ;
    void drawghnode(ghnode *n, int llx, int lly, int depth, ghnode *z) ;
    void ensure_hashed() ;
-   g_uintptr_t writecell(std::ostream &os, ghnode *root, int depth) ;
-   g_uintptr_t writecell_2p1(ghnode *root, int depth) ;
-   g_uintptr_t writecell_2p2(std::ostream &os, ghnode *root, int depth) ;
+   typedef std::map<std::pair<int, g_uintptr_t>, g_uintptr_t> blockindex ;
+   g_uintptr_t writecell(std::ostream &os, ghnode *root, int depth,
+                         mcindex &index, blockindex &blocks,
+                         double done, double share) ;
+   g_uintptr_t writeblock(std::ostream &os, const state *g, int pitch, int d,
+                          mcindex &index, blockindex &blocks) ;
+   g_uintptr_t blockkey(const state *g, int pitch, int side) ;
+   ghnode *mcroot(ghnode **ind, const std::vector<state> &sub,
+                  const std::vector<g_uintptr_t> &subat, g_uintptr_t k) ;
    void drawpixel(int x, int y);
-   void draw4x4_1(state sw, state se, state nw, state ne, int llx, int lly) ;
+   void drawleaf(ghleaf *l, int llx, int lly) ;
+   int getbitsfromleaves(const std::vector<ghnode *> &v) ;
    void draw4x4_1(ghnode *n, ghnode *z, int llx, int lly) ;
    // AKT: set all pixels to background color
    void killpixels();
 } ;
+/**
+ *   Deriving from ghashalgo<T> rather than ghashbase puts T::slowcalc
+ *   straight into the leaf computation, with no virtual call per cell.
+ *   The cells T::calcmask() says the rule ignores are passed as zero, so
+ *   a von Neumann or hexagonal rule does not read them at all.  Since
+ *   gridcalc has to be compiled where slowcalc is defined to inline it,
+ *   T's header should say extern template and its source file
+ *   instantiate the template.
+ */
+template <class T> class ghashalgo : public ghashbase {
+public:
+   virtual void gridcalc(const state *in, state *out, int pitch,
+                         int w, int h) {
+      switch (static_cast<T *>(this)->calcmask()) {
+      case VON_NEUMANN:
+         calcgrid<VON_NEUMANN>(in, out, pitch, w, h) ;
+         break ;
+      case HEXAGONAL:
+         calcgrid<HEXAGONAL>(in, out, pitch, w, h) ;
+         break ;
+      default:
+         calcgrid<MOORE>(in, out, pitch, w, h) ;
+         break ;
+      }
+   }
+private:
+   template <int m> void calcgrid(const state *in, state *out, int pitch,
+                                  int w, int h) {
+      for (int y=0; y<h; y++, in += pitch, out += pitch) {
+         for (int x=0; x<w; x++) {
+            const state *c = in + x ;
+            out[x] = static_cast<T *>(this)->T::slowcalc(
+                       (m & 0x100) ? c[-pitch-1] : 0,
+                       (m & 0x80) ? c[-pitch] : 0,
+                       (m & 0x40) ? c[1-pitch] : 0,
+                       (m & 0x20) ? c[-1] : 0, c[0],
+                       (m & 0x08) ? c[1] : 0,
+                       (m & 0x04) ? c[pitch-1] : 0,
+                       (m & 0x02) ? c[pitch] : 0,
+                       (m & 0x01) ? c[pitch+1] : 0) ;
+         }
+      }
+   }
+} ;
 #endif
@@ -50,34 +50,39 @@ void ghashbase::drawpixel(int x, int y) {
 }
 
 /*
- *   Draw a 4x4 area yielding 1x1, 2x2, or 4x4 pixels.
+ *   Draw a leaf:  a pixel a cell, in the cell's state, or at smaller
+ *   scales a pixel for each square of cells with any alive.
  */
-void ghashbase::draw4x4_1(state sw, state se, state nw, state ne,
-                          int llx, int lly) {
-   // sw,se,nw,ne contain cell states (0..255)
-   int i = (pmsize-1+lly) * pmsize - llx;
-   if (renderer->justState() || pmag > 1) {
-      // store state info
-      pixbuf[i] = sw;
-      pixbuf[i+1] = se;
-      i -= pmsize;
-      pixbuf[i] = nw;
-      pixbuf[i+1] = ne;
-   } else {
-      // store RGBA info
-      if (sw) {
-         pixRGBAbuf[i] = cellRGBA[sw] ;
-      }
-      if (se) {
-         pixRGBAbuf[i+1] = cellRGBA[se] ;
-      }
-      i -= pmsize ;
-      if (nw) {
-         pixRGBAbuf[i] = cellRGBA[nw] ;
-      }
-      if (ne) {
-         pixRGBAbuf[i+1] = cellRGBA[ne] ;
+void ghashbase::drawleaf(ghleaf *l, int llx, int lly) {
+   int s = 2 << leafdepth ;
+   state g[64] ;
+   unpackleaf(l, g, s) ;
+   if (mag == 0) {
+      int i = (pmsize-1+lly) * pmsize - llx;
+      for (int y=0; y<s; y++, i -= pmsize) {
+         const state *row = g + (s - 1 - y) * s ;
+         if (renderer->justState() || pmag > 1) {
+            // store state info
+            for (int x=0; x<s; x++)
+               pixbuf[i+x] = row[x] ;
+         } else {
+            // store RGBA info
+            for (int x=0; x<s; x++)
+               if (row[x])
+                  pixRGBAbuf[i+x] = cellRGBA[row[x]] ;
+         }
       }
+   } else {
+      int k = 1 << mag, sw = s >> mag ;
+      for (int y=0; y<sw; y++)
+         for (int x=0; x<sw; x++) {
+            state any = 0 ;
+            for (int j=0; j<k; j++)
+               for (int i=0; i<k; i++)
+                  any |= g[(s - 1 - y * k - j) * s + x * k + i] ;
+            if (any)
+               drawpixel(x - llx, y - lly) ;
+         }
    }
 }
 
@@ -161,7 +166,7 @@ void ghashbase::drawghnode(ghnode *n, int llx, int lly, int depth, ghnode *z) {
       return ;
    if (n == z) {
       // don't do anything
-   } else if (depth > 0 && sw > 2) {
+   } else if (depth > leafdepth && sw > 2) {
       z = z->nw ;
       sw >>= 1 ;
       depth-- ;
@@ -177,18 +182,12 @@ void ghashbase::drawghnode(ghnode *n, int llx, int lly, int depth, ghnode *z) {
          drawghnode(n->nw, llx, lly-sw, depth, z) ;
          drawghnode(n->ne, llx-sw, lly-sw, depth, z) ;
       }
-   } else if (depth > 0 && sw == 2) {
+   } else if (depth > leafdepth && sw == 2) {
       draw4x4_1(n, z->nw, llx, lly) ;
    } else if (sw == 1) {
       drawpixel(-llx, -lly) ;
    } else {
-      struct ghleaf *l = (struct ghleaf *)n ;
-      sw >>= 1 ;
-      if (sw == 1) {
-         draw4x4_1(l->sw, l->se, l->nw, l->ne, llx, lly) ;
-      } else {
-         lifefatal("Can't happen") ;
-      }
+      drawleaf((ghleaf *)n, llx, lly) ;
    }
 }
 /*
@@ -301,7 +300,7 @@ void ghashbase::draw(viewport &viewarg, liferender &rendererarg) {
       }
    }
    /*  Find the lowest four we need to examine */
-   while (d > 0 && d - mag >= 0 &&
+   while (d > leafdepth && d - mag >= 0 &&
           (d - mag > 28 || (1 << (d - mag)) > 2 * maxd)) {
       llx = (llx << 1) + llxb[d] ;
       lly = (lly << 1) + llyb[d] ;
@@ -375,33 +374,24 @@ bail:
    renderer = 0 ;
    view = 0 ;
 }
-static
-int getbitsfromleaves(const vector<ghnode *> &v) {
-  unsigned short nw=0, ne=0, sw=0, se=0 ;
-  int i;
-  for (i=0; i<(int)v.size(); i++) {
-    ghleaf *p = (ghleaf *)v[i] ;
-    nw |= p->nw ;
-    ne |= p->ne ;
-    sw |= p->sw ;
-    se |= p->se ;
+/*
+ *   Which rows (low 8 bits, top row highest) and which columns (next 8,
+ *   west column highest) of these leaves have any cells alive.
+ */
+int ghashbase::getbitsfromleaves(const vector<ghnode *> &v) {
+  int s = 2 << leafdepth ;
+  int rows = 0, cols = 0 ;
+  state g[64] ;
+  for (int i=0; i<(int)v.size(); i++) {
+    unpackleaf((ghleaf *)v[i], g, s) ;
+    for (int y=0; y<s; y++)
+      for (int x=0; x<s; x++)
+        if (g[y * s + x]) {
+          rows |= 1 << (s - 1 - y) ;
+          cols |= 1 << (s - 1 - x) ;
+        }
   }
-  int r = 0 ;
-  // horizontal bits are least significant ones
-  unsigned short w = nw | sw ;
-  unsigned short e = ne | se ;
-  // vertical bits are next 8
-  unsigned short n = nw | ne ;
-  unsigned short s = sw | se ;
-  if (w)
-    r |= 512 ;
-  if (e)
-    r |= 256 ;
-  if (n)
-    r |= 2 ;
-  if (s)
-    r |= 1 ;
-  return r ;
+  return (cols << 8) | rows ;
 }
 
 /**
@@ -442,15 +432,15 @@ void ghashbase::findedges(bigint *ptop, bigint *pleft, bigint *pbottom, bigint *
    bottom.push_back(root) ;
    right.push_back(root) ;
    int topbm = 0, bottombm = 0, rightbm = 0, leftbm = 0 ;
-   while (currdepth >= -2) {
+   while (currdepth >= 0) {
       currdepth-- ;
-      if (currdepth == -1) { // we have ghleaf ghnodes; turn them into bitmasks
+      if (currdepth == leafdepth - 1) { // we have ghleaf ghnodes; turn them into bitmasks
          topbm = getbitsfromleaves(top) & 0xff ;
          bottombm = getbitsfromleaves(bottom) & 0xff ;
          leftbm = getbitsfromleaves(left) >> 8 ;
          rightbm = getbitsfromleaves(right) >> 8 ;
       }
-      if (currdepth == -1) {
+      if (currdepth < leafdepth) {
           int sz = 1 << (currdepth + 2) ;
           int maskhi = (1 << sz) - (1 << (sz >> 1)) ;
           int masklo = (1 << (sz >> 1)) - 1 ;
@@ -476,7 +466,7 @@ void ghashbase::findedges(bigint *ptop, bigint *pleft, bigint *pbottom, bigint *
           } else {
             leftbm >>= (sz >> 1) ;
           }
-      } else if (currdepth >= 0) {
+      } else {
          ghnode *z = 0 ;
          if (hashed)
             z = zeroghnode(currdepth) ;
@@ -583,10 +573,10 @@ void ghashbase::findedges(bigint *ptop, bigint *pleft, bigint *pbottom, bigint *
    xmax >>= 1 ;
    ymin >>= 1 ;
    ymax >>= 1 ;
-   xmin <<= (currdepth + 3) ;
-   ymin <<= (currdepth + 3) ;
-   xmax <<= (currdepth + 3) ;
-   ymax <<= (currdepth + 3) ;
+   xmin <<= (currdepth + 1) ;
+   ymin <<= (currdepth + 1) ;
+   xmax <<= (currdepth + 1) ;
+   ymax <<= (currdepth + 1) ;
    xmax -= 1 ;
    ymax -= 1 ;
    ymin.mul_smallint(-1) ;
@@ -627,13 +617,13 @@ void ghashbase::fit(viewport &view, int force) {
    int topbm = 0, bottombm = 0, rightbm = 0, leftbm = 0 ;
    while (currdepth >= 0) {
       currdepth-- ;
-      if (currdepth == -1) { // we have ghleaf ghnodes; turn them into bitmasks
+      if (currdepth == leafdepth - 1) { // we have ghleaf ghnodes; turn them into bitmasks
          topbm = getbitsfromleaves(top) & 0xff ;
          bottombm = getbitsfromleaves(bottom) & 0xff ;
          leftbm = getbitsfromleaves(left) >> 8 ;
          rightbm = getbitsfromleaves(right) >> 8 ;
       }
-      if (currdepth == -1) {
+      if (currdepth < leafdepth) {
          int sz = 1 << (currdepth + 2) ;
          int maskhi = (1 << sz) - (1 << (sz >> 1)) ;
          int masklo = (1 << (sz >> 1)) - 1 ;
@@ -665,7 +655,7 @@ void ghashbase::fit(viewport &view, int force) {
          }
          xsize <<= 1 ;
          ysize <<= 1 ;
-      } else if (currdepth >= 0) {
+      } else {
          ghnode *z = 0 ;
          if (hashed)
             z = zeroghnode(currdepth) ;
@@ -14,16 +14,36 @@
  *   it if necessary).  No UI, few options.
  */
 #include "hlifealgo.h"
+#include "lifethreads.h"
 #include "util.h"
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#if defined(COMPACTNODES) && defined(_WIN32)
+#include <malloc.h>
+#endif
+/*
+ *   Node files need mmap, and rely on nodes pointing at each other
+ *   directly, so they are not available everywhere.
+ */
+#if !defined(_WIN32) && !defined(COMPACTNODES)
+#define NODEFILES
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 using namespace std ;
 /*
  *   Power of two hash sizes work fine.
  */
 #ifdef PRIMEMOD
 #define HASHMOD(a) ((a)%hashprime)
+#define OLDHASHMOD(a) ((a)%oldhashprime)
 static g_uintptr_t nexthashsize(g_uintptr_t i) {
    g_uintptr_t j ;
    i |= 1 ;
@@ -37,6 +57,7 @@ static g_uintptr_t nexthashsize(g_uintptr_t i) {
 }
 #else
 #define HASHMOD(a) ((a)&(hashmask))
+#define OLDHASHMOD(a) ((a)&(oldhashprime-1))
 static g_uintptr_t nexthashsize(g_uintptr_t i) {
    while ((i & (i - 1)))
       i += (i & (1 + ~i)) ; // i & - i is more idiomatic but generates warning
@@ -48,6 +69,49 @@ static g_uintptr_t nexthashsize(g_uintptr_t i) {
  *   unsigned shorts; this is so we can directly index into these arrays.
  */
 static unsigned char shortpop[65536] ;
+#ifdef COMPACTNODES
+/*
+ *   The node blocks themselves are shared by every hlifealgo, since a
+ *   handle has to mean the same thing to all of them.  The table of
+ *   blocks never moves, so looking up a handle needs no lock; only
+ *   allocating and freeing blocks does.
+ */
+#define NODEBLOCK ((int)(NODEBLOCKBYTES / sizeof(node)))
+node *nodeptr::blocks[NODEMAXBLOCKS] ;
+static std::mutex blockmutex ;
+static std::vector<unsigned int> freeblockids ;
+static unsigned int nextblockid = 1 ;
+static node *allocnodeblock(blockpool *pool) {
+   node *b = (node *)pool->alloc() ;
+   if (b == 0)
+      return 0 ;
+   std::lock_guard<std::mutex> lk(blockmutex) ;
+   if (!freeblockids.empty()) {
+      b->nw.bits = freeblockids.back() ;
+      freeblockids.pop_back() ;
+   } else if (nextblockid < NODEMAXBLOCKS) {
+      b->nw.bits = nextblockid++ ;
+   } else {
+      lifefatal("Out of node handles; try reducing the hash memory limit.") ;
+   }
+   nodeptr::blocks[b->nw.bits] = b ;
+   return b ;
+}
+/*
+ *   The memory itself goes back when the pool is released.
+ */
+static void freenodeblock(node *b) {
+   std::lock_guard<std::mutex> lk(blockmutex) ;
+   nodeptr::blocks[b->nw.bits] = 0 ;
+   freeblockids.push_back(b->nw.bits) ;
+}
+#define NODEBLOCKALIGN NODEBLOCKBYTES
+#else
+#define NODEBLOCK (1001)
+#define NODEBLOCKALIGN (64)
+#define allocnodeblock(pool) ((node *)(pool)->alloc())
+#define freenodeblock(b) ((void)(b))
+#endif
 /*
  *   The cached result of an 8-square is a new 4-square representing
  *   two generations into the future.  This subroutine calculates that
@@ -82,6 +146,10 @@ static unsigned char shortpop[65536] ;
        (((t10) << 7) & 0x880) | ((t11) << 5) | (((t12) << 3) & 0x110) | \
        (((t20) >> 1) & 0x8) | ((t21) >> 3) | ((t22) >> 5)
 void hlifealgo::leafres(leaf *n) {
+   n->leafpop = (unsigned short)(shortpop[n->nw] + shortpop[n->ne] +
+                                 shortpop[n->sw] + shortpop[n->se]) ;
+   if (slicerule)
+      return ; // the results are only used by the table-driven code
    unsigned short
    t00 = ruletable[n->nw],
    t01 = ruletable[((n->nw << 2) & 0xcccc) | ((n->ne >> 2) & 0x3333)],
@@ -99,8 +167,6 @@ void hlifealgo::leafres(leaf *n) {
    (ruletable[(t01 << 10) | (t02 << 8) | (t11 << 2) | t12] << 8) |
    (ruletable[(t10 << 10) | (t11 << 8) | (t20 << 2) | t21] << 2) |
     ruletable[(t11 << 10) | (t12 << 8) | (t21 << 2) | t22] ;
-   n->leafpop = bigint((short)(shortpop[n->nw] + shortpop[n->ne] +
-                               shortpop[n->sw] + shortpop[n->se])) ;
 }
 /*
  *   We do now support garbage collection, but there are some routines we
@@ -108,141 +174,338 @@ void hlifealgo::leafres(leaf *n) {
  */
 #ifdef PRIMEMOD
 #define node_hash(a,b,c,d) (65537*(g_uintptr_t)(d)+257*(g_uintptr_t)(c)+17*(g_uintptr_t)(b)+5*(g_uintptr_t)(a))
+#define leaf_hash(a,b,c,d) (65537*(d)+257*(c)+17*(b)+5*(a))
 #else
+/*
+ *   With a power of two hash size we only look at the low bits, and
+ *   since we probe linearly we want them well mixed.
+ */
+static inline g_uintptr_t hashmix(g_uintptr_t r) {
+   r *= (g_uintptr_t)0x9e3779b97f4a7c15ULL ;
+   return r ^ (r >> (4 * sizeof(g_uintptr_t))) ;
+}
 g_uintptr_t node_hash(void *a, void *b, void *c, void *d) {
-   g_uintptr_t r = (65537*(g_uintptr_t)(d)+257*(g_uintptr_t)(c)+17*(g_uintptr_t)(b)+5*(g_uintptr_t)(a)) ;
-   r += (r >> 11) ;
-   return r ;
+   return hashmix(65537*(g_uintptr_t)(d)+257*(g_uintptr_t)(c)+17*(g_uintptr_t)(b)+5*(g_uintptr_t)(a)) ;
+}
+static inline g_uintptr_t leaf_hash(g_uintptr_t a, g_uintptr_t b,
+                                    g_uintptr_t c, g_uintptr_t d) {
+   return hashmix(65537*d+257*c+17*b+5*a) ;
 }
 #endif
-#define leaf_hash(a,b,c,d) (65537*(d)+257*(c)+17*(b)+5*(a))
 /*
- *   Resize the hash.  The max load factor defined here does not actually
- *   yield the maximum load factor the hash will see, because when we
- *   do the last resize before exhausting memory, we may find we are
- *   not permitted (while keeping total memory consumption below the
- *   limit) to do the resize, so the actual max load factor may be
- *   somewhat higher.  Conversely, because we double the hash size
- *   each time, the actual final max load factor may be less than this.
- *   Additional code can be added to manage this, but after some
- *   experimentation, it has been found that the impact is tiny, so
- *   we are keeping the code simple.  Nonetheless, this factor can be
- *   tweaked in the case where you absolutely want as many nodes as
- *   possible in memory, and are willing to use a large load factor to
- *   permit this; with the move-to-front heuristic, the code actually
- *   handles a large load factor fairly well.
+ *   The hash table is open-addressed with linear probing; an entry is
+ *   in the first empty slot at or after its home slot (wrapping around
+ *   at the end of the table).  Nothing is ever removed from the table
+ *   except by a gc or a resize, both of which rebuild it from scratch,
+ *   so a lookup can always stop at the first empty slot it sees.
+ *
+ *   Nodes and leaves are pointer-aligned (just four-byte aligned with
+ *   COMPACTNODES), so the low bits of each slot are free; we keep a few
+ *   more bits of the hash there.  Most of the time this lets a probe
+ *   skip past an entry for a different node without having to touch it.
+ *
+ *   The top one of those bits is not part of the tag; once a step has
+ *   needed a gc, it is set when a lookup finds the node, and tells the
+ *   next gc that the node is in use even if nothing it can see points
+ *   to it (see do_gc).
+ */
+#ifdef COMPACTNODES
+#define TAGMASK ((g_uintptr_t)3)
+#else
+#define TAGMASK ((g_uintptr_t)(sizeof(node *) - 1))
+#endif
+#define REFBIT ((TAGMASK + 1) >> 1)
+#define HASHTAG(h) ((((h) * (g_uintptr_t)0x9e3779b97f4a7c15ULL) >> \
+                     (8 * sizeof(g_uintptr_t) - 3)) & TAGMASK & ~REFBIT)
+#define slotnode(p) ((node *)(~TAGMASK & (g_uintptr_t)(p)))
+#define slottag(p) (TAGMASK & ~REFBIT & (g_uintptr_t)(p))
+#define referenced(p) (REFBIT & (g_uintptr_t)(p))
+#define tagged(p,t) ((node *)((t) | (g_uintptr_t)(p)))
+#define nextslot(i) ((i) + 1 == hashprime ? 0 : (i) + 1)
+#define nextoldslot(i) ((i) + 1 == oldhashprime ? 0 : (i) + 1)
+/*
+ *   Resize the hash.  Because we double the hash size each time, the
+ *   actual load factor will be somewhere between half of the max load
+ *   factor defined here and the max itself.  When we do the last resize
+ *   before exhausting memory, we may find we are not permitted (while
+ *   keeping total memory consumption below the limit) to grow the
+ *   hash; in that case we let it fill up to the max fill factor
+ *   instead, which makes probes longer but lets us keep more nodes.
+ *   An open-addressed table must never fill up completely, so past
+ *   that point we grow the hash regardless.
+ *
+ *   Moving tens of millions of entries at once is a long pause, so
+ *   normally we don't.  The old table stays around, a lookup that
+ *   misses in the new table looks in the old one too, and each such
+ *   lookup moves the next few slots of the old table across (see
+ *   movehash); that is done long before the new table can fill up.
+ *   Both tables count against the memory limit while they both exist,
+ *   and a gc rebuilds the hash from the live nodes anyway, so it just
+ *   drops the old table.
+ *
+ *   We used to do a gc before every resize, since the gc often throws
+ *   away most of the hash and leaves little to move.  When we expect
+ *   that (the last gc did), or when there is room for the bigger table
+ *   but not for both at once, we free the old table first and let the
+ *   gc fill in the new one; that gc is the whole resize, and growing
+ *   the hash never takes us over the limit.  Define NOGCBEFORERESIZE
+ *   to only do so when short of memory.  While stepping with more than
+ *   one thread, lookups never look in an old table, so there anything
+ *   else is moved all at once.
  */
 double hlifealgo::maxloadfactor = 0.7 ;
+double hlifealgo::maxfillfactor = 0.9 ;
+#define MOVESLOTS 8
 void hlifealgo::resize() {
-#ifndef NOGCBEFORERESIZE
-   if (okaytogc) {
-      do_gc(0) ; // faster resizes if we do a gc first
-   }
-#endif
-   g_uintptr_t i, nhashprime = nexthashsize(2 * hashprime) ;
-   node *p, **nhashtab ;
+   finishresize() ;
+   g_uintptr_t nhashprime = nexthashsize(2 * hashprime) ;
+   g_uintptr_t nbytes = nhashprime * sizeof(node *) ;
+   g_uintptr_t obytes = hashprime * sizeof(node *) ;
+   g_uintptr_t room = alloced > maxmem ? 0 : maxmem - alloced ;
+   int rebuild = okaytogc && nbytes > room ;
    if (hashprime > (totalthings >> 2)) {
-      if (alloced > maxmem ||
-          nhashprime * sizeof(node *) > (maxmem - alloced)) {
-         hashlimit = G_MAX ;
-         return ;
+      if (nbytes - obytes > room || (nbytes > room && !okaytogc)) {
+         hashlimit = (g_uintptr_t)(maxfillfactor * hashprime) ;
+         if (hashpop <= hashlimit)
+            return ;
       }
    }
+#ifndef NOGCBEFORERESIZE
+   // a gc first is worth it if it throws most of the hash away; if the
+   // last one didn't, move things over instead, but try again next time
+   if (okaytogc && lastgcfreed > 0.5)
+      rebuild = 1 ;
+   else
+      lastgcfreed = 1 ;
+#endif
    if (verbose) {
      sprintf(statusline, "Resizing hash to %" PRIuPTR "...", nhashprime) ;
      lifestatus(statusline) ;
    }
-   nhashtab = (node **)calloc(nhashprime, sizeof(node *)) ;
+   node **nhashtab ;
+   if (rebuild) {
+      bigfree(hashtab) ;
+      hashtab = 0 ;
+      nhashtab = (node **)bigcalloc(nhashprime, sizeof(node *)) ;
+      if (nhashtab == 0) {
+         // we had the old size a moment ago, so we should get it back
+         hashtab = (node **)bigcalloc(hashprime, sizeof(node *)) ;
+         if (hashtab == 0)
+            lifefatal("Out of memory; try reducing the hash memory limit.") ;
+      }
+   } else {
+      nhashtab = (node **)bigcalloc(nhashprime, sizeof(node *)) ;
+   }
    if (nhashtab == 0) {
+     hashlimit = (g_uintptr_t)(maxfillfactor * hashprime) ;
+     if (hashpop > hashlimit && !rebuild)
+       lifefatal("Out of memory; try reducing the hash memory limit.") ;
      lifewarning("Out of memory; running in a somewhat slower mode; "
                  "try reducing the hash memory limit after restarting.") ;
-     hashlimit = G_MAX ;
+     if (rebuild)
+       do_gc(0) ;
      return ;
    }
-   alloced += sizeof(node *) * (nhashprime - hashprime) ;
-   g_uintptr_t ohashprime = hashprime ;
+   if (rebuild) {
+      alloced += nbytes - obytes ;
+   } else {
+      alloced += nbytes ;
+      oldhashtab = hashtab ;
+      oldhashprime = hashprime ;
+      oldhashnext = 0 ;
+   }
+   hashtab = nhashtab ;
    hashprime = nhashprime ;
 #ifndef PRIMEMOD
    hashmask = hashprime - 1 ;
 #endif
-   for (i=0; i<ohashprime; i++) {
-      for (p=hashtab[i]; p;) {
-         node *np = p->next ;
-         g_uintptr_t h ;
-         if (is_node(p)) {
-            h = node_hash(p->nw, p->ne, p->sw, p->se) ;
-         } else {
-            leaf *l = (leaf *)p ;
-            h = leaf_hash(l->nw, l->ne, l->sw, l->se) ;
-         }
-         h = HASHMOD(h) ;
-         p->next = nhashtab[h] ;
-         nhashtab[h] = p ;
-         p = np ;
-      }
-   }
-   free(hashtab) ;
-   hashtab = nhashtab ;
    hashlimit = (g_uintptr_t)(maxloadfactor * hashprime) ;
+   if (rebuild)
+      do_gc(0) ;
+   else if (parallel)
+      finishresize() ;
    if (verbose) {
-     strcpy(statusline+strlen(statusline), " done.") ;
+     // a gc will have used the status line
+     sprintf(statusline, "Resizing hash to %" PRIuPTR "... done.", hashprime) ;
      lifestatus(statusline) ;
    }
 }
+/*
+ *   Move the next n slots of the old table into the new one, and get
+ *   rid of the old table once it is empty.  We copy each slot whole,
+ *   so the tag and the referenced bit come along too.
+ */
+void hlifealgo::movehash(g_uintptr_t n) {
+   for (; n > 0 && oldhashnext < oldhashprime; n--) {
+      node *s = oldhashtab[oldhashnext++] ;
+      node *p = slotnode(s) ;
+      if (p == 0)
+         continue ;
+      g_uintptr_t h ;
+      if (is_node(p)) {
+         h = node_hash(p->nw, p->ne, p->sw, p->se) ;
+      } else {
+         leaf *l = (leaf *)p ;
+         h = leaf_hash(l->nw, l->ne, l->sw, l->se) ;
+      }
+      g_uintptr_t i = HASHMOD(h) ;
+      while (hashtab[i])
+         i = nextslot(i) ;
+      hashtab[i] = s ;
+   }
+   if (oldhashnext >= oldhashprime)
+      dropoldhash() ;
+}
+/*
+ *   Finish any resize still under way; for code that walks the whole
+ *   table, or that looks things up some other way.
+ */
+void hlifealgo::finishresize() {
+   if (oldhashtab)
+      movehash(oldhashprime) ;
+}
+void hlifealgo::dropoldhash() {
+   if (oldhashtab) {
+      bigfree(oldhashtab) ;
+      alloced -= oldhashprime * sizeof(node *) ;
+      oldhashtab = 0 ;
+      oldhashprime = 0 ;
+      oldhashnext = 0 ;
+   }
+}
+/*
+ *   Look for an entry that a resize has not moved yet.  If it had been
+ *   moved we would have found it in the new table, so anything we find
+ *   here is still at or past oldhashnext, and its slot is the one that
+ *   will be moved.
+ */
+node *hlifealgo::findoldnode(g_uintptr_t h, node *nw, node *ne,
+                             node *sw, node *se) {
+   node *p ;
+   g_uintptr_t tag = HASHTAG(h) ;
+   for (g_uintptr_t i = OLDHASHMOD(h); (p=oldhashtab[i]) != 0;
+        i = nextoldslot(i)) {
+      if (slottag(p) == tag) {
+         node *s = p ;
+         p = slotnode(p) ;
+         if (nw == p->nw && ne == p->ne && sw == p->sw && se == p->se) {
+            if (gcstep > 1 && !referenced(s))
+               oldhashtab[i] = tagged(s, REFBIT) ;
+            return p ;
+         }
+      }
+   }
+   return 0 ;
+}
+leaf *hlifealgo::findoldleaf(g_uintptr_t h, unsigned short nw,
+                             unsigned short ne, unsigned short sw,
+                             unsigned short se) {
+   node *q ;
+   g_uintptr_t tag = HASHTAG(h) ;
+   for (g_uintptr_t i = OLDHASHMOD(h); (q=oldhashtab[i]) != 0;
+        i = nextoldslot(i)) {
+      if (slottag(q) == tag) {
+         leaf *p = (leaf *)slotnode(q) ;
+         if (nw == p->nw && ne == p->ne && sw == p->sw && se == p->se &&
+             !is_node(p))
+            return p ;
+      }
+   }
+   return 0 ;
+}
+/*
+ *   Put an entry we know is not there yet into the hash.
+ */
+void hlifealgo::hashinsert(node *p, g_uintptr_t h) {
+   g_uintptr_t i = HASHMOD(h) ;
+   while (hashtab[i])
+      i = nextslot(i) ;
+   hashtab[i] = tagged(p, HASHTAG(h)) ;
+}
 /*
  *   These next two routines are (nearly) our only hash table access
  *   routines; we simply look up the passed in information.  If we
  *   find it in the hash table, we return it; otherwise, we build a
- *   new node and store it in the hash table, and return that.
+ *   new node and store it in the hash table, and return that.  If
+ *   getting the new node caused a gc, the table has been rebuilt, so
+ *   we have to look for an empty slot all over again.
  */
 node *hlifealgo::find_node(node *nw, node *ne, node *sw, node *se) {
    node *p ;
    g_uintptr_t h = node_hash(nw,ne,sw,se) ;
-   node *pred = 0 ;
-   h = HASHMOD(h) ;
-   for (p=hashtab[h]; p; p = p->next) { /* make sure to compare nw *first* */
-      if (nw == p->nw && ne == p->ne && sw == p->sw && se == p->se) {
-         if (pred) { /* move this one to the front */
-            pred->next = p->next ;
-            p->next = hashtab[h] ;
-            hashtab[h] = p ;
+   if (parallel)
+      return find_node_mt(h, nw, ne, sw, se) ;
+   g_uintptr_t tag = HASHTAG(h), i = HASHMOD(h) ;
+   counts.lookups++ ;
+   for (; (p=hashtab[i]) != 0; i = nextslot(i)) {
+      counts.probes++ ;
+      if (slottag(p) == tag) {
+         node *s = p ;
+         p = slotnode(p) ; /* make sure to compare nw *first* */
+         if (nw == p->nw && ne == p->ne && sw == p->sw && se == p->se) {
+            if (gcstep > 1 && !referenced(s))
+               hashtab[i] = tagged(s, REFBIT) ;
+            counts.hits++ ;
+            return save(p) ;
          }
+      }
+   }
+   if (oldhashtab) {
+      p = findoldnode(h, nw, ne, sw, se) ;
+      if (p) {
+         counts.hits++ ;
+         movehash(MOVESLOTS) ;
          return save(p) ;
       }
-      pred = p ;
    }
+   int gcs = gccount ;
    p = newnode() ;
    p->nw = nw ;
    p->ne = ne ;
    p->sw = sw ;
    p->se = se ;
    p->res = 0 ;
-   p->next = hashtab[h] ;
-   hashtab[h] = p ;
+   if (gcs == gccount)
+      hashtab[i] = tagged(p, tag) ;
+   else
+      hashinsert(p, h) ;
    hashpop++ ;
    save(p) ;
+   if (oldhashtab)
+      movehash(MOVESLOTS) ;
    if (hashpop > hashlimit)
       resize() ;
    return p ;
 }
 leaf *hlifealgo::find_leaf(unsigned short nw, unsigned short ne,
                                   unsigned short sw, unsigned short se) {
+   if (parallel)
+      return find_leaf_mt(nw, ne, sw, se) ;
    leaf *p ;
-   leaf *pred = 0 ;
+   node *q ;
    g_uintptr_t h = leaf_hash(nw, ne, sw, se) ;
-   h = HASHMOD(h) ;
-   for (p=(leaf *)hashtab[h]; p; p = (leaf *)p->next) {
-      if (nw == p->nw && ne == p->ne && sw == p->sw && se == p->se &&
-          !is_node(p)) {
-         if (pred) {
-            pred->next = p->next ;
-            p->next = hashtab[h] ;
-            hashtab[h] = (node *)p ;
+   g_uintptr_t tag = HASHTAG(h), i = HASHMOD(h) ;
+   counts.lookups++ ;
+   for (; (q=hashtab[i]) != 0; i = nextslot(i)) {
+      counts.probes++ ;
+      if (slottag(q) == tag) {
+         p = (leaf *)slotnode(q) ;
+         if (nw == p->nw && ne == p->ne && sw == p->sw && se == p->se &&
+             !is_node(p)) {
+            counts.hits++ ;
+            return (leaf *)save((node *)p) ;
          }
+      }
+   }
+   if (oldhashtab) {
+      p = findoldleaf(h, nw, ne, sw, se) ;
+      if (p) {
+         counts.hits++ ;
+         movehash(MOVESLOTS) ;
          return (leaf *)save((node *)p) ;
       }
-      pred = p ;
    }
+   int gcs = gccount ;
    p = newleaf() ;
    p->nw = nw ;
    p->ne = ne ;
@@ -250,10 +513,14 @@ leaf *hlifealgo::find_leaf(unsigned short nw, unsigned short ne,
    p->se = se ;
    leafres(p) ;
    p->isnode = 0 ;
-   p->next = hashtab[h] ;
-   hashtab[h] = (node *)p ;
+   if (gcs == gccount)
+      hashtab[i] = tagged(p, tag) ;
+   else
+      hashinsert((node *)p, h) ;
    hashpop++ ;
    save((node *)p) ;
+   if (oldhashtab)
+      movehash(MOVESLOTS) ;
    if (hashpop > hashlimit)
       resize() ;
    return p ;
@@ -264,12 +531,16 @@ leaf *hlifealgo::find_leaf(unsigned short nw, unsigned short ne,
  *   Otherwise, it figures out whether to call the leaf routine or the
  *   non-leaf routine by whether two nodes down is a leaf node or not.
  *   (We'll understand why this is a bit later.)  All the sp stuff is
- *   stack pointer and garbage collection stuff.
+ *   stack pointer and garbage collection stuff.  While we are running
+ *   in parallel, another thread may fill in res at any time, so then
+ *   it is read with acquire and written with release.
  */
+#define atomicres(n) (reinterpret_cast<std::atomic<nodefield> *>(&(n)->res))
 node *hlifealgo::getres(node *n, int depth) {
-   if (n->res)
-     return n->res ;
-   node *res = 0 ;
+   node *res = parallel ? atomicres(n)->load(std::memory_order_acquire)
+                        : n->res ;
+   if (res)
+     return res ;
    /**
     *   This routine be the only place we assign to res.  We use
     *   the fact that the poll routine is *sticky* to allow us to
@@ -281,28 +552,47 @@ node *hlifealgo::getres(node *n, int depth) {
     *   calls here, one to prevent us going deeper, and another
     *   to prevent us from destroying the cache field.
     */
-   if (poller->poll() || softinterrupt)
+   if (parallel) {
+     if (parallelpoll())
+       return zeronode(depth-1) ;
+   } else if (poller->poll() || softinterrupt)
      return zeronode(depth-1) ;
-   int sp = gsp ;
-   if (running_hperf.fastinc(depth, ngens < depth))
-      running_hperf.report(inc_hperf, verbose) ;
+   int sp = stacktop() ;
+   if (!parallel || lifethreads::self() == 0) {
+     if (running_hperf.fastinc(depth, ngens < depth))
+        running_hperf.report(inc_hperf, verbose) ;
+   } else {
+     workers[lifethreads::self()].perf.fastinc(depth, ngens < depth) ;
+   }
    depth-- ;
    if (ngens >= depth) {
      if (is_node(n->nw)) {
-       res = dorecurs(n->nw, n->ne, n->sw, n->se, depth) ;
+       if (parallel && depth >= mintaskdepth)
+         res = dorecurs_mt(n->nw, n->ne, n->sw, n->se, depth, 0) ;
+       else
+         res = dorecurs(n->nw, n->ne, n->sw, n->se, depth) ;
      } else {
-       res = (node *)dorecurs_leaf((leaf *)n->nw, (leaf *)n->ne,
-                                   (leaf *)n->sw, (leaf *)n->se) ;
+       res = (node *)dorecurs_leaf((leaf *)(node *)n->nw,
+                                   (leaf *)(node *)n->ne,
+                                   (leaf *)(node *)n->sw,
+                                   (leaf *)(node *)n->se) ;
      }
    } else {
      if (is_node(n->nw)) {
-       res = dorecurs_half(n->nw, n->ne, n->sw, n->se, depth) ;
+       if (parallel && depth >= mintaskdepth)
+         res = dorecurs_mt(n->nw, n->ne, n->sw, n->se, depth, 1) ;
+       else
+         res = dorecurs_half(n->nw, n->ne, n->sw, n->se, depth) ;
      } else if (ngens == 0) {
-       res = (node *)dorecurs_leaf_quarter((leaf *)n->nw, (leaf *)n->ne,
-                                           (leaf *)n->sw, (leaf *)n->se) ;
+       res = (node *)dorecurs_leaf_quarter((leaf *)(node *)n->nw,
+                                           (leaf *)(node *)n->ne,
+                                           (leaf *)(node *)n->sw,
+                                           (leaf *)(node *)n->se) ;
      } else {
-       res = (node *)dorecurs_leaf_half((leaf *)n->nw, (leaf *)n->ne,
-                                        (leaf *)n->sw, (leaf *)n->se) ;
+       res = (node *)dorecurs_leaf_half((leaf *)(node *)n->nw,
+                                        (leaf *)(node *)n->ne,
+                                        (leaf *)(node *)n->sw,
+                                        (leaf *)(node *)n->se) ;
      }
    }
    pop(sp) ;
@@ -312,7 +602,12 @@ node *hlifealgo::getres(node *n, int depth) {
    else {
      if (ngens < depth && halvesdone < 1000)
        halvesdone++ ;
-     n->res = res ;
+     // other threads may pick up this result as soon as they see it,
+     // so the node it points to must be visible to them first
+     if (parallel)
+       atomicres(n)->store(res, std::memory_order_release) ;
+     else
+       n->res = res ;
    }
    return res ;
 }
@@ -326,36 +621,54 @@ void hlifealgo::setupprefetch(setup_t &su, node *nw, node *ne, node *sw, node *s
    su.prefetch(hashtab + HASHMOD(su.h)) ;
 }
 node *hlifealgo::find_node(setup_t &su) {
+   if (parallel)
+      return find_node_mt(su.h, su.nw, su.ne, su.sw, su.se) ;
    node *p ;
-   node *pred = 0 ;
-   g_uintptr_t h = HASHMOD(su.h) ;
-   for (p=hashtab[h]; p; p = p->next) { /* make sure to compare nw *first* */
-      if (su.nw == p->nw && su.ne == p->ne && su.sw == p->sw && su.se == p->se) {
-         if (pred) { /* move this one to the front */
-            pred->next = p->next ;
-            p->next = hashtab[h] ;
-            hashtab[h] = p ;
+   g_uintptr_t tag = HASHTAG(su.h), i = HASHMOD(su.h) ;
+   counts.lookups++ ;
+   for (; (p=hashtab[i]) != 0; i = nextslot(i)) {
+      counts.probes++ ;
+      if (slottag(p) == tag) {
+         node *s = p ;
+         p = slotnode(p) ; /* make sure to compare nw *first* */
+         if (su.nw == p->nw && su.ne == p->ne && su.sw == p->sw &&
+             su.se == p->se) {
+            if (gcstep > 1 && !referenced(s))
+               hashtab[i] = tagged(s, REFBIT) ;
+            counts.hits++ ;
+            return save(p) ;
          }
+      }
+   }
+   if (oldhashtab) {
+      p = findoldnode(su.h, su.nw, su.ne, su.sw, su.se) ;
+      if (p) {
+         counts.hits++ ;
+         movehash(MOVESLOTS) ;
          return save(p) ;
       }
-      pred = p ;
    }
+   int gcs = gccount ;
    p = newnode() ;
    p->nw = su.nw ;
    p->ne = su.ne ;
    p->sw = su.sw ;
    p->se = su.se ;
    p->res = 0 ;
-   p->next = hashtab[h] ;
-   hashtab[h] = p ;
+   if (gcs == gccount)
+      hashtab[i] = tagged(p, tag) ;
+   else
+      hashinsert(p, su.h) ;
    hashpop++ ;
    save(p) ;
+   if (oldhashtab)
+      movehash(MOVESLOTS) ;
    if (hashpop > hashlimit)
       resize() ;
    return p ;
 }
 node *hlifealgo::dorecurs(node *n, node *ne, node *t, node *e, int depth) {
-   int sp = gsp ;
+   int sp = stacktop() ;
    setup_t su[5] ;
    setupprefetch(su[2], n->se, ne->sw, t->ne, e->nw) ;
    setupprefetch(su[0], n->ne, ne->nw, n->se, ne->sw) ;
@@ -399,7 +712,7 @@ node *hlifealgo::dorecurs(node *n, node *ne, node *t, node *e, int depth) {
  *   then put these together into a new n/2-square.  Simple, eh?
  */
 node *hlifealgo::dorecurs(node *n, node *ne, node *t, node *e, int depth) {
-   int sp = gsp ;
+   int sp = stacktop() ;
    node
    *t11 = getres(find_node(n->se, ne->sw, t->ne, e->nw), depth),
    *t00 = getres(n, depth),
@@ -424,7 +737,7 @@ node *hlifealgo::dorecurs(node *n, node *ne, node *t, node *e, int depth) {
  */
 node *hlifealgo::dorecurs_half(node *n, node *ne, node *t,
                                node *e, int depth) {
-   int sp = gsp ;
+   int sp = stacktop() ;
    node
    *t00 = getres(n, depth),
    *t01 = getres(find_node(n->ne, ne->nw, n->se, ne->sw), depth),
@@ -461,6 +774,109 @@ node *hlifealgo::dorecurs_half(node *n, node *ne, node *t,
    pop(sp) ;
    return save(n) ;
 }
+/*
+ *   When the increment is not a power of two we still step in a single
+ *   pass.  A node's full step is half its width; what we want of each
+ *   node is its centre after the increment modulo its full step.  That
+ *   is the same number of generations for every node of one depth, so
+ *   one answer per node is enough, but it is not the one in res, so it
+ *   goes in steptab instead.
+ *
+ *   We get there in two stages, as dorecurs does.  If the increment
+ *   has the bit for half the node's full step, the second stage is a
+ *   full step of the smaller squares, which res has (ngens is the top
+ *   bit of the increment, so every depth we need does full steps), and
+ *   the first stage is whatever is left, which is the same question
+ *   one depth down.  Otherwise the first stage is all of it and the
+ *   second stage just takes the centres.  If nothing is left, the first
+ *   stage just takes the centres.  So each depth sees at most one
+ *   partial step, and changing between increments with the same top
+ *   bit never clears the cache.
+ */
+node *hlifealgo::getstepres(node *n, int depth) {
+   node *res = findstep(n) ;
+   if (res)
+      return res ;
+   if (parallel) {
+     if (parallelpoll())
+       return zeronode(depth-1) ;
+   } else if (poller->poll() || softinterrupt)
+     return zeronode(depth-1) ;
+   int sp = stacktop() ;
+   if (running_hperf.fastinc(depth, 1))
+      running_hperf.report(inc_hperf, verbose) ;
+   depth-- ;
+   if (is_node(n->nw))
+      res = dorecurs_step(n->nw, n->ne, n->sw, n->se, depth) ;
+   else
+      res = (node *)dorecurs_leaf_gens((leaf *)(node *)n->nw,
+                                       (leaf *)(node *)n->ne,
+                                       (leaf *)(node *)n->sw,
+                                       (leaf *)(node *)n->se,
+                                       stepbits[0] + 2 * stepbits[1]) ;
+   pop(sp) ;
+   if (softinterrupt || poller->isInterrupted())
+      res = zeronode(depth) ;
+   else
+      addstep(n, res) ;
+   return res ;
+}
+/*
+ *   The centre of the square made of these four, which have the given
+ *   depth.
+ */
+node *hlifealgo::centre(node *n, node *ne, node *t, node *e, int depth) {
+   if (depth > 2)
+      return find_node(n->se, ne->sw, t->ne, e->nw) ;
+   return (node *)find_leaf(((leaf *)n)->se, ((leaf *)ne)->sw,
+                            ((leaf *)t)->ne, ((leaf *)e)->nw) ;
+}
+node *hlifealgo::dorecurs_step(node *n, node *ne, node *t, node *e,
+                               int depth) {
+   int sp = stacktop() ;
+   int part = steplow < depth - 1 ;
+   int full = depth - 1 < (int)stepbits.size() && stepbits[depth-1] ;
+   node *t00, *t01, *t02, *t10, *t11, *t12, *t20, *t21, *t22 ;
+   if (part) {
+      t00 = getstepres(n, depth) ;
+      t01 = getstepres(find_node(n->ne, ne->nw, n->se, ne->sw), depth) ;
+      t02 = getstepres(ne, depth) ;
+      t10 = getstepres(find_node(n->sw, n->se, t->nw, t->ne), depth) ;
+      t11 = getstepres(find_node(n->se, ne->sw, t->ne, e->nw), depth) ;
+      t12 = getstepres(find_node(ne->sw, ne->se, e->nw, e->ne), depth) ;
+      t20 = getstepres(t, depth) ;
+      t21 = getstepres(find_node(t->ne, e->nw, t->se, e->sw), depth) ;
+      t22 = getstepres(e, depth) ;
+   } else {
+      depth-- ;
+      t00 = centre(n->nw, n->ne, n->sw, n->se, depth) ;
+      t01 = centre(n->ne, ne->nw, n->se, ne->sw, depth) ;
+      t02 = centre(ne->nw, ne->ne, ne->sw, ne->se, depth) ;
+      t10 = centre(n->sw, n->se, t->nw, t->ne, depth) ;
+      t11 = centre(n->se, ne->sw, t->ne, e->nw, depth) ;
+      t12 = centre(ne->sw, ne->se, e->nw, e->ne, depth) ;
+      t20 = centre(t->nw, t->ne, t->sw, t->se, depth) ;
+      t21 = centre(t->ne, e->nw, t->se, e->sw, depth) ;
+      t22 = centre(e->nw, e->ne, e->sw, e->se, depth) ;
+      depth++ ;
+   }
+   node *t33, *t34, *t43, *t44 ;
+   if (full) {
+      t33 = getres(find_node(t00, t01, t10, t11), depth) ;
+      t34 = getres(find_node(t01, t02, t11, t12), depth) ;
+      t43 = getres(find_node(t10, t11, t20, t21), depth) ;
+      t44 = getres(find_node(t11, t12, t21, t22), depth) ;
+   } else {
+      depth-- ;
+      t33 = centre(t00, t01, t10, t11, depth) ;
+      t34 = centre(t01, t02, t11, t12, depth) ;
+      t43 = centre(t10, t11, t20, t21, depth) ;
+      t44 = centre(t11, t12, t21, t22, depth) ;
+   }
+   n = find_node(t33, t34, t43, t44) ;
+   pop(sp) ;
+   return save(n) ;
+}
 /*
  *   If the node is a 16-node, then the constituents are leaves, so we
  *   need a very similar but still somewhat different subroutine.  Since
@@ -468,6 +884,8 @@ node *hlifealgo::dorecurs_half(node *n, node *ne, node *t,
  *   save/pop mumbo-jumbo.
  */
 leaf *hlifealgo::dorecurs_leaf(leaf *n, leaf *ne, leaf *t, leaf *e) {
+   if (slicerule)
+      return sliceleaf(n, ne, t, e, 4) ;
    unsigned short
    t00 = n->res2,
    t01 = find_leaf(n->ne, ne->nw, n->se, ne->sw)->res2,
@@ -489,6 +907,8 @@ leaf *hlifealgo::dorecurs_leaf(leaf *n, leaf *ne, leaf *t, leaf *e) {
 #define combine4(t00,t01,t10,t11) (unsigned short)\
 ((((t00)<<10)&0xcc00)|(((t01)<<6)&0x3300)|(((t10)>>6)&0xcc)|(((t11)>>10)&0x33))
 leaf *hlifealgo::dorecurs_leaf_half(leaf *n, leaf *ne, leaf *t, leaf *e) {
+   if (slicerule)
+      return sliceleaf(n, ne, t, e, 2) ;
    unsigned short
    t00 = n->res2,
    t01 = find_leaf(n->ne, ne->nw, n->se, ne->sw)->res2,
@@ -509,6 +929,8 @@ leaf *hlifealgo::dorecurs_leaf_half(leaf *n, leaf *ne, leaf *t, leaf *e) {
  */
 leaf *hlifealgo::dorecurs_leaf_quarter(leaf *n, leaf *ne,
                                    leaf *t, leaf *e) {
+   if (slicerule)
+      return sliceleaf(n, ne, t, e, 1) ;
    unsigned short
    t00 = n->res1,
    t01 = find_leaf(n->ne, ne->nw, n->se, ne->sw)->res1,
@@ -524,41 +946,110 @@ leaf *hlifealgo::dorecurs_leaf_quarter(leaf *n, leaf *ne,
                     combine4(t10, t11, t20, t21),
                     combine4(t11, t12, t21, t22)) ;
 }
+/*
+ *   Any number of generations from one to four, for getstepres.  Three
+ *   is one generation of each 4-square and then two more.
+ */
+leaf *hlifealgo::dorecurs_leaf_gens(leaf *n, leaf *ne, leaf *t, leaf *e,
+                                    int gens) {
+   if (slicerule)
+      return sliceleaf(n, ne, t, e, gens) ;
+   if (gens == 1)
+      return dorecurs_leaf_quarter(n, ne, t, e) ;
+   if (gens == 2)
+      return dorecurs_leaf_half(n, ne, t, e) ;
+   if (gens == 4)
+      return dorecurs_leaf(n, ne, t, e) ;
+   unsigned short
+   t00 = n->res1,
+   t01 = find_leaf(n->ne, ne->nw, n->se, ne->sw)->res1,
+   t02 = ne->res1,
+   t10 = find_leaf(n->sw, n->se, t->nw, t->ne)->res1,
+   t11 = find_leaf(n->se, ne->sw, t->ne, e->nw)->res1,
+   t12 = find_leaf(ne->sw, ne->se, e->nw, e->ne)->res1,
+   t20 = t->res1,
+   t21 = find_leaf(t->ne, e->nw, t->se, e->sw)->res1,
+   t22 = e->res1 ;
+   return find_leaf(find_leaf(t00, t01, t10, t11)->res2,
+                    find_leaf(t01, t02, t11, t12)->res2,
+                    find_leaf(t10, t11, t20, t21)->res2,
+                    find_leaf(t11, t12, t21, t22)->res2) ;
+}
+/*
+ *   The four routines above build up to eight leaves in between that
+ *   nothing else may ever ask for.  For the usual Bx/Sy rules on the
+ *   Moore neighborhood we can do better: we lay the whole 16-square out
+ *   as sixteen rows of sixteen bits, run it forward with bit-sliced
+ *   adders (see lifeslice.h), and look up just the one leaf we want,
+ *   the middle 8x8, at the end.
+ */
+leaf *hlifealgo::sliceleaf(leaf *n, leaf *ne, leaf *t, leaf *e, int gens) {
+   sliceword w[4] ;
+   w[0] = (spread4(n->nw) << 12) | (spread4(n->ne) << 8) |
+          (spread4(ne->nw) << 4) | spread4(ne->ne) ;
+   w[1] = (spread4(n->sw) << 12) | (spread4(n->se) << 8) |
+          (spread4(ne->sw) << 4) | spread4(ne->se) ;
+   w[2] = (spread4(t->nw) << 12) | (spread4(t->ne) << 8) |
+          (spread4(e->nw) << 4) | spread4(e->ne) ;
+   w[3] = (spread4(t->sw) << 12) | (spread4(t->se) << 8) |
+          (spread4(e->sw) << 4) | spread4(e->se) ;
+   slicegens(w, gens, slicerule == 1 ? 0 : slicesel) ;
+   return find_leaf(gather4(w[1] >> 8), gather4(w[1] >> 4),
+                    gather4(w[2] >> 8), gather4(w[2] >> 4)) ;
+}
+/*
+ *   See if the rule table is a Bx/Sy rule on the Moore neighborhood; if
+ *   it is, set up slicesel.
+ */
+void hlifealgo::setslicerule() {
+#ifdef NOSLICELEAVES
+   slicerule = 0 ;
+#else
+   slicerule = findslicerule(ruletable, slicesel) ;
+#endif
+}
 /*
  *   We keep free nodes in a linked list for allocation, and we allocate
- *   them 1000 at a time.
+ *   them a block at a time.  The first node of each block links the
+ *   blocks together.
  */
+void hlifealgo::addnodeblock() {
+   int i ;
+   freenodes = nodefd >= 0 ? arenablock() : allocnodeblock(nodepool) ;
+   if (freenodes == 0)
+      lifefatal("Out of memory; try reducing the hash memory limit.") ;
+   alloced += NODEBLOCK * sizeof(node) ;
+   freenodes->res = nodeblocks ;
+   nodeblocks = freenodes++ ;
+   for (i=0; i<NODEBLOCK-2; i++) {
+      freenodes[1].res = freenodes ;
+      freenodes++ ;
+   }
+   totalthings += NODEBLOCK - 1 ;
+}
 node *hlifealgo::newnode() {
    node *r ;
-   if (freenodes == 0) {
-      int i ;
-      freenodes = (node *)calloc(1001, sizeof(node)) ;
-      if (freenodes == 0)
-         lifefatal("Out of memory; try reducing the hash memory limit.") ;
-      alloced += 1001 * sizeof(node) ;
-      freenodes->next = nodeblocks ;
-      nodeblocks = freenodes++ ;
-      for (i=0; i<999; i++) {
-         freenodes[1].next = freenodes ;
-         freenodes++ ;
-      }
-      totalthings += 1000 ;
-   }
-   if (freenodes->next == 0 && alloced + 1000 * sizeof(node) > maxmem &&
-       okaytogc) {
+   if (parallel)
+      return newnode_mt() ;
+   if (nodefilesaved)
+      dirtynodefile() ;
+   if (freenodes == 0)
+      sweep(0) ;
+   if (freenodes == 0)
+      addnodeblock() ;
+   if (freenodes->res == 0 && sweepnext == sweepblocks.size() &&
+       alloced + (NODEBLOCK - 1) * sizeof(node) > maxmem && okaytogc) {
       do_gc(0) ;
    }
    r = freenodes ;
-   freenodes = freenodes->next ;
+   freenodes = freenodes->res ;
    return r ;
 }
 /*
  *   Leaves are the same.
  */
 leaf *hlifealgo::newleaf() {
-   leaf *r = (leaf *)newnode() ;
-   new(&(r->leafpop))bigint ;
-   return r ;
+   return (leaf *)newnode() ;
 }
 /*
  *   Sometimes we want the new node or leaf to be automatically cleared
@@ -568,10 +1059,331 @@ node *hlifealgo::newclearednode() {
    return (node *)memset(newnode(), 0, sizeof(node)) ;
 }
 leaf *hlifealgo::newclearedleaf() {
-   leaf *r = (leaf *)newclearednode() ;
-   new(&(r->leafpop))bigint ;
+   return (leaf *)newclearednode() ;
+}
+/*
+ *   Multithreaded stepping.  The nine sub-results computed by dorecurs
+ *   (and the four after that) do not depend on each other, so for big
+ *   enough nodes we hand them to a pool of threads.  Everything below
+ *   mintaskdepth is done by whichever thread gets there, just as in
+ *   the single-threaded case.  Two threads may well end up computing
+ *   the same uncached result; since results are canonical they both
+ *   get the same answer, and we have only lost a bit of time.
+ */
+int hlifealgo::mintaskdepth = 8 ;
+/*
+ *   Same as find_node, but safe to call from any thread.  While we are
+ *   running in parallel entries are only ever added to the hash, so
+ *   when a probe reaches an empty slot we know the node is not there,
+ *   and we try to claim the slot.  If another thread got there first
+ *   we look at what it stored and carry on probing.  We grab a node to
+ *   fill in before we look, because getting one may mean parking while
+ *   worker 0 does a gc.
+ */
+#define atomicslot(i) (reinterpret_cast<std::atomic<node *> *>(hashtab + (i)))
+node *hlifealgo::find_node_mt(g_uintptr_t h, node *nw, node *ne,
+                              node *sw, node *se) {
+   node *q = newnode_mt() ;
+   hlifeworker &w = workers[lifethreads::self()] ;
+   q->nw = nw ;
+   q->ne = ne ;
+   q->sw = sw ;
+   q->se = se ;
+   q->res = 0 ;
+   g_uintptr_t tag = HASHTAG(h), i = HASHMOD(h) ;
+   w.counts.lookups++ ;
+   for (;; i = nextslot(i)) {
+      node *p = atomicslot(i)->load(std::memory_order_acquire) ;
+      if (p != 0)
+         w.counts.probes++ ;
+      if (p == 0 &&
+          atomicslot(i)->compare_exchange_strong(p, tagged(q, tag),
+                                                 std::memory_order_acq_rel))
+         break ;
+      if (slottag(p) == tag) {
+         node *s = p ;
+         p = slotnode(p) ;
+         if (nw == p->nw && ne == p->ne && sw == p->sw && se == p->se) {
+            // if someone else changes the slot first, that's fine
+            if (gcstep > 1 && !referenced(s))
+               atomicslot(i)->compare_exchange_weak(s, tagged(s, REFBIT),
+                                                   std::memory_order_relaxed) ;
+            w.counts.hits++ ;
+            q->res = w.freenodes ;
+            w.freenodes = q ;
+            return save(p) ;
+         }
+      }
+   }
+   save(q) ;
+   parinserted() ;
+   return q ;
+}
+leaf *hlifealgo::find_leaf_mt(unsigned short nw, unsigned short ne,
+                              unsigned short sw, unsigned short se) {
+   leaf *q = (leaf *)newnode_mt() ;
+   hlifeworker &w = workers[lifethreads::self()] ;
+   int filled = 0 ;
+   g_uintptr_t h = leaf_hash(nw, ne, sw, se) ;
+   g_uintptr_t tag = HASHTAG(h), i = HASHMOD(h) ;
+   w.counts.lookups++ ;
+   for (;; i = nextslot(i)) {
+      node *p = atomicslot(i)->load(std::memory_order_acquire) ;
+      if (p != 0)
+         w.counts.probes++ ;
+      if (p == 0) {
+         if (!filled) {
+            q->nw = nw ;
+            q->ne = ne ;
+            q->sw = sw ;
+            q->se = se ;
+            leafres(q) ;
+            q->isnode = 0 ;
+            filled = 1 ;
+         }
+         if (atomicslot(i)->compare_exchange_strong(p, tagged(q, tag),
+                                                    std::memory_order_acq_rel))
+            break ;
+      }
+      if (slottag(p) == tag) {
+         leaf *l = (leaf *)slotnode(p) ;
+         if (nw == l->nw && ne == l->ne && sw == l->sw && se == l->se &&
+             !is_node(l)) {
+            w.counts.hits++ ;
+            ((node *)q)->res = w.freenodes ;
+            w.freenodes = (node *)q ;
+            return (leaf *)save((node *)l) ;
+         }
+      }
+   }
+   save((node *)q) ;
+   parinserted() ;
+   return q ;
+}
+/*
+ *   The hash must never fill up, so as soon as a thread takes it past
+ *   its limit we stop the world (or ask worker 0 to) so that it can be
+ *   resized.  The new entry is already saved, so a gc will not lose it.
+ */
+void hlifealgo::parinserted() {
+   if (hashpop + ++parhashpop <= hashlimit)
+      return ;
+   if (lifethreads::self() == 0) {
+      threads->stopworld() ;
+      runexclusive() ;
+      threads->startworld() ;
+   } else {
+      threads->requestexclusive() ;
+   }
+}
+/*
+ *   Each thread takes free nodes from the shared list a batch at a
+ *   time.  As in newnode(), we gc when the shared list runs dry and we
+ *   are at the memory limit; the nodes we just took are unreachable,
+ *   so the gc simply puts them back, and we try again.
+ */
+node *hlifealgo::newnode_mt() {
+   hlifeworker &w = workers[lifethreads::self()] ;
+   while (w.freenodes == 0)
+      refill(w) ;
+   node *r = w.freenodes ;
+   w.freenodes = r->res ;
    return r ;
 }
+void hlifealgo::refill(hlifeworker &w) {
+   int wantgc = 0 ;
+   allocmutex.lock() ;
+   if (freenodes == 0)
+      addnodeblock() ;
+   node *last = freenodes ;
+   for (int i=1; i<64 && last->res; i++)
+      last = last->res ;
+   w.freenodes = freenodes ;
+   freenodes = last->res ;
+   last->res = 0 ;
+   if (freenodes == 0 && alloced + (NODEBLOCK - 1) * sizeof(node) > maxmem && okaytogc)
+      wantgc = 1 ;
+   allocmutex.unlock() ;
+   if (wantgc) {
+      gcrequested = 1 ;
+      if (lifethreads::self() == 0) {
+         threads->stopworld() ;
+         runexclusive() ;
+         threads->startworld() ;
+      } else {
+         threads->requestexclusive() ;
+      }
+   }
+}
+/*
+ *   Worker 0 checks here whether anyone needs the whole table; only
+ *   worker 0 talks to the poller.  Other workers just park if the
+ *   world is being stopped.
+ */
+void hlifealgo::mainsafepoint() {
+   if (threads->exclusivewanted() || hashpop + parhashpop > hashlimit) {
+      threads->stopworld() ;
+      runexclusive() ;
+      threads->startworld() ;
+   }
+}
+void hlifealgo::mainsafepoint(void *obj) {
+   ((hlifealgo *)obj)->mainsafepoint() ;
+}
+int hlifealgo::parallelpoll() {
+   if (lifethreads::self() == 0) {
+      mainsafepoint() ;
+      return poller->poll() || softinterrupt ;
+   }
+   threads->safepoint() ;
+   return poller->isInterrupted() || softinterrupt ;
+}
+/*
+ *   Called by worker 0 with every other thread parked.
+ */
+void hlifealgo::runexclusive() {
+   hashpop += parhashpop.exchange(0) ;
+   if (gcrequested) {
+      gcrequested = 0 ;
+      do_gc(0) ;
+   }
+   if (hashpop > hashlimit)
+      resize() ;
+}
+/*
+ *   Get the results for a set of nodes into their cache fields,
+ *   spreading the ones we don't have yet across the pool.
+ */
+struct hliferestask {
+   node *n ;
+   int depth ;
+} ;
+void hlifealgo::restask(void *obj, void *arg) {
+   hliferestask *t = (hliferestask *)arg ;
+   ((hlifealgo *)obj)->getres(t->n, t->depth) ;
+}
+void hlifealgo::spawnres(node **in, int cnt, int depth) {
+   lifejoin join ;
+   hliferestask t[9] ;
+   for (int i=0; i<cnt; i++) {
+      // only a hint; the getres that uses it loads it properly
+      if (atomicres(in[i])->load(std::memory_order_relaxed))
+         continue ;
+      int j ;
+      for (j=0; j<i; j++)
+         if (in[j] == in[i])
+            break ;
+      if (j < i)
+         continue ;
+      t[i].n = in[i] ;
+      t[i].depth = depth ;
+      threads->spawn(join, &hlifealgo::restask, this, t+i) ;
+   }
+   threads->join(join) ;
+}
+/*
+ *   The parallel version of dorecurs and dorecurs_half.  Once the
+ *   tasks are done the results are all cached (unless we were
+ *   interrupted), so the getres calls here are cheap.
+ */
+node *hlifealgo::dorecurs_mt(node *n, node *ne, node *t, node *e, int depth,
+                             int half) {
+   int sp = stacktop() ;
+   node *in[9] ;
+   in[0] = n ;
+   in[1] = find_node(n->ne, ne->nw, n->se, ne->sw) ;
+   in[2] = ne ;
+   in[3] = find_node(n->sw, n->se, t->nw, t->ne) ;
+   in[4] = find_node(n->se, ne->sw, t->ne, e->nw) ;
+   in[5] = find_node(ne->sw, ne->se, e->nw, e->ne) ;
+   in[6] = t ;
+   in[7] = find_node(t->ne, e->nw, t->se, e->sw) ;
+   in[8] = e ;
+   spawnres(in, 9, depth) ;
+   node
+   *t00 = getres(in[0], depth),
+   *t01 = getres(in[1], depth),
+   *t02 = getres(in[2], depth),
+   *t10 = getres(in[3], depth),
+   *t11 = getres(in[4], depth),
+   *t12 = getres(in[5], depth),
+   *t20 = getres(in[6], depth),
+   *t21 = getres(in[7], depth),
+   *t22 = getres(in[8], depth) ;
+   if (half) {
+      n = find_node(find_node(t00->se, t01->sw, t10->ne, t11->nw),
+                    find_node(t01->se, t02->sw, t11->ne, t12->nw),
+                    find_node(t10->se, t11->sw, t20->ne, t21->nw),
+                    find_node(t11->se, t12->sw, t21->ne, t22->nw)) ;
+   } else {
+      in[0] = find_node(t00, t01, t10, t11) ;
+      in[1] = find_node(t01, t02, t11, t12) ;
+      in[2] = find_node(t10, t11, t20, t21) ;
+      in[3] = find_node(t11, t12, t21, t22) ;
+      spawnres(in, 4, depth) ;
+      n = find_node(getres(in[0], depth), getres(in[1], depth),
+                    getres(in[2], depth), getres(in[3], depth)) ;
+   }
+   pop(sp) ;
+   return save(n) ;
+}
+/*
+ *   Start and finish a multithreaded getres.  Worker 0 is the calling
+ *   thread; its saves in the meantime go to its worker stack, and
+ *   the main stack stays as it was.
+ */
+void hlifealgo::beginparallel() {
+   int n = getNumThreads() ;
+   if (threads == 0)
+      threads = new lifethreads() ;
+   threads->setthreads(n) ;
+   if (nworkers != n) {
+      for (int i=0; i<nworkers; i++)
+         if (workers[i].stack)
+            free(workers[i].stack) ;
+      delete [] workers ;
+      workers = new hlifeworker[n] ;
+      for (int i=0; i<n; i++) {
+         workers[i].stack = 0 ;
+         workers[i].stacksize = 0 ;
+      }
+      nworkers = n ;
+   }
+   for (int i=0; i<n; i++) {
+      workers[i].gsp = 0 ;
+      workers[i].freenodes = 0 ;
+      workers[i].perf.clear() ;
+      workers[i].counts.clear() ;
+   }
+   gcrequested = 0 ;
+   parhashpop = 0 ;
+   finishresize() ;
+   sweep(1) ;
+   parallel = 1 ;
+   threads->begin(&hlifealgo::mainsafepoint, this) ;
+}
+void hlifealgo::endparallel() {
+   threads->end() ;
+   parallel = 0 ;
+   hashpop += parhashpop.exchange(0) ;
+   for (int i=0; i<nworkers; i++) {
+      hlifeworker &w = workers[i] ;
+      while (w.freenodes) {
+         node *r = w.freenodes ;
+         w.freenodes = r->res ;
+         r->res = freenodes ;
+         freenodes = r ;
+      }
+      running_hperf.fastNodeInc += w.perf.fastNodeInc ;
+      running_hperf.depthSum += w.perf.depthSum ;
+      running_hperf.halfNodes += w.perf.halfNodes ;
+      w.perf.clear() ;
+      counts.add(w.counts) ;
+      w.counts.clear() ;
+   }
+   if (hashpop > hashlimit)
+      resize() ;
+}
 hlifealgo::hlifealgo() {
    int i ;
 /*
@@ -589,10 +1401,18 @@ hlifealgo::hlifealgo() {
 #endif
    hashlimit = (g_uintptr_t)(maxloadfactor * hashprime) ;
    hashpop = 0 ;
-   hashtab = (node **)calloc(hashprime, sizeof(node *)) ;
+   nodepool = new blockpool(NODEBLOCK * sizeof(node), NODEBLOCKALIGN) ;
+   hashtab = (node **)bigcalloc(hashprime, sizeof(node *)) ;
    if (hashtab == 0)
      lifefatal("Out of memory (1).") ;
+   oldhashtab = 0 ;
+   oldhashprime = 0 ;
+   oldhashnext = 0 ;
    alloced = hashprime * sizeof(node *) ;
+   poptab = 0 ;
+   clearpops() ;
+   steptab = 0 ;
+   clearsteps() ;
    ngens = 0 ;
    stacksize = 0 ;
    halvesdone = 0 ;
@@ -604,19 +1424,40 @@ hlifealgo::hlifealgo() {
    okaytogc = 0 ;
    totalthings = 0 ;
    nodeblocks = 0 ;
+   nodefd = -1 ;
+   nodefilesaved = 0 ;
+   arenabase = 0 ;
+   arenasize = arenaused = arenafile = 0 ;
+   sweepnext = 0 ;
+   livenext = 0 ;
+   maxgcpause = 0 ;
+   lastgcpause = 0 ;
+   totalgcpause = 0 ;
+   lastgcfreed = 1 ;
    zeronodea = 0 ;
    ruletable = hliferules.rule0 ;
+   slicerule = 0 ;
+   threads = 0 ;
+   workers = 0 ;
+   nworkers = 0 ;
+   parallel = 0 ;
+   gcrequested = 0 ;
+   parhashpop = 0 ;
+   store = 0 ;
+   current = 0 ;
+   storecalls = 0 ;
 /*
  *   We initialize our universe to be a 16-square.  We are in drawing
- *   mode at this point.
+ *   mode at this point.  If we share a store, the square comes from
+ *   there.
  */
-   root = (node *)newclearednode() ;
+   root = sharenodes ? 0 : (node *)newclearednode() ;
    population = 0 ;
    generation = 0 ;
    increment = 1 ;
    setincrement = 1 ;
-   nonpow2 = 1 ;
-   pow2step = 1 ;
+   setstepbits() ;
+   stepgrid = BORDERGRID ;
    llsize = 0 ;
    depth = 3 ;
    hashed = 0 ;
@@ -625,22 +1466,47 @@ hlifealgo::hlifealgo() {
    inGC = 0 ;
    cacheinvalid = 0 ;
    gccount = 0 ;
+   invalidations = 0 ;
+   counts.clear() ;
    gcstep = 0 ;
    running_hperf.clear() ;
    inc_hperf = running_hperf ;
    step_hperf = running_hperf ;
    softinterrupt = 0 ;
+   if (sharenodes) {
+      joinstore() ;
+      storecall c(this) ;
+      store->root = store->newclearednode() ;
+   }
 }
 /**
  *   Destructor frees memory.
  */
 hlifealgo::~hlifealgo() {
-   free(hashtab) ;
+   if (store)
+      leavestore(store) ;
+   delete threads ;
+   for (int i=0; i<nworkers; i++)
+      if (workers[i].stack)
+         free(workers[i].stack) ;
+   delete [] workers ;
+   bigfree(hashtab) ;
+   bigfree(oldhashtab) ;
+   bigfree(poptab) ;
+   bigfree(steptab) ;
+#ifdef NODEFILES
+   if (nodefd >= 0) {
+      munmap(arenabase, arenasize) ;
+      close(nodefd) ;
+      nodeblocks = 0 ;
+   }
+#endif
    while (nodeblocks) {
       node *r = nodeblocks ;
-      nodeblocks = nodeblocks->next ;
-      free(r) ;
+      nodeblocks = nodeblocks->res ;
+      freenodeblock(r) ;
    }
+   delete nodepool ;
    if (zeronodea)
       free(zeronodea) ;
    if (stack)
@@ -650,10 +1516,514 @@ hlifealgo::~hlifealgo() {
       delete [] llyb ;
    }
 }
+/*
+ *   The node stores, one for each rule that universes sharing nodes are
+ *   using.
+ */
+int hlifealgo::sharenodes = 0 ;
+static std::map<std::string, hlifealgo *> nodestores ;
+/*
+ *   Start using the store for our rule, making it if there is none.
+ */
+void hlifealgo::joinstore() {
+   hlifealgo *&s = nodestores[getrule()] ;
+   if (s == 0) {
+      int share = sharenodes ;
+      sharenodes = 0 ;
+      s = new hlifealgo() ;
+      sharenodes = share ;
+      s->setrule(getrule()) ;
+   }
+   store = s ;
+   s->sharers.push_back(this) ;
+}
+/*
+ *   Stop using a store; if nobody else is using it, free it.  Our nodes
+ *   there are left for its next gc.
+ */
+void hlifealgo::leavestore(hlifealgo *s) {
+   s->sharers.erase(std::find(s->sharers.begin(), s->sharers.end(), this)) ;
+   if (s->current == this) {
+      s->current = 0 ;
+      s->root = 0 ;
+      s->poller = &default_poller ;
+   }
+   if (s->sharers.empty()) {
+      nodestores.erase(s->getrule()) ;
+      delete s ;
+   }
+}
+/*
+ *   Lend our pattern to the store for the length of a call.  The nodes
+ *   of a pattern that has not been hashed yet are not anywhere the gc
+ *   can see, so we hash the last universe's pattern before the store
+ *   goes on to anyone else.  A call made from inside a call (by the
+ *   poller, say) finds our pattern already there.
+ */
+void hlifealgo::bindstore() {
+   hlifealgo *s = store ;
+   if (s->storecalls++ > 0) {
+      if (s->current != this)
+         lifefatal("Two universes sharing nodes were used at once.") ;
+      return ;
+   }
+   if (s->current != this) {
+      hlifealgo *last = s->current ;
+      if (last != 0 && !last->hashed) {
+         s->lendpattern(last) ;
+         s->ensure_hashed() ;
+         s->returnpattern(last) ;
+      }
+      s->current = this ;
+   }
+   s->lendpattern(this) ;
+}
+void hlifealgo::unbindstore() {
+   hlifealgo *s = store ;
+   if (--s->storecalls == 0)
+      s->returnpattern(this) ;
+}
+void hlifealgo::lendpattern(hlifealgo *u) {
+   root = u->root ;
+   depth = u->depth ;
+   hashed = u->hashed ;
+   population = u->population ;
+   popValid = u->popValid ;
+   needPop = u->needPop ;
+   softinterrupt = u->softinterrupt ;
+   generation = u->generation ;
+   increment = u->increment ;
+   poller = u->poller ;
+}
+void hlifealgo::returnpattern(hlifealgo *u) {
+   u->root = root ;
+   u->depth = depth ;
+   u->hashed = hashed ;
+   u->population = population ;
+   u->popValid = popValid ;
+   u->needPop = needPop ;
+   u->softinterrupt = softinterrupt ;
+   u->generation = generation ;
+   u->increment = increment ;
+}
+/*
+ *   Build a copy of a hashed tree from another store in this one.
+ */
+node *hlifealgo::copytree(node *n, std::map<node *, node *> &copies) {
+   node *&r = copies[n] ;
+   if (r == 0) {
+      if (is_node(n)) {
+         r = find_node(copytree(n->nw, copies), copytree(n->ne, copies),
+                       copytree(n->sw, copies), copytree(n->se, copies)) ;
+      } else {
+         leaf *l = (leaf *)n ;
+         r = (node *)find_leaf(l->nw, l->ne, l->sw, l->se) ;
+      }
+   }
+   return r ;
+}
+/*
+ *   Our rule has changed, so our pattern and timeline move to the store
+ *   for the new rule.  A new store starts with the old one's limit.
+ */
+void hlifealgo::movestore() {
+   hlifealgo *from = store ;
+   if (strcmp(from->getrule(), getrule()) == 0)
+      return ;
+   {
+      storecall c(this) ;
+      from->ensure_hashed() ;
+   }
+   joinstore() ;
+   if (store->sharers.size() == 1)
+      store->setMaxMemory((int)(from->maxmem >> 20)) ;
+   std::map<node *, node *> copies ;
+   root = store->copytree(root, copies) ;
+   for (int i=0; i<timeline.framecount; i++)
+      timeline.frames[i] = store->copytree((node *)timeline.frames[i],
+                                           copies) ;
+   leavestore(from) ;
+}
+/*
+ *   A node file starts with a header page saying what was saved in it;
+ *   the node blocks follow, packed one after another, and a saved run
+ *   puts a copy of the hash table after the last block.  The arena is a
+ *   single shared mapping of the file, reserved much larger than the
+ *   file so that it never has to move; we grow the file underneath it a
+ *   chunk at a time.  Since nodes point at each other directly, when we
+ *   pick up a saved run we ask for the mapping at the address it had
+ *   before, and if we do not get it, we walk the saved nodes and move
+ *   their pointers.
+ *
+ *   Once anything changes after a save, the file no longer holds that
+ *   run, so the first change clears the saved flag.
+ */
+#ifdef NODEFILES
+#define NODEFILEMAGIC "hlnodes"
+#define NODEFILEVERSION (3)
+#define NODEFILEHEADER (4096)
+#define NODEFILEGROW ((g_uintptr_t)64 << 20)
+#define NODEFILEBIGINT (1024)
+#ifdef GOLLY64BIT
+#define NODEFILERESERVE ((g_uintptr_t)1 << 40)
+#else
+#define NODEFILERESERVE ((g_uintptr_t)1 << 30)
+#endif
+#define NODEFILEMINRESERVE ((g_uintptr_t)1 << 26)
+struct nodefileheader {
+   char magic[8] ;
+   int version, nodesize, ptrsize, nodeblock ;
+   int saved ;          // nonzero if everything below is good
+   int depth, ngens, halvesdone ;
+   g_uintptr_t base, used, hashprime, hashpop, totalthings ;
+   node *root, *freenodes, *nodeblocks ;
+   char rule[MAXRULESIZE] ;
+   char generation[NODEFILEBIGINT], increment[NODEFILEBIGINT] ;
+} ;
+/*
+ *   On Linux we make the file system find room for the new part of the
+ *   file now; otherwise running out of disk would only show up later,
+ *   as a fault when we first touch a node there.
+ */
+static int growfile(int fd, g_uintptr_t oldsize, g_uintptr_t newsize) {
+#ifdef __linux__
+   return posix_fallocate(fd, (off_t)oldsize, (off_t)(newsize - oldsize)) ;
+#else
+   return ftruncate(fd, (off_t)newsize) ;
+#endif
+}
+static char *mapnodefile(int fd, void *want, g_uintptr_t &size) {
+   for (size=NODEFILERESERVE; size>=NODEFILEMINRESERVE; size >>= 1) {
+      void *p = mmap(want, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) ;
+      if (p != MAP_FAILED)
+         return (char *)p ;
+   }
+   return 0 ;
+}
+static int fileio(int fd, char *p, g_uintptr_t n, g_uintptr_t off, int out) {
+   while (n > 0) {
+      ssize_t r = out ? pwrite(fd, p, n, (off_t)off) : pread(fd, p, n, (off_t)off) ;
+      if (r <= 0)
+         return -1 ;
+      p += r ;
+      off += r ;
+      n -= r ;
+   }
+   return 0 ;
+}
+/*
+ *   Before we trust a saved run, make sure the header agrees with the
+ *   size of the file: the blocks and the copy of the hash must fit in
+ *   it, and everything the header points at must be a node inside the
+ *   blocks (or null, for the two lists).
+ */
+static int badpointer(node *p, const nodefileheader &h, int canbenull) {
+   if (p == 0)
+      return !canbenull ;
+   g_uintptr_t first = h.base + NODEFILEHEADER ;
+   g_uintptr_t off = (g_uintptr_t)p - first ;
+   return (g_uintptr_t)p < first || off >= h.used || off % sizeof(node) != 0 ;
+}
+static int badheader(const nodefileheader &h, g_uintptr_t filesize) {
+   if (filesize < NODEFILEHEADER ||
+       h.used > filesize - NODEFILEHEADER ||
+       h.used % (NODEBLOCK * sizeof(node)) != 0)
+      return 1 ;
+   g_uintptr_t room = (filesize - NODEFILEHEADER - h.used) / sizeof(node *) ;
+   if (h.hashprime == 0 || h.hashprime > room || h.hashpop > h.hashprime)
+      return 1 ;
+#ifndef PRIMEMOD
+   if ((h.hashprime & (h.hashprime - 1)) != 0)
+      return 1 ;
+#endif
+   return badpointer(h.root, h, 0) || badpointer(h.freenodes, h, 1) ||
+          badpointer(h.nodeblocks, h, 1) ;
+}
+static void setsaved(char *arenabase, int saved) {
+   ((nodefileheader *)arenabase)->saved = saved ;
+   msync(arenabase, NODEFILEHEADER, MS_SYNC) ;
+}
+#endif
+/*
+ *   Carve the next block out of the node file.
+ */
+node *hlifealgo::arenablock() {
+#ifdef NODEFILES
+   g_uintptr_t bytes = NODEBLOCK * sizeof(node) ;
+   g_uintptr_t end = NODEFILEHEADER + arenaused + bytes ;
+   if (end > arenasize)
+      return 0 ;
+   if (end > arenafile) {
+      g_uintptr_t newsize = arenafile + NODEFILEGROW ;
+      if (newsize > arenasize)
+         newsize = arenasize ;
+      if (growfile(nodefd, arenafile, newsize))
+         return 0 ;
+      arenafile = newsize ;
+   }
+   node *b = (node *)(arenabase + NODEFILEHEADER + arenaused) ;
+   arenaused += bytes ;
+   memset(b, 0, bytes) ;
+   return b ;
+#else
+   return 0 ;
+#endif
+}
+void hlifealgo::dirtynodefile() {
+#ifdef NODEFILES
+   setsaved(arenabase, 0) ;
+#endif
+   nodefilesaved = 0 ;
+}
+/*
+ *   Everything that points at a node is either in the hash, or is the
+ *   root, or is on the free list or the list of blocks; move them all.
+ */
+void hlifealgo::rebasenodes(g_uintptr_t oldbase) {
+#ifdef NODEFILES
+   g_uintptr_t delta = (g_uintptr_t)arenabase - oldbase ;
+#define rebased(p) ((p) ? (node *)((g_uintptr_t)(p) + delta) : (node *)0)
+   node *p ;
+   for (g_uintptr_t i=0; i<hashprime; i++) {
+      if ((i & 65535) == 0)
+         poller->poll() ;
+      p = slotnode(hashtab[i]) ;
+      if (p == 0)
+         continue ;
+      p = rebased(p) ;
+      hashtab[i] = tagged(p, TAGMASK & (g_uintptr_t)hashtab[i]) ;
+      if (is_node(p)) {
+         p->nw = rebased(p->nw) ;
+         p->ne = rebased(p->ne) ;
+         p->sw = rebased(p->sw) ;
+         p->se = rebased(p->se) ;
+         p->res = rebased(p->res) ;
+      }
+   }
+   root = rebased(root) ;
+   freenodes = rebased(freenodes) ;
+   for (p=freenodes; p; p=p->res)
+      p->res = rebased(p->res) ;
+   nodeblocks = rebased(nodeblocks) ;
+   for (p=nodeblocks; p; p=p->res)
+      p->res = rebased(p->res) ;
+#undef rebased
+#else
+   (void)oldbase ;
+#endif
+}
+const char *hlifealgo::setnodefile(const char *filename, int &resumed) {
+   resumed = 0 ;
+   if (store)
+      return "Node files cannot be used with shared nodes." ;
+#ifdef NODEFILES
+   if (nodefd >= 0)
+      return "This universe already has a node file." ;
+   if (hashed || generation != 0)
+      return "The node file must be set before anything is loaded." ;
+   finishresize() ;
+   int fd = open(filename, O_RDWR | O_CREAT, 0666) ;
+   if (fd < 0)
+      return "Cannot open the node file." ;
+   struct stat st ;
+   nodefileheader h ;
+   memset(&h, 0, sizeof(h)) ;
+   if (fstat(fd, &st) || (st.st_size >= (off_t)sizeof(h) &&
+       fileio(fd, (char *)&h, sizeof(h), 0, 0))) {
+      close(fd) ;
+      return "Cannot read the node file." ;
+   }
+   if (st.st_size > 0) {
+      if (strncmp(h.magic, NODEFILEMAGIC, sizeof(h.magic)) != 0) {
+         close(fd) ;
+         return "That is not a node file." ;
+      }
+      if (h.version != NODEFILEVERSION || h.nodesize != (int)sizeof(node) ||
+          h.ptrsize != (int)sizeof(node *) || h.nodeblock != NODEBLOCK) {
+         close(fd) ;
+         return "That node file was written by a different version." ;
+      }
+      if (h.saved && badheader(h, (g_uintptr_t)st.st_size)) {
+         close(fd) ;
+         return "That node file is damaged." ;
+      }
+   }
+   int resume = h.saved ;
+   if (resume) {
+      const char *err = setrule(h.rule) ;
+      if (err) {
+         close(fd) ;
+         return err ;
+      }
+      cacheinvalid = 0 ; // the saved results are for this rule
+      arenafile = st.st_size ;
+   } else {
+      arenafile = NODEFILEHEADER + NODEFILEGROW ;
+      if (ftruncate(fd, 0) || growfile(fd, 0, arenafile)) {
+         close(fd) ;
+         return "Cannot make room for the node file." ;
+      }
+   }
+   arenabase = mapnodefile(fd, resume ? (void *)h.base : 0, arenasize) ;
+   if (arenabase == 0 || arenasize < arenafile) {
+      if (arenabase)
+         munmap(arenabase, arenasize) ;
+      close(fd) ;
+      return "Cannot map the node file." ;
+   }
+   node **ohashtab = hashtab ;
+   if (resume) {
+      hashtab = (node **)bigcalloc(h.hashprime, sizeof(node *)) ;
+      if (hashtab == 0 ||
+          fileio(fd, (char *)hashtab, h.hashprime * sizeof(node *),
+                 NODEFILEHEADER + h.used, 0)) {
+         bigfree(hashtab) ;
+         hashtab = ohashtab ;
+         munmap(arenabase, arenasize) ;
+         close(fd) ;
+         return "Cannot read the hash from the node file." ;
+      }
+      g_uintptr_t inhash = 0 ;
+      for (g_uintptr_t i=0; i<h.hashprime; i++)
+         if (slotnode(hashtab[i]))
+            inhash++ ;
+      if (inhash != h.hashpop) {
+         bigfree(hashtab) ;
+         hashtab = ohashtab ;
+         munmap(arenabase, arenasize) ;
+         close(fd) ;
+         return "That node file is damaged." ;
+      }
+      bigfree(ohashtab) ;
+   }
+/*
+ *   We can't fail now; throw away the empty universe we started with.
+ */
+   nodefd = fd ;
+   while (nodeblocks) {
+      node *r = nodeblocks ;
+      nodeblocks = nodeblocks->res ;
+      freenodeblock(r) ;
+   }
+   nodepool->release() ;
+   if (zeronodea)
+      free(zeronodea) ;
+   zeronodea = 0 ;
+   nzeros = 0 ;
+   freenodes = 0 ;
+   clearpops() ;
+   clearsteps() ;
+   if (resume) {
+      hashprime = h.hashprime ;
+#ifndef PRIMEMOD
+      hashmask = hashprime - 1 ;
+#endif
+      hashlimit = (g_uintptr_t)(maxloadfactor * hashprime) ;
+      hashpop = h.hashpop ;
+      alloced = hashprime * sizeof(node *) + h.used ;
+      alloced += (popmask + 1) * sizeof(popentry) ;
+      alloced += (stepmask + 1) * sizeof(stepentry) ;
+      arenaused = h.used ;
+      totalthings = h.totalthings ;
+      root = h.root ;
+      freenodes = h.freenodes ;
+      nodeblocks = h.nodeblocks ;
+      if ((g_uintptr_t)arenabase != h.base)
+         rebasenodes(h.base) ;
+      depth = h.depth ;
+      ngens = h.ngens ;
+      halvesdone = h.halvesdone ;
+      generation = bigint(h.generation) ;
+      setincrement = bigint(h.increment) ;
+      increment = setincrement ;
+      setstepbits() ;
+      hashed = 1 ;
+      popValid = 0 ;
+      resumed = 1 ;
+   } else {
+      memset(hashtab, 0, sizeof(node *) * hashprime) ;
+      hashpop = 0 ;
+      alloced = hashprime * sizeof(node *) ;
+      alloced += (popmask + 1) * sizeof(popentry) ;
+      alloced += (stepmask + 1) * sizeof(stepentry) ;
+      totalthings = 0 ;
+      nodeblocks = 0 ;
+      arenaused = 0 ;
+      memset(&h, 0, sizeof(h)) ;
+      strcpy(h.magic, NODEFILEMAGIC) ;
+      h.version = NODEFILEVERSION ;
+      h.nodesize = (int)sizeof(node) ;
+      h.ptrsize = (int)sizeof(node *) ;
+      h.nodeblock = NODEBLOCK ;
+      memcpy(arenabase, &h, sizeof(h)) ;
+      root = (node *)newclearednode() ;
+   }
+   dirtynodefile() ;
+   return 0 ;
+#else
+   (void)filename ;
+   return "Node files are not supported in this build." ;
+#endif
+}
+/*
+ *   Save the current run in the node file, so that setnodefile() can
+ *   pick it up again later.  We finish the lazy sweep first, so every
+ *   node is either in the hash or on the free list.
+ */
+const char *hlifealgo::savenodefile() {
+#ifdef NODEFILES
+   if (nodefd < 0)
+      return "This universe has no node file." ;
+   poller->bailIfCalculating() ;
+   ensure_hashed() ;
+   finishresize() ;
+   sweep(1) ;
+   if (nodefilesaved)
+      dirtynodefile() ;
+   nodefileheader *h = (nodefileheader *)arenabase ;
+   const char *gen = generation.tostring() ;
+   if (strlen(gen) >= NODEFILEBIGINT)
+      return "The generation is too large to save in the node file." ;
+   strcpy(h->generation, gen) ;
+   const char *inc = setincrement.tostring() ;
+   if (strlen(inc) >= NODEFILEBIGINT)
+      return "The step is too large to save in the node file." ;
+   strcpy(h->increment, inc) ;
+   strncpy(h->rule, getrule(), MAXRULESIZE - 1) ;
+   h->depth = depth ;
+   h->ngens = ngens ;
+   h->halvesdone = halvesdone ;
+   h->base = (g_uintptr_t)arenabase ;
+   h->used = arenaused ;
+   h->hashprime = hashprime ;
+   h->hashpop = hashpop ;
+   h->totalthings = totalthings ;
+   h->root = root ;
+   h->freenodes = freenodes ;
+   h->nodeblocks = nodeblocks ;
+   g_uintptr_t hashbytes = hashprime * sizeof(node *) ;
+   if (fileio(nodefd, (char *)hashtab, hashbytes, NODEFILEHEADER + arenaused, 1) ||
+       msync(arenabase, NODEFILEHEADER + arenaused, MS_SYNC) ||
+       fsync(nodefd))
+      return "Cannot write the node file." ;
+   if (NODEFILEHEADER + arenaused + hashbytes > arenafile)
+      arenafile = NODEFILEHEADER + arenaused + hashbytes ;
+   setsaved(arenabase, 1) ;
+   nodefilesaved = 1 ;
+   return 0 ;
+#else
+   return "Node files are not supported in this build." ;
+#endif
+}
 /**
  *   Set increment.
  */
 void hlifealgo::setIncrement(bigint inc) {
+   if (store) {
+      storecall c(this) ;
+      store->setIncrement(inc) ;
+      return ;
+   }
    if (inc < increment)
       softinterrupt = 1 ;
    increment = inc ;
@@ -662,24 +2032,38 @@ void hlifealgo::setIncrement(bigint inc) {
  *   Do a step.
  */
 void hlifealgo::step() {
+   if (store) {
+      storecall c(this) ;
+      store->step() ;
+      return ;
+   }
    poller->bailIfCalculating() ;
+   if (nodefilesaved)
+      dirtynodefile() ;
    // we use while here because the increment may be changed while we are
    // doing the hashtable sweep; if that happens, we may need to sweep
    // again.
    while (1) {
       int cleareddownto = 1000000000 ;
       softinterrupt = 0 ;
-      while (increment != setincrement) {
+      while (increment != setincrement || stepgrid != nativegrid()) {
          bigint pendingincrement = increment ;
-         int newpow2 = 0 ;
-         bigint t = pendingincrement ;
-         while (t > 0 && t.even()) {
-            newpow2++ ;
-            t.div2() ;
+         setincrement = pendingincrement ;
+         stepgrid = nativegrid() ;
+         setstepbits() ;
+         clearsteps() ;
+         if (stepbits.empty())
+            continue ;
+         int newpow2 = (int)stepbits.size() - 1 ;
+         int most = gridngens() ;
+         if (newpow2 > most) {
+            // the rest is done in full steps of 2^ngens; see runtorus
+            newpow2 = most ;
+            stepbits.resize(most + 1) ;
+            stepbits[most] = 1 ;
+            if (steplow > most)
+               steplow = most ;
          }
-         nonpow2 = t.low31() ;
-         if (t != nonpow2)
-            lifefatal("bad increment") ;
          int downto = newpow2 ;
          if (ngens < newpow2)
             downto = ngens ;
@@ -689,17 +2073,11 @@ void hlifealgo::step() {
          } else {
             ngens = newpow2 ;
          }
-         setincrement = pendingincrement ;
-         pow2step = 1 ;
-         while (newpow2--)
-            pow2step += pow2step ;
       }
       gcstep = 0 ;
       running_hperf.genval = generation.todouble() ;
-      for (int i=0; i<nonpow2; i++) {
-         node *newroot = runpattern() ;
-         if (newroot == 0 || softinterrupt || poller->isInterrupted()) // we *were* interrupted
-            break ;
+      node *newroot = setincrement == 0 ? 0 : runpattern() ;
+      if (newroot != 0 && !softinterrupt && !poller->isInterrupted()) {
          popValid = 0 ;
          root = newroot ;
          depth = node_depth(root) ;
@@ -716,10 +2094,134 @@ void hlifealgo::setcurrentstate(void *n) {
       popValid = 0 ;
    }
 }
+/*
+ *   For period search:  the cellhash of a state, moved so its bounding
+ *   box starts at the origin.  We hash the tree from its top left
+ *   corner, then move the hash by the offset of the box from there,
+ *   which we give up on (returning 0) in a tree too deep for 64 bits.
+ *   Hashes of nodes are kept until the next gc, since a step leaves
+ *   most of the tree as it was.
+ */
+int hlifealgo::hashstate(void *state, const bigint &top, const bigint &left,
+                         cellhash &h) {
+   if (store) {
+      storecall c(this) ;
+      return store->hashstate(state, top, left, h) ;
+   }
+   node *n = (node *)state ;
+   int d = node_depth(n) ;
+   if (d >= 50)
+      return 0 ;
+   double half = ldexp(1.0, d) ;
+   double x = left.todouble() + half ;
+   double y = top.todouble() + half - 1 ;
+   if (x < 0 || y < 0)
+      return 0 ;
+   h = hashnode(n, d).moved((unsigned long long)x, (unsigned long long)y) ;
+   return 1 ;
+}
+cellhash hlifealgo::hashnode(node *n, int d) {
+   if (n == zeronode(d))
+      return cellhash() ;
+   std::unordered_map<node *, cellhash>::iterator it = cellhashes.find(n) ;
+   if (it != cellhashes.end())
+      return it->second ;
+   cellhash r ;
+   if (d == 2) {
+      leaf *l = (leaf *)n ;
+      unsigned int top, bot ;
+      unpack8x8(l->nw, l->ne, l->sw, l->se, &top, &bot) ;
+      unsigned long long bits = ((unsigned long long)top << 32) | bot ;
+      for (int i=0; i<64; i++)
+         if ((bits >> (63 - i)) & 1)
+            r.addcell(1, i & 7, i >> 3) ;
+   } else {
+      r = cellhash::quads(hashnode(n->nw, d-1), hashnode(n->ne, d-1),
+                          hashnode(n->sw, d-1), hashnode(n->se, d-1), d) ;
+   }
+   cellhashes[n] = r ;
+   return r ;
+}
+/*
+ *   The part of n (at depth d) in the square of side 2^(wd+1) whose top
+ *   left corner is x across and y down from n's top left corner.  A
+ *   square that falls inside one quadrant is found in that quadrant;
+ *   one that straddles them is built from four smaller squares.
+ */
+node *hlifealgo::window(node *n, int d, long long x, long long y, int wd,
+                        windowmemo &memo) {
+   long long s = (long long)1 << (d + 1) ;
+   long long ws = (long long)1 << (wd + 1) ;
+   if (n == zeronode(d) || x >= s || y >= s || x + ws <= 0 || y + ws <= 0)
+      return zeronode(wd) ;
+   if (x == 0 && y == 0 && wd == d)
+      return n ;
+   if (d > wd) {
+      long long half = s >> 1 ;
+      long long ox = (x >= half) ? half : 0 ;
+      long long oy = (y >= half) ? half : 0 ;
+      if (x >= ox && x + ws <= ox + half && y >= oy && y + ws <= oy + half) {
+         node *q = oy ? (ox ? n->se : n->sw) : (ox ? n->ne : n->nw) ;
+         return window(q, d-1, x-ox, y-oy, wd, memo) ;
+      }
+   }
+   if (wd == 2) {
+      unsigned long long bits = 0 ;
+      windowbits(n, d, x, y, bits) ;
+      return (node *)packleaf(bits) ;
+   }
+   std::tuple<node *, long long, long long, int> key(n, x, y, wd) ;
+   windowmemo::iterator it = memo.find(key) ;
+   if (it != memo.end())
+      return it->second ;
+   long long hw = ws >> 1 ;
+   node *r = find_node(window(n, d, x, y, wd-1, memo),
+                       window(n, d, x+hw, y, wd-1, memo),
+                       window(n, d, x, y+hw, wd-1, memo),
+                       window(n, d, x+hw, y+hw, wd-1, memo)) ;
+   memo[key] = r ;
+   return r ;
+}
+/*
+ *   Or into bits (eight rows of eight, top row in the high byte, left
+ *   cell in each byte's high bit) the cells of n that fall in the 8x8
+ *   square x across and y down from n's top left corner.
+ */
+void hlifealgo::windowbits(node *n, int d, long long x, long long y,
+                           unsigned long long &bits) {
+   long long s = (long long)1 << (d + 1) ;
+   if (n == zeronode(d) || x >= s || y >= s || x + 8 <= 0 || y + 8 <= 0)
+      return ;
+   if (d > 2) {
+      long long half = s >> 1 ;
+      windowbits(n->nw, d-1, x, y, bits) ;
+      windowbits(n->ne, d-1, x-half, y, bits) ;
+      windowbits(n->sw, d-1, x, y-half, bits) ;
+      windowbits(n->se, d-1, x-half, y-half, bits) ;
+      return ;
+   }
+   leaf *l = (leaf *)n ;
+   unsigned int top, bot ;
+   unpack8x8(l->nw, l->ne, l->sw, l->se, &top, &bot) ;
+   unsigned long long lb = ((unsigned long long)top << 32) | bot ;
+   for (int i=0; i<8; i++) {
+      long long wr = i - y ;
+      if (wr < 0 || wr >= 8)
+         continue ;
+      unsigned int row = (unsigned int)(lb >> (56 - 8 * i)) & 0xff ;
+      row = (x >= 0) ? (row << x) : (row >> -x) ;
+      bits |= (unsigned long long)(row & 0xff) << (56 - 8 * wr) ;
+   }
+}
 /*
  *   Set the max memory
  */
 void hlifealgo::setMaxMemory(int newmemlimit) {
+   if (store) {
+      storecall c(this) ;
+      store->setMaxMemory(newmemlimit) ;
+      return ;
+   }
    if (newmemlimit < 10)
      newmemlimit = 10 ;
 #ifndef GOLLY64BIT
@@ -886,7 +2388,7 @@ node *hlifealgo::gsetbit(node *n, int x, int y, int newstate, int depth) {
          wh = 1 << (depth - 1) ;
       }
       depth-- ;
-      node **nptr ;
+      nodefield *nptr ;
       if (depth+1 == this->depth || depth < 31) {
          if (x < 0) {
             if (y < 0)
@@ -921,10 +2423,10 @@ node *hlifealgo::gsetbit(node *n, int x, int y, int newstate, int depth) {
       node *s = gsetbit(*nptr, (x & (w - 1)) - wh,
                                (y & (w - 1)) - wh, newstate, depth) ;
       if (hashed) {
-         node *nw = (nptr == &(n->nw) ? s : n->nw) ;
-         node *sw = (nptr == &(n->sw) ? s : n->sw) ;
-         node *ne = (nptr == &(n->ne) ? s : n->ne) ;
-         node *se = (nptr == &(n->se) ? s : n->se) ;
+         node *nw = (nptr == &(n->nw) ? s : (node *)n->nw) ;
+         node *sw = (nptr == &(n->sw) ? s : (node *)n->sw) ;
+         node *ne = (nptr == &(n->ne) ? s : (node *)n->ne) ;
+         node *se = (nptr == &(n->se) ? s : (node *)n->se) ;
          n = save(find_node(nw, ne, sw, se)) ;
       } else {
          *nptr = s ;
@@ -1055,6 +2557,10 @@ int hlifealgo::nextbit(node *n, int x, int y, int depth) {
  *   flag to inhibit popcount.
  */
 int hlifealgo::setcell(int x, int y, int newstate) {
+   if (store) {
+      storecall c(this) ;
+      return store->setcell(x, y, newstate) ;
+   }
    if (newstate & ~1)
       return -1 ;
    if (hashed) {
@@ -1087,12 +2593,149 @@ int hlifealgo::setcell(int x, int y, int newstate) {
    if (hashed) {
       okaytogc = 0 ;
    }
-   return 0 ;
+   return 0 ;
+}
+/*
+ *   Bulk loading.  Rather than walk down from the root for each cell,
+ *   we gather the batch into leaves, sort those into Morton order so
+ *   each quadrant's leaves are together, build the tree over them from
+ *   the bottom up straight into hashed nodes, and lay that over the
+ *   universe.
+ */
+int hlifealgo::setcells(const vector<loadcell> &cells) {
+   if (store) {
+      storecall c(this) ;
+      return store->setcells(cells) ;
+   }
+   for (size_t i=0; i<cells.size(); i++)
+      if (cells[i].state & ~1)
+         return -1 ;
+   int bd = mortondepth(cells, 3) ;
+   if (bd < 0)
+      return lifealgo::setcells(cells) ;
+   if (cells.empty())
+      return 0 ;
+   ensure_hashed() ;
+   clearstack() ;
+   save(root) ;
+   okaytogc = 1 ;
+   node *b = buildcells(cells, bd) ;
+   while (depth < bd) {
+      root = save(pushroot(root)) ;
+      depth++ ;
+   }
+   while (bd < depth) {
+      b = save(pushroot(b)) ;
+      bd++ ;
+   }
+   root = save(overlay(root, b, depth)) ;
+   okaytogc = 0 ;
+   popValid = 0 ;
+   return 0 ;
+}
+/*
+ *   The tree of depth d for the cells.  Each 8x8 leaf is gathered as 64
+ *   bits (top row in the high byte, left cell in each byte's high bit)
+ *   in a table keyed by its row and column; the readers mostly go along
+ *   rows, so we keep hold of the last leaf we touched.  Then we sort
+ *   the leaves by Morton key and build the nodes over them.
+ */
+node *hlifealgo::buildcells(const vector<loadcell> &cells, int d) {
+   long long half = (long long)1 << d ;
+   std::unordered_map<unsigned long long, unsigned long long> gathered ;
+   unsigned long long lastat = ~0ULL, *bits = 0 ;
+   for (size_t i=0; i<cells.size(); i++) {
+      unsigned long long col = cells[i].x + half ;
+      unsigned long long row = cells[i].y + half - 1 ;
+      unsigned long long at = ((row >> 3) << 32) | (col >> 3) ;
+      if (at != lastat) {
+         bits = &gathered[at] ;
+         lastat = at ;
+      }
+      *bits |= (unsigned long long)1 << (63 - 8 * (row & 7) - (col & 7)) ;
+   }
+   leaflist leaves ;
+   leaves.reserve(gathered.size()) ;
+   for (std::unordered_map<unsigned long long, unsigned long long>::iterator
+           it=gathered.begin(); it != gathered.end(); it++)
+      leaves.push_back(std::make_pair(mortonkey((unsigned int)it->first,
+                                                (unsigned int)(it->first >> 32)),
+                                      (node *)packleaf(it->second))) ;
+   std::sort(leaves.begin(), leaves.end()) ;
+   return buildnodes(leaves, 0, leaves.size(), d) ;
+}
+/*
+ *   The leaf for 64 bits laid out as above.
+ */
+leaf *hlifealgo::packleaf(unsigned long long bits) {
+   unsigned short q[4] = { 0, 0, 0, 0 } ;   // nw, ne, sw, se
+   for (int i=0; i<8; i++) {
+      int row = (int)(bits >> (56 - 8 * i)) & 0xff ;
+      int k = (i < 4) ? 0 : 2 ;
+      int sh = 12 - 4 * (i & 3) ;
+      q[k] |= (unsigned short)((row >> 4) << sh) ;
+      q[k+1] |= (unsigned short)((row & 0xf) << sh) ;
+   }
+   return find_leaf(q[0], q[1], q[2], q[3]) ;
+}
+/*
+ *   The node of depth d over the leaves from lo up to hi, which all lie
+ *   in it.  The quadrant a leaf falls in at this depth is the pair of
+ *   key bits for this level.
+ */
+node *hlifealgo::buildnodes(const leaflist &leaves, size_t lo, size_t hi,
+                            int d) {
+   if (lo == hi)
+      return zeronode(d) ;
+   if (d == 2)
+      return leaves[lo].second ;
+   int sp = stacktop() ;
+   node *q[4] ;
+   size_t at = lo ;
+   for (int i=0; i<4; i++) {
+      size_t end = at ;
+      while (end < hi && (int)((leaves[end].first >> (2 * d - 6)) & 3) == i)
+         end++ ;
+      q[i] = buildnodes(leaves, at, end, d-1) ;
+      at = end ;
+   }
+   node *r = find_node(q[0], q[1], q[2], q[3]) ;
+   pop(sp) ;
+   return save(r) ;
+}
+/*
+ *   The union of two trees of the same depth.
+ */
+node *hlifealgo::overlay(node *a, node *b, int d) {
+   node *z = zeronode(d) ;
+   if (b == z || a == b)
+      return a ;
+   if (a == z)
+      return b ;
+   if (d == 2) {
+      leaf *la = (leaf *)a, *lb = (leaf *)b ;
+      return (node *)find_leaf((unsigned short)(la->nw | lb->nw),
+                               (unsigned short)(la->ne | lb->ne),
+                               (unsigned short)(la->sw | lb->sw),
+                               (unsigned short)(la->se | lb->se)) ;
+   }
+   int sp = stacktop() ;
+   node *nw = overlay(a->nw, b->nw, d-1) ;
+   node *ne = overlay(a->ne, b->ne, d-1) ;
+   node *sw = overlay(a->sw, b->sw, d-1) ;
+   node *se = overlay(a->se, b->se, d-1) ;
+   node *r = find_node(nw, ne, sw, se) ;
+   pop(sp) ;
+   return save(r) ;
 }
 /*
  *   Our nonrecurse top-level bit getting routine.
  */
 int hlifealgo::getcell(int x, int y) {
+   if (store) {
+      storecall c(this) ;
+      return store->getcell(x, y) ;
+   }
    y = - y ;
    int sx = x ;
    int sy = y ;
@@ -1114,6 +2757,10 @@ int hlifealgo::getcell(int x, int y) {
  *   the next set pixel is out of range.
  */
 int hlifealgo::nextcell(int x, int y, int &v) {
+   if (store) {
+      storecall c(this) ;
+      return store->nextcell(x, y, v) ;
+   }
    v = 1 ;
    y = - y ;
    int sx = x ;
@@ -1161,7 +2808,8 @@ node *hlifealgo::hashpattern(node *root, int depth) {
    } else if (depth == 2) {
       leaf *n = (leaf *)root ;
       r = (node *)find_leaf(n->nw, n->ne, n->sw, n->se) ;
-      n->next = freenodes ;
+      root->nw = 0 ;
+      root->res = freenodes ;
       freenodes = root ;
    } else {
       depth-- ;
@@ -1169,12 +2817,18 @@ node *hlifealgo::hashpattern(node *root, int depth) {
                     hashpattern(root->ne, depth),
                     hashpattern(root->sw, depth),
                     hashpattern(root->se, depth)) ;
-      root->next = freenodes ;
+      root->nw = 0 ;
+      root->res = freenodes ;
       freenodes = root ;
    }
    return r ;
 }
 void hlifealgo::endofpattern() {
+   if (store) {
+      storecall c(this) ;
+      store->endofpattern() ;
+      return ;
+   }
    poller->bailIfCalculating() ;
    if (!hashed) {
       root = hashpattern(root, depth) ;
@@ -1211,130 +2865,192 @@ node *hlifealgo::popzeros(node *n) {
 /*
  *   A lot of the routines from here on down traverse the universe, hanging
  *   information off the nodes.  The way they generally do so is by using
- *   (or abusing) the cache (res) field, and the least significant bit of
- *   the hash next field (as a visited bit).
- */
-#define marked(n) (1 & (g_uintptr_t)(n)->next)
-#define mark(n) ((n)->next = (node *)(1 | (g_uintptr_t)(n)->next))
-#define clearmark(n) ((n)->next = (node *)(~1 & (g_uintptr_t)(n)->next))
-#define clearmarkbit(p) ((node *)(~1 & (g_uintptr_t)(p)))
-/*
- *   Sometimes we want to use *res* instead of next to mark.  You cannot
- *   do this to leaves, though.
- */
-#define marked2(n) (3 & (g_uintptr_t)(n)->res)
-#define mark2(n) ((n)->res = (node *)(1 | (g_uintptr_t)(n)->res))
-#define mark2v(n,v) ((n)->res = (node *)(v | (g_uintptr_t)(n)->res))
-#define clearmark2(n) ((n)->res = (node *)(~3 & (g_uintptr_t)(n)->res))
-void hlifealgo::unhash_node(node *n) {
-   node *p ;
-   g_uintptr_t h = node_hash(n->nw,n->ne,n->sw,n->se) ;
-   node *pred = 0 ;
-   h = HASHMOD(h) ;
-   for (p=hashtab[h]; (!is_node(p) || !marked2(p)) && p; p = p->next) {
-      if (p == n) {
-         if (pred)
-            pred->next = p->next ;
-         else
-            hashtab[h] = p->next ;
-         return ;
-      }
-      pred = p ;
-   }
-   lifefatal("Didn't find node to unhash") ;
-}
-void hlifealgo::unhash_node2(node *n) {
-   node *p ;
-   g_uintptr_t h = node_hash(n->nw,n->ne,n->sw,n->se) ;
-   node *pred = 0 ;
-   h = HASHMOD(h) ;
-   for (p=hashtab[h]; p; p = p->next) {
-      if (p == n) {
-         if (pred)
-            pred->next = p->next ;
-         else
-            hashtab[h] = p->next ;
-         return ;
-      }
-      pred = p ;
-   }
-   lifefatal("Didn't find node to unhash 2") ;
-}
-void hlifealgo::rehash_node(node *n) {
-   g_uintptr_t h = node_hash(n->nw,n->ne,n->sw,n->se) ;
-   h = HASHMOD(h) ;
-   n->next = hashtab[h] ;
-   hashtab[h] = n ;
-}
+ *   (or abusing) the cache (res) field.  The least significant bit of res
+ *   is our visited bit.  Leaves have no res field to spare, so the gc
+ *   (the only routine that needs to mark leaves) marks them by putting
+ *   LEAFMARK in the isnode field; it clears these again as it rebuilds
+ *   the hash.
+ */
+#define LEAFMARK (1)
+#define marked(n) (1 & rawptr((n)->res))
+#define mark(n) setrawptr((n)->res, 1 | rawptr((n)->res))
+#define clearmark(n) setrawptr((n)->res, ~1 & rawptr((n)->res))
 /*
- *   This recursive routine calculates the population by hanging the
- *   population on marked nodes.
+ *   This recursive routine calculates the population.  Counts are 64
+ *   bits, and nearly always fit in 63; one that does not is kept as a
+ *   bigint in bigpops instead, and its count has the top bit set and
+ *   the index into bigpops in the rest.  Every node we count keeps its
+ *   count in poptab until the next gc, which is the only thing that
+ *   frees hashed nodes; after a step, most of the universe is made of
+ *   nodes we have counted before, so we only count the new ones.
  */
-const bigint &hlifealgo::calcpop(node *root, int depth) {
+#define BIGPOP ((popword)1 << 63)
+static inline g_uintptr_t pophash(node *n) {
+   g_uintptr_t r = (g_uintptr_t)n * (g_uintptr_t)0x9e3779b97f4a7c15ULL ;
+   return r ^ (r >> (4 * sizeof(g_uintptr_t))) ;
+}
+popword hlifealgo::calcpop(node *root, int depth) {
    if (root == zeronode(depth))
-      return bigint::zero ;
+      return 0 ;
    if (depth == 2)
       return ((leaf *)root)->leafpop ;
-   if (marked2(root))
-      return *(bigint*)&(root->next) ;
+   for (g_uintptr_t i=pophash(root) & popmask; poptab[i].n;
+        i = (i + 1) & popmask)
+      if (poptab[i].n == root)
+         return poptab[i].pop ;
    depth-- ;
-   if (root->next == 0)
-      mark2v(root, 3) ;
-   else {
-      unhash_node(root) ;
-      mark2(root) ;
+   popword a = calcpop(root->nw, depth), b = calcpop(root->ne, depth),
+           c = calcpop(root->sw, depth), d = calcpop(root->se, depth) ;
+   popword r ;
+   if (((a | b | c | d) & BIGPOP) == 0 && a + b < BIGPOP && c + d < BIGPOP &&
+       a + b + c + d < BIGPOP) {
+      r = a + b + c + d ;
+   } else {
+      bigpops.emplace_back(popvalue(a), popvalue(b), popvalue(c), popvalue(d)) ;
+      r = BIGPOP | (popword)(bigpops.size() - 1) ;
    }
-/**
- *   We use allocate-in-place bigint constructor here to initialize the
- *   node.  This should compile to a single instruction.
+   addpop(root, r) ;
+   return r ;
+}
+bigint hlifealgo::popvalue(popword w) {
+   if (w & BIGPOP)
+      return bigpops[(size_t)(w & ~BIGPOP)] ;
+   return bigint((G_INT64)w) ;
+}
+/*
+ *   Remember the count for a node, growing the table when it is half
+ *   full.  The table counts against the memory limit like the hash.
+ */
+void hlifealgo::addpop(node *n, popword pop) {
+   if (2 * (popcount + 1) > popmask + 1) {
+      g_uintptr_t osize = popmask + 1, nsize = 2 * osize ;
+      popentry *otab = poptab ;
+      poptab = (popentry *)bigcalloc(nsize, sizeof(popentry)) ;
+      if (poptab == 0)
+         lifefatal("Out of memory; try reducing the hash memory limit.") ;
+      alloced += (nsize - osize) * sizeof(popentry) ;
+      popmask = nsize - 1 ;
+      for (g_uintptr_t j=0; j<osize; j++)
+         if (otab[j].n) {
+            g_uintptr_t i = pophash(otab[j].n) & popmask ;
+            while (poptab[i].n)
+               i = (i + 1) & popmask ;
+            poptab[i] = otab[j] ;
+         }
+      bigfree(otab) ;
+   }
+   g_uintptr_t i = pophash(n) & popmask ;
+   while (poptab[i].n)
+      i = (i + 1) & popmask ;
+   poptab[i].n = n ;
+   poptab[i].pop = pop ;
+   popcount++ ;
+}
+/*
+ *   Forget every count; the table goes back to its smallest size.
  */
-   new(&(root->next))bigint(
-        calcpop(root->nw, depth), calcpop(root->ne, depth),
-        calcpop(root->sw, depth), calcpop(root->se, depth)) ;
-   return *(bigint *)&(root->next) ;
+#define MINPOPTAB (1024)
+void hlifealgo::clearpops() {
+   if (poptab == 0 || popmask + 1 > MINPOPTAB) {
+      bigfree(poptab) ;
+      if (poptab)
+         alloced -= (popmask + 1) * sizeof(popentry) ;
+      poptab = (popentry *)bigcalloc(MINPOPTAB, sizeof(popentry)) ;
+      if (poptab == 0)
+         lifefatal("Out of memory (3).") ;
+      popmask = MINPOPTAB - 1 ;
+      alloced += MINPOPTAB * sizeof(popentry) ;
+   } else if (popcount) {
+      memset(poptab, 0, MINPOPTAB * sizeof(popentry)) ;
+   }
+   popcount = 0 ;
+   bigpops.clear() ;
 }
 /*
- *   Call this after doing something that unhashes nodes in order to
- *   use the next field as a temp pointer.
+ *   The partial steps (see getstepres) are kept the same way.
  */
-void hlifealgo::aftercalcpop2(node *root, int depth) {
-   if (depth == 2 || root == zeronode(depth))
-      return ;
-   int v = marked2(root) ;
-   if (v) {
-      clearmark2(root) ;
-      depth-- ;
-      if (depth > 2) {
-         aftercalcpop2(root->nw, depth) ;
-         aftercalcpop2(root->ne, depth) ;
-         aftercalcpop2(root->sw, depth) ;
-         aftercalcpop2(root->se, depth) ;
-      }
-      ((bigint *)&(root->next))->~bigint() ;
-      if (v == 3)
-         root->next = 0 ;
-      else
-         rehash_node(root) ;
+node *hlifealgo::findstep(node *n) {
+   for (g_uintptr_t i=pophash(n) & stepmask; steptab[i].n;
+        i = (i + 1) & stepmask)
+      if (steptab[i].n == n)
+         return steptab[i].res ;
+   return 0 ;
+}
+void hlifealgo::addstep(node *n, node *res) {
+   if (2 * (stepcount + 1) > stepmask + 1) {
+      g_uintptr_t osize = stepmask + 1, nsize = 2 * osize ;
+      stepentry *otab = steptab ;
+      steptab = (stepentry *)bigcalloc(nsize, sizeof(stepentry)) ;
+      if (steptab == 0)
+         lifefatal("Out of memory; try reducing the hash memory limit.") ;
+      if (parallel)
+         allocmutex.lock() ;
+      alloced += (nsize - osize) * sizeof(stepentry) ;
+      if (parallel)
+         allocmutex.unlock() ;
+      stepmask = nsize - 1 ;
+      for (g_uintptr_t j=0; j<osize; j++)
+         if (otab[j].n) {
+            g_uintptr_t i = pophash(otab[j].n) & stepmask ;
+            while (steptab[i].n)
+               i = (i + 1) & stepmask ;
+            steptab[i] = otab[j] ;
+         }
+      bigfree(otab) ;
    }
+   g_uintptr_t i = pophash(n) & stepmask ;
+   while (steptab[i].n)
+      i = (i + 1) & stepmask ;
+   steptab[i].n = n ;
+   steptab[i].res = res ;
+   stepcount++ ;
+}
+#define MINSTEPTAB (1024)
+void hlifealgo::clearsteps() {
+   if (steptab == 0 || stepmask + 1 > MINSTEPTAB) {
+      bigfree(steptab) ;
+      if (steptab)
+         alloced -= (stepmask + 1) * sizeof(stepentry) ;
+      steptab = (stepentry *)bigcalloc(MINSTEPTAB, sizeof(stepentry)) ;
+      if (steptab == 0)
+         lifefatal("Out of memory (3).") ;
+      stepmask = MINSTEPTAB - 1 ;
+      alloced += MINSTEPTAB * sizeof(stepentry) ;
+   } else if (stepcount) {
+      memset(steptab, 0, MINSTEPTAB * sizeof(stepentry)) ;
+   }
+   stepcount = 0 ;
 }
 /*
- *   Call this after writing macrocell.
+ *   Unlike the populations, the partial steps are worth keeping across
+ *   a gc.  Once everything else is marked, we keep the entries for
+ *   nodes that survive, along with their results; the rest we drop.
  */
-void hlifealgo::afterwritemc(node *root, int depth) {
-   if (root == zeronode(depth))
-      return ;
-   if (depth == 2) {
-      root->nw = 0 ;
+void hlifealgo::keepsteps(int invalidate) {
+   if (invalidate || stepcount == 0) {
+      clearsteps() ;
       return ;
    }
-   if (marked2(root)) {
-      clearmark2(root) ;
-      depth-- ;
-      afterwritemc(root->nw, depth) ;
-      afterwritemc(root->ne, depth) ;
-      afterwritemc(root->sw, depth) ;
-      afterwritemc(root->se, depth) ;
-      rehash_node(root) ;
+   std::vector<stepentry> keep ;
+   for (g_uintptr_t i=0; i<=stepmask; i++)
+      if (steptab[i].n && marked(steptab[i].n))
+         keep.push_back(steptab[i]) ;
+   clearsteps() ;
+   for (size_t k=0; k<keep.size(); k++) {
+      gc_mark(keep[k].res, 0) ;
+      addstep(keep[k].n, keep[k].res) ;
+   }
+}
+/*
+ *   Work out the bits of a new increment.  ngens is left alone.
+ */
+void hlifealgo::setstepbits() {
+   stepbits.clear() ;
+   steplow = -1 ;
+   for (bigint t=setincrement; t > 0; t.div2()) {
+      if (steplow < 0 && t.odd())
+         steplow = (int)stepbits.size() ;
+      stepbits.push_back((char)t.odd()) ;
    }
 }
 /*
@@ -1344,13 +3060,17 @@ void hlifealgo::calcPopulation() {
    int depth ;
    ensure_hashed() ;
    depth = node_depth(root) ;
-   population = calcpop(root, depth) ;
-   aftercalcpop2(root, depth) ;
+   zeronode(depth) ; // so counting makes no nodes
+   population = popvalue(calcpop(root, depth)) ;
 }
 /*
  *   Is the universe empty?
  */
 int hlifealgo::isEmpty() {
+   if (store) {
+      storecall c(this) ;
+      return store->isEmpty() ;
+   }
    ensure_hashed() ;
    return root == zeronode(depth) ;
 }
@@ -1358,6 +3078,21 @@ int hlifealgo::isEmpty() {
  *   This routine marks a node as needed to be saved.
  */
 node *hlifealgo::save(node *n) {
+   if (parallel) {
+      hlifeworker &w = workers[lifethreads::self()] ;
+      if (w.gsp >= w.stacksize) {
+         int nstacksize = w.stacksize * 2 + 100 ;
+         allocmutex.lock() ;
+         alloced += sizeof(node *)*(nstacksize-w.stacksize) ;
+         allocmutex.unlock() ;
+         w.stack = (node **)realloc(w.stack, nstacksize * sizeof(node *)) ;
+         if (w.stack == 0)
+           lifefatal("Out of memory (3).") ;
+         w.stacksize = nstacksize ;
+      }
+      w.stack[w.gsp++] = n ;
+      return n ;
+   }
    if (gsp >= stacksize) {
       int nstacksize = stacksize * 2 + 100 ;
       alloced += sizeof(node *)*(nstacksize-stacksize) ;
@@ -1373,7 +3108,18 @@ node *hlifealgo::save(node *n) {
  *   This routine pops the stack back to a previous depth.
  */
 void hlifealgo::pop(int n) {
-   gsp = n ;
+   if (parallel)
+      workers[lifethreads::self()].gsp = n ;
+   else
+      gsp = n ;
+}
+/*
+ *   Where the stack is now, so we can pop back to it.
+ */
+int hlifealgo::stacktop() {
+   if (parallel)
+      return workers[lifethreads::self()].gsp ;
+   return gsp ;
 }
 /*
  *   This routine clears the stack altogether.
@@ -1382,37 +3128,64 @@ void hlifealgo::clearstack() {
    gsp = 0 ;
 }
 /*
- *   Do a gc.  Walk down from all nodes reachable on the stack, saveing
- *   them by setting the odd bit on the next link.  Then, walk the hash,
- *   eliminating the res from everything that's not saveed, and moving
- *   the nodes from the hash to the freelist as appropriate.  Finally,
- *   walk the hash again, clearing the low order bits in the next pointers.
+ *   Do a gc.  Walk down from all nodes reachable on the stack, saving
+ *   them by marking them and adding them to livenodes.  We keep our own
+ *   stack of nodes still to be visited rather than recursing, so the
+ *   depth of the universe and the length of any chain of results do not
+ *   matter.  If we are invalidating, we eliminate the res from
+ *   everything we mark.
  */
 void hlifealgo::gc_mark(node *root, int invalidate) {
-   if (!marked(root)) {
-      mark(root) ;
-      if (is_node(root)) {
-         gc_mark(root->nw, invalidate) ;
-         gc_mark(root->ne, invalidate) ;
-         gc_mark(root->sw, invalidate) ;
-         gc_mark(root->se, invalidate) ;
-         if (root->res) {
+   markstack.push_back(root) ;
+   while (!markstack.empty()) {
+      node *n = markstack.back() ;
+      markstack.pop_back() ;
+      if (!is_node(n)) {
+         setrawptr(((leaf *)n)->isnode, LEAFMARK) ;
+         livenodes.push_back(n) ;
+      } else if (rawptr(n->nw) != LEAFMARK && !marked(n)) {
+         node *r = n->res ;
+         mark(n) ;
+         livenodes.push_back(n) ;
+         if (r) {
             if (invalidate)
-              root->res = 0 ;
+              setrawptr(n->res, 1) ; /* cleared, but still marked */
             else
-              gc_mark(root->res, invalidate) ;
+              markstack.push_back(r) ;
          }
+         markstack.push_back(n->se) ;
+         markstack.push_back(n->sw) ;
+         markstack.push_back(n->ne) ;
+         markstack.push_back(n->nw) ;
       }
    }
 }
-/**
- *   If the invalidate flag is set, we want to kill *all* cache entries
- *   and recalculate all leaves.
+/*
+ *   Then we put the live nodes and leaves back into a freshly cleared
+ *   hash, clearing their marks as we go.  Usually most of the nodes are
+ *   dead, and we do not touch those at all while the gc holds things
+ *   up; instead we sort the live nodes and the node blocks by address,
+ *   and sweep the blocks lazily, one at a time as the free list runs
+ *   dry, freeing every node in a block that is not next in livenodes.
+ *
+ *   Before that, we also keep nodes that some lookup has found since the
+ *   last gc, along with everything they point to (their results, in
+ *   particular), as long as no more than maxhotfraction of all nodes
+ *   survive.  These are likely to be asked for again soon, and throwing
+ *   their results away would mean working them out all over again.
+ *   We only do this once a single step has needed more than two gcs,
+ *   which is when we are thrashing; otherwise the extra nodes just make
+ *   the hash fuller.  We spread the budget over the whole table so the
+ *   kept nodes do not all pile up in one end of it.  Since the hash is
+ *   rebuilt from scratch, each gc starts the next round with no node
+ *   referenced.
  */
+double hlifealgo::maxhotfraction = 0.5 ;
 void hlifealgo::do_gc(int invalidate) {
    int i ;
    g_uintptr_t freed_nodes=0 ;
-   node *p, *pp ;
+   std::chrono::steady_clock::time_point gcstart =
+                                          std::chrono::steady_clock::now() ;
    inGC = 1 ;
    gccount++ ;
    gcstep++ ;
@@ -1423,6 +3196,8 @@ void hlifealgo::do_gc(int invalidate) {
        sprintf(statusline, "GC #%d", gccount) ;
      lifestatus(statusline) ;
    }
+   livenodes.clear() ;
+   clearpops() ;
    for (i=nzeros-1; i>=0; i--)
       if (zeronodea[i] != 0)
          break ;
@@ -1434,39 +3209,92 @@ void hlifealgo::do_gc(int invalidate) {
       poller->poll() ;
       gc_mark(stack[i], invalidate) ;
    }
+   if (parallel) {
+      // the world is stopped; pick up every thread's roots, and forget
+      // their free lists since we are about to rebuild ours
+      for (int w=0; w<nworkers; w++) {
+         for (i=0; i<workers[w].gsp; i++)
+            gc_mark(workers[w].stack[i], invalidate) ;
+         workers[w].freenodes = 0 ;
+      }
+      parhashpop = 0 ;
+   }
    for (i=0; i<timeline.framecount; i++)
       gc_mark((node *)timeline.frames[i], invalidate) ;
+   // nodes are about to be freed, and their addresses used again
+   cellhashes.clear() ;
+   // if we are a store, the patterns of all the universes using us
+   for (size_t u=0; u<sharers.size(); u++) {
+      hlifealgo *h = sharers[u] ;
+      if (h != current)
+         gc_mark(h->root, invalidate) ;
+      for (i=0; i<h->timeline.framecount; i++)
+         gc_mark((node *)h->timeline.frames[i], invalidate) ;
+   }
+   if (!invalidate && gcstep > 2) {
+      g_uintptr_t keep = (g_uintptr_t)(maxhotfraction * totalthings) ;
+      double perslot = (double)keep / hashprime ;
+      for (g_uintptr_t j=0; j<hashprime; j++) {
+         if ((j & 65535) == 0)
+            poller->poll() ;
+         if (referenced(hashtab[j]) && livenodes.size() < perslot * j)
+            gc_mark(slotnode(hashtab[j]), 0) ;
+      }
+      // and whatever a resize has not moved yet
+      for (g_uintptr_t j=oldhashnext; j<oldhashprime; j++) {
+         if ((j & 65535) == 0)
+            poller->poll() ;
+         if (referenced(oldhashtab[j]) && livenodes.size() < keep)
+            gc_mark(slotnode(oldhashtab[j]), 0) ;
+      }
+   }
+   keepsteps(invalidate) ;
+   dropoldhash() ;
+   g_uintptr_t oldpop = hashpop ;
    hashpop = 0 ;
    memset(hashtab, 0, sizeof(node *) * hashprime) ;
    freenodes = 0 ;
-   for (p=nodeblocks; p; p=p->next) {
-      poller->poll() ;
-      for (pp=p+1, i=1; i<1001; i++, pp++) {
-         if (marked(pp)) {
-            g_uintptr_t h = 0 ;
-            if (pp->nw) { /* yes, it's a node */
-               h = HASHMOD(node_hash(pp->nw, pp->ne, pp->sw, pp->se)) ;
-            } else {
-               leaf *lp = (leaf *)pp ;
-               if (invalidate)
-                  leafres(lp) ;
-               h = HASHMOD(leaf_hash(lp->nw, lp->ne, lp->sw, lp->se)) ;
-            }
-            pp->next = hashtab[h] ;
-            hashtab[h] = pp ;
-            hashpop++ ;
-         } else {
-            pp->next = freenodes ;
-            freenodes = pp ;
-            freed_nodes++ ;
-         }
+   for (size_t k=0; k<livenodes.size(); k++) {
+      node *pp = livenodes[k] ;
+      if ((k & 4095) == 0)
+         poller->poll() ;
+      if (rawptr(pp->nw) == LEAFMARK) {
+         leaf *lp = (leaf *)pp ;
+         lp->isnode = 0 ;
+         if (invalidate)
+            leafres(lp) ;
+         hashinsert(pp, leaf_hash(lp->nw, lp->ne, lp->sw, lp->se)) ;
+      } else {
+         clearmark(pp) ;
+         hashinsert(pp, node_hash(pp->nw, pp->ne, pp->sw, pp->se)) ;
       }
    }
+   hashpop = livenodes.size() ;
+   lastgcfreed = oldpop > hashpop ? 1 - (double)hashpop / oldpop : 0 ;
+   freed_nodes = totalthings - hashpop ;
+   std::sort(livenodes.begin(), livenodes.end()) ;
+   sweepblocks.clear() ;
+   for (node *p=nodeblocks; p; p=p->res)
+      sweepblocks.push_back(p) ;
+   std::sort(sweepblocks.begin(), sweepblocks.end()) ;
+   sweepnext = 0 ;
+   livenext = 0 ;
+   // other threads take nodes off the free list while we would be
+   // sweeping, so in that case we do it all now; otherwise we just
+   // sweep enough for whoever called us to get a node
+   sweep(parallel) ;
    inGC = 0 ;
+   double pause = std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - gcstart).count() ;
+   if (pause > maxgcpause)
+      maxgcpause = pause ;
+   lastgcpause = pause ;
+   totalgcpause += pause ;
    if (verbose) {
      double perc = (double)freed_nodes / (double)totalthings * 100.0 ;
-     sprintf(statusline+strlen(statusline), " freed %g percent (%" PRIuPTR ").",
-                                                   perc, freed_nodes) ;
+     sprintf(statusline+strlen(statusline),
+             " freed %g percent (%" PRIuPTR ") in %.1f ms (max %.1f ms).",
+             perc, freed_nodes, pause, maxgcpause) ;
      lifestatus(statusline) ;
    }
    if (needPop) {
@@ -1476,12 +3304,31 @@ void hlifealgo::do_gc(int invalidate) {
       poller->updatePop() ;
    }
 }
+/*
+ *   Sweep node blocks onto the free list until we have found some free
+ *   nodes (or until we have swept every block, if all is set).
+ */
+void hlifealgo::sweep(int all) {
+   while (sweepnext < sweepblocks.size() && (all || freenodes == 0)) {
+      node *pp = sweepblocks[sweepnext++] + 1 ;
+      for (int i=1; i<NODEBLOCK; i++, pp++) {
+         if (livenext < livenodes.size() && livenodes[livenext] == pp) {
+            livenext++ ;
+         } else {
+            pp->nw = 0 ;
+            pp->res = freenodes ;
+            freenodes = pp ;
+         }
+      }
+   }
+}
 /*
  *   Clear the cache bits down to the appropriate level, marking the
  *   nodes we've handled.
  */
 void hlifealgo::clearcache(node *n, int depth, int clearto) {
    if (!marked(n)) {
+      node *r = n->res ;
       mark(n) ;
       if (depth > 3) {
          depth-- ;
@@ -1490,11 +3337,11 @@ void hlifealgo::clearcache(node *n, int depth, int clearto) {
          clearcache(n->ne, depth, clearto) ;
          clearcache(n->sw, depth, clearto) ;
          clearcache(n->se, depth, clearto) ;
-         if (n->res)
-            clearcache(n->res, depth, clearto) ;
+         if (r)
+            clearcache(r, depth, clearto) ;
       }
       if (depth >= clearto)
-         n->res = 0 ;
+         setrawptr(n->res, 1) ; /* cleared, but still marked */
    }
 }
 /*
@@ -1517,9 +3364,11 @@ void hlifealgo::new_ngens(int newval) {
       ngens = newval ;
       return ;
    }
+   invalidations++ ;
 #ifndef NOGCBEFOREINC
    do_gc(0) ;
 #endif
+   finishresize() ;
    if (verbose) {
      strcpy(statusline, "Changing increment...") ;
      lifestatus(statusline) ;
@@ -1531,14 +3380,16 @@ void hlifealgo::new_ngens(int newval) {
       clearto = 3 ;
    ngens = newval ;
    inGC = 1 ;
-   for (i=0; i<hashprime; i++)
-      for (p=hashtab[i]; p; p=clearmarkbit(p->next))
-         if (is_node(p) && !marked(p))
-            clearcache(p, node_depth(p), clearto) ;
-   for (p=nodeblocks; p; p=p->next) {
+   for (i=0; i<hashprime; i++) {
+      p = slotnode(hashtab[i]) ;
+      if (p && is_node(p) && !marked(p))
+         clearcache(p, node_depth(p), clearto) ;
+   }
+   for (p=nodeblocks; p; p=p->res) {
       poller->poll() ;
-      for (pp=p+1, i=1; i<1001; i++, pp++)
-         clearmark(pp) ;
+      for (pp=p+1, i=1; i<NODEBLOCK; i++, pp++)
+         if (is_node(pp))
+            clearmark(pp) ;
    }
    halvesdone = 0 ;
    inGC = 0 ;
@@ -1553,6 +3404,49 @@ void hlifealgo::new_ngens(int newval) {
      lifestatus(statusline) ;
    }
 }
+/*
+ *   Statistics for tuning the memory limit and the step size.  Sizing
+ *   the nodes means finding the depth of everything in the hash, as
+ *   new_ngens does, so with a big hash this takes a little while.
+ */
+int hlifealgo::getstats(lifestats &s) {
+   if (store) {
+      storecall c(this) ;
+      return store->getstats(s) ;
+   }
+   s.clear() ;
+   s.lookups = (double)counts.lookups ;
+   s.hits = (double)counts.hits ;
+   s.probes = (double)counts.probes ;
+   s.hashsize = (double)hashprime ;
+   s.hashpop = (double)hashpop ;
+   s.bytesused = (double)alloced ;
+   s.maxmem = (double)maxmem ;
+   s.gccount = gccount ;
+   s.gcpausetotal = totalgcpause ;
+   s.gcpausemax = maxgcpause ;
+   s.gcpauselast = lastgcpause ;
+   s.invalidations = invalidations ;
+   s.nodescalculated = running_hperf.nodesCalculated +
+                       running_hperf.fastNodeInc ;
+   // a resize may not have moved everything yet
+   for (int t=0; t<2; t++) {
+      node **tab = t ? oldhashtab : hashtab ;
+      g_uintptr_t i = t ? oldhashnext : 0, n = t ? oldhashprime : hashprime ;
+      for (; tab && i<n; i++) {
+         node *p = slotnode(tab[i]) ;
+         if (p == 0)
+            continue ;
+         if (!is_node(p))
+            s.leaves++ ;
+         size_t k = node_depth(p) + 1 ;
+         if (s.nodesbysize.size() <= k)
+            s.nodesbysize.resize(k + 1, 0) ;
+         s.nodesbysize[k]++ ;
+      }
+   }
+   return 1 ;
+}
 /*
  *   Return log2.
  */
@@ -1569,6 +3463,15 @@ int hlifealgo::log2(unsigned int n) {
 }
 static bigint negone = -1 ;
 const bigint &hlifealgo::getPopulation() {
+   if (store) {
+      {
+         storecall c(this) ;
+         if (&store->getPopulation() == &negone)
+            return negone ;
+      }
+      // inside a call of ours the store still has the latest count
+      return store->storecalls ? store->population : population ;
+   }
    // note:  if called during gc, then we cannot call calcPopulation
    // since that will mess up the gc.
    if (!popValid) {
@@ -1602,19 +3505,26 @@ node *hlifealgo::runpattern() {
       do_gc(1) ; // invalidate the entire cache and recalc leaves
       cacheinvalid = 0 ;
    }
+   int grid = nativegrid() ;
+   if (grid == PLANEGRID)
+      return runplane(n) ;
+   if (grid == TORUSGRID)
+      return runtorus(n) ;
    int depth = node_depth(n) ;
-   node *n2 ;
    n = pushroot(n) ;
    depth++ ;
    n = pushroot(n) ;
    depth++ ;
-   while (ngens + 2 > depth) {
+   // a step of any increment below 2^(ngens+1) can grow the pattern as
+   // far as two steps of 2^ngens, so it needs one more level of border
+   int partial = steplow < ngens ;
+   while (ngens + 2 + partial > depth) {
       n = pushroot(n) ;
       depth++ ;
    }
    save(zeronode(nzeros-1)) ;
    save(n) ;
-   n2 = getres(n, depth) ;
+   node *n2 = steproot(n, depth, partial) ;
    okaytogc = 0 ;
    clearstack() ;
    if (halvesdone == 1 && n->res != 0) {
@@ -1624,10 +3534,312 @@ node *hlifealgo::runpattern() {
    if (poller->isInterrupted())
       return 0 ; // indicate it was interrupted
    n = popzeros(n2) ;
-   generation += pow2step ;
+   generation += setincrement ;
+   return n ;
+}
+/*
+ *   Take one step of a root runpattern has set up, across the threads
+ *   if it is big enough.
+ */
+node *hlifealgo::steproot(node *n, int depth, int partial) {
+   node *n2 ;
+   if (getNumThreads() > 1 && depth > mintaskdepth) {
+      beginparallel() ;
+      n2 = partial ? getstepres(n, depth) : getres(n, depth) ;
+      endparallel() ;
+   } else {
+      n2 = partial ? getstepres(n, depth) : getres(n, depth) ;
+   }
+   return n2 ;
+}
+/*
+ *   A torus is stepped as a tiling of the grid, cut back down after.
+ *   If step() had to hold ngens below the top bit of the increment
+ *   (see gridngens) we take full steps of 2^ngens until what is left
+ *   is one ordinary step.  What wrapgrid and unwrapgrid build is not on
+ *   the stack until they return (nor is the result they cut the grid
+ *   from), so there must be no gc while they run.
+ */
+node *hlifealgo::runtorus(node *n) {
+   bigint passes = setincrement ;
+   passes >>= ngens ;
+   save(zeronode(nzeros-1)) ;
+   int sp = stacktop() ;
+   for (;;) {
+      int last = passes <= bigint::one ;
+      wrapinfo w ;
+      int depth = node_depth(n) ;
+      okaytogc = 0 ;
+      node *t = save(wrapgrid(w, n, depth)) ;
+      okaytogc = 1 ;
+      node *t2 = steproot(t, depth, last && steplow < ngens) ;
+      if (halvesdone == 1 && t->res != 0) {
+         t->res = 0 ;
+         halvesdone = 0 ;
+      }
+      if (poller->isInterrupted())
+         break ;
+      okaytogc = 0 ;
+      n = unwrapgrid(w, t2, depth-1) ;
+      okaytogc = 1 ;
+      pop(sp) ;
+      save(n) ;
+      if (last)
+         break ;
+      passes -= bigint::one ;
+   }
+   okaytogc = 0 ;
+   clearstack() ;
+   if (poller->isInterrupted())
+      return 0 ; // indicate it was interrupted
+   generation += setincrement ;
+   return n ;
+}
+/*
+ *   A bounded plane has to be cleared outside the grid after every
+ *   generation, so ngens is held at zero and we run the increment one
+ *   generation at a time, each a step of the pattern given one level of
+ *   empty border.  As with a torus, there is no gc while gridclip works
+ *   on a result that is not on the stack.
+ */
+node *hlifealgo::runplane(node *n) {
+   int d = griddepth() ;
+   long long x = -(gridleft.toint() + ((long long)1 << d)) ;
+   long long y = -(gridtop.toint() + ((long long)1 << d) - 1) ;
+   n = save(gridpattern(n, d)) ;
+   save(zeronode(nzeros-1)) ;
+   int sp = stacktop() ;
+   for (bigint g = setincrement; g > 0; g -= bigint::one) {
+      node *p = save(pushroot(n)) ;
+      node *p2 = steproot(p, d+1, 0) ;
+      if (halvesdone == 1 && p->res != 0) {
+         p->res = 0 ;
+         halvesdone = 0 ;
+      }
+      if (poller->isInterrupted())
+         break ;
+      okaytogc = 0 ;
+      n = gridclip(p2, d, x, y) ;
+      okaytogc = 1 ;
+      pop(sp) ;
+      save(n) ;
+   }
+   okaytogc = 0 ;
+   clearstack() ;
+   if (poller->isInterrupted())
+      return 0 ; // indicate it was interrupted
+   n = popzeros(n) ;
+   generation += setincrement ;
+   return n ;
+}
+/*
+ *   The depth of the smallest root (centred as ours always is) that
+ *   holds the whole grid.
+ */
+int hlifealgo::griddepth() {
+   long long l = gridleft.toint(), r = gridright.toint() ;
+   long long t = gridtop.toint(), b = gridbottom.toint() ;
+   int d = 3 ;
+   while (l < -((long long)1 << d) || r >= ((long long)1 << d) ||
+          t < 1 - ((long long)1 << d) || b > ((long long)1 << d))
+      d++ ;
+   return d ;
+}
+/*
+ *   The most ngens can be for the grid we step.  A bounded plane goes a
+ *   generation at a time.  A torus whose sides are not powers of two
+ *   never lines up with the nodes, so its tiling has as many different
+ *   nodes at each depth as the grid has offsets, over and over as the
+ *   root grows; there we keep the root to one more than the grid needs.
+ */
+int hlifealgo::gridngens() {
+   if (stepgrid == PLANEGRID)
+      return 0 ;
+   if (stepgrid == TORUSGRID &&
+       ((gridwd & (gridwd - 1)) != 0 || (gridht & (gridht - 1)) != 0))
+      return griddepth() - 1 ;
+   return 1000000000 ;
+}
+/*
+ *   Root n grown or cut down to depth d, keeping its centre.
+ */
+node *hlifealgo::gridpattern(node *n, int d) {
+   int nd = node_depth(n) ;
+   for (; nd < d; nd++)
+      n = pushroot(n) ;
+   for (; nd > d; nd--)
+      n = find_node(n->nw->se, n->ne->sw, n->sw->ne, n->se->nw) ;
    return n ;
 }
+/*
+ *   Tile the grid part of root n across a root deep enough for ngens and
+ *   for the result to hold the whole grid.  A grid whose sides are
+ *   powers of two lines up with the pattern's nodes, and then with the
+ *   result's, if the tiling starts where the pattern's square does, so
+ *   that only the seams need new nodes.  Any other grid is shifted
+ *   anyway, so there we start the tiling where the grid's corner lands
+ *   on the result's, which needs the smallest root.
+ */
+node *hlifealgo::wrapgrid(wrapinfo &w, node *n, int &depth) {
+   w.patdepth = griddepth() ;
+   w.pat = save(gridpattern(n, w.patdepth)) ;
+   w.wd = gridwd ;
+   w.ht = gridht ;
+   w.left = gridleft.toint() + ((long long)1 << w.patdepth) ;
+   w.top = gridtop.toint() + ((long long)1 << w.patdepth) - 1 ;
+   int aligned = (w.wd & (w.wd - 1)) == 0 && (w.ht & (w.ht - 1)) == 0 ;
+   depth = w.patdepth + 1 ;
+   if (depth < ngens + 2)
+      depth = ngens + 2 ;
+   for (;;) {
+      w.hx.resize(depth + 1) ;
+      w.hy.resize(depth + 1) ;
+      w.hx[0] = 1 % w.wd ;
+      w.hy[0] = 1 % w.ht ;
+      for (int i=1; i<=depth; i++) {
+         w.hx[i] = 2 * w.hx[i-1] % w.wd ;
+         w.hy[i] = 2 * w.hy[i-1] % w.ht ;
+      }
+      if (aligned) {
+         w.u = (w.wd - w.left % w.wd) % w.wd ;
+         w.v = (w.ht - w.top % w.ht) % w.ht ;
+      } else {
+         w.u = (w.wd - w.hx[depth-1]) % w.wd ;
+         w.v = (w.ht - w.hy[depth-1]) % w.ht ;
+      }
+      // where the grid's corner falls in the result
+      w.gx = (2 * w.wd - w.u - w.hx[depth-1]) % w.wd ;
+      w.gy = (2 * w.ht - w.v - w.hy[depth-1]) % w.ht ;
+      if (depth > 40 || (w.gx + w.wd <= ((long long)1 << depth) &&
+                         w.gy + w.ht <= ((long long)1 << depth)))
+         break ;
+      depth++ ;
+   }
+   zeronode(depth+1) ; // ensure enough zero nodes for rendering
+   return wrapped(w, w.u, w.v, depth) ;
+}
+/*
+ *   The square of the tiling at depth d whose top left corner is cell
+ *   (u,v) of the grid.  One that does not cross the grid's edge is cut
+ *   straight out of the pattern.
+ */
+node *hlifealgo::wrapped(wrapinfo &w, long long u, long long v, int d) {
+   if (d < 31 && u + ((long long)2 << d) <= w.wd &&
+       v + ((long long)2 << d) <= w.ht)
+      return window(w.pat, w.patdepth, w.left + u, w.top + v, d, w.windows) ;
+   if (d == 2) {
+      // gather the leaf a piece at a time, each inside the grid
+      unsigned long long bits = 0 ;
+      for (int j=0; j<8; ) {
+         long long sv = (v + j) % w.ht ;
+         int rows = (int)std::min((long long)(8 - j), w.ht - sv) ;
+         for (int i=0; i<8; ) {
+            long long su = (u + i) % w.wd ;
+            int cols = (int)std::min((long long)(8 - i), w.wd - su) ;
+            unsigned long long piece = 0 ;
+            windowbits(w.pat, w.patdepth, w.left + su, w.top + sv, piece) ;
+            unsigned int mask = (0xff00 >> cols) & 0xff ;
+            for (int r=0; r<rows; r++) {
+               unsigned int row = (unsigned int)(piece >> (56 - 8 * r)) & mask ;
+               bits |= (unsigned long long)(row >> i) << (56 - 8 * (j + r)) ;
+            }
+            i += cols ;
+         }
+         j += rows ;
+      }
+      return (node *)packleaf(bits) ;
+   }
+   std::tuple<long long, long long, int> key(u, v, d) ;
+   std::map<std::tuple<long long, long long, int>, node *>::iterator it =
+      w.memo.find(key) ;
+   if (it != w.memo.end())
+      return it->second ;
+   long long u2 = (u + w.hx[d]) % w.wd ;
+   long long v2 = (v + w.hy[d]) % w.ht ;
+   node *r = find_node(wrapped(w, u, v, d-1), wrapped(w, u2, v, d-1),
+                       wrapped(w, u, v2, d-1), wrapped(w, u2, v2, d-1)) ;
+   w.memo[key] = r ;
+   return r ;
+}
+/*
+ *   Cut the grid back out of n, the result (at depth d) of stepping a
+ *   tiling, into a pattern like the one we started from.
+ */
+node *hlifealgo::unwrapgrid(wrapinfo &w, node *n, int d) {
+   long long x = w.gx - w.left ;
+   long long y = w.gy - w.top ;
+   for (; d > w.patdepth + 1; d--)
+      n = n->nw ;
+   windowmemo memo ;
+   n = window(n, d, x, y, w.patdepth, memo) ;
+   return popzeros(gridclip(n, w.patdepth, -w.left, -w.top)) ;
+}
+/*
+ *   Clear the cells of n (at depth d, its top left corner x across and
+ *   y down from the grid's) that fall outside the grid.
+ */
+node *hlifealgo::gridclip(node *n, int d, long long x, long long y) {
+   long long s = (long long)2 << d ;
+   long long wd = gridwd, ht = gridht ;
+   if (n == zeronode(d) || x >= wd || y >= ht || x + s <= 0 || y + s <= 0)
+      return zeronode(d) ;
+   if (x >= 0 && y >= 0 && x + s <= wd && y + s <= ht)
+      return n ;
+   if (d == 2) {
+      unsigned long long bits = 0 ;
+      windowbits(n, 2, 0, 0, bits) ;
+      unsigned int mask = 0 ;
+      for (int i=0; i<8; i++)
+         if (x + i >= 0 && x + i < wd)
+            mask |= 0x80 >> i ;
+      for (int i=0; i<8; i++)
+         if (y + i < 0 || y + i >= ht)
+            bits &= ~((unsigned long long)0xff << (56 - 8 * i)) ;
+         else
+            bits &= ~((unsigned long long)(~mask & 0xff) << (56 - 8 * i)) ;
+      return (node *)packleaf(bits) ;
+   }
+   long long h = s >> 1 ;
+   return find_node(gridclip(n->nw, d-1, x, y), gridclip(n->ne, d-1, x+h, y),
+                    gridclip(n->sw, d-1, x, y+h),
+                    gridclip(n->se, d-1, x+h, y+h)) ;
+}
+/*
+ *   Clear everything outside a grid we step ourselves; setrule has
+ *   already put those cells in clipped_cells.
+ */
+void hlifealgo::cliptogrid() {
+   if (store) {
+      storecall c(this) ;
+      store->cliptogrid() ;
+      return ;
+   }
+   ensure_hashed() ;
+   int sp = stacktop() ;
+   int d = griddepth() ;
+   long long x = -(gridleft.toint() + ((long long)1 << d)) ;
+   long long y = -(gridtop.toint() + ((long long)1 << d) - 1) ;
+   root = popzeros(gridclip(gridpattern(root, d), d, x, y)) ;
+   depth = node_depth(root) ;
+   popValid = 0 ;
+   pop(sp) ;
+}
 const char *hlifealgo::readmacrocell(char *line) {
+   if (store) {
+      const char *err ;
+      std::string rule ;
+      {
+         // the store reads any timeline into its own, so lend it ours
+         storecall c(this) ;
+         std::swap(timeline, store->timeline) ;
+         err = store->readmacrocell(line) ;
+         std::swap(timeline, store->timeline) ;
+         rule.swap(store->filerule) ;
+      }
+      if (err == 0 && !rule.empty())
+         err = setrule(rule.c_str()) ;
+      return err ;
+   }
    int n=0 ;
    g_uintptr_t i=1, nw=0, ne=0, sw=0, se=0, indlen=0 ;
    int r, d ;
@@ -1681,6 +3893,13 @@ default:       return "Illegal character in readmacrocell." ;
             pp = p ;
             while (*pp > ' ') pp++ ;
             *pp = 0 ;
+
+            // a store keeps its rule; the universe reading the file takes
+            // this one up when we are done
+            if (!sharers.empty()) {
+               filerule = p ;
+               break ;
+            }
             
             // AKT: need to check for B0-not-Smax rule
             err = hliferules.setrule(p, this);
@@ -1688,6 +3907,7 @@ default:       return "Illegal character in readmacrocell." ;
                return err;
             if (hliferules.alternate_rules)
                return "B0-not-Smax rules are not allowed in HashLife.";
+            setslicerule() ;
             
             break ;
          case 'G':
@@ -1834,6 +4054,7 @@ const char *hlifealgo::setrule(const char *s) {
    if (!(hliferules.isHexagonal() || hliferules.isWolfram())) {
       fliprule(hliferules.rule0);
    }
+   setslicerule() ;
 
    clearcache() ;
    
@@ -1846,7 +4067,16 @@ const char *hlifealgo::setrule(const char *s) {
       grid_type = VN_GRID;
    else
       grid_type = SQUARE_GRID;
-      
+
+   if (store)
+      movestore() ;
+
+   // a plain torus or bounded plane we step ourselves
+   unbounded = (nativegrid() == BORDERGRID) ;
+   if (!unbounded) {
+      clipcells() ;
+      cliptogrid() ;
+   }
    return 0 ;
 }
 void hlifealgo::unpack8x8(unsigned short nw, unsigned short ne,
@@ -1860,111 +4090,27 @@ void hlifealgo::unpack8x8(unsigned short nw, unsigned short ne,
           (((se & 0xf0) | (sw & 0xf)) << 4) | (se & 0xf) ;
 }
 /**
- *   Write out the native macrocell format.  This is the one we use when
- *   we're not interactive and displaying a progress dialog.
- */
-g_uintptr_t hlifealgo::writecell(std::ostream &os, node *root, int depth) {
-   g_uintptr_t thiscell = 0 ;
-   if (root == zeronode(depth))
-      return 0 ;
-   if (depth == 2) {
-      if (root->nw != 0)
-         return (g_uintptr_t)(root->nw) ;
-   } else {
-      if (marked2(root))
-         return (g_uintptr_t)(root->next) ;
-      unhash_node2(root) ;
-      mark2(root) ;
-   }
-   if (depth == 2) {
-      int i, j ;
-      unsigned int top, bot ;
-      leaf *n = (leaf *)root ;
-      thiscell = ++cellcounter ;
-      root->nw = (node *)thiscell ;
-      unpack8x8(n->nw, n->ne, n->sw, n->se, &top, &bot) ;
-      for (j=7; (top | bot) && j>=0; j--) {
-         int bits = (top >> 24) ;
-         top = (top << 8) | (bot >> 24) ;
-         bot = (bot << 8) ;
-         for (i=0; bits && i<8; i++, bits = (bits << 1) & 255)
-            if (bits & 128)
-               os << '*' ;
-            else
-               os << '.' ;
-         os << '$' ;
-      }
-      os << '\n' ;
-   } else {
-      g_uintptr_t nw = writecell(os, root->nw, depth-1) ;
-      g_uintptr_t ne = writecell(os, root->ne, depth-1) ;
-      g_uintptr_t sw = writecell(os, root->sw, depth-1) ;
-      g_uintptr_t se = writecell(os, root->se, depth-1) ;
-      thiscell = ++cellcounter ;
-      root->next = (node *)thiscell ;
-      os << depth+1 << ' ' << nw << ' ' << ne << ' ' << sw << ' ' << se << '\n';
-   }
-   return thiscell ;
-}
-/**
- *   This new two-pass method works by doing a prepass that numbers the
- *   nodes and counts the number of nodes that should be sent, so we can
- *   display an accurate progress dialog.
- */
-g_uintptr_t hlifealgo::writecell_2p1(node *root, int depth) {
-   g_uintptr_t thiscell = 0 ;
-   if (root == zeronode(depth))
-      return 0 ;
-   if (depth == 2) {
-      if (root->nw != 0)
-         return (g_uintptr_t)(root->nw) ;
-   } else {
-      if (marked2(root))
-         return (g_uintptr_t)(root->next) ;
-      unhash_node2(root) ;
-      mark2(root) ;
-   }
-   if (depth == 2) {
-      thiscell = ++cellcounter ;
-      // note:  we *must* not abort this prescan
-      if ((cellcounter & 4095) == 0)
-         lifeabortprogress(0, "Scanning tree") ;
-      root->nw = (node *)thiscell ;
-   } else {
-      writecell_2p1(root->nw, depth-1) ;
-      writecell_2p1(root->ne, depth-1) ;
-      writecell_2p1(root->sw, depth-1) ;
-      writecell_2p1(root->se, depth-1) ;
-      thiscell = ++cellcounter ;
-      // note:  we *must* not abort this prescan
-      if ((cellcounter & 4095) == 0)
-         lifeabortprogress(0, "Scanning tree") ;
-      root->next = (node *)thiscell ;
-   }
-   return thiscell ;
-}
-/**
- *   This one writes the cells, but assuming they've already been
- *   numbered, and displaying a progress dialog.
+ *   Write out the native macrocell format in a single pass.  Nodes are
+ *   numbered as they are written, children before parents, and the
+ *   numbers are kept in an index of our own rather than in the nodes,
+ *   so writing never changes the tree and nothing needs putting back
+ *   afterwards.  We cannot know ahead of time how many nodes there
+ *   are, so for progress we show how much of the universe is done.
  */
 static char progressmsg[80] ;
-g_uintptr_t hlifealgo::writecell_2p2(std::ostream &os, node *root, int depth) {
-   g_uintptr_t thiscell = 0 ;
+g_uintptr_t hlifealgo::writecell(std::ostream &os, node *root, int depth,
+                                 mcindex &index, double done, double share) {
    if (root == zeronode(depth))
       return 0 ;
+   g_uintptr_t thiscell = index.find(root) ;
+   if (thiscell != 0)
+      return thiscell ;
+   if (isaborted())
+      return 0 ;
    if (depth == 2) {
-      if (cellcounter + 1 != (g_uintptr_t)(root->nw))
-         return (g_uintptr_t)(root->nw) ;
-      thiscell = ++cellcounter ;
-      if ((cellcounter & 4095) == 0) {
-         std::streampos siz = os.tellp();
-         sprintf(progressmsg, "File size: %.2f MB", double(siz) / 1048576.0) ;
-         lifeabortprogress(thiscell/(double)writecells, progressmsg) ;
-      }
       int i, j ;
       unsigned int top, bot ;
       leaf *n = (leaf *)root ;
-      root->nw = (node *)thiscell ;
       unpack8x8(n->nw, n->ne, n->sw, n->se, &top, &bot) ;
       for (j=7; (top | bot) && j>=0; j--) {
          int bits = (top >> 24) ;
@@ -1979,31 +4125,34 @@ g_uintptr_t hlifealgo::writecell_2p2(std::ostream &os, node *root, int depth) {
       }
       os << '\n' ;
    } else {
-      if (cellcounter + 1 > (g_uintptr_t)(root->next) || isaborted())
-         return (g_uintptr_t)(root->next) ;
-      g_uintptr_t nw = writecell_2p2(os, root->nw, depth-1) ;
-      g_uintptr_t ne = writecell_2p2(os, root->ne, depth-1) ;
-      g_uintptr_t sw = writecell_2p2(os, root->sw, depth-1) ;
-      g_uintptr_t se = writecell_2p2(os, root->se, depth-1) ;
-      if (!isaborted() &&
-          cellcounter + 1 != (g_uintptr_t)(root->next)) { // this should never happen
-         lifefatal("Internal in writecell_2p2") ;
-         return (g_uintptr_t)(root->next) ;
-      }
-      thiscell = ++cellcounter ;
-      if ((cellcounter & 4095) == 0) {
-         std::streampos siz = os.tellp();
-         sprintf(progressmsg, "File size: %.2f MB", double(siz) / 1048576.0) ;
-         lifeabortprogress(thiscell/(double)writecells, progressmsg) ;
-      }
-      root->next = (node *)thiscell ;
+      share /= 4 ;
+      g_uintptr_t nw = writecell(os, root->nw, depth-1, index, done, share) ;
+      g_uintptr_t ne = writecell(os, root->ne, depth-1, index,
+                                 done + share, share) ;
+      g_uintptr_t sw = writecell(os, root->sw, depth-1, index,
+                                 done + 2 * share, share) ;
+      g_uintptr_t se = writecell(os, root->se, depth-1, index,
+                                 done + 3 * share, share) ;
       os << depth+1 << ' ' << nw << ' ' << ne << ' ' << sw << ' ' << se << '\n';
    }
+   thiscell = index.add(root) ;
+   if ((thiscell & 4095) == 0) {
+      std::streampos siz = os.tellp();
+      sprintf(progressmsg, "File size: %.2f MB", double(siz) / 1048576.0) ;
+      lifeabortprogress(done, progressmsg) ;
+   }
    return thiscell ;
 }
 #define STRINGIFY(arg) STR2(arg)
 #define STR2(arg) #arg
 const char *hlifealgo::writeNativeFormat(std::ostream &os, char *comments) {
+   if (store) {
+      storecall c(this) ;
+      std::swap(timeline, store->timeline) ;
+      const char *err = store->writeNativeFormat(os, comments) ;
+      std::swap(timeline, store->timeline) ;
+      return err ;
+   }
    int depth = node_depth(root) ;
    os << "[M2] (golly " STRINGIFY(VERSION) ")\n" ;
 
@@ -2037,30 +4186,11 @@ const char *hlifealgo::writeNativeFormat(std::ostream &os, char *comments) {
         }
     }
    
-   inGC = 1 ;
-   /* this is the old way:
-   cellcounter = 0 ;
-   writecell(f, root, depth) ;
-   */
-   /* this is the new two-pass way */
-   cellcounter = 0 ;
-   vector<int> depths(timeline.framecount) ;
+   mcindex index ;
    int framestosave = timeline.framecount ;
    if (timeline.savetimeline == 0)
      framestosave = 0 ;
-   if (framestosave) {
-     for (int i=0; i<timeline.framecount; i++) {
-       node *frame = (node*)timeline.frames[i] ;
-       depths[i] = node_depth(frame) ;
-     }
-     for (int i=0; i<timeline.framecount; i++) {
-       node *frame = (node*)timeline.frames[i] ;
-       writecell_2p1(frame, depths[i]) ;
-     }
-   }
-   writecell_2p1(root, depth) ;
-   writecells = cellcounter ;
-   cellcounter = 0 ;
+   double share = 1.0 / (framestosave + 1) ;
    if (framestosave) {
       os << "#FRAMES"
          << ' ' << timeline.framecount
@@ -2068,20 +4198,12 @@ const char *hlifealgo::writeNativeFormat(std::ostream &os, char *comments) {
          << ' ' << timeline.base << '^' << timeline.expo << '\n' ;
      for (int i=0; i<timeline.framecount; i++) {
        node *frame = (node*)timeline.frames[i] ;
-       writecell_2p2(os, frame, depths[i]) ;
-       os << "#FRAME " << i << ' ' << (g_uintptr_t)frame->next << '\n' ;
-     }
-   }
-   writecell_2p2(os, root, depth) ;
-   /* end new two-pass way */
-   if (framestosave) {
-     for (int i=0; i<timeline.framecount; i++) {
-       node *frame = (node*)timeline.frames[i] ;
-       afterwritemc(frame, depths[i]) ;
+       g_uintptr_t n = writecell(os, frame, node_depth(frame), index,
+                                 i * share, share) ;
+       os << "#FRAME " << i << ' ' << n << '\n' ;
      }
    }
-   afterwritemc(root, depth) ;
-   inGC = 0 ;
+   writecell(os, root, depth, index, framestosave * share, share) ;
    return 0 ;
 }
 char hlifealgo::statusline[200] ;
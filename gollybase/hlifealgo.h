@@ -4,8 +4,18 @@
 #ifndef HLIFEALGO_H
 #define HLIFEALGO_H
 #include "lifealgo.h"
+#include "lifemem.h"
 #include "liferules.h"
+#include "lifeslice.h"
 #include "util.h"
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+class lifethreads ;
 /*
  *   Into instances of this node structure is where almost all of the
  *   memory allocated by this program goes.  Thus, it is imperative we
@@ -87,16 +97,60 @@
  *
  *   Where do we cache the results?  Well, we cache the results in the
  *   same node structure we are using to store the pointers to the
- *   smaller squares themselves.  And since we're hashing them all
- *   together, we want a next pointer for the hash chain.  Put all of
- *   this together, and you get the following structure for the 16-squares
- *   and larger:
+ *   smaller squares themselves.  We hash them all together in an
+ *   open-addressed table of pointers, so the nodes themselves need
+ *   no hash link.  Put all of this together, and you get the following
+ *   structure for the 16-squares and larger:
  */
+#ifdef COMPACTNODES
+/*
+ *   If COMPACTNODES is defined, the fields of a node are 32-bit handles
+ *   rather than pointers, which halves the size of a node on 64-bit
+ *   platforms.  Nodes are allocated in aligned blocks of NODEBLOCKBYTES;
+ *   a handle holds the number of the block (kept in the unused nw field
+ *   of the first node in the block) and the index of the node within the
+ *   block, shifted left two bits so the gc still has the low bits for
+ *   its marks.  Going from a handle to a pointer is a lookup in a fixed
+ *   table of blocks; going back is a mask and a read of the block's
+ *   first node.  Handle zero is the null pointer.
+ */
+#define NODEBLOCKBYTES (65536)
+#define NODESLOTBITS (12)
+#define NODEMAXBLOCKS (1 << (30 - NODESLOTBITS))
+struct node ;
+class nodeptr {
+public:
+   nodeptr() = default ;
+   nodeptr(node *p) : bits(encode(p)) {}
+   operator node *() const { return decode(bits) ; }
+   node *operator->() const { return decode(bits) ; }
+   static unsigned int encode(node *p) ;
+   static node *decode(unsigned int h) ;
+   static node *blocks[NODEMAXBLOCKS] ;
+   unsigned int bits ;
+} ;
+typedef nodeptr nodefield ;
+struct node {
+   nodeptr nw, ne, sw, se ;  /* constant; nw != 0 means nonleaf */
+   nodeptr res ;             /* cache */
+} ;
+inline node *nodeptr::decode(unsigned int h) {
+   return blocks[h >> (NODESLOTBITS + 2)] +
+          ((h >> 2) & ((1 << NODESLOTBITS) - 1)) ;
+}
+inline unsigned int nodeptr::encode(node *p) {
+   if (p == 0)
+      return 0 ;
+   node *b = (node *)(~(g_uintptr_t)(NODEBLOCKBYTES - 1) & (g_uintptr_t)p) ;
+   return (b->nw.bits << (NODESLOTBITS + 2)) | (unsigned int)((p - b) << 2) ;
+}
+#else
 struct node {
-   node *next ;              /* hash link */
    node *nw, *ne, *sw, *se ; /* constant; nw != 0 means nonleaf */
    node *res ;               /* cache */
 } ;
+typedef node *nodefield ;
+#endif
 /*
  *   For the 8-squares, we do not have `children', we have actual data
  *   values.  We still break up the 8-square into 4-squares, but the
@@ -121,17 +175,30 @@ struct node {
  *   so on.
  */
 struct leaf {
-   node *next ;              /* hash link */
-   node *isnode ;            /* must always be zero for leaves */
+   nodefield isnode ;        /* must always be zero for leaves */
    unsigned short nw, ne, sw, se ;  /* constant */
-   bigint leafpop ;         /* how many set bits */
+   unsigned short leafpop ;  /* how many set bits; at most 64 */
    unsigned short res1, res2 ;      /* constant */
 } ;
+/*
+ *   Populations are counted in 64 bits; see calcpop.
+ */
+typedef unsigned long long popword ;
 /*
  *   If it is a struct node, this returns a non-zero value, otherwise it
- *   returns a zero value.
+ *   returns a zero value.  The gc and the macrocell writer also store
+ *   small integers in the pointer fields; rawptr and setrawptr get at
+ *   these without treating them as pointers.
  */
+#ifdef COMPACTNODES
+#define is_node(n) (((node *)(n))->nw.bits)
+#define rawptr(f) ((g_uintptr_t)(f).bits)
+#define setrawptr(f,v) ((f).bits = (unsigned int)(v))
+#else
 #define is_node(n) (((node *)(n))->nw)
+#define rawptr(f) ((g_uintptr_t)(f))
+#define setrawptr(f,v) ((f) = (node *)(v))
+#endif
 /*
  *   For explicit prefetching we retain some state on our lookup
  *   calculations.
@@ -143,6 +210,18 @@ struct setup_t {
    void prefetch(node **addr) const { PREFETCH(addr) ; }
 } ;
 #endif
+/*
+ *   When we step with more than one thread, each thread keeps its own
+ *   stack of roots (the gc scans all of them), a short private list
+ *   of free nodes, and its own performance counters.
+ */
+struct hlifeworker {
+   node **stack ;
+   int gsp, stacksize ;
+   node *freenodes ;
+   hperf perf ;
+   hashcounts counts ;
+} ;
 /**
  *   Our hlifealgo class.
  */
@@ -157,6 +236,7 @@ public:
    virtual int setcell(int x, int y, int newstate) ;
    virtual int getcell(int x, int y) ;
    virtual int nextcell(int x, int y, int &state) ;
+   virtual int setcells(const vector<loadcell> &cells) ;
    virtual void endofpattern() ;
    virtual void setIncrement(bigint inc) ;
    virtual void setIncrement(int inc) { setIncrement(bigint(inc)) ; }
@@ -165,12 +245,16 @@ public:
    virtual int isEmpty() ;
    virtual int hyperCapable() { return 1 ; }
    virtual void setMaxMemory(int m) ;
-   virtual int getMaxMemory() { return (int)(maxmem >> 20) ; }
+   virtual int getMaxMemory() {
+      return (int)((store ? store->maxmem : maxmem) >> 20) ;
+   }
    virtual const char *setrule(const char *s) ;
    virtual const char *getrule() { return hliferules.getrule() ; }
    virtual void step() ;
    virtual void* getcurrentstate() { return root ; }
    virtual void setcurrentstate(void *n) ;
+   virtual int hashstate(void *state, const bigint &top, const bigint &left,
+                         cellhash &h) ;
    /*
     *   The contract of draw() is that it render every pixel in the
     *   viewport precisely once.  This allows us to eliminate all
@@ -182,7 +266,27 @@ public:
    virtual void findedges(bigint *t, bigint *l, bigint *b, bigint *r) ;
    virtual const char *readmacrocell(char *line) ;
    virtual const char *writeNativeFormat(std::ostream &os, char *comments) ;
+   virtual int getstats(lifestats &s) ;
    static void doInitializeAlgoInfo(staticAlgoInfo &) ;
+   /*
+    *   Keep the nodes in a memory-mapped file rather than in memory, so
+    *   the operating system can page cold ones out to disk; the memory
+    *   limit then counts the file too.  This must be done before
+    *   anything is put into the universe.  If the file holds a run
+    *   saved with savenodefile(), that run is picked up, cache and all,
+    *   and resumed is set.  Both return an error message or 0.
+    */
+   const char *setnodefile(const char *filename, int &resumed) ;
+   const char *savenodefile() ;
+   /*
+    *   Universes made while this is on keep their nodes in a store they
+    *   share with every other such universe that has the same rule, so
+    *   whatever one of them works out the rest can use; the store goes
+    *   when the last of them does.  The memory limit and the statistics
+    *   are then those of the store.  Only one universe of a store may be
+    *   in a call at any one time.
+    */
+   static void setsharednodes(int share) { sharenodes = share ; }
 private:
 /*
  *   Some globals representing our universe.  The root is the
@@ -211,21 +315,36 @@ private:
 #ifndef PRIMEMOD
    g_uintptr_t hashmask ;
 #endif
-   static double maxloadfactor ;
+   static double maxloadfactor, maxfillfactor, maxhotfraction ;
    node **hashtab ;
-   int halvesdone ;
+   node **oldhashtab ; // the table a resize is still moving out of
+   g_uintptr_t oldhashprime, oldhashnext ;
+   std::atomic<int> halvesdone ;
    int gsp ;
    g_uintptr_t alloced, maxmem ;
    node *freenodes ;
    int okaytogc ;
    g_uintptr_t totalthings ;
    node *nodeblocks ;
+   blockpool *nodepool ; // where node blocks come from, unless in a file
+   int nodefd ; // file backing the node arena, or -1
+   int nodefilesaved ; // whether the file holds the run as it is now
+   char *arenabase ;
+   g_uintptr_t arenasize, arenaused, arenafile ;
+   std::vector<node *> markstack, livenodes, sweepblocks ;
+   size_t sweepnext, livenext ; // how far the lazy sweep has got
+   double maxgcpause ; // longest gc so far, in milliseconds
+   double lastgcpause, totalgcpause ; // the same, for getstats
+   double lastgcfreed ; // share of the hash the last gc threw away
    char *ruletable ;
+   int slicerule ; // 0 uses the rule table; 1 is Life, 2 another Bx/Sy rule
+   sliceword slicesel[24] ;
    bigint population ;
    bigint setincrement ;
-   bigint pow2step ; // greatest power of two in increment
-   int nonpow2 ; // increment / pow2step
-   int ngens ; // log2(pow2step)
+   int ngens ; // log2 of the highest power of two in the increment
+   std::vector<char> stepbits ; // the increment in binary, low bit first
+   int steplow ; // the lowest bit set in it
+   int stepgrid ; // the kind of grid ngens was chosen for
    int popValid, needPop, inGC ;
    /*
     *   When rendering we store the relevant bits here rather than
@@ -238,32 +357,161 @@ private:
    char *llxb, *llyb ;
    int hashed ;
    int cacheinvalid ;
-   g_uintptr_t cellcounter ; // used when writing
-   g_uintptr_t writecells ; // how many to write
    int gccount ; // how many gcs total this pattern
    int gcstep ; // how many gcs this step
    hperf running_hperf, step_hperf, inc_hperf ;
+   hashcounts counts ; // lookups, for getstats
+   int invalidations ; // times new_ngens cleared the cache
    int softinterrupt ;
+   /*
+    *   The population of each node we have counted since the last gc,
+    *   in an open-addressed table keyed by the node, and the few that
+    *   did not fit in 63 bits.
+    */
+   struct popentry {
+      node *n ;
+      popword pop ;
+   } ;
+   popentry *poptab ;
+   g_uintptr_t popmask, popcount ;
+   std::deque<bigint> bigpops ;
+   /*
+    *   When the increment is not a power of two, what each node comes
+    *   to after the part of the increment below its own full step (see
+    *   getstepres), in another such table.
+    */
+   struct stepentry {
+      node *n, *res ;
+   } ;
+   stepentry *steptab ;
+   g_uintptr_t stepmask, stepcount ;
    static char statusline[] ;
+/*
+ *   Multithreading state.  While parallel is set, new entries go into
+ *   the hash table with a compare-and-swap, node allocation goes
+ *   through allocmutex, and anything that needs the whole table (gc
+ *   and resize) is done by worker 0 with the world stopped.
+ */
+   static int mintaskdepth ;
+   lifethreads *threads ;
+   hlifeworker *workers ;
+   int nworkers ;
+   int parallel ;
+   int gcrequested ;
+   std::atomic<g_uintptr_t> parhashpop ;
+   std::mutex allocmutex ;
+/*
+ *   Sharing a node store.  A universe that shares one keeps only its
+ *   own pattern (the root, the generation, and so on); every call that
+ *   needs nodes is handed to the store, itself an hlifealgo, after
+ *   lending it that pattern.  The store knows its universes, so its
+ *   gc can keep all of their patterns.
+ */
+   static int sharenodes ;
+   hlifealgo *store ;                 // the store we use, or 0
+   std::vector<hlifealgo *> sharers ; // if we are a store, who uses us
+   hlifealgo *current ;               // whose pattern we hold, if a store
+   int storecalls ;                   // how many calls deep it is in us
+   std::string filerule ;             // the rule in a file a store read
+   struct storecall {
+      storecall(hlifealgo *u) : u(u) { u->bindstore() ; }
+      ~storecall() { u->unbindstore() ; }
+      hlifealgo *u ;
+   } ;
+   void joinstore() ;
+   void leavestore(hlifealgo *s) ;
+   void movestore() ;
+   void bindstore() ;
+   void unbindstore() ;
+   void lendpattern(hlifealgo *u) ;
+   void returnpattern(hlifealgo *u) ;
+   node *copytree(node *n, std::map<node *, node *> &copies) ;
+   std::unordered_map<node *, cellhash> cellhashes ; // cleared by each gc
+   cellhash hashnode(node *n, int d) ;
+   typedef std::map<std::tuple<node *, long long, long long, int>, node *>
+      windowmemo ;
+   node *window(node *n, int d, long long x, long long y, int wd,
+                windowmemo &memo) ;
+   void windowbits(node *n, int d, long long x, long long y,
+                   unsigned long long &bits) ;
+   /*
+    *   Stepping a torus ourselves:  the pattern, cut to the grid, is
+    *   tiled across a root as deep as the step needs, and the grid is
+    *   cut back out of the result.  Squares of the tiling are found by
+    *   where their top left corner falls in the grid.
+    */
+   struct wrapinfo {
+      node *pat ;                     // the pattern, at depth patdepth
+      int patdepth ;
+      long long wd, ht ;              // the grid's size
+      long long left, top ;           // its top left corner in pat
+      long long u, v ;                // where the root's corner falls
+      long long gx, gy ;              // the grid's corner in the result
+      std::vector<long long> hx, hy ; // 2^d mod wd and mod ht
+      windowmemo windows ;
+      std::map<std::tuple<long long, long long, int>, node *> memo ;
+   } ;
+   int griddepth() ;
+   int gridngens() ;
+   node *gridpattern(node *n, int d) ;
+   node *wrapgrid(wrapinfo &w, node *n, int &depth) ;
+   node *wrapped(wrapinfo &w, long long u, long long v, int d) ;
+   node *unwrapgrid(wrapinfo &w, node *n, int d) ;
+   node *gridclip(node *n, int d, long long x, long long y) ;
+   void cliptogrid() ;
+   node *steproot(node *n, int depth, int partial) ;
+   node *runtorus(node *n) ;
+   node *runplane(node *n) ;
 //
    void leafres(leaf *n) ;
    void resize() ;
+   void hashinsert(node *p, g_uintptr_t h) ;
+   void movehash(g_uintptr_t n) ;
+   void finishresize() ;
+   void dropoldhash() ;
+   node *findoldnode(g_uintptr_t h, node *nw, node *ne, node *sw, node *se) ;
+   leaf *findoldleaf(g_uintptr_t h, unsigned short nw, unsigned short ne,
+                     unsigned short sw, unsigned short se) ;
    node *find_node(node *nw, node *ne, node *sw, node *se) ;
 #ifdef USEPREFETCH
    node *find_node(setup_t &su) ;
    void setupprefetch(setup_t &su, node *nw, node *ne, node *sw, node *se) ;
 #endif
-   void unhash_node(node *n) ;
-   void unhash_node2(node *n) ;
-   void rehash_node(node *n) ;
    leaf *find_leaf(unsigned short nw, unsigned short ne,
                    unsigned short sw, unsigned short se) ;
    node *getres(node *n, int depth) ;
+   node *getstepres(node *n, int depth) ;
+   node *dorecurs_step(node *n, node *ne, node *t, node *e, int depth) ;
+   node *centre(node *n, node *ne, node *t, node *e, int depth) ;
+   node *dorecurs_mt(node *n, node *ne, node *t, node *e, int depth,
+                     int half) ;
+   void spawnres(node **in, int cnt, int depth) ;
+   static void restask(void *obj, void *arg) ;
+   node *find_node_mt(g_uintptr_t h, node *nw, node *ne, node *sw, node *se) ;
+   leaf *find_leaf_mt(unsigned short nw, unsigned short ne,
+                      unsigned short sw, unsigned short se) ;
+   node *newnode_mt() ;
+   void refill(hlifeworker &w) ;
+   void parinserted() ;
+   void beginparallel() ;
+   void endparallel() ;
+   int parallelpoll() ;
+   void mainsafepoint() ;
+   static void mainsafepoint(void *obj) ;
+   void runexclusive() ;
+   int stacktop() ;
    node *dorecurs(node *n, node *ne, node *t, node *e, int depth) ;
    node *dorecurs_half(node *n, node *ne, node *t, node *e, int depth) ;
    leaf *dorecurs_leaf(leaf *n, leaf *ne, leaf *t, leaf *e) ;
    leaf *dorecurs_leaf_half(leaf *n, leaf *ne, leaf *t, leaf *e) ;
    leaf *dorecurs_leaf_quarter(leaf *n, leaf *ne, leaf *t, leaf *e) ;
+   leaf *dorecurs_leaf_gens(leaf *n, leaf *ne, leaf *t, leaf *e, int gens) ;
+   leaf *sliceleaf(leaf *n, leaf *ne, leaf *t, leaf *e, int gens) ;
+   void setslicerule() ;
+   void addnodeblock() ;
+   node *arenablock() ;
+   void dirtynodefile() ;
+   void rebasenodes(g_uintptr_t oldbase) ;
    node *newnode() ;
    leaf *newleaf() ;
    node *newclearednode() ;
@@ -277,9 +525,20 @@ private:
    int nextbit(node *n, int x, int y, int depth) ;
    node *hashpattern(node *root, int depth) ;
    node *popzeros(node *n) ;
-   const bigint &calcpop(node *root, int depth) ;
-   void aftercalcpop2(node *root, int depth) ;
-   void afterwritemc(node *root, int depth) ;
+   typedef std::vector<std::pair<unsigned long long, node *> > leaflist ;
+   node *buildcells(const vector<loadcell> &cells, int depth) ;
+   leaf *packleaf(unsigned long long bits) ;
+   node *buildnodes(const leaflist &leaves, size_t lo, size_t hi, int depth) ;
+   node *overlay(node *a, node *b, int depth) ;
+   popword calcpop(node *root, int depth) ;
+   bigint popvalue(popword w) ;
+   void addpop(node *n, popword pop) ;
+   void clearpops() ;
+   node *findstep(node *n) ;
+   void addstep(node *n, node *res) ;
+   void clearsteps() ;
+   void keepsteps(int invalidate) ;
+   void setstepbits() ;
    void calcPopulation() ;
    node *save(node *n) ;
    void pop(int n) ;
@@ -287,6 +546,7 @@ private:
    void clearcache() ;
    void gc_mark(node *root, int invalidate) ;
    void do_gc(int invalidate) ;
+   void sweep(int all) ;
    void clearcache(node *n, int depth, int clearto) ;
    void clearcache_p1(node *n, int depth, int clearto) ;
    void clearcache_p2(node *n, int depth, int clearto) ;
@@ -297,9 +557,8 @@ private:
    void fill_ll(int d) ;
    void drawnode(node *n, int llx, int lly, int depth, node *z) ;
    void ensure_hashed() ;
-   g_uintptr_t writecell(std::ostream &os, node *root, int depth) ;
-   g_uintptr_t writecell_2p1(node *root, int depth) ;
-   g_uintptr_t writecell_2p2(std::ostream &os, node *root, int depth) ;
+   g_uintptr_t writecell(std::ostream &os, node *root, int depth,
+                         mcindex &index, double done, double share) ;
    void unpack8x8(unsigned short nw, unsigned short ne,
                   unsigned short sw, unsigned short se,
                   unsigned int *top, unsigned int *bot) ;
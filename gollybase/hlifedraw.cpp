@@ -229,6 +229,11 @@ static void init_compress4x4() {
  *   display an image.
  */
 void hlifealgo::draw(viewport &viewarg, liferender &rendererarg) {
+   if (store) {
+      storecall c(this) ;
+      store->draw(viewarg, rendererarg) ;
+      return ;
+   }
    if (!inited) {
       init_compress4x4() ;
       inited = true;
@@ -417,6 +422,11 @@ void sortunique(vector<node *> &dest, vector<node *> &src) {
 }
 
 void hlifealgo::findedges(bigint *ptop, bigint *pleft, bigint *pbottom, bigint *pright) {
+   if (store) {
+      storecall c(this) ;
+      store->findedges(ptop, pleft, pbottom, pright) ;
+      return ;
+   }
    // AKT: following code is from fit() but all goal/size stuff
    // has been removed so it finds the exact pattern edges
    ensure_hashed() ;
@@ -598,6 +608,11 @@ void hlifealgo::findedges(bigint *ptop, bigint *pleft, bigint *pbottom, bigint *
 }
 
 void hlifealgo::fit(viewport &view, int force) {
+   if (store) {
+      storecall c(this) ;
+      store->fit(view, force) ;
+      return ;
+   }
    ensure_hashed() ;
    bigint xmin = -1 ;
    bigint xmax = 1 ;
@@ -805,6 +820,11 @@ void hlifealgo::fit(viewport &view, int force) {
    view.setpositionmag(xmin, xmax, ymin, ymax, mag) ;
 }
 void hlifealgo::lowerRightPixel(bigint &x, bigint &y, int mag) {
+   if (store) {
+      storecall c(this) ;
+      store->lowerRightPixel(x, y, mag) ;
+      return ;
+   }
    if (mag >= 0)
      return ;
    x >>= -mag ;
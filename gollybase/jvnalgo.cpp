@@ -15,6 +15,8 @@ using namespace std ;
 // this algorithm supports three rules:
 const char* RULE_STRINGS[] = { "JvN29", "Nobili32", "Hutton32" };
 const int N_STATES[] = { 29, 32, 32 };
+// marks a row of slowcalc's table not worked out yet
+const unsigned short NOROW = 0xffff;
 
 int jvnalgo::NumCellStates() {
    return N_STATES[current_rule];
@@ -40,6 +42,10 @@ const char* jvnalgo::setrule(const char *s)
    else {
       return "This algorithm only supports these rules:\nJvN29, Nobili32, Hutton32.";
    }
+   // the table is per rule, so start it again
+   rowof.assign(1 << 15, NOROW);
+   rows.clear();
+   rowids.clear();
    
    // check for rule suffix like ":T200,100" to specify a bounded universe
    if (colonptr) {
@@ -187,6 +193,7 @@ jvnalgo::jvnalgo() {
      compress[uncompress[i]] = (state)i ;
   current_rule = JvN29 ;
   maxCellStates = N_STATES[current_rule] ;
+  rowof.assign(1 << 15, NOROW) ;
 }
 
 jvnalgo::~jvnalgo() {
@@ -194,9 +201,42 @@ jvnalgo::~jvnalgo() {
 
 state slowcalc_Hutton32(state c,state n,state s,state e,state w);
 
-// --- the update function ---
+/**
+ *   The rules below take dozens of branches to find a cell's new state,
+ *   many of them hard to predict, so slowcalc looks it up instead.  A
+ *   table of every neighborhood would have 32^5 entries, but each row of
+ *   32 by 32 new states for the east and south neighbors is one of a
+ *   few dozen (a hundred or so for Hutton32), so we keep those once each
+ *   and index them by the other three cells.  Rows are worked out from
+ *   the rules the first time their c, n and w turn up (about 20us each),
+ *   so changing the rule costs nothing and a pattern only pays for the
+ *   rows it uses.
+ */
+unsigned int jvnalgo::addrow(state n, state w, state c) {
+   int ns = N_STATES[current_rule] ;
+   vector<state> row(1 << 10, 0) ;
+   for (int e=0; e<ns; e++)
+      for (int s=0; s<ns; s++)
+         row[(e << 5) | s] = logiccalc(n, w, c, e, s) ;
+   map< vector<state>, unsigned short >::iterator it = rowids.find(row) ;
+   if (it == rowids.end()) {
+      it = rowids.insert(make_pair(row, (unsigned short)rowids.size())).first ;
+      rows.insert(rows.end(), row.begin(), row.end()) ;
+   }
+   rowof[(c << 10) | (n << 5) | w] = it->second ;
+   return it->second ;
+}
+
 state jvnalgo::slowcalc(state, state n, state, state w, state c, state e,
                         state, state s, state) {
+   unsigned int r = rowof[(c << 10) | (n << 5) | w] ;
+   if (r == NOROW)
+      r = addrow(n, w, c) ;
+   return rows[(r << 10) | (e << 5) | s] ;
+}
+
+// --- the update function ---
+state jvnalgo::logiccalc(state n, state w, state c, state e, state s) {
    if(current_rule == JvN29 || current_rule == Nobili32)
    {
 	   c = uncompress[c] ;
@@ -245,6 +285,8 @@ state jvnalgo::slowcalc(state, state n, state, state w, state c, state e,
    	return slowcalc_Hutton32(c,n,s,e,w);
 }
 
+template class ghashalgo<jvnalgo> ;
+
 // XPM data for the 31 7x7 icons used in JvN algo
 static const char* jvn7x7[] = {
 // width height ncolors chars_per_pixel
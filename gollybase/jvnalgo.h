@@ -4,10 +4,12 @@
 #ifndef JVNALGO_H
 #define JVNALGO_H
 #include "ghashbase.h"
+#include <vector>
+#include <map>
 /**
  *   Our JvN algo class.
  */
-class jvnalgo : public ghashbase {
+class jvnalgo : public ghashalgo<jvnalgo> {
 public:
    jvnalgo() ;
    virtual ~jvnalgo() ;
@@ -18,7 +20,21 @@ public:
    virtual const char* DefaultRule() ;
    virtual int NumCellStates() ;
    static void doInitializeAlgoInfo(staticAlgoInfo &) ;
+   int calcmask() const { return VON_NEUMANN ; }
+   // the transition rules as written; slowcalc looks the same results
+   // up in a table built from this (for checking and benchmarking)
+   state logiccalc(state n, state w, state c, state e, state s) ;
 private:
+   unsigned int addrow(state n, state w, state c) ;
    enum { JvN29, Nobili32, Hutton32 } current_rule ;
+   // slowcalc's table, filled in as neighborhoods turn up: rowof[c,n,w]
+   // says which row of rows holds the new states for every e and s,
+   // with rows that come out the same shared
+   std::vector<unsigned short> rowof ;
+   std::vector<state> rows ;
+   std::map<std::vector<state>, unsigned short> rowids ;
 };
+
+extern template class ghashalgo<jvnalgo> ;
+
 #endif
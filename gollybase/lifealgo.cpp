@@ -4,12 +4,21 @@
 #include "lifealgo.h"
 #include "util.h"       // for lifestatus
 #include "string.h"
+#include <algorithm>
 using namespace std ;
 lifealgo::~lifealgo() {
    poller = 0 ;
    maxCellStates = 2 ;
 }
 int lifealgo::verbose ;
+int lifealgo::numthreads = 1 ;
+void lifealgo::setNumThreads(int n) {
+   if (n < 1)
+      n = 1 ;
+   else if (n > MAX_THREADS)
+      n = MAX_THREADS ;
+   numthreads = n ;
+}
 /*
  *   Right now, the base/expo should match the current increment.
  *   We do not check this.
@@ -99,6 +108,167 @@ void lifealgo::destroytimeline() {
   timeline.next = 0 ;
 }
 
+/*
+ *   Period search.  We remember, for every different state seen since
+ *   the search started, the last generation it was seen at and where
+ *   it was.  Two states are the same pattern if they agree on
+ *   population, bounding box size and cellhash; the cellhash does not
+ *   depend on where the pattern is, so a spaceship is found too.
+ */
+int lifealgo::startperiodsearch() {
+   stopperiodsearch() ;
+   if (getcurrentstate() == 0)
+      return 0 ;
+   periods.searching = 1 ;
+   bigint period, dx, dy ;
+   findperiod(period, dx, dy) ;
+   if (periods.states.empty()) {
+      stopperiodsearch() ;
+      return 0 ;
+   }
+   return 1 ;
+}
+int lifealgo::findperiod(bigint &period, bigint &dx, bigint &dy) {
+   if (!periods.searching)
+      return 0 ;
+   periodsearch_t::seen s ;
+   bigint bottom, right ;
+   cellhash h ;
+   if (isEmpty()) {
+      s.top = s.left = 0 ;
+      bottom = right = -1 ;
+   } else {
+      findedges(&s.top, &s.left, &bottom, &right) ;
+      // after isEmpty, which may have put the pattern into canonical form
+      if (!hashstate(getcurrentstate(), s.top, s.left, h))
+         return 0 ;
+   }
+   s.gen = generation ;
+   bigint wd = right, ht = bottom ;
+   wd -= s.left ;
+   ht -= s.top ;
+   periodsearch_t::key key(getPopulation().todouble(), wd.todouble(),
+                           ht.todouble(), h) ;
+   std::map<periodsearch_t::key, periodsearch_t::seen>::iterator it =
+      periods.states.find(key) ;
+   if (it == periods.states.end()) {
+      periods.states.insert(make_pair(key, s)) ;
+      return 0 ;
+   }
+   // measure from the latest time we saw it, for the shortest period
+   period = s.gen ;
+   period -= it->second.gen ;
+   dx = s.left ;
+   dx -= it->second.left ;
+   dy = s.top ;
+   dy -= it->second.top ;
+   it->second = s ;
+   return 1 ;
+}
+void lifealgo::stopperiodsearch() {
+   periods.searching = 0 ;
+   periods.states.clear() ;
+}
+
+/*
+ *   Arithmetic modulo 2^61-1 for cellhash, done in 64 bits:  since
+ *   2^61 is 1 modulo the prime, the bits above 61 fold back onto the
+ *   low ones.  The tables hold each base to the power 2^k, and the
+ *   inverse of each base likewise, for moving hashes.
+ */
+static const unsigned long long HASHPRIME = ((unsigned long long)1 << 61) - 1 ;
+static unsigned long long hashfold(unsigned long long x) {
+   x = (x & HASHPRIME) + (x >> 61) ;
+   return x >= HASHPRIME ? x - HASHPRIME : x ;
+}
+static unsigned long long hashmul(unsigned long long a, unsigned long long b) {
+   unsigned long long a1 = a >> 32, a0 = a & 0xffffffff ;
+   unsigned long long b1 = b >> 32, b0 = b & 0xffffffff ;
+   unsigned long long mid = a1 * b0 + a0 * b1 ;
+   return hashfold(hashfold(8 * a1 * b1) +
+                   hashfold((mid >> 29) + ((mid & 0x1fffffff) << 32)) +
+                   hashfold(a0 * b0)) ;
+}
+static struct hashpowers {
+   // [lane][0 for x, 1 for y][k]
+   unsigned long long pow2[2][2][64], inv2[2][2][64] ;
+   hashpowers() {
+      static const unsigned long long bases[2][2] = {
+         { 0x0b7e151628aed2a6ULL, 0x13198a2e03707344ULL },
+         { 0x0a4093822299f31dULL, 0x082efa98ec4e6c89ULL } } ;
+      for (int l=0; l<2; l++)
+         for (int a=0; a<2; a++) {
+            unsigned long long b = bases[l][a] ;
+            for (int k=0; k<64; k++, b=hashmul(b, b))
+               pow2[l][a][k] = b ;
+            // b^(p-2) is the inverse of b
+            unsigned long long inv = 1, e = HASHPRIME - 2 ;
+            for (int k=0; e; k++, e >>= 1)
+               if (e & 1)
+                  inv = hashmul(inv, pow2[l][a][k]) ;
+            for (int k=0; k<64; k++, inv=hashmul(inv, inv))
+               inv2[l][a][k] = inv ;
+         }
+   }
+   static unsigned long long power(const unsigned long long *tab,
+                                   unsigned long long n) {
+      unsigned long long r = 1 ;
+      for (int k=0; n; k++, n >>= 1)
+         if (n & 1)
+            r = hashmul(r, tab[k]) ;
+      return r ;
+   }
+} hashpow ;
+void cellhash::addcell(int state, unsigned long long x, unsigned long long y) {
+   for (int l=0; l<2; l++)
+      h[l] = hashfold(h[l] +
+                      hashmul(hashmul((unsigned long long)state,
+                                      hashpow.power(hashpow.pow2[l][0], x)),
+                              hashpow.power(hashpow.pow2[l][1], y))) ;
+}
+cellhash cellhash::quads(const cellhash &nw, const cellhash &ne,
+                         const cellhash &sw, const cellhash &se, int k) {
+   cellhash r ;
+   for (int l=0; l<2; l++) {
+      unsigned long long ax = hashpow.pow2[l][0][k] ;
+      unsigned long long by = hashpow.pow2[l][1][k] ;
+      r.h[l] = hashfold(hashfold(nw.h[l] + hashmul(ne.h[l], ax)) +
+                        hashmul(hashfold(sw.h[l] + hashmul(se.h[l], ax)),
+                                by)) ;
+   }
+   return r ;
+}
+cellhash cellhash::moved(unsigned long long x, unsigned long long y) const {
+   cellhash r ;
+   for (int l=0; l<2; l++)
+      r.h[l] = hashmul(hashmul(h[l], hashpow.power(hashpow.inv2[l][0], x)),
+                       hashpow.power(hashpow.inv2[l][1], y)) ;
+   return r ;
+}
+
+g_uintptr_t mcindex::add(const void *p) {
+   if (2 * (count + 1) > mask + 1) {
+      vector<slot> old ;
+      old.swap(slots) ;
+      mask = old.empty() ? 4095 : 2 * mask + 1 ;
+      slot empty = { 0, 0 } ;
+      slots.assign(mask + 1, empty) ;
+      for (size_t j=0; j<old.size(); j++)
+         if (old[j].p) {
+            g_uintptr_t i = hash(old[j].p) & mask ;
+            while (slots[i].p)
+               i = (i + 1) & mask ;
+            slots[i] = old[j] ;
+         }
+   }
+   g_uintptr_t i = hash(p) & mask ;
+   while (slots[i].p)
+      i = (i + 1) & mask ;
+   slots[i].p = p ;
+   slots[i].n = ++count ;
+   return count ;
+}
+
 // -----------------------------------------------------------------------------
 
 // AKT: the following routines provide support for a bounded universe
@@ -876,6 +1046,60 @@ bool lifealgo::DeleteBorderCells()
     return true;
 }
 
+int lifealgo::nativegrid() const
+{
+    if (gridwd == 0 || gridht == 0 || sphere || htwist || vtwist ||
+        hshift != 0 || vshift != 0) return BORDERGRID;
+    return boundedplane ? PLANEGRID : TORUSGRID;
+}
+
+void lifealgo::clipcells()
+{
+    clipped_cells.clear();
+    if (isEmpty()) return;
+    
+    bigint top, left, bottom, right;
+    findedges(&top, &left, &bottom, &right);
+    if (gridtop <= top && gridleft <= left && gridbottom >= bottom && gridright >= right) {
+        return;
+    }
+    
+    // a pattern too big for nextcell is just cleared, not saved
+    if ( top < bigint::min_coord || left < bigint::min_coord ||
+         bottom > bigint::max_coord || right > bigint::max_coord ) {
+        return;
+    }
+    
+    int pl = left.toint();
+    int pt = top.toint();
+    int pr = right.toint();
+    int pb = bottom.toint();
+    int gr = gridright.toint();
+    
+    int cx, cy, v;
+    for ( cy = pt; cy <= pb; cy++ ) {
+        for ( cx = pl; cx <= pr; cx++ ) {
+            int skip = nextcell(cx, cy, v);
+            if (skip < 0 || skip + cx > pr) break;
+            cx += skip;
+            if (!clipcell(cx, cy, v) && cx < gr) {
+                // skip the part of the row inside the grid
+                cx = gr;
+            }
+        }
+    }
+}
+
+bool lifealgo::clipcell(int x, int y, int s)
+{
+    if (gridleft <= x && gridright >= x && gridtop <= y && gridbottom >= y)
+        return false;
+    clipped_cells.push_back(x);
+    clipped_cells.push_back(y);
+    clipped_cells.push_back(s);
+    return true;
+}
+
 void lifealgo::getcells(unsigned char *buf, int x, int y, int w, int h) {
    viewport vp(w, h) ;
    vp.setpositionmag(x+(w>>1), y+(h>>1), 0) ;
@@ -884,6 +1108,83 @@ void lifealgo::getcells(unsigned char *buf, int x, int y, int w, int h) {
    draw(vp, hsr) ;
 }
 
+int lifealgo::setcells(const vector<loadcell> &cells) {
+   for (size_t i=0; i<cells.size(); i++)
+      if (cells[i].state != 0 &&
+          setcell(cells[i].x, cells[i].y, cells[i].state) < 0)
+         return -1 ;
+   return 0 ;
+}
+
+/*
+ *   For setcells in the hash algorithms.  We find the smallest square
+ *   (of side 2^(depth+1), at least mindepth, centred where the root is)
+ *   that holds the cells; -1 if the cells are too far apart for their
+ *   Morton keys in it to fit in 64 bits.
+ */
+int lifealgo::mortondepth(const vector<loadcell> &cells, int mindepth) {
+   // like setcell, the root holds -2^d <= x < 2^d and -2^d <= -y < 2^d
+   long long lo = 0, hi = 0 ;
+   for (size_t i=0; i<cells.size(); i++) {
+      long long x = cells[i].x, y = - (long long)cells[i].y ;
+      lo = std::min(lo, std::min(x, y)) ;
+      hi = std::max(hi, std::max(x, y)) ;
+   }
+   int d = mindepth ;
+   while (lo < -((long long)1 << d) || hi >= ((long long)1 << d))
+      d++ ;
+   return d > 31 ? -1 : d ;
+}
+static unsigned long long spreadbits(unsigned long long v) {
+   v = (v | (v << 16)) & 0x0000ffff0000ffffULL ;
+   v = (v | (v << 8)) & 0x00ff00ff00ff00ffULL ;
+   v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0fULL ;
+   v = (v | (v << 2)) & 0x3333333333333333ULL ;
+   v = (v | (v << 1)) & 0x5555555555555555ULL ;
+   return v ;
+}
+unsigned long long lifealgo::mortonkey(unsigned int col, unsigned int row) {
+   return (spreadbits(row) << 1) | spreadbits(col) ;
+}
+/*
+ *   The cells with their keys in that square, sorted; a stable sort, so
+ *   that a cell given twice takes the later state.  Returns the depth,
+ *   or -1 as above.
+ */
+int lifealgo::mortonsort(const vector<loadcell> &cells, int mindepth,
+                         vector<mortoncell> &sorted) {
+   int d = mortondepth(cells, mindepth) ;
+   if (d < 0)
+      return -1 ;
+   long long half = (long long)1 << d ;
+   sorted.resize(cells.size()) ;
+   for (size_t i=0; i<cells.size(); i++) {
+      sorted[i].key = mortonkey((unsigned int)(cells[i].x + half),
+                                (unsigned int)(cells[i].y + half - 1)) ;
+      sorted[i].state = cells[i].state ;
+   }
+   // an LSD radix sort, which is stable, on just the bits the keys use
+   const int RADIXBITS = 11 ;
+   vector<mortoncell> tmp(sorted.size()) ;
+   vector<size_t> count(1 << RADIXBITS) ;
+   for (int shift=0; shift<2*(d+1); shift += RADIXBITS) {
+      std::fill(count.begin(), count.end(), 0) ;
+      for (size_t i=0; i<sorted.size(); i++)
+         count[(sorted[i].key >> shift) & ((1 << RADIXBITS) - 1)]++ ;
+      size_t sum = 0 ;
+      for (size_t k=0; k<count.size(); k++) {
+         size_t c = count[k] ;
+         count[k] = sum ;
+         sum += c ;
+      }
+      for (size_t i=0; i<sorted.size(); i++)
+         tmp[count[(sorted[i].key >> shift) & ((1 << RADIXBITS) - 1)]++] =
+                                                                  sorted[i] ;
+      sorted.swap(tmp) ;
+   }
+   return d ;
+}
+
 // -----------------------------------------------------------------------------
 
 int staticAlgoInfo::nextAlgoId = 0 ;
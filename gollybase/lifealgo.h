@@ -24,12 +24,17 @@
    #pragma warning(default:4702)   // enable "unreachable code" warnings
 #endif
 using std::vector;
+#include <map>
+#include <tuple>
 #include <iostream>
 
 // this must not be increased beyond 32767, because we use a bigint
 // multiply that only supports multiplicands up to that size.
 const int MAX_FRAME_COUNT = 32000 ;
 
+// the most threads we will let a step use
+const int MAX_THREADS = 256 ;
+
 /**
  *   Timeline support is pretty generic.
  */
@@ -42,9 +47,131 @@ public:
    vector<void *> frames ;
 } ;
 
+/**
+ *   A hash of a set of cells that does not change when they move.  For
+ *   each of two fixed bases (a, b), it is the sum over the live cells of
+ *   state * a^x * b^y, modulo the prime 2^61-1.  A square's hash is
+ *   built from its quadrants' hashes, and moving cells multiplies their
+ *   hash by a power of the bases, so the hash algorithms can find the
+ *   hash of a pattern moved to the origin without moving it.
+ */
+struct cellhash {
+   cellhash() { h[0] = h[1] = 0 ; }
+   unsigned long long h[2] ;
+   // add one cell x across and y down from the origin
+   void addcell(int state, unsigned long long x, unsigned long long y) ;
+   // the hash of a square from those of its quadrants, 2^k on a side
+   static cellhash quads(const cellhash &nw, const cellhash &ne,
+                         const cellhash &sw, const cellhash &se, int k) ;
+   // the same cells moved x left and y up
+   cellhash moved(unsigned long long x, unsigned long long y) const ;
+   bool operator<(const cellhash &o) const {
+      return h[0] < o.h[0] || (h[0] == o.h[0] && h[1] < o.h[1]) ;
+   }
+} ;
+
+/**
+ *   Period search keeps, for every different state it has seen, the
+ *   latest generation it was seen at and where it was.  States are
+ *   told apart by population, bounding box size and cellhash, so none
+ *   of them has to be kept alive by the algorithm's garbage collector.
+ */
+class periodsearch_t {
+public:
+   periodsearch_t() : searching(0), states() {}
+   struct seen {
+      bigint gen, top, left ;
+   } ;
+   typedef std::tuple<double, double, double, cellhash> key ;
+   int searching ;
+   std::map<key, seen> states ;
+} ;
+
+/**
+ *   A cell for bulk loading with setcells, and the same cell as the hash
+ *   algorithms sort it:  a Morton key of its position in a square, with
+ *   the row bit above the column bit at each level, so that the cells
+ *   of each quadrant come out together in nw, ne, sw, se order.
+ */
+struct loadcell {
+   int x, y, state ;
+} ;
+struct mortoncell {
+   unsigned long long key ;
+   int state ;
+} ;
+
+/**
+ *   The macrocell writers number the nodes as they write them, and
+ *   keep the numbers here rather than in the nodes, so that writing a
+ *   pattern never changes it.  An open-addressed table from node to
+ *   number; numbers start at 1, and 0 means not written yet.
+ */
+class mcindex {
+public:
+   mcindex() : slots(), mask(0), count(0) {}
+   g_uintptr_t find(const void *p) const {
+      if (count == 0)
+         return 0 ;
+      for (g_uintptr_t i=hash(p) & mask; slots[i].p; i=(i+1) & mask)
+         if (slots[i].p == p)
+            return slots[i].n ;
+      return 0 ;
+   }
+   // give p the next number, and return it
+   g_uintptr_t add(const void *p) ;
+   // take the next number for something written that has no pointer
+   g_uintptr_t skip() { return ++count ; }
+private:
+   static g_uintptr_t hash(const void *p) {
+      g_uintptr_t r = (g_uintptr_t)p * (g_uintptr_t)0x9e3779b97f4a7c15ULL ;
+      return r ^ (r >> (4 * sizeof(g_uintptr_t))) ;
+   }
+   struct slot {
+      const void *p ;
+      g_uintptr_t n ;
+   } ;
+   vector<slot> slots ;
+   g_uintptr_t mask, count ;
+} ;
+
+/**
+ *   What an algorithm can tell us about its hash and its memory, for
+ *   tuning the memory limit and the step size.  Counts run from when
+ *   the universe was created; anything an algorithm does not keep is
+ *   left at zero.  Sizes go by how many cells a side a square is, so
+ *   nodesbysize[k] counts the nodes (and leaves) of side 2^k.
+ */
+struct lifestats {
+   lifestats() { clear() ; }
+   void clear() {
+      lookups = hits = probes = 0 ;
+      hashsize = hashpop = leaves = 0 ;
+      nodesbysize.clear() ;
+      bytesused = maxmem = 0 ;
+      gccount = gcpausetotal = gcpausemax = gcpauselast = 0 ;
+      invalidations = nodescalculated = 0 ;
+   }
+   double lookups ;           // hash lookups
+   double hits ;              // lookups that found what they wanted
+   double probes ;            // occupied slots the lookups looked at
+   double hashsize ;          // slots in the hash
+   double hashpop ;           // nodes and leaves in the hash
+   double leaves ;            // of which leaves
+   vector<double> nodesbysize ;
+   double bytesused ;         // what counts against the memory limit
+   double maxmem ;            // the memory limit
+   double gccount ;
+   double gcpausetotal ;      // gc pauses in milliseconds
+   double gcpausemax ;
+   double gcpauselast ;
+   double invalidations ;     // cache clears from a change of step size
+   double nodescalculated ;   // results worked out rather than looked up
+} ;
+
 class lifealgo {
 public:
-   lifealgo() : generation(0), increment(0), timeline(), grid_type(SQUARE_GRID)
+   lifealgo() : generation(0), increment(0), timeline(), periods(), grid_type(SQUARE_GRID)
       {  poller = &default_poller ;
          gridwd = gridht = 0 ;      // default is an unbounded universe
          unbounded = true ;         // most algorithms use an unbounded universe
@@ -56,6 +183,11 @@ public:
    virtual int getcell(int x, int y) = 0 ;
    virtual int nextcell(int x, int y, int &v) = 0 ;
    void getcells(unsigned char *buf, int x, int y, int w, int h) ;
+   // set a batch of live cells at once (cells of state 0 are skipped);
+   // the hash algorithms build the tree for a batch from the bottom up,
+   // much faster than a setcell for each cell.  Returns <0 if a state
+   // is out of range.
+   virtual int setcells(const vector<loadcell> &cells) ;
    // call after setcell/clearcell calls
    virtual void endofpattern() = 0 ;
    virtual void setIncrement(bigint inc) = 0 ;
@@ -79,11 +211,17 @@ public:
    virtual const char *writeNativeFormat(std::ostream &os, char *comments) = 0 ;
    void setpoll(lifepoll *pollerarg) { poller = pollerarg ; }
    virtual const char *readmacrocell(char *) { return "Cannot read macrocell format." ; }
+   // fill in what we know; returns 0 if the algorithm keeps no statistics
+   virtual int getstats(lifestats &) { return 0 ; }
    
    // Verbosity crosses algorithms.  We need to embed this sort of option
    // into some global shared thing or something rather than use static.
    static void setVerbose(int v) { verbose = v ; }
    static int getVerbose() { return verbose ; }
+   // The number of threads a step may use crosses algorithms too;
+   // algorithms that cannot use more than one simply ignore it.
+   static void setNumThreads(int n) ;
+   static int getNumThreads() { return numthreads ; }
 
    virtual const char* DefaultRule() { return "B3/S23"; }
    // return number of cell states in this universe (2..256)
@@ -109,6 +247,21 @@ public:
    void destroytimeline() ;
    void savetimelinewithframe(int yesno) { timeline.savetimeline = yesno ; }
 
+   // oscillator and spaceship detection: once started, call findperiod
+   // after each step; it returns 1 when the pattern repeats an earlier
+   // state, perhaps moved, giving the generations since then and how
+   // far it moved.  startperiodsearch returns 0 if the algorithm cannot
+   // do this.
+   int startperiodsearch() ;
+   int findperiod(bigint &period, bigint &dx, bigint &dy) ;
+   void stopperiodsearch() ;
+   int isperiodsearching() { return periods.searching ; }
+   // the cellhash of the state whose bounding box starts at top and
+   // left, moved so the box starts at the origin; equal patterns must
+   // give equal hashes, wherever they are.  Returns 0 if not supported.
+   virtual int hashstate(void *, const bigint &, const bigint &,
+                         cellhash &) { return 0 ; }
+
    // support for a bounded universe with various topologies:
    // plane, cylinder, torus, Klein bottle, cross-surface, sphere
    unsigned int gridwd, gridht ;    // bounded universe if either is > 0
@@ -148,12 +301,30 @@ public:
    TGridType getgridtype() const { return grid_type ; }
 
 protected:
+   // bounded grids the hash-based algorithms step themselves rather than
+   // through CreateBorderCells and DeleteBorderCells: a plain torus (so
+   // no twist or shift) and a plane, both bounded in each direction
+   enum { BORDERGRID, TORUSGRID, PLANEGRID } ;
+   int nativegrid() const ;
+   // put the live cells outside the grid in clipped_cells, before an
+   // algorithm with a native grid clears them
+   void clipcells() ;
+   // if cell x,y is outside a grid bounded in both directions, put it
+   // (in state s) in clipped_cells, so the GUI can remember it in case
+   // the rule change is undone, and return true
+   bool clipcell(int x, int y, int s) ;
+   int mortondepth(const vector<loadcell> &cells, int mindepth) ;
+   static unsigned long long mortonkey(unsigned int col, unsigned int row) ;
+   int mortonsort(const vector<loadcell> &cells, int mindepth,
+                  vector<mortoncell> &sorted) ;
    lifepoll *poller ;
    static int verbose ;
+   static int numthreads ;
    int maxCellStates ; // keep up to date; setcell depends on it
    bigint generation ;
    bigint increment ;
    timeline_t timeline ;
+   periodsearch_t periods ;
    TGridType grid_type ;
 
 private:
@@ -0,0 +1,196 @@
+// This file is part of Golly.
+// See docs/License.html for the copyright notice.
+
+#include "lifemem.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#define HUGEPAGE ((size_t)2 << 20)
+/*
+ *   Anything smaller than this just comes from calloc.
+ */
+#define SMALLBYTES (HUGEPAGE / 2)
+static int usehuge = 1, useinterleave = 0 ;
+void setbigmempolicy(int hugepages, int interleave) {
+   usehuge = hugepages ;
+   useinterleave = interleave ;
+}
+int bigmemhugepages() {
+   return usehuge ;
+}
+int bigmeminterleave() {
+   return useinterleave ;
+}
+#ifdef __linux__
+/*
+ *   We do the mbind system call ourselves rather than pull in libnuma.
+ *   The nodes to interleave across are the ones the kernel says are
+ *   online, in a list like "0-3,6".
+ */
+#define MAXNUMANODES (1024)
+#define MPOL_INTERLEAVE_ (3)
+static unsigned long numamask[MAXNUMANODES / (8 * sizeof(unsigned long))] ;
+static int numanodes = -1 ;
+static void findnumanodes() {
+   numanodes = 0 ;
+   FILE *f = fopen("/sys/devices/system/node/online", "r") ;
+   if (f == 0)
+      return ;
+   char buf[256] ;
+   if (fgets(buf, sizeof(buf), f)) {
+      for (char *s=buf; *s >= '0' && *s <= '9'; ) {
+         int lo = (int)strtol(s, &s, 10), hi = lo ;
+         if (*s == '-')
+            hi = (int)strtol(s + 1, &s, 10) ;
+         for (int i=lo; i<=hi && i<MAXNUMANODES; i++) {
+            numamask[i / (8 * sizeof(unsigned long))] |=
+                            1UL << (i % (8 * sizeof(unsigned long))) ;
+            numanodes++ ;
+         }
+         if (*s == ',')
+            s++ ;
+      }
+   }
+   fclose(f) ;
+}
+static void interleave(void *p, size_t bytes) {
+#ifdef SYS_mbind
+   if (numanodes < 0)
+      findnumanodes() ;
+   if (numanodes > 1)
+      syscall(SYS_mbind, p, bytes, MPOL_INTERLEAVE_, numamask,
+              (unsigned long)MAXNUMANODES, 0) ;
+#else
+   (void)p ;
+   (void)bytes ;
+#endif
+}
+/*
+ *   Map some whole number of huge pages, aligned to a huge page.  We try
+ *   the huge page pool first; that fails at once if there is no pool or
+ *   it is too small, and then we map ordinary memory, trim it to a huge
+ *   page boundary, and ask for transparent huge pages.
+ */
+static void *mapbig(size_t bytes) {
+   void *p = MAP_FAILED ;
+#ifdef MAP_HUGETLB
+   if (usehuge)
+      p = mmap(0, bytes, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0) ;
+#endif
+   if (p == MAP_FAILED) {
+      char *q = (char *)mmap(0, bytes + HUGEPAGE, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) ;
+      if (q == (char *)MAP_FAILED)
+         return 0 ;
+      char *a = (char *)(((size_t)q + HUGEPAGE - 1) & ~(HUGEPAGE - 1)) ;
+      if (a > q)
+         munmap(q, a - q) ;
+      if (q + HUGEPAGE > a)
+         munmap(a + bytes, q + HUGEPAGE - a) ;
+      p = a ;
+#ifdef MADV_HUGEPAGE
+      if (usehuge)
+         madvise(p, bytes, MADV_HUGEPAGE) ;
+#endif
+   }
+   if (useinterleave)
+      interleave(p, bytes) ;
+   return p ;
+}
+static void unmapbig(void *p, size_t bytes) {
+   munmap(p, bytes) ;
+}
+#else
+static void *mapbig(size_t) {
+   return 0 ;
+}
+static void unmapbig(void *, size_t) {
+}
+#endif
+/*
+ *   Each array has a header saying how big the mapping is, or zero if
+ *   it came from calloc.  It is a cache line long, so the array itself
+ *   is still aligned to one.
+ */
+#define HEADERBYTES (64)
+void *bigcalloc(size_t n, size_t size) {
+   if (size != 0 && n > ((size_t)-1 - HUGEPAGE - HEADERBYTES) / size)
+      return 0 ;
+   size_t bytes = n * size + HEADERBYTES ;
+   size_t mapped = 0 ;
+   char *h = 0 ;
+   if (bytes >= SMALLBYTES) {
+      mapped = (bytes + HUGEPAGE - 1) & ~(HUGEPAGE - 1) ;
+      h = (char *)mapbig(mapped) ;
+   }
+   if (h == 0) {
+      mapped = 0 ;
+      h = (char *)calloc(bytes, 1) ;
+      if (h == 0)
+         return 0 ;
+   }
+   *(size_t *)h = mapped ;
+   return h + HEADERBYTES ;
+}
+void bigfree(void *p) {
+   if (p == 0)
+      return ;
+   char *h = (char *)p - HEADERBYTES ;
+   size_t mapped = *(size_t *)h ;
+   if (mapped)
+      unmapbig(h, mapped) ;
+   else
+      free(h) ;
+}
+/*
+ *   Chunks are a couple of huge pages each.  Fresh memory is already
+ *   zero, and blocks are never reused within a chunk, so we never clear
+ *   anything.  A chunk we map is aligned to a huge page, and so to any
+ *   block alignment; one from calloc we have to align ourselves.
+ */
+#define CHUNKBYTES (2 * HUGEPAGE)
+blockpool::blockpool(size_t blocksize_, size_t align_) {
+   blocksize = (blocksize_ + align_ - 1) & ~(align_ - 1) ;
+   align = align_ ;
+   next = end = 0 ;
+}
+blockpool::~blockpool() {
+   release() ;
+}
+void *blockpool::alloc() {
+   if ((size_t)(end - next) < blocksize) {
+      chunk c ;
+      c.mapped = CHUNKBYTES ;
+      c.base = (char *)mapbig(CHUNKBYTES) ;
+      char *p = c.base ;
+      if (p == 0) {
+         c.mapped = 0 ;
+         c.base = (char *)calloc(CHUNKBYTES + align, 1) ;
+         if (c.base == 0)
+            return 0 ;
+         p = (char *)(((size_t)c.base + align - 1) & ~(align - 1)) ;
+      }
+      chunks.push_back(c) ;
+      next = p ;
+      end = p + CHUNKBYTES ;
+   }
+   void *r = next ;
+   next += blocksize ;
+   return r ;
+}
+void blockpool::release() {
+   for (size_t i=0; i<chunks.size(); i++) {
+      if (chunks[i].mapped)
+         unmapbig(chunks[i].base, chunks[i].mapped) ;
+      else
+         free(chunks[i].base) ;
+   }
+   chunks.clear() ;
+   next = end = 0 ;
+}
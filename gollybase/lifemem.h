@@ -0,0 +1,56 @@
+// This file is part of Golly.
+// See docs/License.html for the copyright notice.
+
+/**
+ *   Memory for the big things the hashing algorithms keep:  their hash
+ *   tables and their blocks of nodes.  With gigabytes of these, nearly
+ *   every hash probe and every node we follow lands on a different 4K
+ *   page, so ordinary pages mean a TLB miss almost every time.  On
+ *   Linux we back anything big with 2MB huge pages when we can, taking
+ *   them from the huge page pool if one has been set aside and asking
+ *   for transparent huge pages otherwise.  On machines with more than
+ *   one NUMA node the memory can also be interleaved across the nodes,
+ *   so that the threads of a parallel step are not all waiting on one
+ *   node's memory.  Whatever of this is not available we quietly do
+ *   without; on other systems all of it comes from calloc.
+ */
+#ifndef LIFEMEM_H
+#define LIFEMEM_H
+#include <stddef.h>
+#include <vector>
+/*
+ *   Like calloc and free, for one big array.  What bigcalloc returns
+ *   must go back through bigfree.
+ */
+void *bigcalloc(size_t n, size_t size) ;
+void bigfree(void *p) ;
+/*
+ *   Hands out zeroed blocks of one size, each aligned to align (which
+ *   must be a power of two no bigger than 2MB), carved from big chunks.
+ *   Blocks are never given back one at a time; they all go when the
+ *   pool is released or destroyed.
+ */
+class blockpool {
+public:
+   blockpool(size_t blocksize, size_t align) ;
+   ~blockpool() ;
+   void *alloc() ;
+   void release() ;
+private:
+   struct chunk {
+      char *base ;
+      size_t mapped ; // bytes mapped, or zero if from calloc
+   } ;
+   size_t blocksize, align ;
+   std::vector<chunk> chunks ;
+   char *next, *end ;
+} ;
+/*
+ *   Whether to use huge pages (on by default) and whether to spread
+ *   memory across NUMA nodes (off by default).  Only memory allocated
+ *   after the call is affected.
+ */
+void setbigmempolicy(int hugepages, int interleave) ;
+int bigmemhugepages() ;
+int bigmeminterleave() ;
+#endif
@@ -10,6 +10,7 @@
  */
 #ifndef LIFEPOLL_H
 #define LIFEPOLL_H
+#include <atomic>
 /**
  *   How frequently to invoke the heavyweight event checker, as a
  *   count of inner-loop polls.
@@ -54,7 +55,7 @@ public:
     *   millions of times a second.
     */
    inline int poll() {
-      return (countdown-- > 0) ? interrupted : inner_poll() ;
+      return (countdown-- > 0) ? isInterrupted() : inner_poll() ;
    }
    int inner_poll() ;
    /**
@@ -80,7 +81,9 @@ public:
     */
    virtual void updatePop() ;
 private:
-   int interrupted ;
+   // worker threads stepping in parallel look at this while the
+   // main thread polls, so it has to be atomic
+   std::atomic<int> interrupted ;
    int calculating ;
    int countdown ;
 } ;
@@ -0,0 +1,217 @@
+// This file is part of Golly.
+// See docs/License.html for the copyright notice.
+
+#include "lifeslice.h"
+#include <string.h>
+#if !defined(NOSIMDLEAVES) && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define SLICESIMD
+#include <immintrin.h>
+#endif
+#ifdef __GNUC__
+#define SLICEINLINE inline __attribute__((always_inline))
+#else
+#define SLICEINLINE inline
+#endif
+/*
+ *   One generation for one word's worth of rows.  b is the word, and
+ *   a and c are the rows above and below each of its rows, lined up
+ *   with them.  Each cell adds up the 3x3 square around it, in four
+ *   bit planes, first down the columns and then along the rows.  We
+ *   never mask the shifts; bits that wander across the edge of a row
+ *   only spoil cells that are already too near the edge to be right.
+ *
+ *   sel holds, for each of dead and alive and for each count of the
+ *   3x3 square divided by four, a mask for each possible remainder
+ *   saying whether the cell is alive next time.
+ *
+ *   This is written once for any type that has the bit operators, so
+ *   the SIMD kernels below do exactly the same arithmetic as the plain
+ *   one; the result comes back through r so no vector crosses a call.
+ */
+template <class T>
+static SLICEINLINE void slicestep(const T &a, const T &b, const T &c,
+                                  T &r, const sliceword *sel) {
+   T v0 = a ^ b ^ c, v1 = (a & b) | (c & (a ^ b)) ;
+   T l0 = v0 >> 1, r0 = v0 << 1, l1 = v1 >> 1, r1 = v1 << 1 ;
+   T s0 = l0 ^ v0 ^ r0, c0 = (l0 & v0) | (r0 & (l0 ^ v0)) ;
+   T t = l1 ^ v1 ^ r1, c1 = (l1 & v1) | (r1 & (l1 ^ v1)) ;
+   T s1 = t ^ c0, c2 = t & c0 ;
+   T s2 = c1 ^ c2, s3 = c1 & c2 ;
+   if (sel == 0) {
+      // three in the square is a birth or a survival; four keeps a
+      // live cell alive
+      r = ~s3 & ((s0 & s1 & ~s2) | (b & ~s0 & ~s1 & s2)) ;
+      return ;
+   }
+   T lo[4] = { ~s0 & ~s1, s0 & ~s1, ~s0 & s1, s0 & s1 } ;
+   T hi[3] = { ~s2 & ~s3, s2 & ~s3, s3 } ;
+   r = b & ~b ;
+   for (int h=0; h<3; h++) {
+      const sliceword *d = sel + 4 * h, *l = sel + 12 + 4 * h ;
+      T dead = (lo[0] & d[0]) | (lo[1] & d[1]) |
+               (lo[2] & d[2]) | (lo[3] & d[3]) ;
+      T live = (lo[0] & l[0]) | (lo[1] & l[1]) |
+               (lo[2] & l[2]) | (lo[3] & l[3]) ;
+      r |= hi[h] & ((b & live) | (~b & dead)) ;
+   }
+}
+/*
+ *   The plain kernel, one word at a time.
+ */
+static void swargens(sliceword *w, int gens, const sliceword *sel) {
+   sliceword nw[4] ;
+   while (gens-- > 0) {
+      for (int k=0; k<4; k++) {
+         sliceword a = w[k] >> 16, c = w[k] << 16 ;
+         if (k > 0)
+            a |= w[k-1] << 48 ;
+         if (k < 3)
+            c |= w[k+1] >> 48 ;
+         slicestep(a, w[k], c, nw[k], sel) ;
+      }
+      memcpy(w, nw, sizeof(nw)) ;
+   }
+}
+#ifdef SLICESIMD
+/*
+ *   The SSE2 kernel keeps the first two words in one register and the
+ *   last two in another, and the AVX2 kernel keeps all four in one.
+ *   Either way the rows from the neighboring words come from shifting
+ *   or permuting whole words across the register, with zeros off the
+ *   top and bottom, just as in the plain kernel.
+ */
+typedef unsigned long long v2du __attribute__((vector_size(16))) ;
+typedef unsigned long long v4du __attribute__((vector_size(32))) ;
+__attribute__((target("sse2")))
+static void sse2gens(sliceword *w, int gens, const sliceword *sel) {
+   __m128i lo = _mm_loadu_si128((const __m128i *)w) ;
+   __m128i hi = _mm_loadu_si128((const __m128i *)(w + 2)) ;
+   while (gens-- > 0) {
+      v2du x = (v2du)lo, y = (v2du)hi, nx, ny ;
+      v2du px = (v2du)_mm_slli_si128(lo, 8) ;
+      v2du py = (v2du)_mm_or_si128(_mm_slli_si128(hi, 8),
+                                   _mm_srli_si128(lo, 8)) ;
+      v2du sx = (v2du)_mm_or_si128(_mm_srli_si128(lo, 8),
+                                   _mm_slli_si128(hi, 8)) ;
+      v2du sy = (v2du)_mm_srli_si128(hi, 8) ;
+      v2du ax = (x >> 16) | (px << 48), cx = (x << 16) | (sx >> 48) ;
+      v2du ay = (y >> 16) | (py << 48), cy = (y << 16) | (sy >> 48) ;
+      slicestep(ax, x, cx, nx, sel) ;
+      slicestep(ay, y, cy, ny, sel) ;
+      lo = (__m128i)nx ;
+      hi = (__m128i)ny ;
+   }
+   _mm_storeu_si128((__m128i *)w, lo) ;
+   _mm_storeu_si128((__m128i *)(w + 2), hi) ;
+}
+__attribute__((target("avx2")))
+static void avx2gens(sliceword *w, int gens, const sliceword *sel) {
+   __m256i v = _mm256_loadu_si256((const __m256i *)w) ;
+   const __m256i zero = _mm256_setzero_si256() ;
+   while (gens-- > 0) {
+      // word k-1 and word k+1 in lane k
+      v4du p = (v4du)_mm256_blend_epi32(_mm256_permute4x64_epi64(v, 0x90),
+                                        zero, 0x03) ;
+      v4du s = (v4du)_mm256_blend_epi32(_mm256_permute4x64_epi64(v, 0xf9),
+                                        zero, 0xc0) ;
+      v4du x = (v4du)v, nx ;
+      v4du a = (x >> 16) | (p << 48), c = (x << 16) | (s >> 48) ;
+      slicestep(a, x, c, nx, sel) ;
+      v = (__m256i)nx ;
+   }
+   _mm256_storeu_si256((__m256i *)w, v) ;
+}
+#endif
+/*
+ *   The kernels we can run here, worst first.
+ */
+struct slicekernelinfo {
+   const char *name ;
+   slicekernel fn ;
+} ;
+static slicekernelinfo kernels[3] ;
+static int nkernels ;
+static slicekernel findkernels() {
+   nkernels = 0 ;
+   kernels[nkernels].name = "swar" ;
+   kernels[nkernels++].fn = swargens ;
+#ifdef SLICESIMD
+   __builtin_cpu_init() ;
+   if (__builtin_cpu_supports("sse2")) {
+      kernels[nkernels].name = "sse2" ;
+      kernels[nkernels++].fn = sse2gens ;
+   }
+   if (__builtin_cpu_supports("avx2")) {
+      kernels[nkernels].name = "avx2" ;
+      kernels[nkernels++].fn = avx2gens ;
+   }
+#endif
+   return kernels[nkernels-1].fn ;
+}
+slicekernel slicegens = findkernels() ;
+int numslicekernels() {
+   return nkernels ;
+}
+const char *slicekernelname(int i) {
+   return i >= 0 && i < nkernels ? kernels[i].name : 0 ;
+}
+slicekernel getslicekernel(int i) {
+   return i >= 0 && i < nkernels ? kernels[i].fn : 0 ;
+}
+int setslicekernel(const char *name) {
+   for (int i=0; i<nkernels; i++)
+      if (strcmp(name, kernels[i].name) == 0) {
+         slicegens = kernels[i].fn ;
+         return 1 ;
+      }
+   return 0 ;
+}
+const char *currentslicekernel() {
+   for (int i=0; i<nkernels; i++)
+      if (slicegens == kernels[i].fn)
+         return kernels[i].name ;
+   return 0 ;
+}
+/*
+ *   We look at each of the four cells each entry of the table works
+ *   out, and check that its future depends only on whether it is
+ *   alive and how many of its neighbors are.
+ */
+static int bitcount(int x) {
+   int r = 0 ;
+   for (; x; x &= x - 1)
+      r++ ;
+   return r ;
+}
+int findslicerule(const char *ruletable, sliceword *sel) {
+   static const int cellbit[4] = { 0x400, 0x200, 0x40, 0x20 } ;
+   static const int nbrmask[4] = { 0xeae0, 0x7570, 0x0eae, 0x0757 } ;
+   static const int outbit[4] = { 0x20, 0x10, 0x2, 0x1 } ;
+   int fate[2][9] ;
+   for (int i=0; i<9; i++)
+      fate[0][i] = fate[1][i] = -1 ;
+   for (int x=0; x<65536; x++) {
+      for (int c=0; c<4; c++) {
+         int alive = (x & cellbit[c]) != 0 ;
+         int cnt = bitcount(x & nbrmask[c]) ;
+         int f = (ruletable[x] & outbit[c]) != 0 ;
+         if (fate[alive][cnt] < 0)
+            fate[alive][cnt] = f ;
+         else if (fate[alive][cnt] != f)
+            return 0 ;
+      }
+   }
+   // index by the count of the whole 3x3 square, which for a live
+   // cell includes itself
+   int life = 1 ;
+   for (int sq=0; sq<12; sq++) {
+      int dead = sq < 9 ? fate[0][sq] : 0 ;
+      int live = sq >= 1 && sq <= 9 ? fate[1][sq-1] : 0 ;
+      sel[sq] = dead ? ~(sliceword)0 : 0 ;
+      sel[12+sq] = live ? ~(sliceword)0 : 0 ;
+      if (dead != (sq == 3) || live != (sq == 3 || sq == 4))
+         life = 0 ;
+   }
+   return life ? 1 : 2 ;
+}
@@ -0,0 +1,67 @@
+// This file is part of Golly.
+// See docs/License.html for the copyright notice.
+
+/**
+ *   Bit-sliced evaluation of Bx/Sy rules on the Moore neighborhood,
+ *   a 16x16 square at a time; this is how hlifealgo works out its
+ *   leaf-level results for such rules.
+ *
+ *   The square is kept as sixteen rows of sixteen bits, four rows to
+ *   a 64-bit word:  the top row is in the high bits of the first word,
+ *   and the leftmost column is in the high bit of each row.  A kernel
+ *   runs the square forward up to four generations in place.  After
+ *   gens generations only the cells at least gens cells in from the
+ *   edge are right; the rest is garbage.
+ *
+ *   There is a plain 64-bit kernel that runs anywhere, and on x86
+ *   processors that have them, SSE2 and AVX2 kernels that work on two
+ *   or four words at once.  The best kernel this processor can run is
+ *   chosen at startup; they all give exactly the same results.  Define
+ *   NOSIMDLEAVES to leave the SIMD kernels out.
+ */
+#ifndef LIFESLICE_H
+#define LIFESLICE_H
+typedef unsigned long long sliceword ;
+/*
+ *   The rule comes in as the 24 masks that findslicerule() fills in;
+ *   a null pointer means Life itself, which has its own short path.
+ */
+typedef void (*slicekernel)(sliceword *w, int gens, const sliceword *sel) ;
+/*
+ *   See if a 65536-entry rule table (laid out as hlifealgo uses it) is
+ *   a Bx/Sy rule on the Moore neighborhood.  Returns 0 if it is not,
+ *   1 if it is Life, and 2 if it is some other such rule, in which
+ *   case sel is filled in.
+ */
+int findslicerule(const char *ruletable, sliceword *sel) ;
+/*
+ *   The kernel in use.
+ */
+extern slicekernel slicegens ;
+/*
+ *   The kernels this processor can run, numbered from zero:  some of
+ *   "swar", "sse2" and "avx2".  setslicekernel() picks one by name,
+ *   and returns 0 if there is no such kernel here.
+ */
+int numslicekernels() ;
+const char *slicekernelname(int i) ;
+slicekernel getslicekernel(int i) ;
+int setslicekernel(const char *name) ;
+const char *currentslicekernel() ;
+/*
+ *   Move a 4x4 block of cells, packed in a short the way leaves keep
+ *   them, into the sliced layout and back.  Each word holds one row
+ *   of four blocks; spread4() puts the block at the right-hand end,
+ *   so shift it left by 4 for each block to its right.
+ */
+inline sliceword spread4(unsigned short s) {
+   sliceword x = s ;
+   return ((x & 0xf000) << 36) | ((x & 0xf00) << 24) |
+          ((x & 0xf0) << 12) | (x & 0xf) ;
+}
+inline unsigned short gather4(sliceword x) {
+   x &= 0x000f000f000f000fULL ;
+   return (unsigned short)(((x >> 36) & 0xf000) | ((x >> 24) & 0xf00) |
+                           ((x >> 12) & 0xf0) | (x & 0xf)) ;
+}
+#endif
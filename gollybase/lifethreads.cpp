@@ -0,0 +1,196 @@
+// This file is part of Golly.
+// See docs/License.html for the copyright notice.
+
+#include "lifethreads.h"
+#include <chrono>
+thread_local int lifethreads::selfindex = 0 ;
+/*
+ *   How many times an idle worker looks around for work before it
+ *   goes to sleep, and how long it sleeps before looking again.  The
+ *   sleep is short because a spawn only wakes sleepers if it notices
+ *   them.
+ */
+static const int SPINLIMIT = 256 ;
+static const std::chrono::milliseconds SLEEPTIME(2) ;
+lifethreads::lifethreads() : nthreads(1), running(0), epoch(0), active(0),
+                             stopping(0), exclusivereq(0), shutdown(0),
+                             sleepers(0), idle(0), idleobj(0) {
+   queues.push_back(new taskqueue) ;
+}
+lifethreads::~lifethreads() {
+   stopthreads() ;
+   for (size_t i=0; i<queues.size(); i++)
+      delete queues[i] ;
+}
+int lifethreads::hardwarethreads() {
+   int n = (int)std::thread::hardware_concurrency() ;
+   return n > 0 ? n : 1 ;
+}
+void lifethreads::stopthreads() {
+   shutdown = 1 ;
+   {
+      std::lock_guard<std::mutex> lk(mtx) ;
+      wakecv.notify_all() ;
+   }
+   for (size_t i=0; i<threads.size(); i++)
+      threads[i].join() ;
+   threads.clear() ;
+   shutdown = 0 ;
+   running = 0 ;
+}
+void lifethreads::setthreads(int n) {
+   if (n < 1)
+      n = 1 ;
+   if (n == nthreads)
+      return ;
+   stopthreads() ;
+   while ((int)queues.size() < n)
+      queues.push_back(new taskqueue) ;
+   nthreads = n ;
+   running = n - 1 ;
+   for (int i=1; i<n; i++)
+      threads.push_back(std::thread(&lifethreads::workerloop, this, i)) ;
+}
+void lifethreads::begin(idlefn idlearg, void *obj) {
+   idle = idlearg ;
+   idleobj = obj ;
+   active = 1 ;
+   std::lock_guard<std::mutex> lk(mtx) ;
+   wakecv.notify_all() ;
+}
+void lifethreads::end() {
+   active = 0 ;
+}
+void lifethreads::spawn(lifejoin &j, taskfn f, void *obj, void *arg) {
+   task t ;
+   t.fn = f ;
+   t.obj = obj ;
+   t.arg = arg ;
+   t.join = &j ;
+   j.pending++ ;
+   taskqueue *q = queues[selfindex] ;
+   q->lock.lock() ;
+   q->tasks.push_back(t) ;
+   q->lock.unlock() ;
+   if (sleepers > 0)
+      wakecv.notify_one() ;
+}
+/*
+ *   Our own newest task first; otherwise steal someone else's oldest.
+ */
+int lifethreads::grab(task &t) {
+   taskqueue *q = queues[selfindex] ;
+   q->lock.lock() ;
+   if (!q->tasks.empty()) {
+      t = q->tasks.back() ;
+      q->tasks.pop_back() ;
+      q->lock.unlock() ;
+      return 1 ;
+   }
+   q->lock.unlock() ;
+   for (int i=1; i<nthreads; i++) {
+      q = queues[(selfindex + i) % nthreads] ;
+      q->lock.lock() ;
+      if (!q->tasks.empty()) {
+         t = q->tasks.front() ;
+         q->tasks.pop_front() ;
+         q->lock.unlock() ;
+         return 1 ;
+      }
+      q->lock.unlock() ;
+   }
+   return 0 ;
+}
+void lifethreads::run(task &t) {
+   t.fn(t.obj, t.arg) ;
+   t.join->pending-- ;
+}
+void lifethreads::join(lifejoin &j) {
+   while (j.pending > 0) {
+      task t ;
+      if (grab(t)) {
+         run(t) ;
+      } else {
+         if (selfindex == 0) {
+            if (idle)
+               idle(idleobj) ;
+         } else {
+            safepoint() ;
+         }
+         std::this_thread::yield() ;
+      }
+   }
+}
+/*
+ *   Parking and sleeping both take the worker out of the running
+ *   count, which is what stopworld() waits on.
+ */
+void lifethreads::park() {
+   std::unique_lock<std::mutex> lk(mtx) ;
+   running-- ;
+   parkedcv.notify_all() ;
+   while (stopping)
+      wakecv.wait(lk) ;
+   running++ ;
+}
+void lifethreads::sleep() {
+   std::unique_lock<std::mutex> lk(mtx) ;
+   running-- ;
+   parkedcv.notify_all() ;
+   sleepers++ ;
+   if (!shutdown)
+      wakecv.wait_for(lk, SLEEPTIME) ;
+   sleepers-- ;
+   while (stopping && !shutdown)
+      wakecv.wait(lk) ;
+   running++ ;
+}
+/*
+ *   Worker 0 may have stopped the world again by the time we get the
+ *   lock back, and it will not wait for us if we are not counted as
+ *   running, so we stay parked until that is over too.
+ */
+void lifethreads::requestexclusive() {
+   std::unique_lock<std::mutex> lk(mtx) ;
+   unsigned long e = epoch ;
+   exclusivereq = 1 ;
+   running-- ;
+   parkedcv.notify_all() ;
+   while (epoch == e || stopping)
+      wakecv.wait(lk) ;
+   running++ ;
+}
+void lifethreads::stopworld() {
+   std::unique_lock<std::mutex> lk(mtx) ;
+   stopping = 1 ;
+   while (running > 0)
+      parkedcv.wait(lk) ;
+}
+void lifethreads::startworld() {
+   std::lock_guard<std::mutex> lk(mtx) ;
+   stopping = 0 ;
+   exclusivereq = 0 ;
+   epoch++ ;
+   wakecv.notify_all() ;
+}
+void lifethreads::workerloop(int index) {
+   selfindex = index ;
+   int spins = 0 ;
+   while (!shutdown) {
+      task t ;
+      if (active && grab(t)) {
+         run(t) ;
+         spins = 0 ;
+      } else if (stopping) {
+         park() ;
+      } else if (active && ++spins < SPINLIMIT) {
+         std::this_thread::yield() ;
+      } else {
+         sleep() ;
+         spins = 0 ;
+      }
+   }
+   std::lock_guard<std::mutex> lk(mtx) ;
+   running-- ;
+   parkedcv.notify_all() ;
+}
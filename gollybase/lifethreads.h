@@ -0,0 +1,94 @@
+// This file is part of Golly.
+// See docs/License.html for the copyright notice.
+
+/**
+ *   A small fork-join thread pool for the algorithms that can split a
+ *   generation step into independent pieces of work.
+ *
+ *   The thread that calls begin() is worker 0; it spawns tasks and
+ *   joins on them like any other worker, and it alone is allowed to
+ *   talk to the poller.  The remaining workers live in the pool and
+ *   steal tasks from each other's queues.  Tasks are coarse, so each
+ *   queue is simply a deque protected by its own mutex; the owner
+ *   pushes and pops at the back, and thieves take the oldest (and
+ *   usually largest) task from the front.  A worker that waits on a
+ *   join keeps running tasks, so a join never blocks the pool.
+ *
+ *   Algorithms that need to reorganize shared data in the middle of
+ *   a step (a garbage collection or a hash resize, say) can stop the
+ *   world:  worker 0 calls stopworld(), which returns once every
+ *   other worker is parked at a safe point, and startworld() lets
+ *   them go again.  Other workers call requestexclusive() to ask
+ *   worker 0 to do this on their behalf; they stay parked until it
+ *   has been done.
+ */
+#ifndef LIFETHREADS_H
+#define LIFETHREADS_H
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+/**
+ *   Spawning a task increments the join count; finishing it
+ *   decrements it.
+ */
+struct lifejoin {
+   lifejoin() : pending(0) {}
+   std::atomic<int> pending ;
+} ;
+class lifethreads {
+public:
+   typedef void (*taskfn)(void *obj, void *arg) ;
+   typedef void (*idlefn)(void *obj) ;
+   lifethreads() ;
+   ~lifethreads() ;
+   // start or stop pool threads so there are n workers in total
+   void setthreads(int n) ;
+   int getthreads() const { return nthreads ; }
+   // bracket a parallel section; idle is called by worker 0 whenever
+   // it is waiting on a join and has nothing to run
+   void begin(idlefn idle, void *obj) ;
+   void end() ;
+   void spawn(lifejoin &j, taskfn f, void *obj, void *arg) ;
+   void join(lifejoin &j) ;
+   // called by workers other than 0 every so often
+   void safepoint() { if (stopping) park() ; }
+   void requestexclusive() ;
+   int exclusivewanted() const { return exclusivereq ; }
+   // only for worker 0
+   void stopworld() ;
+   void startworld() ;
+   // which worker is this?  0 for any thread not in a pool
+   static int self() { return selfindex ; }
+   static int hardwarethreads() ;
+private:
+   struct task {
+      taskfn fn ;
+      void *obj, *arg ;
+      lifejoin *join ;
+   } ;
+   struct taskqueue {
+      std::mutex lock ;
+      std::deque<task> tasks ;
+   } ;
+   int grab(task &t) ;
+   void run(task &t) ;
+   void park() ;
+   void sleep() ;
+   void workerloop(int index) ;
+   void stopthreads() ;
+   int nthreads ;
+   std::vector<std::thread> threads ;
+   std::vector<taskqueue *> queues ;
+   std::mutex mtx ;
+   std::condition_variable wakecv, parkedcv ;
+   int running ;                  // pool workers not parked or asleep
+   unsigned long epoch ;          // bumped by every startworld()
+   std::atomic<int> active, stopping, exclusivereq, shutdown, sleepers ;
+   idlefn idle ;
+   void *idleobj ;
+   static thread_local int selfindex ;
+} ;
+#endif
@@ -2147,16 +2147,9 @@ void ltlalgo::restore_cells()
         int x = cell_list[i];
         int y = cell_list[i+1];
         int s = cell_list[i+2];
-        // check if x,y is outside grid
-        if (x < gleft || x > gright || y < gtop || y > gbottom) {
-            // store clipped cells so that GUI code (eg. ClearOutsideGrid)
-            // can remember them in case this rule change is undone
-            clipped_cells.push_back(x);
-            clipped_cells.push_back(y);
-            clipped_cells.push_back(s);
-        } else {
-            setcell(x, y, s);
-        }
+        // cells outside the grid go in clipped_cells for the GUI code
+        // (eg. ClearOutsideGrid)
+        if (!clipcell(x, y, s)) setcell(x, y, s);
     }
     cell_list.clear();
 }
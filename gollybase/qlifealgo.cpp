@@ -7,6 +7,7 @@
  */
 #include "qlifealgo.h"
 #include "liferules.h"
+#include "lifethreads.h"
 #include "util.h"
 #include <stdlib.h>
 #include <string.h>
@@ -74,10 +75,14 @@ static int bricks, tiles, supertiles, rcc, dq, ds, rccs, dqs, dss ;
  */
 brick *qlifealgo::newbrick() {
    brick *r ;
+   if (parallel)
+      memlock.lock() ;
    if (bricklist == 0)
       bricklist = filllist(sizeof(brick)) ;
    r = (brick *)(bricklist) ;
    bricklist = bricklist->next ;
+   if (parallel)
+      memlock.unlock() ;
    memset(r, 0, sizeof(brick)) ;
    STAT(bricks++) ;
    return r ;
@@ -88,10 +93,14 @@ brick *qlifealgo::newbrick() {
  */
 tile *qlifealgo::newtile() {
    tile *r ;
+   if (parallel)
+      memlock.lock() ;
    if (tilelist == 0)
       tilelist = filllist(sizeof(tile)) ;
    r = (tile *)(tilelist) ;
    tilelist = tilelist->next ;
+   if (parallel)
+      memlock.unlock() ;
    r->b[0] = r->b[1] = r->b[2] = r->b[3] = emptybrick ;
    r->flags = -1 ;
    STAT(tiles++) ;
@@ -103,10 +112,14 @@ tile *qlifealgo::newtile() {
  */
 supertile *qlifealgo::newsupertile(int lev) {
    supertile *r ;
+   if (parallel)
+      memlock.lock() ;
    if (supertilelist == 0)
       supertilelist = filllist(sizeof(supertile)) ;
    r = (supertile *)supertilelist ;
    supertilelist = supertilelist->next ;
+   if (parallel)
+      memlock.unlock() ;
    r->d[0] = r->d[1] = r->d[2] = r->d[3] = r->d[4] = r->d[5] =
                                  r->d[6] = r->d[7] = nullroots[lev-1] ;
    STAT(supertiles++) ;
@@ -198,6 +211,10 @@ qlifealgo::qlifealgo() {
       lifefatal("bad platform for this program") ;
    memused = 0 ;
    maxmemory = 0 ;
+   threads = 0 ;
+   taskjoin = 0 ;
+   parallel = 0 ;
+   planodd = 0 ;
    clearall() ;
 }
 /*
@@ -247,6 +264,7 @@ qlifealgo::~qlifealgo() {
       free(memused) ;
       memused = nu ;
    }
+   delete threads ;
 }
 /*
  *   Set the max memory
@@ -303,7 +321,8 @@ int qlifealgo::doquad01(supertile *zis, supertile *edge,
  *   Note that the parallel and corner have already been recomputed so
  *   their changing bits are shifted up 10 positions in c.
  */
-   poller->poll() ;
+   if (!parallel || lifethreads::self() == 0)
+      poller->poll() ;
    int changing = (zis->flags | (par->flags >> 19) |
                    (((edge->flags >> 18) | (cor->flags >> 27)) & 1)) & 0xff ;
    int x, b, nchanging = (zis->flags & 0x3ff00) << 10 ;
@@ -368,7 +387,8 @@ int qlifealgo::doquad01(supertile *zis, supertile *edge,
  */
 int qlifealgo::doquad10(supertile *zis, supertile *edge,
                         supertile *par, supertile *cor, int lev) {
-   poller->poll() ;
+   if (!parallel || lifethreads::self() == 0)
+      poller->poll() ;
    int changing = (zis->flags | (par->flags >> 19) |
                    (((edge->flags >> 18) | (cor->flags >> 27)) & 1)) & 0xff ;
    int x, b, nchanging = (zis->flags & 0x3ff00) << 10 ;
@@ -671,6 +691,149 @@ void qlifealgo::markglobalchange() {
    markglobalchange(root, rootlev) ;
    deltaforward = 0xffffffff ;
 }
+/*
+ *   Multithreaded stepping; see qlifetask in qlifealgo.h.  Tasks are
+ *   2^tasklevel supertiles (256x256 cells), which is big enough to
+ *   dwarf the cost of scheduling them, and small enough that a dense
+ *   pattern gives plenty of tasks that can run at once.
+ */
+int qlifealgo::tasklevel = 2 ;
+/*
+ *   Walk a supertile above tasklevel the way doquad01 (or doquad10 for
+ *   odd generations) would, recording its changing flags to fill in
+ *   later and making tasks of the subtiles at tasklevel.  Our neighbors
+ *   only ever look at the bits saved from the previous generation, so
+ *   we store those now, just as the step would.
+ */
+void qlifealgo::plan(supertile *zis, supertile *edge, supertile *par,
+                     supertile *cor, int lev, int parent, int shift) {
+   poller->poll() ;
+   int changing = (zis->flags | (par->flags >> 19) |
+                   (((edge->flags >> 18) | (cor->flags >> 27)) & 1)) & 0xff ;
+   int x, b, dir = planodd ? 1 : -1, r = (int)recs.size() ;
+   supertile *p, *pf, *pu, *pfu ;
+   qliferec rec ;
+   rec.zis = zis ;
+   rec.parent = parent ;
+   rec.shift = shift ;
+   rec.nchanging = (zis->flags & 0x3ff00) << 10 ;
+   recs.push_back(rec) ;
+   if (changing & 1) {
+      x = planodd ? 0 : 7 ;
+      b = 1 ;
+      pf = edge->d[7 - x] ;
+      pfu = cor->d[7 - x] ;
+   } else {
+      b = (changing & - changing) ;
+      x = planodd ? ai[b] : 7 - ai[b] ;
+      pf = zis->d[x - dir] ;
+      pfu = par->d[x - dir] ;
+   }
+   for (;;) {
+      p = zis->d[x] ;
+      pu = par->d[x] ;
+      if (changing & b) {
+         if (zis->d[x] == nullroots[lev-1])
+            p = zis->d[x] = newsupertile(lev-1) ;
+         if (lev - 1 > tasklevel)
+            plan(p, pu, pf, pfu, lev-1, r, planodd ? 7 - x : x) ;
+         else
+            addtask(p, pu, pf, pfu, r, planodd ? 7 - x : x) ;
+         changing -= b ;
+      } else if (changing == 0)
+         break ;
+      b <<= 1 ;
+      x += dir ;
+      pfu = pu ;
+      pf = p ;
+   }
+   zis->flags = recs[r].nchanging | 0xf0000000 ;
+}
+/*
+ *   A new task waits for the tasks of whichever neighbors have one;
+ *   those were all planned before it.
+ */
+void qlifealgo::addtask(supertile *zis, supertile *edge, supertile *par,
+                        supertile *cor, int parent, int shift) {
+   int i = (int)tasks.size(), pending = 0 ;
+   tasks.emplace_back() ;
+   qlifetask &t = tasks.back() ;
+   t.zis = zis ;
+   t.edge = edge ;
+   t.par = par ;
+   t.cor = cor ;
+   t.parent = parent ;
+   t.shift = shift ;
+   t.result = 0 ;
+   t.ndependents = 0 ;
+   supertile *nb[3] = { edge, par, cor } ;
+   for (int k=0; k<3; k++) {
+      std::unordered_map<supertile *, int>::iterator it = taskof.find(nb[k]) ;
+      if (it != taskof.end()) {
+         qlifetask &n = tasks[it->second] ;
+         n.dependents[n.ndependents++] = i ;
+         pending++ ;
+      }
+   }
+   t.pending = pending ;
+   taskof[zis] = i ;
+}
+void qlifealgo::runtask(void *obj, void *arg) {
+   ((qlifealgo *)obj)->runtask((qlifetask *)arg) ;
+}
+void qlifealgo::runtask(qlifetask *t) {
+   if (planodd)
+      t->result = doquad10(t->zis, t->edge, t->par, t->cor, tasklevel) ;
+   else
+      t->result = doquad01(t->zis, t->edge, t->par, t->cor, tasklevel) ;
+   if (taskjoin == 0)
+      return ;
+   for (int i=0; i<t->ndependents; i++) {
+      qlifetask *d = &tasks[t->dependents[i]] ;
+      if (--d->pending == 0)
+         threads->spawn(*taskjoin, &qlifealgo::runtask, this, d) ;
+   }
+}
+void qlifealgo::dogenparallel() {
+   planodd = generation.odd() ;
+   tasks.clear() ;
+   recs.clear() ;
+   taskof.clear() ;
+   plan(root, nullroot, nullroot, nullroot, rootlev, -1, 0) ;
+   if ((int)tasks.size() < 4 * getNumThreads()) {
+      // not worth waking the threads; the tasks are planned in an order
+      // that is fine for doing them one after another
+      for (size_t i=0; i<tasks.size(); i++)
+         runtask(&tasks[i]) ;
+   } else {
+      if (threads == 0)
+         threads = new lifethreads() ;
+      threads->setthreads(getNumThreads()) ;
+      // find the tasks that can start now before any of them can finish
+      std::vector<qlifetask *> ready ;
+      for (size_t i=0; i<tasks.size(); i++)
+         if (tasks[i].pending == 0)
+            ready.push_back(&tasks[i]) ;
+      lifejoin join ;
+      taskjoin = &join ;
+      parallel = 1 ;
+      threads->begin(0, 0) ;
+      for (size_t i=0; i<ready.size(); i++)
+         threads->spawn(join, &qlifealgo::runtask, this, ready[i]) ;
+      threads->join(join) ;
+      threads->end() ;
+      parallel = 0 ;
+      taskjoin = 0 ;
+   }
+   for (size_t i=0; i<tasks.size(); i++)
+      recs[tasks[i].parent].nchanging |= tasks[i].result << tasks[i].shift ;
+   for (int i=(int)recs.size()-1; i>=0; i--) {
+      qliferec &r = recs[i] ;
+      r.zis->flags = r.nchanging | 0xf0000000 ;
+      if (r.parent >= 0)
+         recs[r.parent].nchanging |= upchanging(r.nchanging) << r.shift ;
+   }
+}
 /*
  *   This subroutine sets a bit at a particular location.
  *
@@ -1091,7 +1254,9 @@ void qlifealgo::dogen() {
       while (uproot_needed())
          uproot() ;
    }
-   if (generation.odd())
+   if (getNumThreads() > 1 && rootlev > tasklevel)
+      dogenparallel() ;
+   else if (generation.odd())
       doquad10(root, nullroot, nullroot, nullroot, rootlev) ;
    else
       doquad01(root, nullroot, nullroot, nullroot, rootlev) ;
@@ -8,7 +8,13 @@
 #define QLIFEALGO_H
 #include "lifealgo.h"
 #include "liferules.h"
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
+class lifethreads ;
+struct lifejoin ;
 /*
  *   The smallest unit of the universe is the `slice', which is a
  *   4 (horizontal) by 8 (vertical) chunk of the world.  Each slice
@@ -147,6 +153,30 @@ struct supertile { /* 44 bytes */
    int flags ;
    int pop[2] ;
 } ;
+/*
+ *   To step with more than one thread, dogen first plans the generation:
+ *   it walks the top of the tree just as doquad01 and doquad10 would,
+ *   and turns each supertile at tasklevel that needs recomputing into a
+ *   task.  A task reads its edge, parallel and corner neighbors only
+ *   once they have been recomputed, as on a single thread, so it waits
+ *   for their tasks; other tasks touch disjoint parts of the tree and
+ *   can run at the same time.  This gives exactly the same cells and
+ *   changing flags as a single thread.  The changing flags of the
+ *   supertiles above the tasks (the qliferecs) are filled in afterwards,
+ *   from the bottom up.
+ */
+struct qlifetask {
+   supertile *zis, *edge, *par, *cor ;
+   int parent, shift ;           // the qliferec our changing bits go to
+   int result ;
+   int dependents[3], ndependents ;
+   std::atomic<int> pending ;    // neighbor tasks still to finish
+} ;
+struct qliferec {
+   supertile *zis ;
+   int parent, shift ;
+   int nchanging ;
+} ;
 /*
  *   This is a common header for chunks of memory linked together.
  */
@@ -232,6 +262,13 @@ private:
                 supertile *par, supertile *cor, int lev) ;
    int doquad10(supertile *zis, supertile *edge,
                 supertile *par, supertile *cor, int lev) ;
+   void plan(supertile *zis, supertile *edge, supertile *par,
+             supertile *cor, int lev, int parent, int shift) ;
+   void addtask(supertile *zis, supertile *edge, supertile *par,
+                supertile *cor, int parent, int shift) ;
+   static void runtask(void *obj, void *arg) ;
+   void runtask(qlifetask *t) ;
+   void dogenparallel() ;
    int p01(tile *p, tile *pr, tile *pd, tile *prd) ;
    int p10(tile *plu, tile *pu, tile *pl, tile *p) ;
    G_INT64 find_set_bits(supertile *p, int lev, int gm1) ;
@@ -277,5 +314,14 @@ private:
    int llbits, llsize ;
    char *llxb, *llyb ;
    liferules qliferules ;
+   // when stepping with more than one thread, these are used
+   static int tasklevel ;
+   lifethreads *threads ;
+   lifejoin *taskjoin ;
+   int parallel, planodd ;
+   std::mutex memlock ;          // for the free lists
+   std::deque<qlifetask> tasks ;
+   std::vector<qliferec> recs ;
+   std::unordered_map<supertile *, int> taskof ;
 } ;
 #endif
@@ -11,6 +11,7 @@
 #endif
 #include <cstdlib>
 #include <cstring>
+#include <vector>
 
 #define LINESIZE 20000
 #define CR 13
@@ -96,6 +97,25 @@ char *getline(char *line, int maxlinelen) {
 }
 
 const char *SETCELLERROR = "Impossible; set cell error for state 1" ;
+const char *STATEERROR = "Cell state out of range for this algorithm" ;
+
+// The readers collect live cells here and hand them over in batches,
+// which the hash algorithms load much faster than one cell at a time.
+#define CELLBATCH (1 << 20)
+static std::vector<loadcell> cellbatch ;
+
+// set the cells collected so far; false if a state was out of range
+static bool flushcells(lifealgo &imp) {
+   bool ok = cellbatch.empty() || imp.setcells(cellbatch) >= 0 ;
+   cellbatch.clear() ;
+   return ok ;
+}
+
+static bool addcell(lifealgo &imp, int x, int y, int state) {
+   loadcell c = { x, y, state } ;
+   cellbatch.push_back(c) ;
+   return cellbatch.size() < CELLBATCH || flushcells(imp) ;
+}
 
 // Read a text pattern like "...ooo$$$ooo" where '.', ',' and chars <= ' '
 // represent dead cells, '$' represents 10 dead cells, and all other chars
@@ -111,7 +131,7 @@ const char *readtextpattern(lifealgo &imp, char *line) {
          } else if (*p == '$') {
             x += 10;
          } else {
-            if (imp.setcell(x, y, 1) < 0) {
+            if (!addcell(imp, x, y, 1)) {
                return SETCELLERROR ;
             }
             x++;
@@ -123,7 +143,7 @@ const char *readtextpattern(lifealgo &imp, char *line) {
    } while (getline(line, LINESIZE));
 
    if (getedges) bottom = y - 1;
-   return 0 ;
+   return flushcells(imp) ? 0 : SETCELLERROR ;
 }
 
 /*
@@ -192,6 +212,7 @@ const char *readrle(lifealgo &imp, char *line) {
             p = ruleptr;
             while (*p > ' ') p++;
             *p = 0;
+            if (!flushcells(imp)) return STATEERROR;
             errmsg = imp.setrule(ruleptr);
             if (errmsg) return errmsg;
             sawrule = true;
@@ -269,7 +290,7 @@ const char *readrle(lifealgo &imp, char *line) {
                   x = 0 ;
                   y += n ;
                } else if (c == '!') {
-                  return 0;
+                  return flushcells(imp) ? 0 : STATEERROR;
                } else if (('o' <= c && c <= 'y') || ('A' <= c && c <= 'X')) {
                   int state = -1 ;
                   if (c == 'o')
@@ -294,8 +315,8 @@ const char *readrle(lifealgo &imp, char *line) {
                   if (ght == 0 || y < ght) {
                      while (n-- > 0) {
                         if (gwd == 0 || x < gwd) {  
-                           if (imp.setcell(xoff + x, yoff + y, state) < 0)
-                              return "Cell state out of range for this algorithm" ;
+                           if (!addcell(imp, xoff + x, yoff + y, state))
+                              return STATEERROR ;
                         }
                         x++;
                      }
@@ -307,7 +328,7 @@ const char *readrle(lifealgo &imp, char *line) {
       }
    } while (getline(line, LINESIZE));
 
-   return 0;
+   return flushcells(imp) ? 0 : STATEERROR;
 }
 
 /*
@@ -328,6 +349,7 @@ const char *readpclife(lifealgo &imp, char *line) {
             if (!sawrule) {
                // if no rule given then try Conway's Life; if it fails then
                // return error so Golly will look for matching algo
+               if (!flushcells(imp)) return SETCELLERROR;
                errmsg = imp.setrule("B3/S23");
                if (errmsg) return errmsg;
                sawrule = true;      // in case there are many #P lines
@@ -335,6 +357,7 @@ const char *readpclife(lifealgo &imp, char *line) {
             sscanf(line + 2, " %d %d", &x, &y) ;
             leftx = x ;
          } else if (line[1] == 'N') {
+            if (!flushcells(imp)) return SETCELLERROR;
             errmsg = imp.setrule("B3/S23");
             if (errmsg) return errmsg;
             sawrule = true;
@@ -345,18 +368,19 @@ const char *readpclife(lifealgo &imp, char *line) {
             p = ruleptr;
             while (*p > ' ') p++;
             *p = 0;
+            if (!flushcells(imp)) return SETCELLERROR;
             errmsg = imp.setrule(ruleptr);
             if (errmsg) return errmsg;
             sawrule = true;
          }
       } else if (line[0] == '-' || ('0' <= line[0] && line[0] <= '9')) {
          sscanf(line, "%d %d", &x, &y) ;
-         if (imp.setcell(x, y, 1) < 0)
+         if (!addcell(imp, x, y, 1))
             return SETCELLERROR ;
       } else if (line[0] == '.' || line[0] == '*') {
          for (p = line; *p; p++) {
             if (*p == '*') {
-               if (imp.setcell(x, y, 1) < 0)
+               if (!addcell(imp, x, y, 1))
                   return SETCELLERROR ;
             }
             x++ ;
@@ -366,7 +390,7 @@ const char *readpclife(lifealgo &imp, char *line) {
       }
    } while (getline(line, LINESIZE));
 
-   return 0;
+   return flushcells(imp) ? 0 : SETCELLERROR;
 }
 
 /*
@@ -389,7 +413,7 @@ const char *readdblife(lifealgo &imp, char *line) {
                   x += n;
                } else if (*p == 'O') {
                   while (n-- > 0)
-                     if (imp.setcell(x++, y, 1) < 0)
+                     if (!addcell(imp, x++, y, 1))
                         return SETCELLERROR ;
                } else {
                   // ignore dblife commands like "5k10h@"
@@ -400,7 +424,7 @@ const char *readdblife(lifealgo &imp, char *line) {
          y++;
       }
    }
-   return 0;
+   return flushcells(imp) ? 0 : SETCELLERROR;
 }
 
 //
@@ -755,6 +779,9 @@ const char *loadpattern(lifealgo &imp) {
       }
    }
 
+   // let go of any cells left by an error, and the batch's memory
+   std::vector<loadcell>().swap(cellbatch) ;
+
    lifeendprogress();
    return errmsg ;
 }
@@ -209,6 +209,16 @@ state ruleloaderalgo::slowcalc(state nw, state n, state ne, state w, state c,
         return LocalRuleTree->slowcalc(nw, n, ne, w, c, e, sw, s, se);
 }
 
+void ruleloaderalgo::gridcalc(const state *in, state *out, int pitch,
+                              int w, int h)
+{
+    // the loaded algo's own gridcalc has its slowcalc inlined
+    if (rule_type == TABLE)
+        LocalRuleTable->gridcalc(in, out, pitch, w, h);
+    else // rule_type == TREE
+        LocalRuleTree->gridcalc(in, out, pitch, w, h);
+}
+
 static lifealgo* creator()
 {
     return new ruleloaderalgo();
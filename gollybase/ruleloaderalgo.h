@@ -17,12 +17,18 @@ public:
     virtual ~ruleloaderalgo();
     virtual state slowcalc(state nw, state n, state ne, state w, state c,
                            state e, state sw, state s, state se);
+    virtual void gridcalc(const state *in, state *out, int pitch,
+                          int w, int h);
     virtual const char* setrule(const char* s);
     virtual const char* getrule();
     virtual const char* DefaultRule();
     virtual int NumCellStates();
     static void doInitializeAlgoInfo(staticAlgoInfo &);
 
+    // the loaded table or tree, if the current rule is one (for benchmarking)
+    ruletable_algo* GetRuleTable() { return rule_type == TABLE ? LocalRuleTable : 0; }
+    ruletreealgo* GetRuleTree() { return rule_type == TREE ? LocalRuleTree : 0; }
+
 protected:
     
     ruletable_algo* LocalRuleTable;      // local instance of RuleTable algo
@@ -539,6 +539,7 @@ string ruletable_algo::LoadRuleTable(string rule)
    this->neighborhood = neighborhood;
    this->n_states = n_states;
    PackTransitions(symmetries,n_inputs,transition_table);
+   CompileTransitions(n_inputs);
 
    return string(""); // success
 }
@@ -639,6 +640,127 @@ void ruletable_algo::PackTransitions(const string& symmetries, int n_inputs,
    }
 }
 
+/*
+ *   The bitmask matcher has to look at every rule that might apply to a
+ *   cell, which for the bigger tables is hundreds of operations.  So
+ *   when the table is loaded we also build a decision DAG: the root
+ *   branches on the centre cell, its children on the next input in lut
+ *   order, and so on, each node standing for the set of rules still
+ *   possible.  As soon as the first of those rules accepts anything for
+ *   the inputs left we know the answer; if there are none left it is the
+ *   centre cell.  Nodes are shared by remaining rule set and then by
+ *   contents, but a table can still need a lot of them, so we give up
+ *   past a fixed size and leave slowcalc on the matcher.
+ */
+static const size_t MAXDAGSIZE = 1 << 22 ;     // entries, so 16MB
+static const size_t MAXRULESETS = 1 << 22 ;    // rule indices held while compiling
+
+class dagbuilder {
+public:
+   typedef unsigned long long TBits ;
+   dagbuilder(const vector< vector< vector<TBits> > > &lut_,
+              const vector<state> &output_, int n_states_, int n_inputs_,
+              vector<int> &dag_) :
+      toobig(false), lut(lut_), output(output_), n_states(n_states_),
+      n_inputs(n_inputs_), dag(dag_), held(0) {
+      // find the input from which each rule accepts every state
+      wildfrom.resize(output.size()) ;
+      for (int r=0; r<(int)output.size(); r++) {
+         int level = n_inputs ;
+         while (level > 0 && accepts_all(level-1, r))
+            level-- ;
+         wildfrom[r] = level ;
+      }
+   }
+   int build(int level, int c, const vector<int> &rules) ;
+   bool toobig ;
+private:
+   bool accepts(int level, int v, int r) const {
+      return (lut[level][v][r >> 6] >> (r & 63)) & 1 ;
+   }
+   bool accepts_all(int level, int r) const {
+      for (int v=0; v<n_states; v++)
+         if (!accepts(level, v, r))
+            return false ;
+      return true ;
+   }
+   const vector< vector< vector<TBits> > > &lut ;
+   const vector<state> &output ;
+   int n_states, n_inputs ;
+   vector<int> &dag ;
+   vector<int> wildfrom ;
+   map< vector<int>, int > byrules ;     // (level, centre, rules...) -> result
+   map< vector<int>, int > bycontents ;  // node entries -> offset
+   size_t held ;
+} ;
+
+int dagbuilder::build(int level, int c, const vector<int> &rules) {
+   // (the root has no centre cell yet, so must always branch)
+   if (level > 0) {
+      if (rules.empty())
+         return ~c ;
+      if (wildfrom[rules[0]] <= level)
+         return ~(int)output[rules[0]] ;
+   }
+   vector<int> key(2) ;
+   key[0] = level ;
+   key[1] = c ;
+   key.insert(key.end(), rules.begin(), rules.end()) ;
+   map< vector<int>, int >::iterator it = byrules.find(key) ;
+   if (it != byrules.end())
+      return it->second ;
+   held += key.size() ;
+   if (held > MAXRULESETS) {
+      toobig = true ;
+      return 0 ;
+   }
+   vector<int> node(n_states), next ;
+   for (int v=0; v<n_states; v++) {
+      next.clear() ;
+      for (size_t i=0; i<rules.size(); i++)
+         if (accepts(level, v, rules[i]))
+            next.push_back(rules[i]) ;
+      node[v] = build(level+1, level == 0 ? v : c, next) ;
+      if (toobig)
+         return 0 ;
+   }
+   // a node whose entries all give the same output is just that output
+   int r = node[0] ;
+   for (int v=1; v<n_states && r < 0; v++)
+      if (node[v] != r)
+         r = 0 ;
+   if (r >= 0) {
+      it = bycontents.find(node) ;
+      if (it != bycontents.end()) {
+         r = it->second ;
+      } else {
+         if (dag.size() + n_states > MAXDAGSIZE) {
+            toobig = true ;
+            return 0 ;
+         }
+         r = (int)dag.size() ;
+         dag.insert(dag.end(), node.begin(), node.end()) ;
+         bycontents[node] = r ;
+      }
+   }
+   byrules[key] = r ;
+   return r ;
+}
+
+void ruletable_algo::CompileTransitions(int n_inputs)
+{
+   dag.clear() ;
+   vector<int> rules(output.size()) ;
+   for (int r=0; r<(int)rules.size(); r++)
+      rules[r] = r ;
+   dagbuilder builder(lut, output, n_states, n_inputs, dag) ;
+   dagroot = builder.build(0, 0, rules) ;
+   if (builder.toobig) {
+      vector<int> none ;
+      dag.swap(none) ;
+   }
+}
+
 void ruletable_algo::PackTransition(const vector< vector<state> > & inputs,
                                     state output)
 {
@@ -680,7 +802,7 @@ const char* ruletable_algo::DefaultRule() {
 }
 
 ruletable_algo::ruletable_algo()
-   : n_states(8), neighborhood(vonNeumann), n_compressed_rules(0)
+   : n_states(8), neighborhood(vonNeumann), n_compressed_rules(0), dagroot(0)
 {
    maxCellStates = n_states;
 }
@@ -692,6 +814,38 @@ ruletable_algo::~ruletable_algo()
 // --- the update function ---
 state ruletable_algo::slowcalc(state nw, state n, state ne, state w, state c, state e,
                         state sw, state s, state se) 
+{
+   if (dag.empty())
+      return matchcalc(nw, n, ne, w, c, e, sw, s, se);
+
+   // walk the compiled transitions, taking the inputs in lut order
+   state in[9];
+   switch(this->neighborhood)
+   {
+      case vonNeumann: // c,n,e,s,w
+         in[0] = c; in[1] = n; in[2] = e; in[3] = s; in[4] = w;
+         break;
+      case Moore: // c,n,ne,e,se,s,sw,w,nw
+         in[0] = c; in[1] = n; in[2] = ne; in[3] = e; in[4] = se;
+         in[5] = s; in[6] = sw; in[7] = w; in[8] = nw;
+         break;
+      case hexagonal: // c,n,e,se,s,w,nw
+         in[0] = c; in[1] = n; in[2] = e; in[3] = se; in[4] = s;
+         in[5] = w; in[6] = nw;
+         break;
+      case oneDimensional: // c,w,e
+         in[0] = c; in[1] = w; in[2] = e;
+         break;
+   }
+   int i = dagroot;
+   for (int k=0; i >= 0; k++)
+      i = dag[i + in[k]];
+   return (state)~i;
+}
+
+// match the inputs against the packed bitmasks, a word of rules at a time
+state ruletable_algo::matchcalc(state nw, state n, state ne, state w, state c, state e,
+                        state sw, state s, state se) 
 {
    TBits is_match = 0;  // AKT: explicitly initialized to avoid gcc warning
 
@@ -736,6 +890,8 @@ state ruletable_algo::slowcalc(state nw, state n, state ne, state w, state c, st
    return c; // default: no change
 }
 
+template class ghashalgo<ruletable_algo> ;
+
 static lifealgo *creator() { return new ruletable_algo(); }
 
 void ruletable_algo::doInitializeAlgoInfo(staticAlgoInfo &ai) 
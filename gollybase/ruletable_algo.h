@@ -10,7 +10,7 @@
 /**
  *   An algo that takes a rule table.
  */
-class ruletable_algo : public ghashbase {
+class ruletable_algo : public ghashalgo<ruletable_algo> {
 
 public:
 
@@ -23,17 +23,29 @@ public:
    virtual const char* DefaultRule() ;
    virtual int NumCellStates() ;
    static void doInitializeAlgoInfo(staticAlgoInfo &) ;
+   int calcmask() const {
+      return neighborhood == vonNeumann ? VON_NEUMANN :
+             neighborhood == hexagonal ? HEXAGONAL : MOORE ;
+   }
 
    // these two methods are needed for RuleLoader algo
    bool IsDefaultRule(const char* rulename);
    const char* LoadTable(FILE* rulefile, int lineno, char endchar, const char* s);
 
+   // slowcalc walks the compiled transitions when there are any; these
+   // let the benchmark check and time them against the bitmask matcher
+   state matchcalc(state nw, state n, state ne, state w, state c,
+                   state e, state sw, state s, state se) ;
+   bool iscompiled() const { return !dag.empty() ; }
+   size_t compiledsize() const { return dag.size() * sizeof(int) ; }
+
 protected:
 
    std::string LoadRuleTable(std::string filename);
    void PackTransitions(const std::string& symmetries, int n_inputs, 
                         const std::vector< std::pair< std::vector< std::vector<state> >, state> > & transition_table);
    void PackTransition(const std::vector< std::vector<state> > & inputs, state output);
+   void CompileTransitions(int n_inputs);
                         
 protected:
 
@@ -49,5 +61,15 @@ protected:
    unsigned int n_compressed_rules;
    std::vector<state> output; // state output[n_rules];
 
+   // the same transitions compiled into a decision DAG on the inputs in
+   // lut order: a node has one entry per state of its input, either the
+   // offset of the node for the next input or ~output once that is known
+   // (empty if the table was too big to compile; see CompileTransitions)
+   std::vector<int> dag;
+   int dagroot;
+
 };
+
+extern template class ghashalgo<ruletable_algo> ;
+
 #endif
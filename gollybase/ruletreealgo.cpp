@@ -234,7 +234,7 @@ const char* ruletreealgo::DefaultRule() {
    return "B3/S23" ;
 }
 
-ruletreealgo::ruletreealgo() : ghashbase(), a(0), base(0), b(0),
+ruletreealgo::ruletreealgo() : ghashalgo(), a(0), base(0), b(0),
                                num_neighbors(0),
                                num_states(0), num_nodes(0) {
    rule[0] = 0 ;
@@ -259,6 +259,8 @@ state ruletreealgo::slowcalc(state nw, state n, state ne, state w, state c, stat
      return b[a[a[a[a[a[a[a[a[base+nw]+ne]+sw]+se]+n]+w]+e]+s]+c] ;
 }
 
+template class ghashalgo<ruletreealgo> ;
+
 static lifealgo *creator() { return new ruletreealgo() ; }
 
 void ruletreealgo::doInitializeAlgoInfo(staticAlgoInfo &ai) {
@@ -7,7 +7,7 @@
 /**
  *   An algorithm that uses an n-dary decision diagram.
  */
-class ruletreealgo : public ghashbase {
+class ruletreealgo : public ghashalgo<ruletreealgo> {
 public:
    ruletreealgo() ;
    virtual ~ruletreealgo() ;
@@ -18,6 +18,7 @@ public:
    virtual const char* DefaultRule() ;
    virtual int NumCellStates() ;
    static void doInitializeAlgoInfo(staticAlgoInfo &) ;
+   int calcmask() const { return num_neighbors == 4 ? VON_NEUMANN : MOORE ; }
 
    // these two methods are needed for RuleLoader algo
    bool IsDefaultRule(const char* rulename);
@@ -29,4 +30,7 @@ private:
    int num_neighbors, num_states, num_nodes ;
    char rule[MAXRULESIZE] ;
 };
+
+extern template class ghashalgo<ruletreealgo> ;
+
 #endif
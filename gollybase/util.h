@@ -109,4 +109,19 @@ struct hperf {
    static int reportMask ;
    static double reportInterval ;
 } ;
+/*
+ *   Hash lookup counts for getstats.  Like hperf, each thread of a
+ *   parallel step keeps its own, and they are added up at the end.
+ */
+struct hashcounts {
+   void clear() {
+      lookups = hits = probes = 0 ;
+   }
+   void add(const hashcounts &c) {
+      lookups += c.lookups ;
+      hits += c.hits ;
+      probes += c.probes ;
+   }
+   unsigned long long lookups, hits, probes ;
+} ;
 #endif
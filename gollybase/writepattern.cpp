@@ -230,6 +230,8 @@ const char *writemacrocell(std::ostream &os, char *comments, lifealgo &imp)
 }
 
 #ifdef ZLIB
+// writes go through a buffer of our own so that formatting a pattern
+// costs one gzwrite per BUFFSIZE bytes rather than one call per char
 class gzbuf : public std::streambuf
 {
 public:
@@ -241,33 +243,48 @@ public:
    {
       if (file) return NULL;
       file = gzopen(path, "wb");
+      setp(buff, buff + BUFFSIZE);
       return file ? this : NULL;
    }
 
    gzbuf *close()
    {
       if (!file) return NULL;
+      bool ok = flushbuff();
       int res = gzclose(file);
       file = NULL;
-      return res == Z_OK ? this : NULL;
+      return ok && res == Z_OK ? this : NULL;
    }
 
    bool is_open() const { return file!=NULL; }
 
    int overflow(int c=EOF)
    {
-      if (c == EOF)
-         return c ;
-      return gzputc(file, c) ;
+      if (!flushbuff())
+         return EOF;
+      if (c != EOF) {
+         *pptr() = (char)c;
+         pbump(1);
+      }
+      return c == EOF ? 0 : c;
    }
 
    std::streamsize xsputn(const char_type *s, std::streamsize n)
    {
+      if (n <= epptr() - pptr()) {
+         memcpy(pptr(), s, (size_t)n);
+         pbump((int)n);
+         return n;
+      }
+      if (!flushbuff())
+         return 0;
       return gzwrite(file, s, (unsigned int)n);
    }
 
    int sync()
    {
+      if (!flushbuff())
+         return -1;
       return gzflush(file, Z_SYNC_FLUSH) == Z_OK ? 0 : -1;
    }
 
@@ -288,7 +305,15 @@ public:
       return pos_type(off_type(-1));
    }
 private:
+   bool flushbuff()
+   {
+      int n = (int)(pptr() - pbase());
+      setp(buff, buff + BUFFSIZE);
+      return n == 0 || gzwrite(file, buff, (unsigned int)n) == n;
+   }
+
    gzFile file;
+   char buff[BUFFSIZE];
 };
 #endif
 
@@ -7,6 +7,7 @@
 #include "hlifealgo.h"
 #include "generationsalgo.h"
 #include "ltlalgo.h"
+#include "bitgenalgo.h"
 #include "jvnalgo.h"
 #include "ruleloaderalgo.h"
 
@@ -882,6 +883,7 @@ void InitAlgorithms()
     // these algos can be in any order
     generationsalgo::doInitializeAlgoInfo(AlgoData::tick());
     ltlalgo::doInitializeAlgoInfo(AlgoData::tick());
+    bitgenalgo::doInitializeAlgoInfo(AlgoData::tick());
     jvnalgo::doInitializeAlgoInfo(AlgoData::tick());
     
     // RuleLoader must be last so we can display detailed error messages
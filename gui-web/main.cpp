@@ -8,6 +8,7 @@
 #include "hlifealgo.h"
 #include "generationsalgo.h"
 #include "ltlalgo.h"
+#include "bitgenalgo.h"
 #include "jvnalgo.h"
 #include "ruleloaderalgo.h"
 
@@ -154,6 +154,7 @@ int wheelsens = MAX_SENSITIVITY; // mouse wheel sensitivity
 int thumbrange = 10;             // thumb box scrolling range in terms of view wd/ht
 int mindelay = 250;              // minimum millisec delay
 int maxdelay = 2000;             // maximum millisec delay
+int numthreads = 1;              // number of threads used by HashLife and QuickLife
 wxString opensavedir;            // directory for Open and Save dialogs
 wxString overlaydir;             // directory for Save Overlay dialog
 wxString rundir;                 // directory for Run Script dialog
@@ -1477,6 +1478,7 @@ void SavePrefs()
     fprintf(f, "random_fill=%d (1..100)\n", randomfill);
     fprintf(f, "min_delay=%d (0..%d millisecs)\n", mindelay, MAX_DELAY);
     fprintf(f, "max_delay=%d (0..%d millisecs)\n", maxdelay, MAX_DELAY);
+    fprintf(f, "num_threads=%d (1..%d)\n", numthreads, MAX_THREADS);
     fprintf(f, "auto_fit=%d\n", currlayer->autofit ? 1 : 0);
     fprintf(f, "hyperspeed=%d\n", currlayer->hyperspeed ? 1 : 0);
     fprintf(f, "hash_info=%d\n", currlayer->showhashinfo ? 1 : 0);
@@ -2062,6 +2064,12 @@ void GetPrefs()
             if (maxdelay < 0) maxdelay = 0;
             if (maxdelay > MAX_DELAY) maxdelay = MAX_DELAY;
             
+        } else if (strcmp(keyword, "num_threads") == 0) {
+            sscanf(value, "%d", &numthreads);
+            if (numthreads < 1) numthreads = 1;
+            if (numthreads > MAX_THREADS) numthreads = MAX_THREADS;
+            lifealgo::setNumThreads(numthreads);
+            
         } else if (strcmp(keyword, "auto_fit") == 0) {
             initautofit = value[0] == '1';
             
@@ -2684,6 +2692,7 @@ enum {
     PREF_STEP_NOTE,
     PREF_MIN_DELAY,
     PREF_MAX_DELAY,
+    PREF_NUM_THREADS,
     PREF_RULES_BUTT,
     PREF_RULES_BOX,
     // View prefs
@@ -3036,15 +3045,18 @@ void PrefsDialog::OnSpinCtrlChar(wxKeyEvent& event)
             wxSpinCtrl* s2 = (wxSpinCtrl*) FindWindowById(PREF_BASE_STEP);
             wxSpinCtrl* s3 = (wxSpinCtrl*) FindWindowById(PREF_MIN_DELAY);
             wxSpinCtrl* s4 = (wxSpinCtrl*) FindWindowById(PREF_MAX_DELAY);
+            wxSpinCtrl* s5 = (wxSpinCtrl*) FindWindowById(PREF_NUM_THREADS);
             wxTextCtrl* t1 = s1->GetText();
             wxTextCtrl* t2 = s2->GetText();
             wxTextCtrl* t3 = s3->GetText();
             wxTextCtrl* t4 = s4->GetText();
+            wxTextCtrl* t5 = s5->GetText();
             wxWindow* focus = FindFocus();
             if ( focus == t1 ) { s2->SetFocus(); s2->SetSelection(ALL_TEXT); }
             if ( focus == t2 ) { s3->SetFocus(); s3->SetSelection(ALL_TEXT); }
             if ( focus == t3 ) { s4->SetFocus(); s4->SetSelection(ALL_TEXT); }
-            if ( focus == t4 ) { s1->SetFocus(); s1->SetSelection(ALL_TEXT); }
+            if ( focus == t4 ) { s5->SetFocus(); s5->SetSelection(ALL_TEXT); }
+            if ( focus == t5 ) { s1->SetFocus(); s1->SetSelection(ALL_TEXT); }
         } else if ( currpage == VIEW_PAGE ) {
             wxSpinCtrl* s1 = (wxSpinCtrl*) FindWindowById(PREF_BOLD_SPACING);
             wxSpinCtrl* s2 = (wxSpinCtrl*) FindWindowById(PREF_SENSITIVITY);
@@ -3565,8 +3577,12 @@ wxPanel* PrefsDialog::CreateControlPrefs(wxWindow* parent)
     wxBoxSizer* maxbox = new wxBoxSizer(wxHORIZONTAL);
     maxbox->Add(new wxStaticText(panel, wxID_STATIC, _("Maximum delay:")), 0, wxALL, 0);
     
+    wxBoxSizer* threadbox = new wxBoxSizer(wxHORIZONTAL);
+    threadbox->Add(new wxStaticText(panel, wxID_STATIC, _("Threads:")), 0, wxALL, 0);
+    
     // align spin controls
     minbox->SetMinSize( maxbox->GetMinSize() );
+    threadbox->SetMinSize( maxbox->GetMinSize() );
     
     wxBoxSizer* hbox3 = new wxBoxSizer(wxHORIZONTAL);
     hbox3->Add(minbox, 0, wxALIGN_CENTER_VERTICAL, 0);
@@ -3584,6 +3600,16 @@ wxPanel* PrefsDialog::CreateControlPrefs(wxWindow* parent)
     hbox4->Add(new wxStaticText(panel, wxID_STATIC, _("millisecs")),
                0, wxALIGN_CENTER_VERTICAL, 0);
     
+    // num_threads
+    
+    wxBoxSizer* hbox5 = new wxBoxSizer(wxHORIZONTAL);
+    hbox5->Add(threadbox, 0, wxALIGN_CENTER_VERTICAL, 0);
+    wxSpinCtrl* spin5 = new MySpinCtrl(panel, PREF_NUM_THREADS, wxEmptyString,
+                                       wxDefaultPosition, wxSize(80, wxDefaultCoord));
+    hbox5->Add(spin5, 0, wxLEFT | wxRIGHT | wxALIGN_CENTER_VERTICAL, SPINGAP);
+    hbox5->Add(new wxStaticText(panel, wxID_STATIC, _("(used by HashLife and QuickLife)")),
+               0, wxALIGN_CENTER_VERTICAL, 0);
+    
     // user_rules
     
     wxButton* rulesbutt = new wxButton(panel, PREF_RULES_BUTT, _("Your Rules..."));
@@ -3612,6 +3638,10 @@ wxPanel* PrefsDialog::CreateControlPrefs(wxWindow* parent)
     vbox->AddSpacer(S2VGAP);
     vbox->Add(hbox4, 0, wxLEFT | wxRIGHT, LRGAP);
     
+    vbox->AddSpacer(5);
+    vbox->AddSpacer(GROUPGAP);
+    vbox->Add(hbox5, 0, wxLEFT | wxRIGHT, LRGAP);
+    
     vbox->AddSpacer(15);
     vbox->AddSpacer(GROUPGAP);
     vbox->Add(hrbox, 0, wxLEFT | wxRIGHT, LRGAP);
@@ -3627,6 +3657,7 @@ wxPanel* PrefsDialog::CreateControlPrefs(wxWindow* parent)
     spin2->SetValue(algoinfo[algopos1]->defbase);
     spin3->SetRange(0, MAX_DELAY);           spin3->SetValue(mindelay);
     spin4->SetRange(0, MAX_DELAY);           spin4->SetValue(maxdelay);
+    spin5->SetRange(1, MAX_THREADS);         spin5->SetValue(numthreads);
     spin1->SetFocus();
     spin1->SetSelection(ALL_TEXT);
     algomenu->SetSelection(algopos1);
@@ -4670,6 +4701,8 @@ bool PrefsDialog::ValidatePage()
             return false;
         if ( BadSpinVal(PREF_MAX_DELAY, 0, MAX_DELAY, _("Maximum delay")) )
             return false;
+        if ( BadSpinVal(PREF_NUM_THREADS, 1, MAX_THREADS, _("Number of threads")) )
+            return false;
         
     } else if (currpage == VIEW_PAGE) {
         if ( BadSpinVal(PREF_BOLD_SPACING, 2, MAX_SPACING, _("Spacing of bold grid lines")) )
@@ -4763,6 +4796,8 @@ bool PrefsDialog::TransferDataFromWindow()
     }
     mindelay = GetSpinVal(PREF_MIN_DELAY);
     maxdelay = GetSpinVal(PREF_MAX_DELAY);
+    numthreads = GetSpinVal(PREF_NUM_THREADS);
+    lifealgo::setNumThreads(numthreads);
     userrules = newuserrules;
     
     // VIEW_PAGE
@@ -113,6 +113,7 @@ extern int thumbrange;           // thumb box scrolling range in terms of view w
 extern int wheelsens;            // mouse wheel sensitivity
 extern int mindelay;             // minimum millisec delay
 extern int maxdelay;             // maximum millisec delay
+extern int numthreads;           // number of threads used by HashLife and QuickLife
 extern wxString opensavedir;     // directory for Open/Save Pattern dialogs
 extern wxString overlaydir;      // directory for Save Overlay dialog
 extern wxString rundir;          // directory for Run Script dialog